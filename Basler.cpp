@@ -43,6 +43,7 @@ const char* g_ObjectiveDeviceName = "DObjective";
 const char* g_StageDeviceName = "DStage";
 const char* g_XYStageDeviceName = "DXYStage";
 const char* g_AutoFocusDeviceName = "DAutoFocus";
+const char* g_ReconstructionFocusDeviceName = "ReconstructionAutoFocus";
 const char* g_ShutterDeviceName = "DShutter";
 const char* g_DADeviceName = "D-DA";
 const char* g_MagnifierDeviceName = "DOptovar";
@@ -55,11 +56,81 @@ const char* g_PixelType_32bitRGB = "32bitRGB";
 const char* g_PixelType_64bitRGB = "64bitRGB";
 const char* g_PixelType_32bit = "32bit";  // floating point greyscale
 
+// frame sources
+const char* g_FrameSource_Grabber = "Grabber";
+const char* g_FrameSource_Pattern = "SinePattern";
+const char* g_FrameSource_Hologram = "Hologram";
+const char* g_FrameSource_Replay = "Replay";
+
+// scenes of the hologram source, in HologramSource::Scene order
+const char* const g_HologramScenes[] = {"Particles", "USAF", "Image"};
+
+// hologram source settings, in property units
+struct HologramParameter
+{
+   const char* name;
+   double HologramSource::Settings::* value;
+   double lower;
+   double upper;
+};
+
+const HologramParameter g_HologramParameters[] =
+{
+   {"HologramParticleDiameter (um)", &HologramSource::Settings::particleDiameterUm, 0.5, 1000.},
+   {"HologramParticleDrift (um)", &HologramSource::Settings::driftUm, 0., 1000.},
+   {"HologramDistance (um)", &HologramSource::Settings::distanceUm, -100000., 100000.},
+   {"HologramBackground", &HologramSource::Settings::background, 1., 255.}
+};
+
+// sensor noise parameters of the synthetic frames, in property units
+struct NoiseParameter
+{
+   const char* name;
+   double SensorNoise::Model::* value;
+   double scale;     // property units per model unit
+   double lower;
+   double upper;
+};
+
+const NoiseParameter g_NoiseParameters[] =
+{
+   {"NoiseGain (ADU/e-)", &SensorNoise::Model::gain, 1., 0.001, 100.},
+   {"ReadNoise (e-)", &SensorNoise::Model::readNoise, 1., 0., 1000.},
+   {"DarkCurrent (e-/s)", &SensorNoise::Model::darkCurrent, 1., 0., 1e6},
+   {"PRNU (%)", &SensorNoise::Model::prnu, 100., 0., 100.},
+   {"DSNU (%)", &SensorNoise::Model::dsnu, 100., 0., 1000.}
+};
+
+// largest number of planes in a refocus stack
+const int g_MaxRefocusPlanes = 16;
+
+// property name prefixes of the camera's pipeline stages, in Stage order
+const char* const g_StageNames[] = {"Capture", "Reconstruction", "Insert"};
+
+// property name prefixes of the call sites of the pixel lock, in LockSite order
+const char* const g_LockSiteNames[] = {"GetImageBuffer", "GetCameraImage", "GenerateEmptyImage", "GenerateSyntheticImage",
+   "InsertImage", "FrameSource", "ReconstructionBatch", "AutoFocus", "Properties"};
+
+// statistics of every lock site, property name suffixes
+enum LockStatistic
+{
+   LOCK_ACQUISITIONS,
+   LOCK_CONTENTIONS,
+   LOCK_WAIT_P99,
+   LOCK_WAIT_MAX,
+   LOCK_HOLD_P99,
+   LOCK_HOLD_MAX,
+   LOCK_STATISTIC_COUNT
+};
+const char* const g_LockStatisticNames[] = {"LockAcquisitions", "LockContentions", "LockWait p99 (us)", "LockWait max (us)",
+   "LockHold p99 (us)", "LockHold max (us)"};
+
 // TODO: linux entry code
 
 void WINAPI GlobalCallback(PMCSIGNALINFO SigInfo)
 {
-	
+    TraceLog::Instance().SetThreadName("MultiCam callback");
+    TraceScope trace("GlobalCallback");
 
     if (SigInfo && SigInfo->Context)
     {
@@ -101,13 +172,16 @@ MODULE_API void InitializeModuleData()
    AddAvailableDeviceName(g_XYStageDeviceName, "Demo XY stage");
    AddAvailableDeviceName(g_LightPathDeviceName, "Demo light path");
    AddAvailableDeviceName(g_AutoFocusDeviceName, "Demo auto focus");
+   AddAvailableDeviceName(g_ReconstructionFocusDeviceName, "Hologram reconstruction auto focus");
    AddAvailableDeviceName(g_ShutterDeviceName, "Demo shutter");
    AddAvailableDeviceName(g_DADeviceName, "Demo DA");
    AddAvailableDeviceName(g_MagnifierDeviceName, "Demo Optovar");
    AddAvailableDeviceName("TransposeProcessor", "TransposeProcessor");
    AddAvailableDeviceName("ImageFlipX", "ImageFlipX");
    AddAvailableDeviceName("ImageFlipY", "ImageFlipY");
+   AddAvailableDeviceName("Orientation", "Orientation");
    AddAvailableDeviceName("MedianFilter", "MedianFilter");
+   AddAvailableDeviceName("RankFilter", "RankFilter");
    AddAvailableDeviceName(g_HubDeviceName, "DHub");
 }
 
@@ -167,6 +241,11 @@ MODULE_API MM::Device* CreateDevice(const char* deviceName)
       // create autoFocus
       return new DemoAutoFocus();
    }
+   else if (strcmp(deviceName, g_ReconstructionFocusDeviceName) == 0)
+   {
+      // create reconstruction autoFocus
+      return new ReconstructionAutoFocus();
+   }
    else if (strcmp(deviceName, g_MagnifierDeviceName) == 0)
    {
       // create Optovar 
@@ -185,10 +264,18 @@ MODULE_API MM::Device* CreateDevice(const char* deviceName)
    {
       return new ImageFlipY();
    }
+   else if(strcmp(deviceName, "Orientation") == 0)
+   {
+      return new OrientationProcessor();
+   }
    else if(strcmp(deviceName, "MedianFilter") == 0)
    {
       return new MedianFilter();
    }
+   else if(strcmp(deviceName, "RankFilter") == 0)
+   {
+      return new RankFilter();
+   }
    else if (strcmp(deviceName, g_HubDeviceName) == 0)
    {
 	  return new DemoHub();
@@ -239,15 +326,46 @@ CBaslerCamera::CBaslerCamera() :
    stopOnOverflow_(false),
 	dropPixels_(false),
    fastImage_(false),
+   frameSource_(FRAME_SOURCE_GRABBER),
    saturatePixels_(false),
 	fractionOfPixelsToDropOrSaturate_(0.002),
    pDemoResourceLock_(0),
-   nComponents_(1)
+   imgPixelsLock_(LOCK_SITE_COUNT),
+   nComponents_(1),
+   cpuBackend_(false),
+   reconWidth_(0),
+   reconHeight_(0),
+   batchSize_(1),
+   batchLatencyLimitMs_(50.0),
+   batchCount_(0),
+   batchStartTime_(0),
+   reconstructionFps_(0.),
+   reconstructionLatencyMs_(0.),
+   accuracyReport_("Not measured"),
+   hologramFps_(0.),
+   hologramGrabs_(0),
+   hologramStart_(0),
+   hologramFrame_(0),
+   hologramReport_("Not measured"),
+   replayRealTime_(true),
+   replayLoop_(false),
+   replayPosition_(0),
+   replayGrabs_(0),
+   replayStart_(0),
+   replayStartFrame_(0),
+   replayFrame_(0),
+   traceSeconds_(10.),
+   traceFile_("BaslerTrace.json")
 {
    memset(testProperty_,0,sizeof(testProperty_));
 
    // call the base class method to set-up default error codes/messages
    InitializeDefaultErrorMessages();
+   SetErrorText(ERR_HOLOGRAM_SCENE, "The hologram scene could not be prepared (image file or memory)");
+   SetErrorText(ERR_REPLAY_OPEN, "The replay recording or its index could not be read");
+   SetErrorText(ERR_REPLAY_FORMAT, "The replay frames do not match the 8 bit reconstruction frame size");
+   SetErrorText(ERR_REPLAY_END, "The replay reached the end of the recording");
+   SetErrorText(ERR_TRACE_DUMP, "The trace file could not be written");
    readoutStartTime_ = GetCurrentMMTime();
    pDemoResourceLock_ = new MMThreadLock();
    thd_ = new MySequenceThread(this);
@@ -546,11 +664,37 @@ int CBaslerCamera::Initialize()
    AddAllowedValue("SaturatePixels", "0");
    AddAllowedValue("SaturatePixels", "1");
 
+   // shot, read, dark and fixed pattern noise of the synthetic frames
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnSensorNoise);
+   CreateProperty("SensorNoise", "0", MM::Integer, false, pAct);
+   AddAllowedValue("SensorNoise", "0");
+   AddAllowedValue("SensorNoise", "1");
+
+   for (long i = 0; i < (long)(sizeof(g_NoiseParameters) / sizeof(g_NoiseParameters[0])); ++i)
+   {
+      const NoiseParameter& p = g_NoiseParameters[i];
+      pActX = new CPropertyActionEx(this, &CBaslerCamera::OnNoiseParameter, i);
+      CreateProperty(p.name, CDeviceUtils::ConvertToString(noiseModel_.*p.value * p.scale), MM::Float, false, pActX);
+      SetPropertyLimits(p.name, p.lower, p.upper);
+   }
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnNoiseSeed);
+   CreateProperty("NoiseSeed", CDeviceUtils::ConvertToString((long)noise_.Seed()), MM::Integer, false, pAct);
+
    pAct = new CPropertyAction (this, &CBaslerCamera::OnFastImage);
    CreateProperty("FastImage", "0", MM::Integer, false, pAct);
    AddAllowedValue("FastImage", "0");
    AddAllowedValue("FastImage", "1");
 
+   // synthetic frames stand in for the grabber, e.g. for pipeline
+   // benchmarks without a camera
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnFrameSource);
+   CreateProperty("FrameSource", g_FrameSource_Grabber, MM::String, false, pAct);
+   AddAllowedValue("FrameSource", g_FrameSource_Grabber);
+   AddAllowedValue("FrameSource", g_FrameSource_Pattern);
+   AddAllowedValue("FrameSource", g_FrameSource_Hologram);
+   AddAllowedValue("FrameSource", g_FrameSource_Replay);
+
    pAct = new CPropertyAction (this, &CBaslerCamera::OnFractionOfPixelsToDropOrSaturate);
    CreateProperty("FractionOfPixelsToDropOrSaturate", "0.002", MM::Float, false, pAct);
    SetPropertyLimits("FractionOfPixelsToDropOrSaturate", 0., 0.1);
@@ -608,6 +752,281 @@ int CBaslerCamera::Initialize()
    nRet = CreateProperty("PaddedSizeY", paddedy, MM::Integer, true);
    assert(nRet == DEVICE_OK);
 
+   reconWidth_ = img_.Width();
+   reconHeight_ = img_.Height();
+
+   // reconstruction backend, the CPU backend is set up on first use
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReconstructionBackend);
+   nRet = CreateProperty("ReconstructionBackend", "CUDA", MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+   AddAllowedValue("ReconstructionBackend", "CUDA");
+   AddAllowedValue("ReconstructionBackend", "CPU");
+
+   // number of frames reconstructed together during sequence acquisition
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReconstructionBatchSize);
+   nRet = CreateProperty("ReconstructionBatchSize", "1", MM::Integer, false, pAct);
+   assert(nRet == DEVICE_OK);
+   SetPropertyLimits("ReconstructionBatchSize", 1, 16);
+
+   // a partial batch is flushed once its oldest frame has waited this long
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReconstructionBatchLatencyLimit);
+   nRet = CreateProperty("ReconstructionBatchLatencyLimit (ms)", "50", MM::Float, false, pAct);
+   assert(nRet == DEVICE_OK);
+   SetPropertyLimits("ReconstructionBatchLatencyLimit (ms)", 0., 1000.);
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReconstructionThroughput);
+   nRet = CreateProperty("ReconstructionThroughput (fps)", "0", MM::Float, true, pAct);
+   assert(nRet == DEVICE_OK);
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReconstructionLatency);
+   nRet = CreateProperty("ReconstructionLatency (ms)", "0", MM::Float, true, pAct);
+   assert(nRet == DEVICE_OK);
+
+   // storage / arithmetic precision of the CPU backend spectra
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReconstructionPrecision);
+   nRet = CreateProperty("ReconstructionPrecision", "float32", MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+   AddAllowedValue("ReconstructionPrecision", "float32");
+   AddAllowedValue("ReconstructionPrecision", "float16");
+   AddAllowedValue("ReconstructionPrecision", "int16");
+
+   // compares the selected precision against float32 on the current frame
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReconstructionAccuracyCheck);
+   nRet = CreateProperty("ReconstructionAccuracyCheck", "Idle", MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+   AddAllowedValue("ReconstructionAccuracyCheck", "Idle");
+   AddAllowedValue("ReconstructionAccuracyCheck", "Run");
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReconstructionAccuracy);
+   nRet = CreateProperty("ReconstructionAccuracy", accuracyReport_.c_str(), MM::String, true, pAct);
+   assert(nRet == DEVICE_OK);
+
+   // output format of the CPU backend, selects the matching pixel type
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReconstructionOutput);
+   nRet = CreateProperty("ReconstructionOutput", "Intensity8", MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+   AddAllowedValue("ReconstructionOutput", "Intensity8");
+   AddAllowedValue("ReconstructionOutput", "Intensity32");
+   AddAllowedValue("ReconstructionOutput", "AmplitudePhase");
+
+   // refocus stack: every frame is reconstructed at each listed distance
+   // and the planes are delivered as camera channels
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnRefocusDistances);
+   nRet = CreateProperty("RefocusDistances (um)", "", MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+
+   // reconstruction geometry, a change only recomputes the transfer function
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnPropagationDistance);
+   nRet = CreateProperty("PropagationDistance (um)", CDeviceUtils::ConvertToString(RECONSTRUCTION_DEFAULT_DISTANCE_UM), MM::Float, false, pAct);
+   assert(nRet == DEVICE_OK);
+   SetPropertyLimits("PropagationDistance (um)", -100000., 100000.);
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnWavelength);
+   nRet = CreateProperty("Wavelength (nm)", CDeviceUtils::ConvertToString(RECONSTRUCTION_DEFAULT_WAVELENGTH_NM), MM::Float, false, pAct);
+   assert(nRet == DEVICE_OK);
+   SetPropertyLimits("Wavelength (nm)", 200., 2000.);
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnPixelPitch);
+   nRet = CreateProperty("PixelPitch (um)", CDeviceUtils::ConvertToString(RECONSTRUCTION_DEFAULT_PIXELPITCH_UM), MM::Float, false, pAct);
+   assert(nRet == DEVICE_OK);
+   SetPropertyLimits("PixelPitch (um)", 0.1, 100.);
+
+   // unused transfer functions kept for a quick return to recent settings
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnTransferFunctionCacheSize);
+   nRet = CreateProperty("TransferFunctionCacheSize", CDeviceUtils::ConvertToString((long)RECONSTRUCTION_DEFAULT_CACHE_SIZE), MM::Integer, false, pAct);
+   assert(nRet == DEVICE_OK);
+   SetPropertyLimits("TransferFunctionCacheSize", 0, 32);
+
+   // threads sharing the row and column passes of the CPU backend
+   const int hardwareThreads = WorkerPool::HardwareThreads();
+   cpuReconstructor_.SetThreadCount(hardwareThreads);
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReconstructionThreads);
+   nRet = CreateProperty("ReconstructionThreads", CDeviceUtils::ConvertToString((long)hardwareThreads), MM::Integer, false, pAct);
+   assert(nRet == DEVICE_OK);
+   SetPropertyLimits("ReconstructionThreads", 1, hardwareThreads);
+
+   // threads filling the bands of synthetic frames; the pool is the one
+   // the image processors share, so this and their "Threads" properties
+   // are one module wide setting
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnSyntheticThreads);
+   nRet = CreateProperty("SyntheticThreads", CDeviceUtils::ConvertToString((long)synthetic_.ThreadCount()), MM::Integer, false, pAct);
+   assert(nRet == DEVICE_OK);
+   SetPropertyLimits("SyntheticThreads", 1, hardwareThreads);
+
+   // hologram frame source: the scene is propagated over HologramDistance
+   // with the reconstruction wavelength and pixel pitch, the frames are
+   // computed when the source is first used after a change
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnHologramScene);
+   nRet = CreateProperty("HologramScene", g_HologramScenes[hologramSettings_.scene], MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+   for (int i = 0; i < (int)(sizeof(g_HologramScenes) / sizeof(g_HologramScenes[0])); ++i)
+      AddAllowedValue("HologramScene", g_HologramScenes[i]);
+
+   // binary PGM of the Image scene
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnHologramImage);
+   nRet = CreateProperty("HologramImage", "", MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnHologramFrames);
+   nRet = CreateProperty("HologramFrames", CDeviceUtils::ConvertToString((long)hologramSettings_.frameCount), MM::Integer, false, pAct);
+   assert(nRet == DEVICE_OK);
+   SetPropertyLimits("HologramFrames", 1, 1024);
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnHologramParticles);
+   nRet = CreateProperty("HologramParticles", CDeviceUtils::ConvertToString((long)hologramSettings_.particleCount), MM::Integer, false, pAct);
+   assert(nRet == DEVICE_OK);
+   SetPropertyLimits("HologramParticles", 0, 10000);
+
+   for (long i = 0; i < (long)(sizeof(g_HologramParameters) / sizeof(g_HologramParameters[0])); ++i)
+   {
+      const HologramParameter& p = g_HologramParameters[i];
+      pActX = new CPropertyActionEx(this, &CBaslerCamera::OnHologramParameter, i);
+      nRet = CreateProperty(p.name, CDeviceUtils::ConvertToString(hologramSettings_.*p.value), MM::Float, false, pActX);
+      assert(nRet == DEVICE_OK);
+      SetPropertyLimits(p.name, p.lower, p.upper);
+   }
+
+   // replay rate of the pool frames, 0 advances one frame per grab
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnHologramFrameRate);
+   nRet = CreateProperty("HologramFrameRate (fps)", "0", MM::Float, false, pAct);
+   assert(nRet == DEVICE_OK);
+   SetPropertyLimits("HologramFrameRate (fps)", 0., 10000.);
+
+   // reconstructs the current hologram with the CPU backend and scores it
+   // against the scene
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnHologramAccuracyCheck);
+   nRet = CreateProperty("HologramAccuracyCheck", "Idle", MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+   AddAllowedValue("HologramAccuracyCheck", "Idle");
+   AddAllowedValue("HologramAccuracyCheck", "Run");
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnHologramAccuracy);
+   nRet = CreateProperty("HologramAccuracy", hologramReport_.c_str(), MM::String, true, pAct);
+   assert(nRet == DEVICE_OK);
+
+   // replay frame source: a raw recording of 8 bit frames of the
+   // reconstruction size and its index, see FrameReplay.h
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReplayFile);
+   nRet = CreateProperty("ReplayFile", "", MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+
+   // empty takes ReplayFile + ".idx"
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReplayIndex);
+   nRet = CreateProperty("ReplayIndex", "", MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+
+   // RealTime serves the frame the recording shows at the time of the grab,
+   // Fast the next frame on every grab
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReplayMode);
+   nRet = CreateProperty("ReplayMode", "RealTime", MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+   AddAllowedValue("ReplayMode", "RealTime");
+   AddAllowedValue("ReplayMode", "Fast");
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReplayLoop);
+   nRet = CreateProperty("ReplayLoop", "0", MM::Integer, false, pAct);
+   assert(nRet == DEVICE_OK);
+   AddAllowedValue("ReplayLoop", "0");
+   AddAllowedValue("ReplayLoop", "1");
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReplayReadAhead);
+   nRet = CreateProperty("ReplayReadAhead (MB)", CDeviceUtils::ConvertToString((long)(replay_.ReadAhead() >> 20)), MM::Integer, false, pAct);
+   assert(nRet == DEVICE_OK);
+   SetPropertyLimits("ReplayReadAhead (MB)", 0, 1024);
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReplayFrames);
+   nRet = CreateProperty("ReplayFrames", "0", MM::Integer, true, pAct);
+   assert(nRet == DEVICE_OK);
+
+   // next frame to serve; setting it restarts the replay clock there
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnReplayPosition);
+   nRet = CreateProperty("ReplayPosition", "0", MM::Integer, false, pAct);
+   assert(nRet == DEVICE_OK);
+
+   // instruction set of the pixel kernels, Scalar forces the plain loops
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnPixelKernelISA);
+   nRet = CreateProperty("PixelKernelISA", PixelIsaName(Kernels().isa), MM::String, true, pAct);
+   assert(nRet == DEVICE_OK);
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnPixelKernelMode);
+   nRet = CreateProperty("PixelKernelMode", "Auto", MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+   AddAllowedValue("PixelKernelMode", "Auto");
+   AddAllowedValue("PixelKernelMode", "Scalar");
+
+   // scratch blocks the camera and the processors share; the allocation
+   // count stays put once every geometry in use has been seen
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnScratchInUse);
+   nRet = CreateProperty("ScratchInUse (MB)", "0", MM::Float, true, pAct);
+   assert(nRet == DEVICE_OK);
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnScratchHighWater);
+   nRet = CreateProperty("ScratchHighWater (MB)", "0", MM::Float, true, pAct);
+   assert(nRet == DEVICE_OK);
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnScratchAllocations);
+   nRet = CreateProperty("ScratchAllocations", "0", MM::Integer, true, pAct);
+   assert(nRet == DEVICE_OK);
+
+   // latency distribution of every pipeline stage, e.g. "CaptureLatency p99 (us)"
+   for (int stage = 0; stage < STAGE_COUNT; ++stage)
+   {
+      for (int stat = 0; stat < LatencyHistogram::LATENCY_STATISTIC_COUNT; ++stat)
+      {
+         const std::string name = std::string(g_StageNames[stage]) + LatencyHistogram::StatisticName((LatencyHistogram::Statistic)stat);
+         CPropertyActionEx* pActX = new CPropertyActionEx(this, &CBaslerCamera::OnStageLatency, stage * LatencyHistogram::LATENCY_STATISTIC_COUNT + stat);
+         nRet = CreateProperty(name.c_str(), "0", MM::Float, true, pActX);
+         assert(nRet == DEVICE_OK);
+      }
+   }
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnStageLatencyReset);
+   nRet = CreateProperty("StageLatencyReset", "Idle", MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+   AddAllowedValue("StageLatencyReset", "Idle");
+   AddAllowedValue("StageLatencyReset", "Reset");
+
+   // begin and end events of the grabber callback, the sequence thread, the
+   // reconstruction, the core insertion and the processors of this module;
+   // TraceDump writes the last TraceSeconds to TraceFile for chrome://tracing
+   // or Perfetto
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnTrace);
+   nRet = CreateProperty("Trace", "Off", MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+   AddAllowedValue("Trace", "Off");
+   AddAllowedValue("Trace", "On");
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnTraceSeconds);
+   nRet = CreateProperty("TraceSeconds", CDeviceUtils::ConvertToString(traceSeconds_), MM::Float, false, pAct);
+   assert(nRet == DEVICE_OK);
+   SetPropertyLimits("TraceSeconds", 0.1, 3600.);
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnTraceFile);
+   nRet = CreateProperty("TraceFile", traceFile_.c_str(), MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnTraceDump);
+   nRet = CreateProperty("TraceDump", "Idle", MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+   AddAllowedValue("TraceDump", "Idle");
+   AddAllowedValue("TraceDump", "Dump");
+
+   // use of the pixel lock by every call site, e.g. "GetImageBufferLockWait p99 (us)"
+   for (int site = 0; site < LOCK_SITE_COUNT; ++site)
+   {
+      for (int stat = 0; stat < LOCK_STATISTIC_COUNT; ++stat)
+      {
+         const std::string name = std::string(g_LockSiteNames[site]) + g_LockStatisticNames[stat];
+         CPropertyActionEx* pActX = new CPropertyActionEx(this, &CBaslerCamera::OnPixelsLock, site * LOCK_STATISTIC_COUNT + stat);
+         nRet = CreateProperty(name.c_str(), "0", (stat < LOCK_WAIT_P99) ? MM::Integer : MM::Float, true, pActX);
+         assert(nRet == DEVICE_OK);
+      }
+   }
+   pAct = new CPropertyAction (this, &CBaslerCamera::OnPixelsLockReset);
+   nRet = CreateProperty("PixelsLockReset", "Idle", MM::String, false, pAct);
+   assert(nRet == DEVICE_OK);
+   AddAllowedValue("PixelsLockReset", "Idle");
+   AddAllowedValue("PixelsLockReset", "Reset");
+
    return DEVICE_OK;
 
 }
@@ -658,15 +1077,30 @@ int CBaslerCamera::SnapImage()
       exp = GetSequenceExposure();
    }
 
-   // Start an acquisition sequence by activating the channel
-   McSetParamInt(m_Channel, MC_ChannelState, MC_ChannelState_ACTIVE);
+   MM::MMTime captureStart = GetCurrentMMTime();
+   if (FRAME_SOURCE_PATTERN == frameSource_)
+   {
+      GenerateSyntheticImage(img_, exp);
+   }
+   else if (FRAME_SOURCE_GRABBER != frameSource_)
+   {
+      int ret = NextSurface();
+      if (ret != DEVICE_OK)
+         return ret;
+      GetCameraImage(img_);
+   }
+   else
+   {
+      // Start an acquisition sequence by activating the channel
+      McSetParamInt(m_Channel, MC_ChannelState, MC_ChannelState_ACTIVE);
 
-   // Generate a soft trigger event (STRG)
-   McSetParamInt(m_Channel, MC_ForceTrig, MC_ForceTrig_TRIG);
+      // Generate a soft trigger event (STRG)
+      McSetParamInt(m_Channel, MC_ForceTrig, MC_ForceTrig_TRIG);
 
-   GetCameraImage(img_);
+      GetCameraImage(img_);
+   }
+   RecordStage(STAGE_CAPTURE, GetCurrentMMTime() - captureStart, GetImageBufferSize());
    //GenerateEmptyImage(img_);
-   //GenerateSyntheticImage(img_,exp);
 
    MM::MMTime s0(0,0);
    if( s0 < startTime )
@@ -705,13 +1139,47 @@ const unsigned char* CBaslerCamera::GetImageBuffer()
    if (pHub && pHub->GenerateRandomError())
       return 0;
 
-   MMThreadGuard g(imgPixelsLock_);
+   InstrumentedGuard g(imgPixelsLock_, LOCK_GET_IMAGE_BUFFER);
    MM::MMTime readoutTime(readoutUs_);
    while (readoutTime > (GetCurrentMMTime() - readoutStartTime_)) {}		
    unsigned char *pB = (unsigned char*)(img_.GetPixels());
    return pB;
 }
 
+/**
+* Returns the pixels of one refocus plane, channel 0 is the image buffer.
+*/
+const unsigned char* CBaslerCamera::GetImageBuffer(unsigned channel)
+{
+   if (0 == channel)
+      return GetImageBuffer();
+
+   InstrumentedGuard g(imgPixelsLock_, LOCK_GET_IMAGE_BUFFER);
+   const size_t planeBytes = GetImageBufferSize();
+   if (channel >= (unsigned)ActivePlaneCount() || planeImages_.size() < (channel + 1) * planeBytes)
+      return 0;
+   return &planeImages_[channel * planeBytes];
+}
+
+/**
+* Each refocus plane is one channel.
+*/
+unsigned CBaslerCamera::GetNumberOfChannels() const
+{
+   return ActivePlaneCount();
+}
+
+int CBaslerCamera::GetChannelName(unsigned channel, char* name)
+{
+   if (channel >= (unsigned)ActivePlaneCount())
+      return DEVICE_NONEXISTENT_CHANNEL;
+
+   std::ostringstream os;
+   os << "z=" << cpuReconstructor_.PlaneDistance(channel) << "um";
+   CDeviceUtils::CopyLimitedString(name, os.str().c_str());
+   return DEVICE_OK;
+}
+
 /**
 * Returns image buffer X-size in pixels.
 * Required by the MM::Camera API.
@@ -722,7 +1190,7 @@ unsigned CBaslerCamera::GetImageWidth() const
    if (pHub && pHub->GenerateRandomError())
       return 0;
 
-   return img_.Width();
+   return ProcessorSwapsAxes() ? img_.Height() : img_.Width();
 }
 
 /**
@@ -735,7 +1203,24 @@ unsigned CBaslerCamera::GetImageHeight() const
    if (pHub && pHub->GenerateRandomError())
       return 0;
 
-   return img_.Height();
+   return ProcessorSwapsAxes() ? img_.Width() : img_.Height();
+}
+
+/**
+* True while the image processor of this camera transposes or rotates the
+* frames by 90 degrees; the reported width and height are then swapped so
+* that the core allocates the processed image.
+*/
+bool CBaslerCamera::ProcessorSwapsAxes() const
+{
+   MM::Core* core = GetCoreCallback();
+   if (!core)
+      return false;
+   MM::Device* processor = core->GetImageProcessor(this);
+   if (dynamic_cast<TransposeProcessor*>(processor))
+      return true;
+   OrientationProcessor* orientation = dynamic_cast<OrientationProcessor*>(processor);
+   return orientation && orientation->SwapsAxes();
 }
 
 /**
@@ -1033,10 +1518,36 @@ int CBaslerCamera::StartSequenceAcquisition(long numImages, double interval_ms,
  */
 int CBaslerCamera::InsertImage()
 {
+   TraceScope trace("InsertImage");
    DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
    if (pHub && pHub->GenerateRandomError())
       return SIMULATED_ERROR;
 
+   InstrumentedGuard g(imgPixelsLock_, LOCK_INSERT_IMAGE);
+   if (ActivePlaneCount() > 1 && planeImages_.size() >= ReconstructionFrameBytes())
+      return InsertPlanes(&planeImages_[0]);
+   return InsertFrame(GetImageBuffer());
+}
+
+/*
+ * Inserts every plane of a refocus stack, planes are stored back to back
+ */
+int CBaslerCamera::InsertPlanes(const unsigned char* planes)
+{
+   const long planeBytes = GetImageBufferSize();
+   const int planeCount = ActivePlaneCount();
+   int ret = DEVICE_OK;
+   for (int p = 0; p < planeCount && DEVICE_OK == ret; ++p)
+      ret = InsertFrame(planes + p * planeBytes, p);
+   return ret;
+}
+
+/*
+ * Inserts one frame of the current image geometry, e.g. from a reconstruction
+ * batch, with its MetaData into MMCore circular Buffer
+ */
+int CBaslerCamera::InsertFrame(const unsigned char* pI, int plane)
+{
    MM::MMTime timeStamp = this->GetCurrentMMTime();
    char label[MM::MaxStrLength];
    this->GetLabel(label);
@@ -1049,25 +1560,33 @@ int CBaslerCamera::InsertImage()
    md.put(MM::g_Keyword_Metadata_ROI_X, CDeviceUtils::ConvertToString( (long) roiX_)); 
    md.put(MM::g_Keyword_Metadata_ROI_Y, CDeviceUtils::ConvertToString( (long) roiY_)); 
 
-   imageCounter_++;
+   if (ActivePlaneCount() > 1)
+   {
+      char channelName[MM::MaxStrLength];
+      GetChannelName(plane, channelName);
+      md.put(MM::g_Keyword_CameraChannelIndex, CDeviceUtils::ConvertToString((long)plane));
+      md.put(MM::g_Keyword_CameraChannelName, channelName);
+      md.put("RefocusDistance (um)", CDeviceUtils::ConvertToString(cpuReconstructor_.PlaneDistance(plane)));
+   }
+
+   // the planes of a refocus stack count as one captured frame
+   if (0 == plane)
+      imageCounter_++;
 
    char buf[MM::MaxStrLength];
    GetProperty(MM::g_Keyword_Binning, buf);
    md.put(MM::g_Keyword_Binning, buf);
 
-   MMThreadGuard g(imgPixelsLock_);
-
-   const unsigned char* pI;
-   pI = GetImageBuffer();
-
    unsigned int w = GetImageWidth();
    unsigned int h = GetImageHeight();
    unsigned int b = GetImageBytesPerPixel();
 
+   TraceScope trace("MMCore InsertImage");
    int ret = GetCoreCallback()->InsertImage(this, pI, w, h, b, md.Serialize().c_str());
    if (!stopOnOverflow_ && ret == DEVICE_BUFFER_OVERFLOW)
    {
       // do not stop on overflow - just reset the buffer
+      TraceLog::Instance().Instant("Buffer overflow");
       GetCoreCallback()->ClearImageBuffer(this);
       // don't process this same image again...
       return GetCoreCallback()->InsertImage(this, pI, w, h, b, md.Serialize().c_str(), false);
@@ -1081,6 +1600,8 @@ int CBaslerCamera::InsertImage()
  */
 int CBaslerCamera::ThreadRun (MM::MMTime startTime)
 {
+   TraceLog::Instance().SetThreadName("Sequence");
+   TraceScope trace("ThreadRun");
    DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
    if (pHub && pHub->GenerateRandomError())
       return SIMULATED_ERROR;
@@ -1098,15 +1619,48 @@ int CBaslerCamera::ThreadRun (MM::MMTime startTime)
    
    if (!fastImage_)
    {
-      //GenerateSyntheticImage(img_, GetSequenceExposure());
-	  GetCameraImage(img_);
+      ret = NextSurface();
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+
+   if (!fastImage_ && FRAME_SOURCE_PATTERN != frameSource_ && CanBatchReconstruction())
+   {
+      // frames are staged and reconstructed together, images reach the
+      // circular buffer when the batch is flushed
+      QueueFrameForBatch();
+      ret = DEVICE_OK;
+      if (IsBatchDue())
+         ret = FlushReconstructionBatch();
    }
+   else
+   {
+      if (!fastImage_ && FRAME_SOURCE_PATTERN == frameSource_)
+      {
+         MM::MMTime t0 = GetCurrentMMTime();
+         GenerateSyntheticImage(img_, GetSequenceExposure());
+         RecordStage(STAGE_CAPTURE, GetCurrentMMTime() - t0, GetImageBufferSize());
+      }
+      else if (!fastImage_)
+      {
+         MM::MMTime t0 = GetCurrentMMTime();
+         GetCameraImage(img_);
+         MM::MMTime elapsed = GetCurrentMMTime() - t0;
+         UpdateReconstructionStats(1, elapsed, elapsed);
+         RecordStage(STAGE_CAPTURE, elapsed, GetImageBufferSize());
+      }
 
-   ret = InsertImage();
-     
+      MM::MMTime t0 = GetCurrentMMTime();
+      ret = InsertImage();
+      RecordStage(STAGE_INSERT, GetCurrentMMTime() - t0, GetImageBufferSize());
+   }
 
-   while (((double) (this->GetCurrentMMTime() - startTime).getMsec() / imageCounter_) < this->GetSequenceExposure())
+   while (((double) (this->GetCurrentMMTime() - startTime).getMsec() / (imageCounter_ + batchCount_)) < this->GetSequenceExposure())
    {
+      // a partial batch is not held past its latency limit while the
+      // next frame is not due yet
+      if (DEVICE_OK == ret && IsBatchLate())
+         ret = FlushReconstructionBatch();
       CDeviceUtils::SleepMs(1);
    }
 
@@ -1129,6 +1683,9 @@ void CBaslerCamera::OnThreadExiting() throw()
    try
    {
       LogMessage(g_Msg_SEQUENCE_ACQUISITION_THREAD_EXITING);
+      // frames still waiting in a partial batch belong to this acquisition
+      if (batchCount_ > 0 && GetCoreCallback())
+         FlushReconstructionBatch();
       GetCoreCallback()?GetCoreCallback()->AcqFinished(this,0):DEVICE_OK;
    }
 
@@ -1562,101 +2119,451 @@ int CBaslerCamera::OnFastImage(MM::PropertyBase* pProp, MM::ActionType eAct)
    return DEVICE_OK;
 }
 
-int CBaslerCamera::OnSaturatePixels(MM::PropertyBase* pProp, MM::ActionType eAct)
+int CBaslerCamera::OnFrameSource(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
-   DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
-   if (pHub && pHub->GenerateRandomError())
-      return SIMULATED_ERROR;
-
-   if (eAct == MM::AfterSet)
+   if (eAct == MM::BeforeGet)
    {
-      long tvalue = 0;
-      pProp->Get(tvalue);
-		saturatePixels_ = (0==tvalue)?false:true;
+      switch (frameSource_)
+      {
+      case FRAME_SOURCE_PATTERN: pProp->Set(g_FrameSource_Pattern); break;
+      case FRAME_SOURCE_HOLOGRAM: pProp->Set(g_FrameSource_Hologram); break;
+      case FRAME_SOURCE_REPLAY: pProp->Set(g_FrameSource_Replay); break;
+      default: pProp->Set(g_FrameSource_Grabber); break;
+      }
    }
-   else if (eAct == MM::BeforeGet)
+   else if (eAct == MM::AfterSet)
    {
-      pProp->Set(saturatePixels_?1L:0L);
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+      std::string source;
+      pProp->Get(source);
+      if (source == g_FrameSource_Pattern)
+         frameSource_ = FRAME_SOURCE_PATTERN;
+      else if (source == g_FrameSource_Hologram)
+         frameSource_ = FRAME_SOURCE_HOLOGRAM;
+      else if (source == g_FrameSource_Replay)
+         frameSource_ = FRAME_SOURCE_REPLAY;
+      else
+         frameSource_ = FRAME_SOURCE_GRABBER;
+      hologramGrabs_ = 0;
+      replayGrabs_ = 0;
    }
-
    return DEVICE_OK;
 }
 
-int CBaslerCamera::OnFractionOfPixelsToDropOrSaturate(MM::PropertyBase* pProp, MM::ActionType eAct)
+int CBaslerCamera::OnSensorNoise(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
-   DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
-   if (pHub && pHub->GenerateRandomError())
-      return SIMULATED_ERROR;
-
-   if (eAct == MM::AfterSet)
+   if (eAct == MM::BeforeGet)
    {
-      double tvalue = 0;
-      pProp->Get(tvalue);
-		fractionOfPixelsToDropOrSaturate_ = tvalue;
+      pProp->Set(noiseModel_.enabled ? 1L : 0L);
    }
-   else if (eAct == MM::BeforeGet)
+   else if (eAct == MM::AfterSet)
    {
-      pProp->Set(fractionOfPixelsToDropOrSaturate_);
-   }
+      long enabled;
+      pProp->Get(enabled);
 
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      noiseModel_.enabled = (0 != enabled);
+   }
    return DEVICE_OK;
 }
 
-/*
-* Handles "ScanMode" property.
-* Changes allowed Binning values to test whether the UI updates properly
-*/
-int CBaslerCamera::OnScanMode(MM::PropertyBase* pProp, MM::ActionType eAct)
-{ 
-   DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
-   if (pHub && pHub->GenerateRandomError())
-      return SIMULATED_ERROR;
+int CBaslerCamera::OnNoiseParameter(MM::PropertyBase* pProp, MM::ActionType eAct, long index)
+{
+   const NoiseParameter& p = g_NoiseParameters[index];
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(noiseModel_.*p.value * p.scale);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double value;
+      pProp->Get(value);
 
-   if (eAct == MM::AfterSet) {
-      pProp->Get(scanMode_);
-      SetAllowedBinning();
-      if (initialized_) {
-         int ret = OnPropertiesChanged();
-         if (ret != DEVICE_OK)
-            return ret;
-      }
-   } else if (eAct == MM::BeforeGet) {
-      LogMessage("Reading property ScanMode", true);
-      pProp->Set(scanMode_);
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      noiseModel_.*p.value = value / p.scale;
    }
    return DEVICE_OK;
 }
 
-
-
-
-int CBaslerCamera::OnCameraCCDXSize(MM::PropertyBase* pProp , MM::ActionType eAct)
+int CBaslerCamera::OnNoiseSeed(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
-   DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
-   if (pHub && pHub->GenerateRandomError())
-      return SIMULATED_ERROR;
-
    if (eAct == MM::BeforeGet)
    {
-		pProp->Set(cameraCCDXSize_);
+      pProp->Set((long)noise_.Seed());
    }
    else if (eAct == MM::AfterSet)
    {
-      long value;
-      pProp->Get(value);
-		if ( (value < 16) || (33000 < value))
-			return DEVICE_ERR;  // invalid image size
-		if( value != cameraCCDXSize_)
-		{
-			cameraCCDXSize_ = value;
-			img_.Resize(cameraCCDXSize_/binSize_, cameraCCDYSize_/binSize_);
-		}
+      long seed;
+      pProp->Get(seed);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      noise_.SetSeed((unsigned)seed);
    }
-	return DEVICE_OK;
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnHologramScene(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(g_HologramScenes[hologramSettings_.scene]);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string scene;
+      pProp->Get(scene);
 
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      for (int i = 0; i < (int)(sizeof(g_HologramScenes) / sizeof(g_HologramScenes[0])); ++i)
+      {
+         if (scene == g_HologramScenes[i])
+            hologramSettings_.scene = (HologramSource::Scene)i;
+      }
+   }
+   return DEVICE_OK;
 }
 
-int CBaslerCamera::OnCameraCCDYSize(MM::PropertyBase* pProp, MM::ActionType eAct)
+int CBaslerCamera::OnHologramImage(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(hologramSettings_.imagePath.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string path;
+      pProp->Get(path);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      hologramSettings_.imagePath = path;
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnHologramFrames(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)hologramSettings_.frameCount);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long frames;
+      pProp->Get(frames);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      hologramSettings_.frameCount = (int)frames;
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnHologramParticles(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)hologramSettings_.particleCount);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long particles;
+      pProp->Get(particles);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      hologramSettings_.particleCount = (int)particles;
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnHologramParameter(MM::PropertyBase* pProp, MM::ActionType eAct, long index)
+{
+   const HologramParameter& p = g_HologramParameters[index];
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(hologramSettings_.*p.value);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double value;
+      pProp->Get(value);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      hologramSettings_.*p.value = value;
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnHologramFrameRate(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(hologramFps_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double fps;
+      pProp->Get(fps);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      hologramFps_ = fps;
+      hologramGrabs_ = 0;
+   }
+   return DEVICE_OK;
+}
+
+/**
+* Handles "HologramAccuracyCheck" property.
+* Setting it to "Run" reconstructs the current hologram frame as 8 bit
+* intensity at the reconstruction distance and reports its correlation
+* with the intensity transmittance of the scene.
+*/
+int CBaslerCamera::OnHologramAccuracyCheck(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set("Idle");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string value;
+      pProp->Get(value);
+      if (value != "Run")
+         return DEVICE_OK;
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+      InitCpuReconstructor();
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      if (0 == hologram_.FrameCount() || (int)hologram_.Width() != cpuReconstructor_.Width() || (int)hologram_.Height() != cpuReconstructor_.Height())
+      {
+         hologramReport_ = "No hologram";
+         pProp->Set("Idle");
+         return DEVICE_OK;
+      }
+
+      const ReconstructionOutput output = cpuReconstructor_.GetOutput();
+      std::vector<unsigned char> planes((size_t)cpuReconstructor_.Width() * cpuReconstructor_.Height() * cpuReconstructor_.PlaneCount());
+      cpuReconstructor_.SetOutput(OUTPUT_INTENSITY8);
+      cpuReconstructor_.Reconstruct(hologram_.Frame(hologramFrame_), &planes[0]);
+      cpuReconstructor_.SetOutput(output);
+
+      std::ostringstream os;
+      os << "Frame " << hologramFrame_ << ": correlation " << hologram_.ScoreReconstruction(hologramFrame_, &planes[0]) <<
+         " at " << cpuReconstructor_.PlaneDistance(0) << " um";
+      hologramReport_ = os.str();
+      pProp->Set("Idle");
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnHologramAccuracy(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(hologramReport_.c_str());
+   }
+   return DEVICE_OK;
+}
+
+/**
+* Handles "ReplayFile" property.
+* The recording is opened right away so a wrong file or index fails the
+* property change; an empty path closes the replay.
+*/
+int CBaslerCamera::OnReplayFile(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(replayFile_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+      std::string path;
+      pProp->Get(path);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      replayFile_ = path;
+      return OpenReplay();
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnReplayIndex(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(replayIndexFile_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+      std::string path;
+      pProp->Get(path);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      replayIndexFile_ = path;
+      return OpenReplay();
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnReplayMode(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(replayRealTime_ ? "RealTime" : "Fast");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string mode;
+      pProp->Get(mode);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      replayRealTime_ = (mode == "RealTime");
+      replayGrabs_ = 0;
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnReplayLoop(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(replayLoop_ ? 1L : 0L);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long loop;
+      pProp->Get(loop);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      replayLoop_ = (0 != loop);
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnReplayReadAhead(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)(replay_.ReadAhead() >> 20));
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long megabytes;
+      pProp->Get(megabytes);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      replay_.SetReadAhead((size_t)megabytes << 20);
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnReplayFrames(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)replay_.FrameCount());
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnReplayPosition(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)replayPosition_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+      long position;
+      pProp->Get(position);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      replayPosition_ = (size_t)std::max(0L, position);
+      replayGrabs_ = 0;
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnSaturatePixels(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
+   if (pHub && pHub->GenerateRandomError())
+      return SIMULATED_ERROR;
+
+   if (eAct == MM::AfterSet)
+   {
+      long tvalue = 0;
+      pProp->Get(tvalue);
+		saturatePixels_ = (0==tvalue)?false:true;
+   }
+   else if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(saturatePixels_?1L:0L);
+   }
+
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnFractionOfPixelsToDropOrSaturate(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
+   if (pHub && pHub->GenerateRandomError())
+      return SIMULATED_ERROR;
+
+   if (eAct == MM::AfterSet)
+   {
+      double tvalue = 0;
+      pProp->Get(tvalue);
+		fractionOfPixelsToDropOrSaturate_ = tvalue;
+   }
+   else if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(fractionOfPixelsToDropOrSaturate_);
+   }
+
+   return DEVICE_OK;
+}
+
+/*
+* Handles "ScanMode" property.
+* Changes allowed Binning values to test whether the UI updates properly
+*/
+int CBaslerCamera::OnScanMode(MM::PropertyBase* pProp, MM::ActionType eAct)
+{ 
+   DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
+   if (pHub && pHub->GenerateRandomError())
+      return SIMULATED_ERROR;
+
+   if (eAct == MM::AfterSet) {
+      pProp->Get(scanMode_);
+      SetAllowedBinning();
+      if (initialized_) {
+         int ret = OnPropertiesChanged();
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+   } else if (eAct == MM::BeforeGet) {
+      LogMessage("Reading property ScanMode", true);
+      pProp->Set(scanMode_);
+   }
+   return DEVICE_OK;
+}
+
+
+
+
+int CBaslerCamera::OnCameraCCDXSize(MM::PropertyBase* pProp , MM::ActionType eAct)
 {
    DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
    if (pHub && pHub->GenerateRandomError())
@@ -1664,7 +2571,7 @@ int CBaslerCamera::OnCameraCCDYSize(MM::PropertyBase* pProp, MM::ActionType eAct
 
    if (eAct == MM::BeforeGet)
    {
-		pProp->Set(cameraCCDYSize_);
+		pProp->Set(cameraCCDXSize_);
    }
    else if (eAct == MM::AfterSet)
    {
@@ -1672,9 +2579,9 @@ int CBaslerCamera::OnCameraCCDYSize(MM::PropertyBase* pProp, MM::ActionType eAct
       pProp->Get(value);
 		if ( (value < 16) || (33000 < value))
 			return DEVICE_ERR;  // invalid image size
-		if( value != cameraCCDYSize_)
+		if( value != cameraCCDXSize_)
 		{
-			cameraCCDYSize_ = value;
+			cameraCCDXSize_ = value;
 			img_.Resize(cameraCCDXSize_/binSize_, cameraCCDYSize_/binSize_);
 		}
    }
@@ -1682,61 +2589,670 @@ int CBaslerCamera::OnCameraCCDYSize(MM::PropertyBase* pProp, MM::ActionType eAct
 
 }
 
-int CBaslerCamera::OnTriggerDevice(MM::PropertyBase* pProp, MM::ActionType eAct)
+int CBaslerCamera::OnCameraCCDYSize(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
+   if (pHub && pHub->GenerateRandomError())
+      return SIMULATED_ERROR;
+
+   if (eAct == MM::BeforeGet)
+   {
+		pProp->Set(cameraCCDYSize_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long value;
+      pProp->Get(value);
+		if ( (value < 16) || (33000 < value))
+			return DEVICE_ERR;  // invalid image size
+		if( value != cameraCCDYSize_)
+		{
+			cameraCCDYSize_ = value;
+			img_.Resize(cameraCCDXSize_/binSize_, cameraCCDYSize_/binSize_);
+		}
+   }
+	return DEVICE_OK;
+
+}
+
+int CBaslerCamera::OnTriggerDevice(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
+   if (pHub && pHub->GenerateRandomError())
+      return SIMULATED_ERROR;
+
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(triggerDevice_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(triggerDevice_);
+   }
+   return DEVICE_OK;
+}
+
+
+int CBaslerCamera::OnCCDTemp(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(ccdT_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(ccdT_);
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnIsSequenceable(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   std::string val = "Yes";
+   if (eAct == MM::BeforeGet)
+   {
+      if (!isSequenceable_) 
+      {
+         val = "No";
+      }
+      pProp->Set(val.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      isSequenceable_ = false;
+      pProp->Get(val);
+      if (val == "Yes") 
+      {
+         isSequenceable_ = true;
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+
+/**
+* Handles "ReconstructionBackend" property.
+*/
+int CBaslerCamera::OnReconstructionBackend(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(cpuBackend_ ? "CPU" : "CUDA");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+      std::string backend;
+      pProp->Get(backend);
+      cpuBackend_ = (backend == "CPU");
+      if (cpuBackend_)
+      {
+         InitCpuReconstructor();
+         return DEVICE_OK;
+      }
+
+      // the CUDA backend reconstructs one 8 bit plane
+      int ret = DEVICE_OK;
+      if (cpuReconstructor_.PlaneCount() > 1)
+         ret = SetProperty("RefocusDistances (um)", "");
+      if (DEVICE_OK == ret && cpuReconstructor_.GetOutput() != OUTPUT_INTENSITY8)
+         ret = SetProperty("ReconstructionOutput", "Intensity8");
+      return ret;
+   }
+   return DEVICE_OK;
+}
+
+/**
+* Handles "ReconstructionBatchSize" property.
+*/
+int CBaslerCamera::OnReconstructionBatchSize(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(batchSize_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+      long value;
+      pProp->Get(value);
+      if (value < 1)
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      batchSize_ = value;
+      batchCount_ = 0;
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnReconstructionBatchLatencyLimit(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(batchLatencyLimitMs_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(batchLatencyLimitMs_);
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnReconstructionThroughput(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(reconstructionFps_);
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnReconstructionLatency(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(reconstructionLatencyMs_);
+   }
+   return DEVICE_OK;
+}
+
+/**
+* Handles "ReconstructionPrecision" property.
+* float16 keeps the spectra in half precision between the passes, int16
+* runs fixed point butterflies several rows or columns at once in SIMD
+* lanes; both halve the memory traffic of float32.
+*/
+int CBaslerCamera::OnReconstructionPrecision(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      switch (cpuReconstructor_.GetPrecision())
+      {
+      case PRECISION_FLOAT16: pProp->Set("float16"); break;
+      case PRECISION_INT16: pProp->Set("int16"); break;
+      default: pProp->Set("float32"); break;
+      }
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string precision;
+      pProp->Get(precision);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      if (precision == "float16")
+         cpuReconstructor_.SetPrecision(PRECISION_FLOAT16);
+      else if (precision == "int16")
+         cpuReconstructor_.SetPrecision(PRECISION_INT16);
+      else
+         cpuReconstructor_.SetPrecision(PRECISION_FLOAT32);
+   }
+   return DEVICE_OK;
+}
+
+/**
+* Handles "ReconstructionAccuracyCheck" property.
+* Setting it to "Run" reconstructs the current frame in float32 and in the
+* selected precision and reports the difference.
+*/
+int CBaslerCamera::OnReconstructionAccuracyCheck(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set("Idle");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string value;
+      pProp->Get(value);
+      if (value != "Run")
+         return DEVICE_OK;
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+      if (m_pCurrent1 == 0)
+      {
+         accuracyReport_ = "No frame";
+         return DEVICE_OK;
+      }
+
+      InitCpuReconstructor();
+      double maxError, psnr;
+      {
+         InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+         cpuReconstructor_.MeasureAccuracy(m_pCurrent1, maxError, psnr);
+      }
+
+      char precision[MM::MaxStrLength];
+      GetProperty("ReconstructionPrecision", precision);
+      std::ostringstream os;
+      os << precision << ": PSNR " << psnr << " dB, max error " << maxError;
+      accuracyReport_ = os.str();
+      pProp->Set("Idle");
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnReconstructionAccuracy(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(accuracyReport_.c_str());
+   }
+   return DEVICE_OK;
+}
+
+/**
+* Handles "ReconstructionOutput" property.
+* Intensity32 delivers float intensity as "32bit" pixels, AmplitudePhase
+* packs 16 bit amplitude and phase into the first two components of
+* "64bitRGB" pixels. The CUDA backend only produces 8 bit intensity.
+*/
+int CBaslerCamera::OnReconstructionOutput(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      switch (cpuReconstructor_.GetOutput())
+      {
+      case OUTPUT_INTENSITY32: pProp->Set("Intensity32"); break;
+      case OUTPUT_AMPLITUDE_PHASE: pProp->Set("AmplitudePhase"); break;
+      default: pProp->Set("Intensity8"); break;
+      }
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+      std::string output;
+      pProp->Get(output);
+
+      ReconstructionOutput format = OUTPUT_INTENSITY8;
+      const char* pixelType = g_PixelType_8bit;
+      if (output == "Intensity32")
+      {
+         format = OUTPUT_INTENSITY32;
+         pixelType = g_PixelType_32bit;
+      }
+      else if (output == "AmplitudePhase")
+      {
+         format = OUTPUT_AMPLITUDE_PHASE;
+         pixelType = g_PixelType_64bitRGB;
+      }
+      if (format != OUTPUT_INTENSITY8 && !cpuBackend_)
+      {
+         pProp->Set("Intensity8");
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+
+      {
+         InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+         cpuReconstructor_.SetOutput(format);
+      }
+      return SetProperty(MM::g_Keyword_PixelType, pixelType);
+   }
+   return DEVICE_OK;
+}
+
+/**
+* Handles "RefocusDistances (um)" property.
+* A comma or space separated list of propagation distances; the forward
+* spectrum of each frame is computed once and propagated to every plane.
+* An empty list reconstructs the single default plane.
+*/
+int CBaslerCamera::OnRefocusDistances(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(refocusDistances_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+      std::string value;
+      pProp->Get(value);
+      std::string list(value);
+      std::replace(list.begin(), list.end(), ',', ' ');
+
+      std::vector<double> distances;
+      std::istringstream is(list);
+      double distance;
+      while (is >> distance)
+         distances.push_back(distance);
+
+      // only the CPU backend can reconstruct more than one plane
+      if (!is.eof() || distances.size() > (size_t)g_MaxRefocusPlanes ||
+         (distances.size() > 1 && !cpuBackend_))
+      {
+         pProp->Set(refocusDistances_.c_str());
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+
+      SetReconstructionPlanes(distances);
+      refocusDistances_ = value;
+   }
+   return DEVICE_OK;
+}
+
+/**
+* Handles "PropagationDistance (um)" property.
+* Safe to change during live view: the reconstruction plan is kept and the
+* transfer function comes from the cache when it was used recently.
+*/
+int CBaslerCamera::OnPropagationDistance(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(cpuReconstructor_.Distance());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double distance;
+      pProp->Get(distance);
+      SetReconstructionGeometry(GEOMETRY_DISTANCE, distance, LOCK_PROPERTIES);
+   }
+   return DEVICE_OK;
+}
+
+/**
+* Handles "Wavelength (nm)" property.
+*/
+int CBaslerCamera::OnWavelength(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(cpuReconstructor_.Wavelength());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double wavelength;
+      pProp->Get(wavelength);
+      SetReconstructionGeometry(GEOMETRY_WAVELENGTH, wavelength, LOCK_PROPERTIES);
+   }
+   return DEVICE_OK;
+}
+
+/**
+* Handles "PixelPitch (um)" property.
+*/
+int CBaslerCamera::OnPixelPitch(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(cpuReconstructor_.PixelPitch());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double pitch;
+      pProp->Get(pitch);
+      SetReconstructionGeometry(GEOMETRY_PIXEL_PITCH, pitch, LOCK_PROPERTIES);
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnTransferFunctionCacheSize(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)cpuReconstructor_.CacheSize());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long size;
+      pProp->Get(size);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      cpuReconstructor_.SetCacheSize(size);
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnReconstructionThreads(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)cpuReconstructor_.ThreadCount());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long threads;
+      pProp->Get(threads);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      cpuReconstructor_.SetThreadCount(threads);
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnSyntheticThreads(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)synthetic_.ThreadCount());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long threads;
+      pProp->Get(threads);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      synthetic_.SetThreadCount(threads);
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnPixelKernelISA(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(PixelIsaName(Kernels().isa));
+   }
+   return DEVICE_OK;
+}
+
+/**
+* Auto uses the widest instruction set found at load time, Scalar the plain
+* C++ loops. The kernels are shared by all devices of the adapter.
+*/
+int CBaslerCamera::OnPixelKernelMode(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(Kernels().isa == ISA_SCALAR && DetectedPixelIsa() != ISA_SCALAR ? "Scalar" : "Auto");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string mode;
+      pProp->Get(mode);
+
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      LimitPixelIsa(mode == "Scalar" ? ISA_SCALAR : DetectedPixelIsa());
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnStageLatency(MM::PropertyBase* pProp, MM::ActionType eAct, long index)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      const LatencyHistogram& h = stageLatency_[index / LatencyHistogram::LATENCY_STATISTIC_COUNT];
+      pProp->Set(h.Value((LatencyHistogram::Statistic)(index % LatencyHistogram::LATENCY_STATISTIC_COUNT)));
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnStageLatencyReset(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set("Idle");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string value;
+      pProp->Get(value);
+      if (value == "Reset")
+      {
+         for (int stage = 0; stage < STAGE_COUNT; ++stage)
+            stageLatency_[stage].Reset();
+      }
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnTrace(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(TraceLog::Instance().Enabled() ? "On" : "Off");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string value;
+      pProp->Get(value);
+      TraceLog::Instance().Enable(value == "On");
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnTraceSeconds(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(traceSeconds_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(traceSeconds_);
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnTraceFile(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
-   DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
-   if (pHub && pHub->GenerateRandomError())
-      return SIMULATED_ERROR;
-
    if (eAct == MM::BeforeGet)
    {
-      pProp->Set(triggerDevice_.c_str());
+      pProp->Set(traceFile_.c_str());
    }
    else if (eAct == MM::AfterSet)
    {
-      pProp->Get(triggerDevice_);
+      pProp->Get(traceFile_);
    }
    return DEVICE_OK;
 }
 
-
-int CBaslerCamera::OnCCDTemp(MM::PropertyBase* pProp, MM::ActionType eAct)
+int CBaslerCamera::OnTraceDump(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
    if (eAct == MM::BeforeGet)
    {
-      pProp->Set(ccdT_);
+      pProp->Set("Idle");
    }
    else if (eAct == MM::AfterSet)
    {
-      pProp->Get(ccdT_);
+      std::string value;
+      pProp->Get(value);
+      if (value == "Dump" && !TraceLog::Instance().Dump(traceFile_, traceSeconds_))
+         return ERR_TRACE_DUMP;
    }
    return DEVICE_OK;
 }
 
-int CBaslerCamera::OnIsSequenceable(MM::PropertyBase* pProp, MM::ActionType eAct)
+int CBaslerCamera::OnPixelsLock(MM::PropertyBase* pProp, MM::ActionType eAct, long index)
 {
-   std::string val = "Yes";
    if (eAct == MM::BeforeGet)
    {
-      if (!isSequenceable_) 
+      const int site = (int)(index / LOCK_STATISTIC_COUNT);
+      switch (index % LOCK_STATISTIC_COUNT)
       {
-         val = "No";
+      case LOCK_ACQUISITIONS: pProp->Set((long)imgPixelsLock_.Wait(site).Count()); break;
+      case LOCK_CONTENTIONS: pProp->Set((long)imgPixelsLock_.Contentions(site)); break;
+      case LOCK_WAIT_P99: pProp->Set(imgPixelsLock_.Wait(site).Value(LatencyHistogram::LATENCY_P99)); break;
+      case LOCK_WAIT_MAX: pProp->Set(imgPixelsLock_.Wait(site).Max()); break;
+      case LOCK_HOLD_P99: pProp->Set(imgPixelsLock_.Hold(site).Value(LatencyHistogram::LATENCY_P99)); break;
+      case LOCK_HOLD_MAX: pProp->Set(imgPixelsLock_.Hold(site).Max()); break;
       }
-      pProp->Set(val.c_str());
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnPixelsLockReset(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set("Idle");
    }
    else if (eAct == MM::AfterSet)
    {
-      isSequenceable_ = false;
-      pProp->Get(val);
-      if (val == "Yes") 
-      {
-         isSequenceable_ = true;
-      }
+      std::string value;
+      pProp->Get(value);
+      if (value == "Reset")
+         imgPixelsLock_.Reset();
    }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnScratchInUse(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(ScratchArena::Instance().GetStats().bytesInUse / 1048576.);
+   }
+   return DEVICE_OK;
+}
+
+int CBaslerCamera::OnScratchHighWater(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(ScratchArena::Instance().GetStats().highWater / 1048576.);
+   }
+   return DEVICE_OK;
+}
 
+int CBaslerCamera::OnScratchAllocations(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)ScratchArena::Instance().GetStats().allocations);
+   }
    return DEVICE_OK;
 }
 
+/**
+* Copies the latest raw hologram with the optics it was recorded with.
+* Returns false before the first frame.
+*/
+bool CBaslerCamera::CopyHologram(std::vector<unsigned char>& frame, int& width, int& height, double& wavelengthNm, double& pixelPitchUm)
+{
+   InstrumentedGuard g(imgPixelsLock_, LOCK_AUTOFOCUS);
+   if (m_pCurrent1 == 0 || reconWidth_ <= 0 || reconHeight_ <= 0)
+      return false;
+
+   width = reconWidth_;
+   height = reconHeight_;
+   frame.assign(m_pCurrent1, m_pCurrent1 + (size_t)width * height);
+   wavelengthNm = cpuReconstructor_.Wavelength();
+   pixelPitchUm = cpuReconstructor_.PixelPitch();
+   return true;
+}
+
+/**
+* Moves the reconstruction plane; the next frame the CPU backend
+* reconstructs uses it. The CUDA backend keeps its own distance.
+*/
+void CBaslerCamera::SetPropagationDistance(double distanceUm)
+{
+   SetReconstructionGeometry(GEOMETRY_DISTANCE, distanceUm, LOCK_AUTOFOCUS);
+   std::ostringstream os;
+   os << distanceUm;
+   OnPropertyChanged("PropagationDistance (um)", os.str().c_str());
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // Private CBaslerCamera methods
@@ -1789,9 +3305,9 @@ int CBaslerCamera::ResizeImageBuffer()
    return DEVICE_OK;
 }
 
-void CBaslerCamera::GenerateEmptyImage(ImgBuffer& img)
+void CBaslerCamera::GenerateEmptyImage(FrameBuffer& img)
 {
-   MMThreadGuard g(imgPixelsLock_);
+   InstrumentedGuard g(imgPixelsLock_, LOCK_EMPTY_IMAGE);
 
    char buf[MM::MaxStrLength];
    GetProperty(MM::g_Keyword_PixelType, buf);
@@ -1806,259 +3322,439 @@ void CBaslerCamera::GenerateEmptyImage(ImgBuffer& img)
 
 
 
-void CBaslerCamera::GetCameraImage(ImgBuffer& img) 
+void CBaslerCamera::GetCameraImage(FrameBuffer& img) 
 {
+   TraceScope trace("GetCameraImage");
 
-   MMThreadGuard g(imgPixelsLock_);
+   InstrumentedGuard g(imgPixelsLock_, LOCK_GET_CAMERA_IMAGE);
    if (img.Height() == 0 || img.Width() == 0 || img.Depth() == 0)
       return;  
 
    unsigned char* pBuf = (unsigned char*)const_cast<unsigned char*>(img.GetPixels());
 
+   if (cpuBackend_)
+   {
+      if (ReconstructionMatchesImage() && 1 == cpuReconstructor_.PlaneCount())
+      {
+         cpuReconstructor_.Reconstruct(m_pCurrent1, pBuf);
+      }
+      else
+      {
+         // refocus planes are kept for GetImageBuffer(channel), the image
+         // buffer gets the first plane
+         planeImages_.resize(ReconstructionFrameBytes());
+         cpuReconstructor_.Reconstruct(m_pCurrent1, &planeImages_[0]);
+         memcpy(pBuf, &planeImages_[0], min(cpuReconstructor_.OutputPlaneBytes(), (size_t)(img.Width() * img.Height() * img.Depth())));
+      }
+      return;
+   }
+
    unsigned char *rec = reconstruct(method, m_pCurrent1);
 
    memcpy (pBuf, rec, paddedX*paddedY);
 
 }
 
+/**
+* Points the grabber surface at the next frame of the simulated sources;
+* the grabber and the sine pattern need nothing.
+*/
+int CBaslerCamera::NextSurface()
+{
+   switch (frameSource_)
+   {
+   case FRAME_SOURCE_HOLOGRAM: return NextHologram();
+   case FRAME_SOURCE_REPLAY: return NextReplay();
+   default: return DEVICE_OK;
+   }
+}
 
 /**
-* Generate a spatial sine wave.
+* Points the grabber surface at the hologram frame due now: with a frame
+* rate the pool is replayed on the clock of the first grab, otherwise every
+* grab takes the next frame. The pool is rebuilt first when the settings,
+* the optics or the noise model changed.
 */
-void CBaslerCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
-{ 
+int CBaslerCamera::NextHologram()
+{
+   InstrumentedGuard g(imgPixelsLock_, LOCK_FRAME_SOURCE);
+   HologramSource::Settings settings = hologramSettings_;
+   settings.wavelengthNm = cpuReconstructor_.Wavelength();
+   settings.pixelPitchUm = cpuReconstructor_.PixelPitch();
+   settings.seed = noise_.Seed();
+   settings.noise = noiseModel_;
+   settings.exposureMs = GetExposure();
+   if (!hologram_.Prepare(reconWidth_, reconHeight_, settings))
+      return ERR_HOLOGRAM_SCENE;
+
+   const MM::MMTime now = GetCurrentMMTime();
+   if (0 == hologramGrabs_)
+      hologramStart_ = now;
+   if (hologramFps_ > 0.)
+      hologramFrame_ = (int)((long long)((now - hologramStart_).getMsec() * hologramFps_ / 1000.) % hologram_.FrameCount());
+   else
+      hologramFrame_ = (int)(hologramGrabs_ % hologram_.FrameCount());
+   ++hologramGrabs_;
 
-   MMThreadGuard g(imgPixelsLock_);
+   m_pCurrent1 = const_cast<unsigned char*>(hologram_.Frame(hologramFrame_));
+   return DEVICE_OK;
+}
 
-	//std::string pixelType;
-	char buf[MM::MaxStrLength];
-   GetProperty(MM::g_Keyword_PixelType, buf);
-	std::string pixelType(buf);
+/**
+* Points the grabber surface at the recorded frame due now. In real time
+* the replay clock starts at the first grab from ReplayPosition and frames
+* the acquisition is too slow for are skipped, as a live camera would drop
+* them; Fast serves every frame in turn. Without looping the end of the
+* recording ends the acquisition.
+*/
+int CBaslerCamera::NextReplay()
+{
+   InstrumentedGuard g(imgPixelsLock_, LOCK_FRAME_SOURCE);
+   if (!replay_.IsOpen())
+      return ERR_REPLAY_OPEN;
+   if (replay_.Width() != (unsigned)reconWidth_ || replay_.Height() != (unsigned)reconHeight_ || 1 != replay_.BytesPerPixel())
+      return ERR_REPLAY_FORMAT;
 
-	if (img.Height() == 0 || img.Width() == 0 || img.Depth() == 0)
-      return;
+   const size_t count = replay_.FrameCount();
+   const MM::MMTime now = GetCurrentMMTime();
+   if (0 == replayGrabs_)
+   {
+      replayStart_ = now;
+      replayStartFrame_ = std::min(replayPosition_, count - 1);
+   }
 
-   const double cPi = 3.14159265358979;
-   long lPeriod = img.Width()/2;
-   double dLinePhase = 0.0;
-   const double dAmp = exp;
-   const double cLinePhaseInc = 2.0 * cPi / 4.0 / img.Height();
+   size_t frame;
+   if (replayRealTime_)
+   {
+      const long long first = replay_.TimestampUs(0);
+      long long t = replay_.TimestampUs(replayStartFrame_) + (long long)(now - replayStart_).getUsec();
+      if (t >= first + replay_.DurationUs())
+      {
+         if (!replayLoop_)
+            return ERR_REPLAY_END;
+         t = first + (t - first) % replay_.DurationUs();
+      }
+      frame = replay_.FrameAt(t);
+   }
+   else
+   {
+      frame = replayPosition_;
+      if (frame >= count)
+      {
+         if (!replayLoop_)
+            return ERR_REPLAY_END;
+         frame = 0;
+      }
+   }
 
-   static bool debugRGB = false;
-#ifdef TIFFDEMO
-	debugRGB = true;
-#endif
-   static  unsigned char* pDebug  = NULL;
-   static unsigned long dbgBufferSize = 0;
-   static long iseq = 1;
+   const unsigned char* pixels = replay_.Frame(frame);
+   if (NULL == pixels)
+      return ERR_REPLAY_OPEN;
+   replayPosition_ = frame + 1;
+   ++replayGrabs_;
+   replayFrame_ = pixels;
+   m_pCurrent1 = const_cast<unsigned char*>(pixels);
+   return DEVICE_OK;
+}
 
- 
+/**
+* Opens the replay files, or closes the replay for an empty file name. A
+* surface served from the old mapping is dropped with it.
+*/
+int CBaslerCamera::OpenReplay()
+{
+   if (NULL != replayFrame_ && m_pCurrent1 == replayFrame_)
+      m_pCurrent1 = 0;
+   replayFrame_ = 0;
+   replayPosition_ = 0;
+   replayGrabs_ = 0;
 
-	// for integer images: bitDepth_ is 8, 10, 12, 16 i.e. it is depth per component
-   long maxValue = (1L << bitDepth_)-1;
+   if (replayFile_.empty())
+   {
+      replay_.Close();
+      return DEVICE_OK;
+   }
+   if (!replay_.Open(replayFile_, replayIndexFile_))
+      return ERR_REPLAY_OPEN;
+   if (replay_.Width() != (unsigned)reconWidth_ || replay_.Height() != (unsigned)reconHeight_ || 1 != replay_.BytesPerPixel())
+      return ERR_REPLAY_FORMAT;
+   return DEVICE_OK;
+}
+
+/**
+* Changes one field of the reconstruction geometry. The transfer functions
+* it misses are computed outside imgPixelsLock_, which a frame waits for;
+* the lock is only held to list them and to swap them in.
+*/
+void CBaslerCamera::SetReconstructionGeometry(GeometryField field, double value, LockSite site)
+{
+   double distance, wavelength, pitch;
+   CpuReconstructor::TransferList computed;
+   {
+      InstrumentedGuard g(imgPixelsLock_, site);
+      ReconstructionGeometry(field, value, distance, wavelength, pitch);
+      cpuReconstructor_.MissingForGeometry(distance, wavelength, pitch, computed);
+   }
+   CpuReconstructor::ComputeTransferFunctions(computed);
 
-	long pixelsToDrop = 0;
-	if( dropPixels_)
-		pixelsToDrop = (long)(0.5 + fractionOfPixelsToDropOrSaturate_*img.Height()*img.Width());
-	long pixelsToSaturate = 0;
-	if( saturatePixels_)
-		pixelsToSaturate = (long)(0.5 + fractionOfPixelsToDropOrSaturate_*img.Height()*img.Width());
+   // the other fields are read again, another thread may have set them
+   InstrumentedGuard g(imgPixelsLock_, site);
+   ReconstructionGeometry(field, value, distance, wavelength, pitch);
+   cpuReconstructor_.SetGeometry(distance, wavelength, pitch, &computed);
+}
 
-   unsigned j, k;
-   if (pixelType.compare(g_PixelType_8bit) == 0)
+void CBaslerCamera::ReconstructionGeometry(GeometryField field, double value, double& distanceUm, double& wavelengthNm, double& pixelPitchUm) const
+{
+   distanceUm = (GEOMETRY_DISTANCE == field) ? value : cpuReconstructor_.Distance();
+   wavelengthNm = (GEOMETRY_WAVELENGTH == field) ? value : cpuReconstructor_.Wavelength();
+   pixelPitchUm = (GEOMETRY_PIXEL_PITCH == field) ? value : cpuReconstructor_.PixelPitch();
+}
+
+/**
+* Sets the refocus planes, computing the transfer functions they miss
+* outside imgPixelsLock_ as SetReconstructionGeometry() does.
+*/
+void CBaslerCamera::SetReconstructionPlanes(const std::vector<double>& distancesUm)
+{
+   CpuReconstructor::TransferList computed;
    {
-      double pedestal = 127 * exp / 100.0 * GetBinning() * GetBinning();
-      unsigned char* pBuf = const_cast<unsigned char*>(img.GetPixels());
-      for (j=0; j<img.Height(); j++)
-      {
-         for (k=0; k<img.Width(); k++)
-         {
-            long lIndex = img.Width()*j + k;
-            *(pBuf + lIndex) = (unsigned char) (g_IntensityFactor_ * min(255.0, (pedestal + dAmp * sin(dPhase_ + dLinePhase + (2.0 * cPi * k) / lPeriod))));
-         }
-         dLinePhase += cLinePhaseInc;
-      }
-	   for(int snoise = 0; snoise < pixelsToSaturate; ++snoise)
-		{
-			j = (unsigned)( (double)(img.Height()-1)*(double)rand()/(double)RAND_MAX);
-			k = (unsigned)( (double)(img.Width()-1)*(double)rand()/(double)RAND_MAX);
-			*(pBuf + img.Width()*j + k) = (unsigned char)maxValue;
-		}
-		int pnoise;
-		for(pnoise = 0; pnoise < pixelsToDrop; ++pnoise)
-		{
-			j = (unsigned)( (double)(img.Height()-1)*(double)rand()/(double)RAND_MAX);
-			k = (unsigned)( (double)(img.Width()-1)*(double)rand()/(double)RAND_MAX);
-			*(pBuf + img.Width()*j + k) = 0;
-		}
+      InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+      cpuReconstructor_.MissingForPlanes(distancesUm, computed);
+   }
+   CpuReconstructor::ComputeTransferFunctions(computed);
+
+   InstrumentedGuard g(imgPixelsLock_, LOCK_PROPERTIES);
+   cpuReconstructor_.SetPlanes(distancesUm, &computed);
+   planeImages_.clear();
+}
+
+/**
+* Sets up the CPU reconstructor with the block size of the CUDA backend.
+*/
+void CBaslerCamera::InitCpuReconstructor()
+{
+   if (cpuReconstructor_.IsInitialized())
+      return;
+
+   char buf[MM::MaxStrLength];
+   GetProperty("BLOCKx", buf);
+   int bx = atoi(buf);
+   GetProperty("BLOCKy", buf);
+   int by = atoi(buf);
+   cpuReconstructor_.Init(reconWidth_, reconHeight_, &bx, &by);
+}
+
+/**
+* Bytes per pixel the active backend writes.
+*/
+int CBaslerCamera::ReconstructionBytesPerPixel() const
+{
+   return cpuBackend_ ? cpuReconstructor_.OutputBytesPerPixel() : 1;
+}
+
+/**
+* Batching needs the reconstruction geometry to match the image buffer,
+* otherwise frames go through GetCameraImage one by one.
+*/
+bool CBaslerCamera::CanBatchReconstruction() const
+{
+   return batchSize_ > 1 && ReconstructionMatchesImage();
+}
+
+/**
+* True when reconstructed planes can be used as image buffers as they are.
+*/
+bool CBaslerCamera::ReconstructionMatchesImage() const
+{
+   return (unsigned)ReconstructionBytesPerPixel() == img_.Depth() &&
+      (unsigned)reconWidth_ == img_.Width() && (unsigned)reconHeight_ == img_.Height();
+}
+
+/**
+* Number of refocus planes delivered per frame.
+*/
+int CBaslerCamera::ActivePlaneCount() const
+{
+   return (cpuBackend_ && ReconstructionMatchesImage()) ? cpuReconstructor_.PlaneCount() : 1;
+}
+
+/**
+* Bytes the active backend writes per frame, all planes included.
+*/
+size_t CBaslerCamera::ReconstructionFrameBytes() const
+{
+   if (cpuBackend_)
+      return cpuReconstructor_.OutputPlaneBytes() * cpuReconstructor_.PlaneCount();
+   return (size_t)reconWidth_ * reconHeight_;
+}
+
+/**
+* Copies the current surface into the next free slot of the batch.
+*/
+void CBaslerCamera::QueueFrameForBatch()
+{
+   const size_t frameSize = (size_t)reconWidth_ * reconHeight_;
+   if (batchFrames_.size() < frameSize * batchSize_)
+      batchFrames_.resize(frameSize * batchSize_);
+   if (batchOutput_.size() < ReconstructionFrameBytes() * batchSize_)
+      batchOutput_.resize(ReconstructionFrameBytes() * batchSize_);
+   if (0 == batchCount_)
+      batchStartTime_ = GetCurrentMMTime();
+   memcpy(&batchFrames_[frameSize * batchCount_], m_pCurrent1, frameSize);
+   ++batchCount_;
+}
+
+/**
+* A batch is flushed when it is full, when its oldest frame reached the
+* latency limit or when the sequence is about to end.
+*/
+bool CBaslerCamera::IsBatchDue()
+{
+   if (batchCount_ >= batchSize_ || IsBatchLate())
+      return true;
+   return thd_->GetImageCounter() >= thd_->GetLength() - 1;
+}
+
+/**
+* The oldest staged frame reached the latency limit.
+*/
+bool CBaslerCamera::IsBatchLate()
+{
+   return batchCount_ > 0 && (GetCurrentMMTime() - batchStartTime_).getMsec() >= batchLatencyLimitMs_;
+}
+
+/**
+* Reconstructs all staged frames and inserts them into the circular buffer.
+*/
+int CBaslerCamera::FlushReconstructionBatch()
+{
+   TraceScope trace("FlushReconstructionBatch");
+   const long count = batchCount_;
+   if (0 == count)
+      return DEVICE_OK;
 
+   const size_t frameSize = (size_t)reconWidth_ * reconHeight_;
+   const size_t outSize = ReconstructionFrameBytes();
+   std::vector<const unsigned char*> frames(count);
+   std::vector<unsigned char*> outs(count);
+   for (long i = 0; i < count; ++i)
+   {
+      frames[i] = &batchFrames_[frameSize * i];
+      outs[i] = &batchOutput_[outSize * i];
    }
-   else if (pixelType.compare(g_PixelType_16bit) == 0)
+
+   MM::MMTime t0 = GetCurrentMMTime();
    {
-      double pedestal = maxValue/2 * exp / 100.0 * GetBinning() * GetBinning();
-      double dAmp16 = dAmp * maxValue/255.0; // scale to behave like 8-bit
-      unsigned short* pBuf = (unsigned short*) const_cast<unsigned char*>(img.GetPixels());
-	  for (int i=0;i<2040*1088;i++)
-		  *(pBuf+i)= *(m_pCurrent1+i);
-      for (j=0; j<img.Height(); j++)
+      InstrumentedGuard g(imgPixelsLock_, LOCK_RECONSTRUCTION_BATCH);
+      if (cpuBackend_)
       {
-         for (k=0; k<img.Width(); k++)
-         {
-            long lIndex = img.Width()*j + k;
-            *(pBuf + lIndex) = (unsigned short) (g_IntensityFactor_ * min((double)maxValue, pedestal + dAmp16 * sin(dPhase_ + dLinePhase + (2.0 * cPi * k) / lPeriod)));
-         }
-         dLinePhase += cLinePhaseInc;
-      }         
-	   for(int snoise = 0; snoise < pixelsToSaturate; ++snoise)
-		{
-			j = (unsigned)(0.5 + (double)img.Height()*(double)rand()/(double)RAND_MAX);
-			k = (unsigned)(0.5 + (double)img.Width()*(double)rand()/(double)RAND_MAX);
-			*(pBuf + img.Width()*j + k) = (unsigned short)maxValue;
-		}
-		int pnoise;
-		for(pnoise = 0; pnoise < pixelsToDrop; ++pnoise)
-		{
-			j = (unsigned)(0.5 + (double)img.Height()*(double)rand()/(double)RAND_MAX);
-			k = (unsigned)(0.5 + (double)img.Width()*(double)rand()/(double)RAND_MAX);
-			*(pBuf + img.Width()*j + k) = 0;
-		}
-	
-	}
-   else if (pixelType.compare(g_PixelType_32bit) == 0)
-   {
-      double pedestal = 127 * exp / 100.0 * GetBinning() * GetBinning();
-      float* pBuf = (float*) const_cast<unsigned char*>(img.GetPixels());
-      float saturatedValue = 255.;
-      memset(pBuf, 0, img.Height()*img.Width()*4);
-      // static unsigned int j2;
-      for (j=0; j<img.Height(); j++)
+         cpuReconstructor_.ReconstructBatch(&frames[0], count, &outs[0]);
+      }
+      else
       {
-         for (k=0; k<img.Width(); k++)
-         {
-            long lIndex = img.Width()*j + k;
-            double value =  (g_IntensityFactor_ * min(255.0, (pedestal + dAmp * sin(dPhase_ + dLinePhase + (2.0 * cPi * k) / lPeriod))));
-            *(pBuf + lIndex) = (float) value;
-            if( 0 == lIndex)
-            {
-               std::ostringstream os;
-               os << " first pixel is " << (float)value;
-               LogMessage(os.str().c_str(), true);
-
-            }
-         }
-         dLinePhase += cLinePhaseInc;
+         // the CUDA backend has no batched entry point, its result buffer
+         // is reused by every call
+         const size_t recSize = min(frameSize, (size_t)paddedX * paddedY);
+         for (long i = 0; i < count; ++i)
+            memcpy(outs[i], reconstruct(method, const_cast<unsigned char*>(frames[i])), recSize);
       }
+   }
+   batchCount_ = 0;
+   // one sample per batch
+   RecordStage(STAGE_RECONSTRUCTION, GetCurrentMMTime() - t0, (double)outSize * count);
 
-	   for(int snoise = 0; snoise < pixelsToSaturate; ++snoise)
-		{
-			j = (unsigned)(0.5 + (double)img.Height()*(double)rand()/(double)RAND_MAX);
-			k = (unsigned)(0.5 + (double)img.Width()*(double)rand()/(double)RAND_MAX);
-			*(pBuf + img.Width()*j + k) = saturatedValue;
-		}
-		int pnoise;
-		for(pnoise = 0; pnoise < pixelsToDrop; ++pnoise)
-		{
-			j = (unsigned)(0.5 + (double)img.Height()*(double)rand()/(double)RAND_MAX);
-			k = (unsigned)(0.5 + (double)img.Width()*(double)rand()/(double)RAND_MAX);
-			*(pBuf + img.Width()*j + k) = 0;
-      }
-	
-	}
-	else if (pixelType.compare(g_PixelType_32bitRGB) == 0)
-	{
-      double pedestal = 127 * exp / 100.0;
-      unsigned int * pBuf = (unsigned int*) img.GetPixelsRW();
+   int ret = DEVICE_OK;
+   for (long i = 0; i < count && DEVICE_OK == ret; ++i)
+   {
+      MM::MMTime insertStart = GetCurrentMMTime();
+      ret = InsertPlanes(outs[i]);
+      RecordStage(STAGE_INSERT, GetCurrentMMTime() - insertStart, outSize);
+   }
 
-      unsigned char* pTmpBuffer = NULL;
+   MM::MMTime now = GetCurrentMMTime();
+   UpdateReconstructionStats(count, now - t0, now - batchStartTime_);
+   return ret;
+}
 
-      if(debugRGB)
-      {
-         const unsigned long bfsize = img.Height() * img.Width() * 3;
-         if(  bfsize != dbgBufferSize)
-         {
-            if (NULL != pDebug)
-            {
-               free(pDebug);
-               pDebug = NULL;
-            }
-            pDebug = (unsigned char*)malloc( bfsize);
-            if( NULL != pDebug)
-            {
-               dbgBufferSize = bfsize;
-            }
-         }
-      }
+void CBaslerCamera::UpdateReconstructionStats(long frames, MM::MMTime reconstructionTime, MM::MMTime latency)
+{
+   const double seconds = reconstructionTime.getMsec() / 1000.0;
+   if (seconds > 0.)
+      reconstructionFps_ = frames / seconds;
+   reconstructionLatencyMs_ = latency.getMsec();
+}
+
+
+/**
+* Generate a spatial sine wave.
+* The frame format comes from the buffer and the cached pixel settings, the
+* pixels from the tabulated generator, the sensor noise and the dropped and
+* saturated pixels from the counter based noise model.
+*/
+void CBaslerCamera::GenerateSyntheticImage(FrameBuffer& img, double exp)
+{ 
+
+   InstrumentedGuard g(imgPixelsLock_, LOCK_SYNTHETIC_IMAGE);
+
+	if (img.Height() == 0 || img.Width() == 0 || img.Depth() == 0)
+      return;
+
+   const PixelFormat format = FramePixelFormat(img.Depth(), nComponents_);
+   if (format >= PIXEL_FORMAT_COUNT)
+      return;
 
-		// only perform the debug operations if pTmpbuffer is not 0
-      pTmpBuffer = pDebug;
-      unsigned char* pTmp2 = pTmpBuffer;
-      if( NULL!= pTmpBuffer)
-			memset( pTmpBuffer, 0, img.Height() * img.Width() * 3);
+   const double cPi = 3.14159265358979;
 
-      for (j=0; j<img.Height(); j++)
-      {
-         unsigned char theBytes[4];
-         for (k=0; k<img.Width(); k++)
-         {
-            long lIndex = img.Width()*j + k;
-            unsigned char value0 =   (unsigned char) min(255.0, (pedestal + dAmp * sin(dPhase_ + dLinePhase + (2.0 * cPi * k) / lPeriod)));
-            theBytes[0] = value0;
-            if( NULL != pTmpBuffer)
-               pTmp2[2] = value0;
-            unsigned char value1 =   (unsigned char) min(255.0, (pedestal + dAmp * sin(dPhase_ + dLinePhase*2 + (2.0 * cPi * k) / lPeriod)));
-            theBytes[1] = value1;
-            if( NULL != pTmpBuffer)
-               pTmp2[1] = value1;
-            unsigned char value2 = (unsigned char) min(255.0, (pedestal + dAmp * sin(dPhase_ + dLinePhase*4 + (2.0 * cPi * k) / lPeriod)));
-            theBytes[2] = value2;
-
-            if( NULL != pTmpBuffer){
-               pTmp2[0] = value2;
-               pTmp2+=3;
-            }
-            theBytes[3] = 0;
-            unsigned long tvalue = *(unsigned long*)(&theBytes[0]);
-            *(pBuf + lIndex) =  tvalue ;  //value0+(value1<<8)+(value2<<16);
-         }
-         dLinePhase += cLinePhaseInc;
-      }
+   static bool debugRGB = false;
+#ifdef TIFFDEMO
+	debugRGB = true;
+#endif
+   static long iseq = 1;
 
+	// for integer images: bitDepth_ is 8, 10, 12, 16 i.e. it is depth per component
+   long maxValue = (1L << bitDepth_)-1;
 
-      // ImageJ's AWT images are loaded with a Direct Color processor which expects BGRA, that's why we swapped the Blue and Red components in the generator above.
-      if(NULL != pTmpBuffer)
-      {
-         // write the compact debug image...
-         char ctmp[12];
-         snprintf(ctmp,12,"%ld",iseq++);
-         int status = writeCompactTiffRGB( img.Width(), img.Height(), pTmpBuffer, ("democamera"+std::string(ctmp)).c_str()
-            );
-			status = status;
-      }
+	const double dropFraction = dropPixels_ ? fractionOfPixelsToDropOrSaturate_ : 0.;
+	const double saturateFraction = saturatePixels_ ? fractionOfPixelsToDropOrSaturate_ : 0.;
 
-	}
+   const double binArea = (double)binSize_ * binSize_;
+   SyntheticImageGenerator::Wave wave;
+   wave.phase = dPhase_;
+   wave.amplitude = exp;
+   wave.pedestal = 127 * exp / 100.0 * binArea;
+   wave.maxValue = 255.;
+   wave.factor = g_IntensityFactor_;
+   if (PIXEL_UINT16 == format || PIXEL_RGB64 == format)
+   {
+      wave.amplitude = exp * maxValue/255.0; // scale to behave like 8-bit
+      wave.pedestal = maxValue/2 * exp / 100.0 * binArea;
+      wave.maxValue = maxValue;
+   }
+   // the colour channels are not scaled, and 32 bit RGB is not binned
+   if (PIXEL_RGBA32 == format || PIXEL_RGB64 == format)
+      wave.factor = 1.;
+   if (PIXEL_RGBA32 == format)
+      wave.pedestal = 127 * exp / 100.0;
 
-	// generate an RGB image with bitDepth_ bits in each color
-	else if (pixelType.compare(g_PixelType_64bitRGB) == 0)
-	{
-      double pedestal = maxValue/2 * exp / 100.0 * GetBinning() * GetBinning();
-      double dAmp16 = dAmp * maxValue/255.0; // scale to behave like 8-bit
-      
-		double maxPixelValue = (1<<(bitDepth_))-1;
-      unsigned long long * pBuf = (unsigned long long*) img.GetPixelsRW();
-      for (j=0; j<img.Height(); j++)
-      {
-         for (k=0; k<img.Width(); k++)
-         {
-            long lIndex = img.Width()*j + k;
-            unsigned long long value0 = (unsigned short) min(maxPixelValue, (pedestal + dAmp16 * sin(dPhase_ + dLinePhase + (2.0 * cPi * k) / lPeriod)));
-            unsigned long long value1 = (unsigned short) min(maxPixelValue, (pedestal + dAmp16 * sin(dPhase_ + dLinePhase*2 + (2.0 * cPi * k) / lPeriod)));
-            unsigned long long value2 = (unsigned short) min(maxPixelValue, (pedestal + dAmp16 * sin(dPhase_ + dLinePhase*4 + (2.0 * cPi * k) / lPeriod)));
-            unsigned long long tval = value0+(value1<<16)+(value2<<32);
-         *(pBuf + lIndex) = tval;
-			}
-         dLinePhase += cLinePhaseInc;
-      }
-	}
+   unsigned char* pTmpBuffer = NULL;
+   if (debugRGB && PIXEL_RGBA32 == format)
+      pTmpBuffer = (unsigned char*)debugRGB_.Reserve(img.Height() * img.Width() * 3);
+
+   synthetic_.Generate(img.GetPixelsRW(), img.Width(), img.Height(), format, wave, pTmpBuffer);
+   // saturated pixels are at the wave's limit: 255 for 8 bit channels and
+   // float, the bit depth's maximum otherwise
+   noise_.Apply(img.GetPixelsRW(), img.Width(), img.Height(), format, noiseModel_, exp, wave.maxValue, dropFraction, saturateFraction);
+
+   // ImageJ's AWT images are loaded with a Direct Color processor which expects BGRA, that's why the generator swaps the Blue and Red components of the debug copy.
+   if(NULL != pTmpBuffer)
+   {
+      // write the compact debug image...
+      char ctmp[12];
+      snprintf(ctmp,12,"%ld",iseq++);
+      int status = writeCompactTiffRGB( img.Width(), img.Height(), pTmpBuffer, ("democamera"+std::string(ctmp)).c_str()
+         );
+		status = status;
+   }
 
    dPhase_ += cPi / 4.;
 }
@@ -3429,18 +5125,478 @@ int DemoAutoFocus::Initialize()
    if (DEVICE_OK != ret)
       return ret;
 
-   running_ = false;   
+   running_ = false;   
+
+   ret = UpdateStatus();
+   if (ret != DEVICE_OK)
+      return ret;
+
+   initialized_ = true;*/
+
+   return DEVICE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ReconstructionAutoFocus implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ReconstructionAutoFocus::ReconstructionAutoFocus() :
+   initialized_(false),
+   cameraLabel_(g_CameraDeviceName),
+   searchMinUm_(500.0),
+   searchMaxUm_(5000.0),
+   searchSteps_(12),
+   toleranceUm_(5.0),
+   downsample_(2),
+   trackingStepUm_(20.0),
+   trackingIntervalMs_(100.0),
+   offsetUm_(0.0),
+   lastScore_(0.0),
+   lastMoveUm_(0.0),
+   thd_(0)
+{
+   CreateHubIDProperty();
+   SetErrorText(ERR_FOCUS_NO_CAMERA, "Reconstruction camera not found");
+   SetErrorText(ERR_FOCUS_NO_FRAME, "The camera has not acquired a hologram yet");
+   SetErrorText(ERR_FOCUS_BACKEND, "Focusing needs the CPU reconstruction backend of the camera");
+   thd_ = new FocusTrackingThread(this);
+}
+
+ReconstructionAutoFocus::~ReconstructionAutoFocus()
+{
+   Shutdown();
+   delete thd_;
+}
+
+void ReconstructionAutoFocus::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_ReconstructionFocusDeviceName);
+}
+
+int ReconstructionAutoFocus::Initialize()
+{
+   DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
+   if (pHub)
+   {
+      char hubLabel[MM::MaxStrLength];
+      pHub->GetLabel(hubLabel);
+      SetParentID(hubLabel); // for backward comp.
+   }
+   else
+      LogMessage(NoHubError);
+
+   if (initialized_)
+      return DEVICE_OK;
+
+   int ret = CreateProperty(MM::g_Keyword_Name, g_ReconstructionFocusDeviceName, MM::String, true);
+   if (DEVICE_OK != ret)
+      return ret;
+
+   ret = CreateProperty(MM::g_Keyword_Description, "Searches the propagation distance of the hologram reconstruction; "
+      "focusing needs the CPU reconstruction backend, the CUDA backend does not take the distance found", MM::String, true);
+   if (DEVICE_OK != ret)
+      return ret;
+
+   // label of the camera whose reconstruction is focused
+   CPropertyAction* pAct = new CPropertyAction (this, &ReconstructionAutoFocus::OnCamera);
+   CreateProperty("Camera", cameraLabel_.c_str(), MM::String, false, pAct);
+
+   // search range; distances near 0 show the raw hologram with the sensor
+   // noise in focus and are better left out
+   pAct = new CPropertyAction (this, &ReconstructionAutoFocus::OnSearchMin);
+   CreateProperty("SearchMin (um)", "500", MM::Float, false, pAct);
+   SetPropertyLimits("SearchMin (um)", -100000, 100000);
+
+   pAct = new CPropertyAction (this, &ReconstructionAutoFocus::OnSearchMax);
+   CreateProperty("SearchMax (um)", "5000", MM::Float, false, pAct);
+   SetPropertyLimits("SearchMax (um)", -100000, 100000);
+
+   pAct = new CPropertyAction (this, &ReconstructionAutoFocus::OnSearchSteps);
+   CreateProperty("SearchSteps", "12", MM::Integer, false, pAct);
+   SetPropertyLimits("SearchSteps", FocusSearch::cMinSearchSteps, 64);
+
+   pAct = new CPropertyAction (this, &ReconstructionAutoFocus::OnTolerance);
+   CreateProperty("Tolerance (um)", "5", MM::Float, false, pAct);
+   SetPropertyLimits("Tolerance (um)", 0.1, 1000);
+
+   // the metric is evaluated on frames binned by this factor
+   pAct = new CPropertyAction (this, &ReconstructionAutoFocus::OnDownsample);
+   CreateProperty("Downsample", "2", MM::Integer, false, pAct);
+   AddAllowedValue("Downsample", "1");
+   AddAllowedValue("Downsample", "2");
+   AddAllowedValue("Downsample", "4");
+   AddAllowedValue("Downsample", "8");
+
+   pAct = new CPropertyAction (this, &ReconstructionAutoFocus::OnFocusMetric);
+   CreateProperty("FocusMetric", "Laplacian", MM::String, false, pAct);
+   AddAllowedValue("FocusMetric", "Laplacian");
+   AddAllowedValue("FocusMetric", "Gradient");
+
+   // continuous focusing moves at most one step per interval
+   pAct = new CPropertyAction (this, &ReconstructionAutoFocus::OnTrackingStep);
+   CreateProperty("TrackingStep (um)", "20", MM::Float, false, pAct);
+   SetPropertyLimits("TrackingStep (um)", 0.1, 1000);
+
+   pAct = new CPropertyAction (this, &ReconstructionAutoFocus::OnTrackingInterval);
+   CreateProperty("TrackingInterval (ms)", "100", MM::Float, false, pAct);
+   SetPropertyLimits("TrackingInterval (ms)", 1, 10000);
+
+   ret = UpdateStatus();
+   if (ret != DEVICE_OK)
+      return ret;
+
+   initialized_ = true;
+   return DEVICE_OK;
+}
+
+int ReconstructionAutoFocus::Shutdown()
+{
+   if (thd_ && !thd_->IsStopped())
+   {
+      thd_->Stop();
+      thd_->wait();
+   }
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+/**
+* The focused camera. Callers that move its reconstruction plane set
+* 'moves': only the CPU backend reconstructs at the distance they set.
+*/
+int ReconstructionAutoFocus::FindCamera(CBaslerCamera*& camera, bool moves)
+{
+   camera = dynamic_cast<CBaslerCamera*>(GetDevice(cameraLabel_.c_str()));
+   if (camera == 0)
+      return ERR_FOCUS_NO_CAMERA;
+   if (moves && !camera->ReconstructsOnCpu())
+      return ERR_FOCUS_BACKEND;
+   return DEVICE_OK;
+}
+
+/**
+* Hands the current hologram of the camera to the focus search.
+* Called with searchLock_ held.
+*/
+int ReconstructionAutoFocus::LoadFrame(CBaslerCamera*& camera, bool moves)
+{
+   int ret = FindCamera(camera, moves);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   std::vector<unsigned char> frame;
+   int width, height;
+   double wavelength, pitch;
+   if (!camera->CopyHologram(frame, width, height, wavelength, pitch))
+      return ERR_FOCUS_NO_FRAME;
+
+   search_.SetOptics(wavelength, pitch);
+   search_.SetFrame(&frame[0], width, height);
+   return DEVICE_OK;
+}
+
+/**
+* One hill climbing step from the current reconstruction distance.
+*/
+int ReconstructionAutoFocus::RunTrackingStep()
+{
+   MMThreadGuard g(searchLock_);
+   CBaslerCamera* camera;
+   int ret = LoadFrame(camera, true);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   const double distance = camera->GetPropagationDistance() - offsetUm_;
+   const double best = search_.Track(distance, trackingStepUm_, downsample_, lastScore_);
+   lastMoveUm_ = best - distance;
+   camera->SetPropagationDistance(best + offsetUm_);
+   return DEVICE_OK;
+}
+
+int ReconstructionAutoFocus::SetContinuousFocusing(bool state)
+{
+   if (state == !thd_->IsStopped())
+      return DEVICE_OK;
+
+   if (state)
+   {
+      CBaslerCamera* camera;
+      int ret = FindCamera(camera, true);
+      if (ret != DEVICE_OK)
+         return ret;
+      lastMoveUm_ = trackingStepUm_;
+      thd_->Start();
+   }
+   else
+   {
+      thd_->Stop();
+      thd_->wait();
+   }
+   return DEVICE_OK;
+}
+
+int ReconstructionAutoFocus::GetContinuousFocusing(bool& state)
+{
+   state = !thd_->IsStopped();
+   return DEVICE_OK;
+}
+
+/**
+* Locked while continuous focusing keeps the plane within the tolerance.
+*/
+bool ReconstructionAutoFocus::IsContinuousFocusLocked()
+{
+   MMThreadGuard g(searchLock_);
+   return !thd_->IsStopped() && fabs(lastMoveUm_) <= toleranceUm_;
+}
+
+/**
+* Searches the whole distance range on the current frame and moves the
+* reconstruction plane to the sharpest distance plus the offset.
+*/
+int ReconstructionAutoFocus::FullFocus()
+{
+   MMThreadGuard g(searchLock_);
+   CBaslerCamera* camera;
+   int ret = LoadFrame(camera, true);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   const double best = search_.Search(searchMinUm_, searchMaxUm_, searchSteps_, toleranceUm_, downsample_, lastScore_);
+   lastMoveUm_ = 0.0;
+   camera->SetPropagationDistance(best + offsetUm_);
+
+   std::ostringstream os;
+   os << "Reconstruction focus at " << best << " um, score " << lastScore_;
+   LogMessage(os.str().c_str(), true);
+   return DEVICE_OK;
+}
+
+int ReconstructionAutoFocus::IncrementalFocus()
+{
+   return RunTrackingStep();
+}
+
+int ReconstructionAutoFocus::GetLastFocusScore(double& score)
+{
+   MMThreadGuard g(searchLock_);
+   score = lastScore_;
+   return DEVICE_OK;
+}
+
+/**
+* Scores the current frame at the current reconstruction distance.
+*/
+int ReconstructionAutoFocus::GetCurrentFocusScore(double& score)
+{
+   MMThreadGuard g(searchLock_);
+   CBaslerCamera* camera;
+   int ret = LoadFrame(camera, false);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   const double distance = camera->GetPropagationDistance() - offsetUm_;
+   search_.Score(&distance, 1, downsample_, &score);
+   return DEVICE_OK;
+}
+
+int ReconstructionAutoFocus::GetOffset(double& offset)
+{
+   offset = offsetUm_;
+   return DEVICE_OK;
+}
+
+int ReconstructionAutoFocus::SetOffset(double offset)
+{
+   MMThreadGuard g(searchLock_);
+   offsetUm_ = offset;
+   return DEVICE_OK;
+}
+
+int ReconstructionAutoFocus::OnCamera(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(cameraLabel_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      MMThreadGuard g(searchLock_);
+      pProp->Get(cameraLabel_);
+   }
+   return DEVICE_OK;
+}
+
+int ReconstructionAutoFocus::OnSearchMin(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(searchMinUm_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      MMThreadGuard g(searchLock_);
+      pProp->Get(searchMinUm_);
+   }
+   return DEVICE_OK;
+}
+
+int ReconstructionAutoFocus::OnSearchMax(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(searchMaxUm_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      MMThreadGuard g(searchLock_);
+      pProp->Get(searchMaxUm_);
+   }
+   return DEVICE_OK;
+}
+
+int ReconstructionAutoFocus::OnSearchSteps(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(searchSteps_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      MMThreadGuard g(searchLock_);
+      pProp->Get(searchSteps_);
+   }
+   return DEVICE_OK;
+}
+
+int ReconstructionAutoFocus::OnTolerance(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(toleranceUm_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      MMThreadGuard g(searchLock_);
+      pProp->Get(toleranceUm_);
+   }
+   return DEVICE_OK;
+}
+
+int ReconstructionAutoFocus::OnDownsample(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(downsample_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      MMThreadGuard g(searchLock_);
+      pProp->Get(downsample_);
+   }
+   return DEVICE_OK;
+}
+
+int ReconstructionAutoFocus::OnFocusMetric(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::AfterSet)
+   {
+      std::string metric;
+      pProp->Get(metric);
+
+      MMThreadGuard g(searchLock_);
+      search_.SetMetric(metric == "Gradient" ? FOCUS_METRIC_GRADIENT : FOCUS_METRIC_LAPLACIAN);
+   }
+   return DEVICE_OK;
+}
+
+int ReconstructionAutoFocus::OnTrackingStep(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(trackingStepUm_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      MMThreadGuard g(searchLock_);
+      pProp->Get(trackingStepUm_);
+   }
+   return DEVICE_OK;
+}
+
+int ReconstructionAutoFocus::OnTrackingInterval(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(trackingIntervalMs_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(trackingIntervalMs_);
+   }
+   return DEVICE_OK;
+}
+
+void FocusTrackingThread::Start()
+{
+   MMThreadGuard g(stopLock_);
+   stop_ = false;
+   activate();
+}
 
-   ret = UpdateStatus();
-   if (ret != DEVICE_OK)
-      return ret;
+void FocusTrackingThread::Stop()
+{
+   MMThreadGuard g(stopLock_);
+   stop_ = true;
+}
 
-   initialized_ = true;*/
+bool FocusTrackingThread::IsStopped()
+{
+   MMThreadGuard g(stopLock_);
+   return stop_;
+}
 
+int FocusTrackingThread::svc(void) throw()
+{
+   try
+   {
+      while (!IsStopped())
+      {
+         // a missing frame is normal before acquisition starts, keep waiting
+         int ret = focus_->RunTrackingStep();
+         if (ret != DEVICE_OK && ret != ERR_FOCUS_NO_FRAME)
+         {
+            focus_->LogMessage("Continuous reconstruction focus stopped\n");
+            break;
+         }
+         CDeviceUtils::SleepMs((long)focus_->trackingIntervalMs_);
+      }
+   }catch(...){
+      focus_->LogMessage(g_Msg_EXCEPTION_IN_THREAD, false);
+   }
+   Stop();
    return DEVICE_OK;
 }
 
 
+/**
+* Pixel format of the frames the core's camera hands to the image
+* processors; the pixel size alone cannot tell float from RGBA pixels.
+*/
+PixelFormat ProcessorFrameFormat(MM::Core* core, const MM::Device* processor, unsigned byteDepth)
+{
+   unsigned components = 1;
+   char label[MM::MaxStrLength];
+   if (core && DEVICE_OK == core->GetDeviceProperty(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreCamera, label))
+   {
+      MM::Camera* camera = dynamic_cast<MM::Camera*>(core->GetDevice(processor, label));
+      if (camera)
+         components = camera->GetNumberOfComponents();
+   }
+   return FramePixelFormat(byteDepth, components);
+}
+
+
 int TransposeProcessor::Initialize()
 {
    DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
@@ -3455,14 +5611,18 @@ int TransposeProcessor::Initialize()
    else
       LogMessage(NoHubError);
 
-   if( NULL != this->pTemp_)
-   {
-      free(pTemp_);
-      pTemp_ = NULL;
-      this->tempSize_ = 0;
-   }
+   temp_.Release();
     CPropertyAction* pAct = new CPropertyAction (this, &TransposeProcessor::OnInPlaceAlgorithm);
    (void)CreateProperty("InPlaceAlgorithm", "0", MM::Integer, false, pAct); 
+
+   // bands of rows transposed in parallel, rectangular frames only
+   const int hardwareThreads = WorkerPool::HardwareThreads();
+   pAct = new CPropertyAction (this, &TransposeProcessor::OnThreads);
+   (void)CreateProperty("Threads", CDeviceUtils::ConvertToString((long)pool_->ThreadCount()), MM::Integer, false, pAct);
+   SetPropertyLimits("Threads", 1, hardwareThreads);
+
+   // latency distribution of the Process() calls
+   CreateLatencyProperties();
    return DEVICE_OK;
 }
 
@@ -3489,69 +5649,44 @@ int TransposeProcessor::OnInPlaceAlgorithm(MM::PropertyBase* pProp, MM::ActionTy
 }
 
 
+int TransposeProcessor::OnThreads(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)pool_->ThreadCount());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (busy_.IsSet())
+         return DEVICE_ERR;
+      long threads;
+      pProp->Get(threads);
+      pool_->SetThreadCount(threads);
+   }
+   return DEVICE_OK;
+}
+
+
 int TransposeProcessor::Process(unsigned char *pBuffer, unsigned int width, unsigned int height, unsigned int byteDepth)
 {
+   TraceScope trace("TransposeProcessor::Process");
    DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
    if (pHub && pHub->GenerateRandomError())
       return SIMULATED_ERROR;
 
-   int ret = DEVICE_OK;
-   // 
-   if( width != height)
-      return DEVICE_NOT_SUPPORTED; // problem with tranposing non-square images is that the image buffer
-   // will need to be modified by the image processor.
-   if(busy_)
+   // the camera reports height x width while it feeds this processor, so
+   // 'width' and 'height' describe the transposed image and the frame in
+   // the buffer is height pixels wide
+   BusyGuard busy(busy_);
+   if (!busy.Entered())
       return DEVICE_ERR;
+   const PixelFormat format = ProcessorFrameFormat(GetCoreCallback(), this, byteDepth);
+   if (PIXEL_FORMAT_COUNT == format)
+      return DEVICE_NOT_SUPPORTED;
  
-   busy_ = true;
-
-   if( inPlace_)
-   {
-      if(  sizeof(unsigned char) == byteDepth)
-      {
-         TransposeSquareInPlace( (unsigned char*)pBuffer, width);
-      }
-      else if( sizeof(unsigned short) == byteDepth)
-      {
-         TransposeSquareInPlace( (unsigned short*)pBuffer, width);
-      }
-      else if( sizeof(unsigned long) == byteDepth)
-      {
-         TransposeSquareInPlace( (unsigned long*)pBuffer, width);
-      }
-      else if( sizeof(unsigned long long) == byteDepth)
-      {
-         TransposeSquareInPlace( (unsigned long long*)pBuffer, width);
-      }
-      else 
-      {
-         ret = DEVICE_NOT_SUPPORTED;
-      }
-   }
-   else
-   {
-      if( sizeof(unsigned char) == byteDepth)
-      {
-         ret = TransposeRectangleOutOfPlace( (unsigned char*)pBuffer, width, height);
-      }
-      else if( sizeof(unsigned short) == byteDepth)
-      {
-         ret = TransposeRectangleOutOfPlace( (unsigned short*)pBuffer, width, height);
-      }
-      else if( sizeof(unsigned long) == byteDepth)
-      {
-         ret = TransposeRectangleOutOfPlace( (unsigned long*)pBuffer, width, height);
-      }
-      else if( sizeof(unsigned long long) == byteDepth)
-      {
-         ret =  TransposeRectangleOutOfPlace( (unsigned long long*)pBuffer, width, height);
-      }
-      else
-      {
-         ret =  DEVICE_NOT_SUPPORTED;
-      }
-   }
-   busy_ = false;
+   MM::MMTime  s0 = GetCurrentMMTime();
+   int ret = DispatchPixels(format, *this, pBuffer, width, height);
+   RecordLatency(GetCurrentMMTime() - s0, width, height, byteDepth);
 
    return ret;
 }
@@ -3563,6 +5698,17 @@ int ImageFlipY::Initialize()
 {
     CPropertyAction* pAct = new CPropertyAction (this, &ImageFlipY::OnPerformanceTiming);
     (void)CreateProperty("PeformanceTiming (microseconds)", "0", MM::Float, true, pAct); 
+    pAct = new CPropertyAction (this, &ImageFlipY::OnThroughput);
+    (void)CreateProperty("Throughput (GB/s)", "0", MM::Float, true, pAct);
+
+   // bands of rows processed in parallel
+   const int hardwareThreads = WorkerPool::HardwareThreads();
+   pAct = new CPropertyAction (this, &ImageFlipY::OnThreads);
+   (void)CreateProperty("Threads", CDeviceUtils::ConvertToString((long)pool_->ThreadCount()), MM::Integer, false, pAct);
+   SetPropertyLimits("Threads", 1, hardwareThreads);
+
+   // latency distribution of the Process() calls
+   CreateLatencyProperties();
    return DEVICE_OK;
 }
 
@@ -3583,42 +5729,53 @@ int ImageFlipY::OnPerformanceTiming(MM::PropertyBase* pProp, MM::ActionType eAct
    return DEVICE_OK;
 }
 
+int ImageFlipY::OnThroughput(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(throughput_);
+   }
+   return DEVICE_OK;
+}
+
+int ImageFlipY::OnThreads(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)pool_->ThreadCount());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (busy_.IsSet())
+         return DEVICE_ERR;
+      long threads;
+      pProp->Get(threads);
+      pool_->SetThreadCount(threads);
+   }
+   return DEVICE_OK;
+}
+
 
 int ImageFlipY::Process(unsigned char *pBuffer, unsigned int width, unsigned int height, unsigned int byteDepth)
 {
-   if(busy_)
+   TraceScope trace("ImageFlipY::Process");
+   BusyGuard busy(busy_);
+   if (!busy.Entered())
       return DEVICE_ERR;
+   const PixelFormat format = ProcessorFrameFormat(GetCoreCallback(), this, byteDepth);
+   if (PIXEL_FORMAT_COUNT == format)
+      return DEVICE_NOT_SUPPORTED;
 
-   int ret = DEVICE_OK;
- 
-   busy_ = true;
    performanceTiming_ = MM::MMTime(0.);
    MM::MMTime  s0 = GetCurrentMMTime();
 
-
-   if( sizeof(unsigned char) == byteDepth)
-   {
-      ret = Flip( (unsigned char*)pBuffer, width, height);
-   }
-   else if( sizeof(unsigned short) == byteDepth)
-   {
-      ret = Flip( (unsigned short*)pBuffer, width, height);
-   }
-   else if( sizeof(unsigned long) == byteDepth)
-   {
-      ret = Flip( (unsigned long*)pBuffer, width, height);
-   }
-   else if( sizeof(unsigned long long) == byteDepth)
-   {
-      ret =  Flip( (unsigned long long*)pBuffer, width, height);
-   }
-   else
-   {
-      ret =  DEVICE_NOT_SUPPORTED;
-   }
+   int ret = DispatchPixels(format, *this, pBuffer, width, height);
 
    performanceTiming_ = GetCurrentMMTime() - s0;
-   busy_ = false;
+   RecordLatency(performanceTiming_, width, height, byteDepth);
+   // every byte is read and written once
+   const double usec = performanceTiming_.getUsec();
+   throughput_ = (DEVICE_OK == ret && usec > 0.) ? 2. * width * height * byteDepth / (usec * 1000.) : 0.;
 
    return ret;
 }
@@ -3634,6 +5791,17 @@ int ImageFlipX::Initialize()
 {
     CPropertyAction* pAct = new CPropertyAction (this, &ImageFlipX::OnPerformanceTiming);
     (void)CreateProperty("PeformanceTiming (microseconds)", "0", MM::Float, true, pAct); 
+    pAct = new CPropertyAction (this, &ImageFlipX::OnThroughput);
+    (void)CreateProperty("Throughput (GB/s)", "0", MM::Float, true, pAct);
+
+   // bands of rows processed in parallel
+   const int hardwareThreads = WorkerPool::HardwareThreads();
+   pAct = new CPropertyAction (this, &ImageFlipX::OnThreads);
+   (void)CreateProperty("Threads", CDeviceUtils::ConvertToString((long)pool_->ThreadCount()), MM::Integer, false, pAct);
+   SetPropertyLimits("Threads", 1, hardwareThreads);
+
+   // latency distribution of the Process() calls
+   CreateLatencyProperties();
    return DEVICE_OK;
 }
 
@@ -3654,42 +5822,145 @@ int ImageFlipX::OnPerformanceTiming(MM::PropertyBase* pProp, MM::ActionType eAct
    return DEVICE_OK;
 }
 
+int ImageFlipX::OnThroughput(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(throughput_);
+   }
+   return DEVICE_OK;
+}
+
+int ImageFlipX::OnThreads(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)pool_->ThreadCount());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (busy_.IsSet())
+         return DEVICE_ERR;
+      long threads;
+      pProp->Get(threads);
+      pool_->SetThreadCount(threads);
+   }
+   return DEVICE_OK;
+}
+
 
 int ImageFlipX::Process(unsigned char *pBuffer, unsigned int width, unsigned int height, unsigned int byteDepth)
 {
-   if(busy_)
+   TraceScope trace("ImageFlipX::Process");
+   BusyGuard busy(busy_);
+   if (!busy.Entered())
       return DEVICE_ERR;
+   const PixelFormat format = ProcessorFrameFormat(GetCoreCallback(), this, byteDepth);
+   if (PIXEL_FORMAT_COUNT == format)
+      return DEVICE_NOT_SUPPORTED;
 
-   int ret = DEVICE_OK;
- 
-   busy_ = true;
    performanceTiming_ = MM::MMTime(0.);
    MM::MMTime  s0 = GetCurrentMMTime();
 
+   int ret = DispatchPixels(format, *this, pBuffer, width, height);
+
+   performanceTiming_ = GetCurrentMMTime() - s0;
+   RecordLatency(performanceTiming_, width, height, byteDepth);
+   // every byte is read and written once
+   const double usec = performanceTiming_.getUsec();
+   throughput_ = (DEVICE_OK == ret && usec > 0.) ? 2. * width * height * byteDepth / (usec * 1000.) : 0.;
+
+   return ret;
+}
+
+int OrientationProcessor::Initialize()
+{
+   CPropertyAction* pAct = new CPropertyAction (this, &OrientationProcessor::OnPerformanceTiming);
+   (void)CreateProperty("PeformanceTiming (microseconds)", "0", MM::Float, true, pAct);
+
+   // rotations are clockwise; the transforms that swap the axes also swap
+   // the image size the camera reports
+   pAct = new CPropertyAction (this, &OrientationProcessor::OnOrientation);
+   (void)CreateProperty("Orientation", OrientationName(orientation_), MM::String, false, pAct);
+   for (int o = ORIENT_IDENTITY; o < ORIENT_COUNT; ++o)
+      AddAllowedValue("Orientation", OrientationName((Orientation)o));
+
+   // bands of rows oriented in parallel
+   const int hardwareThreads = WorkerPool::HardwareThreads();
+   pAct = new CPropertyAction (this, &OrientationProcessor::OnThreads);
+   (void)CreateProperty("Threads", CDeviceUtils::ConvertToString((long)pool_->ThreadCount()), MM::Integer, false, pAct);
+   SetPropertyLimits("Threads", 1, hardwareThreads);
 
-   if( sizeof(unsigned char) == byteDepth)
+   // latency distribution of the Process() calls
+   CreateLatencyProperties();
+   return DEVICE_OK;
+}
+
+   // action interface
+   // ----------------
+int OrientationProcessor::OnPerformanceTiming(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
    {
-      ret = Flip( (unsigned char*)pBuffer, width, height);
+      pProp->Set( performanceTiming_.getUsec());
    }
-   else if( sizeof(unsigned short) == byteDepth)
+   return DEVICE_OK;
+}
+
+int OrientationProcessor::OnOrientation(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
    {
-      ret = Flip( (unsigned short*)pBuffer, width, height);
+      pProp->Set(OrientationName(orientation_));
    }
-   else if( sizeof(unsigned long) == byteDepth)
+   else if (eAct == MM::AfterSet)
    {
-      ret = Flip( (unsigned long*)pBuffer, width, height);
+      if (busy_.IsSet())
+         return DEVICE_ERR;
+      std::string name;
+      pProp->Get(name);
+      const Orientation o = OrientationFromName(name.c_str());
+      if (ORIENT_COUNT == o)
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      orientation_ = o;
    }
-   else if( sizeof(unsigned long long) == byteDepth)
+   return DEVICE_OK;
+}
+
+int OrientationProcessor::OnThreads(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
    {
-      ret =  Flip( (unsigned long long*)pBuffer, width, height);
+      pProp->Set((long)pool_->ThreadCount());
    }
-   else
+   else if (eAct == MM::AfterSet)
    {
-      ret =  DEVICE_NOT_SUPPORTED;
+      if (busy_.IsSet())
+         return DEVICE_ERR;
+      long threads;
+      pProp->Get(threads);
+      pool_->SetThreadCount(threads);
    }
+   return DEVICE_OK;
+}
+
+int OrientationProcessor::Process(unsigned char *pBuffer, unsigned int width, unsigned int height, unsigned int byteDepth)
+{
+   TraceScope trace("OrientationProcessor::Process");
+   BusyGuard busy(busy_);
+   if (!busy.Entered())
+      return DEVICE_ERR;
+   const PixelFormat format = ProcessorFrameFormat(GetCoreCallback(), this, byteDepth);
+   if (PIXEL_FORMAT_COUNT == format)
+      return DEVICE_NOT_SUPPORTED;
+
+   performanceTiming_ = MM::MMTime(0.);
+   MM::MMTime  s0 = GetCurrentMMTime();
+
+   int ret = DispatchPixels(format, *this, pBuffer, width, height);
 
    performanceTiming_ = GetCurrentMMTime() - s0;
-   busy_ = false;
+   RecordLatency(performanceTiming_, width, height, byteDepth);
 
    return ret;
 }
@@ -3700,6 +5971,15 @@ int MedianFilter::Initialize()
     CPropertyAction* pAct = new CPropertyAction (this, &MedianFilter::OnPerformanceTiming);
     (void)CreateProperty("PeformanceTiming (microseconds)", "0", MM::Float, true, pAct); 
     (void)CreateProperty("BEWARE", "THIS FILTER MODIFIES DATA, EACH PIXEL IS REPLACED BY 3X3 NEIGHBORHOOD MEDIAN", MM::String, true); 
+
+   // bands of rows filtered in parallel
+   const int hardwareThreads = WorkerPool::HardwareThreads();
+   pAct = new CPropertyAction (this, &MedianFilter::OnThreads);
+   (void)CreateProperty("Threads", CDeviceUtils::ConvertToString((long)pool_->ThreadCount()), MM::Integer, false, pAct);
+   SetPropertyLimits("Threads", 1, hardwareThreads);
+
+   // latency distribution of the Process() calls
+   CreateLatencyProperties();
    return DEVICE_OK;
 }
 
@@ -3721,41 +6001,188 @@ int MedianFilter::OnPerformanceTiming(MM::PropertyBase* pProp, MM::ActionType eA
 }
 
 
+int MedianFilter::OnThreads(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)pool_->ThreadCount());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (busy_.IsSet())
+         return DEVICE_ERR;
+      long threads;
+      pProp->Get(threads);
+      pool_->SetThreadCount(threads);
+   }
+   return DEVICE_OK;
+}
+
+
 int MedianFilter::Process(unsigned char *pBuffer, unsigned int width, unsigned int height, unsigned int byteDepth)
 {
-   if(busy_)
+   TraceScope trace("MedianFilter::Process");
+   BusyGuard busy(busy_);
+   if (!busy.Entered())
       return DEVICE_ERR;
+   const PixelFormat format = ProcessorFrameFormat(GetCoreCallback(), this, byteDepth);
+   if (PIXEL_FORMAT_COUNT == format)
+      return DEVICE_NOT_SUPPORTED;
 
-   int ret = DEVICE_OK;
- 
-   busy_ = true;
    performanceTiming_ = MM::MMTime(0.);
    MM::MMTime  s0 = GetCurrentMMTime();
 
+   int ret = DispatchPixels(format, *this, pBuffer, width, height);
+
+   performanceTiming_ = GetCurrentMMTime() - s0;
+   RecordLatency(performanceTiming_, width, height, byteDepth);
+
+   return ret;
+}
+
+
+int RankFilter::Initialize()
+{
+   CPropertyAction* pAct = new CPropertyAction (this, &RankFilter::OnPerformanceTiming);
+   (void)CreateProperty("PeformanceTiming (microseconds)", "0", MM::Float, true, pAct);
+   (void)CreateProperty("BEWARE", "THIS FILTER MODIFIES DATA, EACH PIXEL IS REPLACED BY A RANK OF ITS NEIGHBORHOOD", MM::String, true);
+
+   pAct = new CPropertyAction (this, &RankFilter::OnMode);
+   (void)CreateProperty("Mode", mode_.c_str(), MM::String, false, pAct);
+   AddAllowedValue("Mode", "Median");
+   AddAllowedValue("Mode", "Minimum");
+   AddAllowedValue("Mode", "Maximum");
+   AddAllowedValue("Mode", "Percentile");
+
+   // used by the Percentile mode
+   pAct = new CPropertyAction (this, &RankFilter::OnPercentile);
+   (void)CreateProperty("Percentile", CDeviceUtils::ConvertToString(percentile_), MM::Float, false, pAct);
+   SetPropertyLimits("Percentile", 0., 100.);
+
+   // window of (2 radius + 1) x (2 radius + 1) pixels
+   pAct = new CPropertyAction (this, &RankFilter::OnRadius);
+   (void)CreateProperty("Radius", CDeviceUtils::ConvertToString((long)filter_.Radius()), MM::Integer, false, pAct);
+   SetPropertyLimits("Radius", 1, HistogramRankFilter::cMaxRadius);
+
+   // horizontal stripes filtered in parallel
+   const int hardwareThreads = WorkerPool::HardwareThreads();
+   pAct = new CPropertyAction (this, &RankFilter::OnThreads);
+   (void)CreateProperty("Threads", CDeviceUtils::ConvertToString((long)filter_.ThreadCount()), MM::Integer, false, pAct);
+   SetPropertyLimits("Threads", 1, hardwareThreads);
+
+   ApplyRank();
+
+   // latency distribution of the Process() calls
+   CreateLatencyProperties();
+   return DEVICE_OK;
+}
+
+void RankFilter::ApplyRank()
+{
+   if (mode_ == "Minimum")
+      filter_.SetPercentile(0.);
+   else if (mode_ == "Maximum")
+      filter_.SetPercentile(100.);
+   else if (mode_ == "Percentile")
+      filter_.SetPercentile(percentile_);
+   else
+      filter_.SetPercentile(50.);
+}
+
+   // action interface
+   // ----------------
+int RankFilter::OnPerformanceTiming(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set( performanceTiming_.getUsec());
+   }
+   return DEVICE_OK;
+}
+
+int RankFilter::OnMode(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(mode_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (busy_.IsSet())
+         return DEVICE_ERR;
+      pProp->Get(mode_);
+      ApplyRank();
+   }
+   return DEVICE_OK;
+}
 
-   if( sizeof(unsigned char) == byteDepth)
+int RankFilter::OnPercentile(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
    {
-      ret = Filter( (unsigned char*)pBuffer, width, height);
+      pProp->Set(percentile_);
    }
-   else if( sizeof(unsigned short) == byteDepth)
+   else if (eAct == MM::AfterSet)
    {
-      ret = Filter( (unsigned short*)pBuffer, width, height);
+      if (busy_.IsSet())
+         return DEVICE_ERR;
+      pProp->Get(percentile_);
+      ApplyRank();
    }
-   else if( sizeof(unsigned long) == byteDepth)
+   return DEVICE_OK;
+}
+
+int RankFilter::OnRadius(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
    {
-      ret = Filter( (unsigned long*)pBuffer, width, height);
+      pProp->Set((long)filter_.Radius());
    }
-   else if( sizeof(unsigned long long) == byteDepth)
+   else if (eAct == MM::AfterSet)
    {
-      ret =  Filter( (unsigned long long*)pBuffer, width, height);
+      if (busy_.IsSet())
+         return DEVICE_ERR;
+      long radius;
+      pProp->Get(radius);
+      filter_.SetRadius(radius);
    }
-   else
+   return DEVICE_OK;
+}
+
+int RankFilter::OnThreads(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
    {
-      ret =  DEVICE_NOT_SUPPORTED;
+      pProp->Set((long)filter_.ThreadCount());
    }
+   else if (eAct == MM::AfterSet)
+   {
+      if (busy_.IsSet())
+         return DEVICE_ERR;
+      long threads;
+      pProp->Get(threads);
+      filter_.SetThreadCount(threads);
+   }
+   return DEVICE_OK;
+}
+
+int RankFilter::Process(unsigned char *pBuffer, unsigned int width, unsigned int height, unsigned int byteDepth)
+{
+   TraceScope trace("RankFilter::Process");
+   BusyGuard busy(busy_);
+   if (!busy.Entered())
+      return DEVICE_ERR;
+   const PixelFormat format = ProcessorFrameFormat(GetCoreCallback(), this, byteDepth);
+   if (PIXEL_FORMAT_COUNT == format)
+      return DEVICE_NOT_SUPPORTED;
+
+   performanceTiming_ = MM::MMTime(0.);
+   MM::MMTime  s0 = GetCurrentMMTime();
+
+   int ret = DispatchPixels(format, *this, pBuffer, width, height);
 
    performanceTiming_ = GetCurrentMMTime() - s0;
-   busy_ = false;
+   RecordLatency(performanceTiming_, width, height, byteDepth);
 
    return ret;
 }
@@ -35,6 +35,20 @@
 #include <algorithm>
 
 #include "multicam.h"
+#include "CpuReconstruction.h"
+#include "FocusSearch.h"
+#include "PixelKernels.h"
+#include "SyntheticImage.h"
+#include "SensorNoise.h"
+#include "HologramSource.h"
+#include "FrameReplay.h"
+#include "PixelTraits.h"
+#include "RankFilter.h"
+#include "Orientation.h"
+#include "ScratchArena.h"
+#include "LatencyHistogram.h"
+#include "Trace.h"
+#include "InstrumentedLock.h"
 
 //////////////////////////////////////////////////////////////////////////////
 // Error codes
@@ -46,6 +60,14 @@
 #define ERR_STAGE_MOVING         106
 #define SIMULATED_ERROR          200
 #define HUB_NOT_AVAILABLE        107
+#define ERR_FOCUS_NO_CAMERA      108
+#define ERR_FOCUS_NO_FRAME       109
+#define ERR_HOLOGRAM_SCENE       110
+#define ERR_REPLAY_OPEN          111
+#define ERR_REPLAY_FORMAT        112
+#define ERR_REPLAY_END           113
+#define ERR_TRACE_DUMP           114
+#define ERR_FOCUS_BACKEND        115
 
 const char* NoHubError = "Parent Hub not defined.";
 
@@ -105,6 +127,9 @@ public:
    // ------------
    int SnapImage();
    const unsigned char* GetImageBuffer();
+   const unsigned char* GetImageBuffer(unsigned channel);
+   unsigned GetNumberOfChannels() const;
+   int GetChannelName(unsigned channel, char* name);
    unsigned GetImageWidth() const;
    unsigned GetImageHeight() const;
    unsigned GetImageBytesPerPixel() const;
@@ -183,10 +208,65 @@ public:
    int OnTriggerDevice(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnDropPixels(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnFastImage(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFrameSource(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSyntheticThreads(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSensorNoise(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnNoiseParameter(MM::PropertyBase* pProp, MM::ActionType eAct, long index);
+   int OnNoiseSeed(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnHologramScene(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnHologramImage(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnHologramFrames(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnHologramParticles(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnHologramParameter(MM::PropertyBase* pProp, MM::ActionType eAct, long index);
+   int OnHologramFrameRate(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnHologramAccuracyCheck(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnHologramAccuracy(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReplayFile(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReplayIndex(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReplayMode(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReplayLoop(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReplayReadAhead(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReplayFrames(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReplayPosition(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnSaturatePixels(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnFractionOfPixelsToDropOrSaturate(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnCCDTemp(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnIsSequenceable(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReconstructionBackend(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReconstructionBatchSize(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReconstructionBatchLatencyLimit(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReconstructionThroughput(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReconstructionLatency(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReconstructionPrecision(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReconstructionAccuracyCheck(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReconstructionAccuracy(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReconstructionOutput(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnRefocusDistances(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPropagationDistance(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnWavelength(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPixelPitch(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTransferFunctionCacheSize(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnReconstructionThreads(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPixelKernelISA(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPixelKernelMode(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnScratchInUse(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnScratchHighWater(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnScratchAllocations(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnStageLatency(MM::PropertyBase* pProp, MM::ActionType eAct, long index);
+   int OnStageLatencyReset(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTrace(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTraceSeconds(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTraceFile(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTraceDump(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPixelsLock(MM::PropertyBase* pProp, MM::ActionType eAct, long index);
+   int OnPixelsLockReset(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+   // reconstruction autofocus access
+   bool CopyHologram(std::vector<unsigned char>& frame, int& width, int& height, double& wavelengthNm, double& pixelPitchUm);
+   double GetPropagationDistance() const {return cpuReconstructor_.Distance();}
+   // only the CPU backend reconstructs at the distance set here
+   bool ReconstructsOnCpu() const {return cpuBackend_;}
+   void SetPropagationDistance(double distanceUm);
 
    //static PVOID m_pCurrent;
    MCHANDLE m_Channel;
@@ -197,15 +277,83 @@ public:
 private:
    int SetAllowedBinning();
    void TestResourceLocking(const bool);
-   void GenerateEmptyImage(ImgBuffer& img);
-   void GetCameraImage(ImgBuffer& img);
-   void GenerateSyntheticImage(ImgBuffer& img, double exp);
+   void GenerateEmptyImage(FrameBuffer& img);
+   void GetCameraImage(FrameBuffer& img);
+   void GenerateSyntheticImage(FrameBuffer& img, double exp);
+   int NextSurface();
+   int NextHologram();
+   int NextReplay();
+   int OpenReplay();
+   bool ProcessorSwapsAxes() const;
    int ResizeImageBuffer();
+   int InsertFrame(const unsigned char* pI, int plane = 0);
+   int InsertPlanes(const unsigned char* planes);
+   void InitCpuReconstructor();
+   int ReconstructionBytesPerPixel() const;
+   size_t ReconstructionFrameBytes() const;
+   bool ReconstructionMatchesImage() const;
+   int ActivePlaneCount() const;
+   bool CanBatchReconstruction() const;
+   void QueueFrameForBatch();
+   bool IsBatchDue();
+   bool IsBatchLate();
+   int FlushReconstructionBatch();
+   void UpdateReconstructionStats(long frames, MM::MMTime reconstructionTime, MM::MMTime latency);
 
    static const double nominalPixelSizeUm_;
 
    double dPhase_;
-   ImgBuffer img_;
+   // where SnapImage() and the sequence thread take their frames from
+   enum FrameSource
+   {
+      FRAME_SOURCE_GRABBER,   // the frame grabber surfaces, reconstructed
+      FRAME_SOURCE_PATTERN,   // GenerateSyntheticImage(), no hardware needed
+      FRAME_SOURCE_HOLOGRAM,  // hologram_ frames in place of the grabber surfaces, reconstructed
+      FRAME_SOURCE_REPLAY     // recorded frames from replay_, reconstructed
+   };
+   // acquisition pipeline stages timed by stageLatency_
+   enum Stage
+   {
+      STAGE_CAPTURE,          // grabbing a frame, with its reconstruction outside batches
+      STAGE_RECONSTRUCTION,   // one reconstruction batch
+      STAGE_INSERT,           // handing a frame to the core, its processors included
+      STAGE_COUNT
+   };
+
+   void RecordStage(Stage stage, MM::MMTime elapsed, double bytes) {stageLatency_[stage].Record(elapsed.getUsec(), bytes);}
+
+   // call sites of imgPixelsLock_, each with its wait, hold and contention
+   // statistics
+   enum LockSite
+   {
+      LOCK_GET_IMAGE_BUFFER,     // GetImageBuffer(), nested in InsertImage(), spins for the readout time
+      LOCK_GET_CAMERA_IMAGE,     // reconstruction of the grabbed frame
+      LOCK_EMPTY_IMAGE,
+      LOCK_SYNTHETIC_IMAGE,
+      LOCK_INSERT_IMAGE,
+      LOCK_FRAME_SOURCE,         // hologram and replay frames
+      LOCK_RECONSTRUCTION_BATCH,
+      LOCK_AUTOFOCUS,            // hologram copies and distance changes of the focus device
+      LOCK_PROPERTIES,           // property handlers
+      LOCK_SITE_COUNT
+   };
+
+   // reconstruction geometry a setter changes, the others are kept
+   enum GeometryField
+   {
+      GEOMETRY_DISTANCE,
+      GEOMETRY_WAVELENGTH,
+      GEOMETRY_PIXEL_PITCH
+   };
+
+   void SetReconstructionGeometry(GeometryField field, double value, LockSite site);
+   // the geometry with 'field' set to 'value'
+   void ReconstructionGeometry(GeometryField field, double value, double& distanceUm, double& wavelengthNm, double& pixelPitchUm) const;
+   void SetReconstructionPlanes(const std::vector<double>& distancesUm);
+
+   FrameBuffer img_;
+   LatencyHistogram stageLatency_[STAGE_COUNT];
+   ScratchBlock debugRGB_;   // RGB copy of synthetic colour frames for the TIFF demo
    bool busy_;
    bool stopOnOverFlow_;
    bool initialized_;
@@ -233,18 +381,61 @@ private:
 
 	bool dropPixels_;
    bool fastImage_;
+   FrameSource frameSource_;
 	bool saturatePixels_;
 	double fractionOfPixelsToDropOrSaturate_;
 
 	double testProperty_[10];
    MMThreadLock* pDemoResourceLock_;
-   MMThreadLock imgPixelsLock_;
+   InstrumentedLock imgPixelsLock_;
    friend class MySequenceThread;
    int nComponents_;
    MySequenceThread * thd_;
    void *method;
    int paddedX;
    int paddedY;
+
+   // reconstruction backend and batching
+   CpuReconstructor cpuReconstructor_;
+   bool cpuBackend_;
+   int reconWidth_;
+   int reconHeight_;
+   long batchSize_;
+   double batchLatencyLimitMs_;
+   long batchCount_;
+   MM::MMTime batchStartTime_;
+   std::vector<unsigned char> batchFrames_;
+   std::vector<unsigned char> batchOutput_;
+   double reconstructionFps_;
+   double reconstructionLatencyMs_;
+   std::string accuracyReport_;
+   std::string refocusDistances_;
+   std::vector<unsigned char> planeImages_;
+
+   SyntheticImageGenerator synthetic_;
+   SensorNoise noise_;
+   SensorNoise::Model noiseModel_;
+
+   HologramSource hologram_;
+   HologramSource::Settings hologramSettings_;
+   double hologramFps_;                // 0: the next pool frame on every grab
+   long hologramGrabs_;
+   MM::MMTime hologramStart_;
+   int hologramFrame_;                 // pool frame m_pCurrent1 points at
+   std::string hologramReport_;
+
+   FrameReplay replay_;
+   std::string replayFile_;
+   std::string replayIndexFile_;       // empty: replayFile_ + ".idx"
+   bool replayRealTime_;               // paced by the recorded timestamps, otherwise a frame per grab
+   bool replayLoop_;
+   size_t replayPosition_;             // frame after the one served last
+   long replayGrabs_;
+   MM::MMTime replayStart_;
+   size_t replayStartFrame_;
+   const unsigned char* replayFrame_;  // served frame, valid while the mapping stays
+   double traceSeconds_;               // span of a trace dump
+   std::string traceFile_;
 };
 PVOID m_pCurrent;
 unsigned char *m_pCurrent1;
@@ -876,78 +1067,167 @@ private:
    double highMag_;
 };
 
+// rows per chunk of the processors that work on bands of rows: about 64 kB,
+// so that handing out a chunk costs little against processing it
+inline int RowBandGrain(size_t rowBytes)
+{
+   return (int)std::max<size_t>(1, 65536 / std::max<size_t>(1, rowBytes));
+}
+
+// copies a frame in 64 kB chunks spread over a pool
+class ParallelCopyTask : public WorkerPool::Task
+{
+public:
+   static const size_t cChunk = 65536;
+
+   ParallelCopyTask(void* dst, const void* src, size_t bytes) : dst_((unsigned char*)dst), src_((const unsigned char*)src), bytes_(bytes) {}
+   void Run(int begin, int end, int)
+   {
+      const size_t first = begin * cChunk;
+      const size_t last = std::min(bytes_, end * cChunk);
+      memcpy(dst_ + first, src_ + first, last - first);
+   }
+
+   static void Copy(WorkerPool& pool, void* dst, const void* src, size_t bytes)
+   {
+      ParallelCopyTask task(dst, src, bytes);
+      pool.ParallelFor((int)((bytes + cChunk - 1) / cChunk), 1, task);
+   }
+
+private:
+   unsigned char* dst_;
+   const unsigned char* src_;
+   size_t bytes_;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// CTimedProcessorBase class
+// image processor keeping the latency distribution of its Process() calls,
+// exposed as read-only properties with a reset action
+//////////////////////////////////////////////////////////////////////////////
+template <class T> class CTimedProcessorBase : public CImageProcessorBase<T>
+{
+public:
+   int OnLatency(MM::PropertyBase* pProp, MM::ActionType eAct, long statistic)
+   {
+      if (eAct == MM::BeforeGet)
+      {
+         pProp->Set(latency_.Value((LatencyHistogram::Statistic)statistic));
+      }
+      return DEVICE_OK;
+   }
+
+   int OnLatencyReset(MM::PropertyBase* pProp, MM::ActionType eAct)
+   {
+      if (eAct == MM::BeforeGet)
+      {
+         pProp->Set("Idle");
+      }
+      else if (eAct == MM::AfterSet)
+      {
+         std::string value;
+         pProp->Get(value);
+         if (value == "Reset")
+            latency_.Reset();
+      }
+      return DEVICE_OK;
+   }
+
+protected:
+   void CreateLatencyProperties()
+   {
+      T* pT = static_cast<T*>(this);
+      for (int s = 0; s < LatencyHistogram::LATENCY_STATISTIC_COUNT; ++s)
+      {
+         MM::ActionEx<T>* pAct = new MM::ActionEx<T>(pT, &T::OnLatency, s);
+         (void)this->CreateProperty(LatencyHistogram::StatisticName((LatencyHistogram::Statistic)s), "0", MM::Float, true, pAct);
+      }
+      MM::Action<T>* pAct = new MM::Action<T>(pT, &T::OnLatencyReset);
+      (void)this->CreateProperty("LatencyReset", "Idle", MM::String, false, pAct);
+      this->AddAllowedValue("LatencyReset", "Idle");
+      this->AddAllowedValue("LatencyReset", "Reset");
+   }
+
+   // one frame of width x height pixels of byteDepth bytes
+   void RecordLatency(MM::MMTime elapsed, unsigned width, unsigned height, unsigned byteDepth)
+   {
+      latency_.Record(elapsed.getUsec(), (double)width * height * byteDepth);
+   }
+
+   LatencyHistogram latency_;
+};
+
 //////////////////////////////////////////////////////////////////////////////
 // TransposeProcessor class
 // transpose an image
 // K.H.
 //////////////////////////////////////////////////////////////////////////////
-class TransposeProcessor : public CImageProcessorBase<TransposeProcessor>
+class TransposeProcessor : public CTimedProcessorBase<TransposeProcessor>
 {
 public:
-   TransposeProcessor () : inPlace_ (false), pTemp_(NULL), tempSize_(0), busy_(false)
+   TransposeProcessor () : inPlace_ (false)
    {
       // parent ID display
       CreateHubIDProperty();
    }
-   ~TransposeProcessor () {if( NULL!= pTemp_) free(pTemp_); tempSize_=0;  }
+   ~TransposeProcessor () {}
 
    int Shutdown() {return DEVICE_OK;}
    void GetName(char* name) const {strcpy(name,"TransposeProcessor");}
 
    int Initialize();
 
-   bool Busy(void) { return busy_;};
+   bool Busy(void) { return busy_.IsSet();};
 
-    // really primative image transpose algorithm which will work fine for non-square images... 
-   template <typename PixelType> int TransposeRectangleOutOfPlace( PixelType* pI, unsigned int width, unsigned int height)
+   // transposes the srcWidth x srcHeight image at pI into a srcHeight x
+   // srcWidth image in the same buffer, through temp_; bands of source
+   // rows run on the shared pool
+   template <typename PixelType> int TransposeRectangleOutOfPlace( PixelType* pI, unsigned int srcWidth, unsigned int srcHeight)
    {
-      int ret = DEVICE_OK;
-      unsigned long tsize = width*height*sizeof(PixelType);
-      if( this->tempSize_ != tsize)
-      {
-         if( NULL != this->pTemp_)
-         {
-            free(pTemp_);
-            pTemp_ = NULL;
-         }
-         pTemp_ = (PixelType *)malloc(tsize);
-      }
-      if( NULL != pTemp_)
+      unsigned long tsize = srcWidth*srcHeight*sizeof(PixelType);
+      PixelType* pTmpImage = (PixelType *) Temp(tsize);
+      if( NULL == pTmpImage)
+         return DEVICE_ERR;
+
+      BandTask<PixelType> task(pI, pTmpImage, srcWidth, srcHeight);
+      pool_->ParallelFor((srcHeight + cBand - 1) / cBand, 1, task);
+      ParallelCopyTask::Copy(*pool_, pI, pTmpImage, tsize);
+      return DEVICE_OK;
+   }
+
+   // in-place transpose of a square image, one cTile x cTile block pair at a time
+   template <typename PixelType> void TransposeSquareInPlace( PixelType* pI, unsigned int dim) 
+   { 
+      for( unsigned long by = 0; by < dim; by += cTile)
       {
-         PixelType* pTmpImage = (PixelType *) pTemp_;
-         tempSize_ = tsize;
-         for( unsigned long ix = 0; ix < width; ++ix)
+         for( unsigned long bx = by; bx < dim; bx += cTile)
          {
-            for( unsigned long iy = 0; iy < height; ++iy)
+            const unsigned long ey = std::min<unsigned long>(dim, by + cTile);
+            const unsigned long ex = std::min<unsigned long>(dim, bx + cTile);
+            for( unsigned long iy = by; iy < ey; ++iy)
             {
-               pTmpImage[iy + ix*width] = pI[ ix + iy*height];
+               for( unsigned long ix = (bx == by ? iy + 1 : bx); ix < ex; ++ix)
+                  std::swap(pI[iy*dim + ix], pI[ix*dim + iy]);
             }
          }
-         memcpy( pI, pTmpImage, tsize);
       }
-      else
-      {
-         ret = DEVICE_ERR;
-      }
-
-      return ret;
    }
 
-   
-   template <typename PixelType> void TransposeSquareInPlace( PixelType* pI, unsigned int dim) 
-   { 
-      PixelType tmp;
-      for( unsigned long ix = 0; ix < dim; ++ix)
+   void TransposeSquareInPlace(unsigned char* pI, unsigned int dim) {Kernels().transposeSquare8(pI, dim);}
+   void TransposeSquareInPlace(unsigned short* pI, unsigned int dim) {Kernels().transposeSquare16(pI, dim);}
+
+   // 'width' and 'height' describe the transposed image; only the pixel
+   // size matters, the pixels are moved as unsigned integers
+   template <class Traits> int Apply( typename Traits::Type* pI, unsigned int width, unsigned int height)
+   {
+      typename Traits::Storage* pPixels = reinterpret_cast<typename Traits::Storage*>(pI);
+      if( inPlace_ && width == height)
       {
-         for( unsigned long iy = ix; iy < dim; ++iy)
-         {
-            tmp = pI[iy*dim + ix];
-            pI[iy*dim +ix] = pI[ix*dim + iy];
-            pI[ix*dim +iy] = tmp; 
-         }
+         TransposeSquareInPlace( pPixels, width);
+         return DEVICE_OK;
       }
-
-      return;
+      // non-square frames always go through the temporary buffer
+      return TransposeRectangleOutOfPlace( pPixels, height, width);
    }
 
    int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
@@ -955,12 +1235,67 @@ public:
    // action interface
    // ----------------
    int OnInPlaceAlgorithm(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnThreads(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 private:
+   // block edge of the generic transposes: 32 lines of source and
+   // destination stay cached for pixels up to 8 bytes
+   static const unsigned long cTile = 32;
+   // source rows per parallel band, a multiple of the kernel blocks
+   static const unsigned int cBand = 64;
+
+   // 'rows' rows of srcWidth pixels at 'src' into as many columns at 'dst'
+   template <typename PixelType> static void TransposeTiles(const PixelType* src, PixelType* dst, unsigned int srcWidth, size_t dstStride, unsigned int rows)
+   {
+      for( unsigned long by = 0; by < rows; by += cTile)
+      {
+         const unsigned long ey = std::min<unsigned long>(rows, by + cTile);
+         for( unsigned long bx = 0; bx < srcWidth; bx += cTile)
+         {
+            const unsigned long ex = std::min<unsigned long>(srcWidth, bx + cTile);
+            for( unsigned long ix = bx; ix < ex; ++ix)
+            {
+               for( unsigned long iy = by; iy < ey; ++iy)
+                  dst[ix*dstStride + iy] = src[iy*srcWidth + ix];
+            }
+         }
+      }
+   }
+   static void TransposeTiles(const unsigned char* src, unsigned char* dst, unsigned int srcWidth, size_t dstStride, unsigned int rows)
+   {
+      Kernels().transpose8(src, srcWidth, dst, dstStride, srcWidth, rows);
+   }
+   static void TransposeTiles(const unsigned short* src, unsigned short* dst, unsigned int srcWidth, size_t dstStride, unsigned int rows)
+   {
+      Kernels().transpose16(src, srcWidth, dst, dstStride, srcWidth, rows);
+   }
+
+   // bands of cBand source rows into bands of destination columns
+   template <typename PixelType> class BandTask : public WorkerPool::Task
+   {
+   public:
+      BandTask(const PixelType* src, PixelType* dst, unsigned int srcWidth, unsigned int srcHeight) :
+         src_(src), dst_(dst), srcWidth_(srcWidth), srcHeight_(srcHeight) {}
+      void Run(int begin, int end, int)
+      {
+         const unsigned int y0 = begin * cBand;
+         const unsigned int y1 = std::min(srcHeight_, end * cBand);
+         TransposeTiles(src_ + (size_t)y0 * srcWidth_, dst_ + y0, srcWidth_, srcHeight_, y1 - y0);
+      }
+   private:
+      const PixelType* src_;
+      PixelType* dst_;
+      unsigned int srcWidth_;
+      unsigned int srcHeight_;
+   };
+
+   // scratch of at least 'size' bytes, kept between frames
+   void* Temp(unsigned long size) {return temp_.Reserve(size);}
+
    bool inPlace_;
-   void* pTemp_;
-   unsigned long tempSize_;
-   bool busy_;
+   ScratchBlock temp_;
+   BusyFlag busy_;
+   SharedWorkerPool pool_;
 };
 
 
@@ -970,42 +1305,69 @@ private:
 // flip an image
 // K.H.
 //////////////////////////////////////////////////////////////////////////////
-class ImageFlipX : public CImageProcessorBase<ImageFlipX>
+class ImageFlipX : public CTimedProcessorBase<ImageFlipX>
 {
 public:
-   ImageFlipX () :  busy_(false) {}
+   ImageFlipX () : performanceTiming_(0.), throughput_(0.) {}
    ~ImageFlipX () {  }
 
    int Shutdown() {return DEVICE_OK;}
    void GetName(char* name) const {strcpy(name,"ImageFlipX");}
 
    int Initialize();
-   bool Busy(void) { return busy_;};
+   bool Busy(void) { return busy_.IsSet();};
 
-    // 
-   template <typename PixelType> int Flip( PixelType* pI, unsigned int width, unsigned int height)
+   // reverses one row with the lane reversal kernel of the pixel size
+   template <typename PixelType> static void ReverseRow( PixelType* row, unsigned int width)
    {
-      PixelType tmp;
-      int ret = DEVICE_OK;
-      for( unsigned long iy = 0; iy < height; ++iy)
+      switch (sizeof(PixelType))
       {
-         for( unsigned long ix = 0; ix <  (width>>1) ; ++ix)
-         {
-            tmp = pI[ ix + iy*width];
-            pI[ ix + iy*width] = pI[ width - 1 - ix + iy*width];
-            pI[ width -1 - ix + iy*width] = tmp;
-         }
+      case 1: Kernels().reverse8(reinterpret_cast<unsigned char*>(row), width); break;
+      case 2: Kernels().reverse16(reinterpret_cast<unsigned short*>(row), width); break;
+      case 4: Kernels().reverse32(reinterpret_cast<unsigned int*>(row), width); break;
+      case 8: Kernels().reverse64(reinterpret_cast<unsigned long long*>(row), width); break;
+      default: std::reverse(row, row + width);
       }
-      return ret;
+   }
+
+   // bands of rows are reversed in parallel
+   template <typename PixelType> int Flip( PixelType* pI, unsigned int width, unsigned int height)
+   {
+      RowTask<PixelType> task(pI, width);
+      pool_->ParallelFor(height, RowBandGrain(sizeof(PixelType) * width), task);
+      return DEVICE_OK;
+   }
+
+   template <class Traits> int Apply( typename Traits::Type* pI, unsigned int width, unsigned int height)
+   {
+      return Flip( reinterpret_cast<typename Traits::Storage*>(pI), width, height);
    }
 
    int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
 
    int OnPerformanceTiming(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnThroughput(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnThreads(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 private:
-   bool busy_;
+   template <typename PixelType> class RowTask : public WorkerPool::Task
+   {
+   public:
+      RowTask(PixelType* pI, unsigned int width) : pI_(pI), width_(width) {}
+      void Run(int begin, int end, int)
+      {
+         for (int iy = begin; iy < end; ++iy)
+            ReverseRow(pI_ + (size_t)iy * width_, width_);
+      }
+   private:
+      PixelType* pI_;
+      unsigned int width_;
+   };
+
+   BusyFlag busy_;
    MM::MMTime performanceTiming_;
+   double throughput_;   // GB/s read and written by the last frame
+   SharedWorkerPool pool_;
 };
 
 
@@ -1014,45 +1376,157 @@ private:
 // flip an image
 // K.H.
 //////////////////////////////////////////////////////////////////////////////
-class ImageFlipY : public CImageProcessorBase<ImageFlipY>
+class ImageFlipY : public CTimedProcessorBase<ImageFlipY>
 {
 public:
-   ImageFlipY () : busy_(false), performanceTiming_(0.) {}
+   ImageFlipY () : performanceTiming_(0.), throughput_(0.) {}
    ~ImageFlipY () {  }
 
    int Shutdown() {return DEVICE_OK;}
    void GetName(char* name) const {strcpy(name,"ImageFlipY");}
 
    int Initialize();
-   bool Busy(void) { return busy_;};
+   bool Busy(void) { return busy_.IsSet();};
 
+   // exchanges whole rows, the pixel type only sets the row length; bands
+   // of row pairs are exchanged in parallel
    template <typename PixelType> int Flip( PixelType* pI, unsigned int width, unsigned int height)
    {
-      PixelType tmp;
-      int ret = DEVICE_OK;
-      for( unsigned long ix = 0; ix < width ; ++ix)
+      RowPairTask task(reinterpret_cast<unsigned char*>(pI), sizeof(PixelType) * width, height);
+      pool_->ParallelFor(height>>1, RowBandGrain(2 * sizeof(PixelType) * width), task);
+      return DEVICE_OK;
+   }
+
+   template <class Traits> int Apply( typename Traits::Type* pI, unsigned int width, unsigned int height)
+   {
+      return Flip( reinterpret_cast<typename Traits::Storage*>(pI), width, height);
+   }
+
+
+   int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
+
+   // action interface
+   // ----------------
+   int OnPerformanceTiming(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnThroughput(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnThreads(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+private:
+   // exchanges row iy with its mirror row; the kernel swaps through
+   // registers, so no row sized scratch is needed
+   class RowPairTask : public WorkerPool::Task
+   {
+   public:
+      RowPairTask(unsigned char* pBytes, size_t rowBytes, unsigned int height) : pBytes_(pBytes), rowBytes_(rowBytes), height_(height) {}
+      void Run(int begin, int end, int)
       {
-         for( unsigned long iy = 0; iy < (height>>1); ++iy)
-         {
-            tmp = pI[ ix + iy*width];
-            pI[ ix + iy*width] = pI[ ix + (height - 1 - iy)*width];
-            pI[ ix + (height - 1 - iy)*width] = tmp;
-         }
+         for (int iy = begin; iy < end; ++iy)
+            Kernels().swapBytes(pBytes_ + iy * rowBytes_, pBytes_ + (height_ - 1 - iy) * rowBytes_, rowBytes_);
       }
-      return ret;
+   private:
+      unsigned char* pBytes_;
+      size_t rowBytes_;
+      unsigned int height_;
+   };
+
+   BusyFlag busy_;
+   MM::MMTime performanceTiming_;
+   double throughput_;   // GB/s read and written by the last frame
+   SharedWorkerPool pool_;
+
+};
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// OrientationProcessor class
+// rotates and mirrors an image in one pass, replacing chains of
+// TransposeProcessor, ImageFlipX and ImageFlipY
+//////////////////////////////////////////////////////////////////////////////
+class OrientationProcessor : public CTimedProcessorBase<OrientationProcessor>
+{
+public:
+   OrientationProcessor () : performanceTiming_(0.), orientation_(ORIENT_IDENTITY)
+   {
+      // parent ID display
+      CreateHubIDProperty();
    }
+   ~OrientationProcessor () {}
+
+   int Shutdown() {return DEVICE_OK;}
+   void GetName(char* name) const {strcpy(name,"Orientation");}
+
+   int Initialize();
+   bool Busy(void) { return busy_.IsSet();};
+
+   // the camera reports height x width while this is true
+   bool SwapsAxes() const {return OrientationSwapsAxes(orientation_);}
 
+   // 'width' and 'height' describe the processed image, the frame in the
+   // buffer is swapped when the transform swaps the axes
+   template <class Traits> int Apply( typename Traits::Type* pI, unsigned int width, unsigned int height)
+   {
+      const bool swap = SwapsAxes();
+      return Orient( reinterpret_cast<typename Traits::Storage*>(pI), swap ? height : width, swap ? width : height);
+   }
 
    int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
 
    // action interface
    // ----------------
    int OnPerformanceTiming(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnOrientation(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnThreads(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 private:
-   bool busy_;
-   MM::MMTime performanceTiming_;
+   // source row bands of the frame: in place for the transforms that keep
+   // the axes, into scratch_ for the others
+   template <typename PixelType> class BandTask : public WorkerPool::Task
+   {
+   public:
+      BandTask(PixelType* pI, PixelType* pDst, unsigned int srcWidth, unsigned int srcHeight, Orientation o) :
+         pI_(pI), pDst_(pDst), srcWidth_(srcWidth), srcHeight_(srcHeight), o_(o) {}
+      void Run(int begin, int end, int)
+      {
+         if (NULL == pDst_)
+            OrientInPlace(pI_, srcWidth_, srcHeight_, o_, begin, end);
+         else
+            ::Orient(pI_, pDst_, srcWidth_, srcHeight_, o_, begin, end);
+      }
+   private:
+      PixelType* pI_;
+      PixelType* pDst_;
+      unsigned int srcWidth_;
+      unsigned int srcHeight_;
+      Orientation o_;
+   };
 
+   template <typename PixelType> int Orient( PixelType* pI, unsigned int srcWidth, unsigned int srcHeight)
+   {
+      const size_t rowBytes = (size_t)srcWidth * sizeof(PixelType);
+      if (!OrientationSwapsAxes(orientation_))
+      {
+         BandTask<PixelType> task(pI, NULL, srcWidth, srcHeight, orientation_);
+         pool_->ParallelFor(OrientInPlaceRows(srcHeight, orientation_), RowBandGrain(2 * rowBytes), task);
+         return DEVICE_OK;
+      }
+
+      const size_t bytes = rowBytes * srcHeight;
+      PixelType* pScratch = (PixelType*)scratch_.Reserve(bytes);
+      if (NULL == pScratch)
+         return DEVICE_ERR;
+      // bands of whole 64 row blocks, the unit of the transposing kernels
+      BandTask<PixelType> task(pI, pScratch, srcWidth, srcHeight, orientation_);
+      pool_->ParallelFor(srcHeight, std::max(64, RowBandGrain(rowBytes) & ~63), task);
+      ParallelCopyTask::Copy(*pool_, pI, pScratch, bytes);
+      return DEVICE_OK;
+   }
+
+   BusyFlag busy_;
+   MM::MMTime performanceTiming_;
+   Orientation orientation_;
+   ScratchBlock scratch_;   // result of the transforms that swap the axes
+   SharedWorkerPool pool_;
 };
 
 
@@ -1062,120 +1536,305 @@ private:
 // apply Median filter an image
 // K.H.
 //////////////////////////////////////////////////////////////////////////////
-class MedianFilter : public CImageProcessorBase<MedianFilter>
+class MedianFilter : public CTimedProcessorBase<MedianFilter>
 {
 public:
-   MedianFilter () : busy_(false), performanceTiming_(0.),pSmoothedIm_(0), sizeOfSmoothedIm_(0)
+   MedianFilter () : performanceTiming_(0.)
    {
       // parent ID display
       CreateHubIDProperty();
    };
-   ~MedianFilter () { if(0!=pSmoothedIm_) free(pSmoothedIm_); };
+   ~MedianFilter () {};
 
    int Shutdown() {return DEVICE_OK;}
    void GetName(char* name) const {strcpy(name,"MedianFilter");}
 
    int Initialize();
-   bool Busy(void) { return busy_;};
+   bool Busy(void) { return busy_.IsSet();};
 
-   // NOTE: this utility MODIFIES the argument, make a copy yourself if you want the original data preserved
-   template <class U> U FindMedian(std::vector<U>& values ) {
-      std::sort(values.begin(), values.end());
-      return values[(values.size())>>1];
-   };
+   // 3x3 median at column i from the rows around it, edge columns duplicated
+   template <class U> static U MedianAt(const U* above, const U* row, const U* below, unsigned int i, unsigned int width)
+   {
+      const unsigned int l = (i > 0) ? i - 1 : 0;
+      const unsigned int r = (i + 1 < width) ? i + 1 : width - 1;
+      U windo[9] = {above[l], above[i], above[r], row[l], row[i], row[r], below[l], below[i], below[r]};
+      std::nth_element(windo, windo + 4, windo + 9);
+      return windo[4];
+   }
 
+   // colour pixels: the median of every channel on its own
+   template <class P> static P ChannelMedianAt(const P* above, const P* row, const P* below, unsigned int i, unsigned int width)
+   {
+      const unsigned int l = (i > 0) ? i - 1 : 0;
+      const unsigned int r = (i + 1 < width) ? i + 1 : width - 1;
+      P median;
+      for (int c = 0; c < P::Channels; c++)
+      {
+         typename P::Channel windo[9] = {above[l].c[c], above[i].c[c], above[r].c[c], row[l].c[c], row[i].c[c], row[r].c[c], below[l].c[c], below[i].c[c], below[r].c[c]};
+         std::nth_element(windo, windo + 4, windo + 9);
+         median.c[c] = windo[4];
+      }
+      return median;
+   }
+   static Rgba32 MedianAt(const Rgba32* above, const Rgba32* row, const Rgba32* below, unsigned int i, unsigned int width)
+   {
+      return ChannelMedianAt(above, row, below, i, width);
+   }
+   static Rgb64 MedianAt(const Rgb64* above, const Rgb64* row, const Rgb64* below, unsigned int i, unsigned int width)
+   {
+      return ChannelMedianAt(above, row, below, i, width);
+   }
 
-   template <typename PixelType> int Filter( PixelType* pI, unsigned int width, unsigned int height)
+   template <class U> static void MedianRow(const U* above, const U* row, const U* below, U* dst, unsigned int width)
    {
-      int ret = DEVICE_OK;
-      int x[9];
-      int y[9];
+      for (unsigned int i=0; i<width; i++)
+         dst[i] = MedianAt(above, row, below, i, width);
+   }
+   static void MedianRow(const unsigned char* above, const unsigned char* row, const unsigned char* below, unsigned char* dst, unsigned int width)
+   {
+      Kernels().median8(above, row, below, dst, width);
+   }
+   static void MedianRow(const unsigned short* above, const unsigned short* row, const unsigned short* below, unsigned short* dst, unsigned int width)
+   {
+      Kernels().median16(above, row, below, dst, width);
+   }
 
-      const unsigned long thisSize = sizeof(*pI)*width*height;
-      if( thisSize != sizeOfSmoothedIm_)
+   /**
+   * Filters rows [y0, y1) in place, one stripe of columns at a time. Inside
+   * a stripe the rows are filtered top down with three stripe wide scratch
+   * rows at pRows: the source of the row above (already overwritten in the
+   * image), the source of the current row and the result. pTop and pBottom
+   * are copies of the source rows y0 - 1 and y1, which the neighbouring
+   * bands overwrite, or NULL at the image edges.
+   */
+   template <typename PixelType> static void FilterBand( PixelType* pI, unsigned int width, unsigned int height, unsigned int y0, unsigned int y1,
+      const PixelType* pTop, const PixelType* pBottom, PixelType* pRows, unsigned int stripe)
+   {
+      const unsigned int span = std::min(width, stripe);
+      PixelType* pAbove = pRows;
+      PixelType* pSaved = pAbove + span;
+      PixelType* pOut = pSaved + span;
+      // the row above the first one is the first row itself
+      if (NULL == pTop)
+         pTop = pI + (size_t)y0 * width;
+      for (unsigned int x0 = 0; x0 < width; x0 += stripe)
       {
-         if(NULL!=pSmoothedIm_)
+         const unsigned int w = std::min(stripe, width - x0);
+         const size_t rowBytes = sizeof(PixelType) * w;
+         memcpy(pAbove, pTop + x0, rowBytes);
+         for (unsigned int j = y0; j < y1; j++)
          {
-            sizeOfSmoothedIm_ = 0;
-            free(pSmoothedIm_);
+            PixelType* pRow = pI + (size_t)j * width + x0;
+            const PixelType* pBelow = (j + 1 < y1) ? pRow + width : ((j + 1 < height) ? pBottom + x0 : pRow);
+            MedianRow(pAbove, pRow, pBelow, pOut, w);
+            memcpy(pSaved, pRow, rowBytes);
+            memcpy(pRow, pOut, rowBytes);
+            std::swap(pAbove, pSaved);
          }
-         // malloc is faster than new...
-         pSmoothedIm_ = (PixelType*)malloc(thisSize);
-         if(NULL!=pSmoothedIm_)
+      }
+   }
+
+   /**
+   * Filters in place. Bands of rows run on the shared pool, each band in
+   * stripes of columns (see FilterBand()); the rows at the band boundaries
+   * are copied first. The stripes treat their own edges as image edges,
+   * the two columns at each stripe boundary are redone afterwards from a
+   * copy of the four source columns around the boundary.
+   */
+   template <typename PixelType> int Filter( PixelType* pI, unsigned int width, unsigned int height)
+   {
+      if (0 == width || 0 == height)
+         return DEVICE_OK;
+
+      const unsigned int stripe = std::max(2u, (unsigned int)(cStripeBytes / sizeof(PixelType)));
+      const unsigned int span = std::min(width, stripe);
+      const unsigned int boundaries = (width - 1) / stripe;
+      // a few bands per thread, for the pool to balance
+      const unsigned int bands = std::min(height, 4u * (unsigned int)pool_->ThreadCount());
+      const size_t thisSize = sizeof(PixelType) * ((size_t)4 * boundaries * height + (size_t)2 * width * (bands - 1) + (size_t)3 * span * bands);
+      PixelType* pColumns = (PixelType*) scratch_.Reserve(thisSize);
+      if(NULL == pColumns)
+         return DEVICE_ERR;
+
+      PixelType* pEdges = pColumns + 4 * boundaries * height;
+      PixelType* pRows = pEdges + 2 * width * (bands - 1);
+
+      // source columns x1 - 2 .. x1 + 1 around each boundary x1, column major
+      for (unsigned int b = 0; b < boundaries; b++)
+      {
+         const unsigned int x1 = (b + 1) * stripe;
+         for (unsigned int c = 0; c < 4; c++)
          {
-            sizeOfSmoothedIm_ = thisSize;
+            const unsigned int x = std::min(x1 + c - 2, width - 1);
+            PixelType* pColumn = pColumns + (4 * b + c) * height;
+            for (unsigned int j = 0; j < height; j++)
+               pColumn[j] = pI[(size_t)j * width + x];
          }
       }
 
-      PixelType* pSmooth = (PixelType*) pSmoothedIm_;
+      // source rows y - 1 and y at the top of every band but the first
+      for (unsigned int k = 1; k < bands; k++)
+      {
+         const unsigned int y = BandStart(k, bands, height);
+         memcpy(pEdges + (size_t)2 * (k - 1) * width, pI + (size_t)(y - 1) * width, 2 * sizeof(PixelType) * width);
+      }
 
-      if(NULL != pSmooth)
+      BandTask<PixelType> task(pI, width, height, bands, stripe, pEdges, pRows);
+      pool_->ParallelFor(bands, 1, task);
+
+      // border pass: columns x1 - 1 and x1 of every boundary
+      for (unsigned int b = 0; b < boundaries; b++)
       {
-      /*Apply 3x3 median filter to reduce shot noise*/
-      for (unsigned int i=0; i<width; i++) {
-         for (unsigned int j=0; j<height; j++) {
-            x[0]=i-1;
-            y[0]=(j-1);
-            x[1]=i;
-            y[1]=(j-1);
-            x[2]=i+1;
-            y[2]=(j-1);
-            x[3]=i-1;
-            y[3]=(j);
-            x[4]=i;
-            y[4]=(j);
-            x[5]=i+1;
-            y[5]=(j);
-            x[6]=i-1;
-            y[6]=(j+1);
-            x[7]=i;
-            y[7]=(j+1);
-            x[8]=i+1;
-            y[8]=(j+1);
-            // truncate the median filter window  -- duplicate edge points
-            // this could be more efficient, we could fill in the interior image [1,w0-1]x[1,h0-1] then explicitly fill in the edge pixels.
-            // also the temporary image could be as small as 2 rasters of the image
-            for(int ij =0; ij < 9; ++ij)
-            {
-               if( x[ij] < 0)
-                  x[ij] = 0;
-               else if( int(width-1) < x[ij])
-                  x[ij] = int(width-1);
-               if( y[ij] < 0)
-                  y[ij] = 0;
-               else if( int(height-1) < y[ij])
-                  y[ij] = (int)(height-1);
-            }
-            std::vector<PixelType> windo;
-            for(int ij = 0; ij < 9; ++ij)
+         const unsigned int x1 = (b + 1) * stripe;
+         const PixelType* pColumn = pColumns + 4 * b * height;
+         for (unsigned int j = 0; j < height; j++)
+         {
+            const unsigned int ja = (j > 0) ? j - 1 : 0;
+            const unsigned int jb = (j + 1 < height) ? j + 1 : height - 1;
+            // the four source columns transposed into three short rows
+            PixelType above[4], row[4], below[4];
+            for (unsigned int c = 0; c < 4; c++)
             {
-               windo.push_back(pI[ x[ij] + width*y[ij]]);
+               above[c] = pColumn[c * height + ja];
+               row[c] = pColumn[c * height + j];
+               below[c] = pColumn[c * height + jb];
             }
-            pSmooth[i + j*width] = FindMedian(windo);
+            pI[(size_t)j * width + x1 - 1] = MedianAt(above, row, below, 1, 4);
+            pI[(size_t)j * width + x1] = MedianAt(above, row, below, 2, 4);
          }
       }
+      return DEVICE_OK;
+   }
+
+   // grey values by value, float frames as floats, colours per channel
+   template <class Traits> int Apply( typename Traits::Type* pI, unsigned int width, unsigned int height)
+   {
+      return Filter( pI, width, height);
+   }
+
+   int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
+
+   // action interface
+   // ----------------
+   int OnPerformanceTiming(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnThreads(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+private:
+   // stripe width in bytes: the five stripe rows in use per output row
+   // (three source rows, the saved row and the result) fit the L1 cache
+   static const unsigned int cStripeBytes = 4096;
+
+   static unsigned int BandStart(unsigned int k, unsigned int bands, unsigned int height)
+   {
+      return (unsigned int)((unsigned long long)height * k / bands);
+   }
 
-      memcpy( pI, pSmoothedIm_, thisSize);
+   // band k with the boundary rows and the scratch rows of its own
+   template <typename PixelType> class BandTask : public WorkerPool::Task
+   {
+   public:
+      BandTask(PixelType* pI, unsigned int width, unsigned int height, unsigned int bands, unsigned int stripe, const PixelType* pEdges, PixelType* pRows) :
+         pI_(pI), width_(width), height_(height), bands_(bands), stripe_(stripe), pEdges_(pEdges), pRows_(pRows) {}
+      void Run(int begin, int end, int)
+      {
+         const unsigned int span = std::min(width_, stripe_);
+         for (unsigned int k = begin; k < (unsigned int)end; k++)
+         {
+            const PixelType* pTop = (k > 0) ? pEdges_ + (size_t)(2 * k - 2) * width_ : NULL;
+            const PixelType* pBottom = (k + 1 < bands_) ? pEdges_ + (size_t)(2 * k + 1) * width_ : NULL;
+            FilterBand(pI_, width_, height_, BandStart(k, bands_, height_), BandStart(k + 1, bands_, height_),
+               pTop, pBottom, pRows_ + (size_t)3 * span * k, stripe_);
+         }
       }
-      else
-         ret = DEVICE_ERR;
+   private:
+      PixelType* pI_;
+      unsigned int width_;
+      unsigned int height_;
+      unsigned int bands_;
+      unsigned int stripe_;
+      const PixelType* pEdges_;
+      PixelType* pRows_;
+   };
+
+   BusyFlag busy_;
+   MM::MMTime performanceTiming_;
+   ScratchBlock scratch_;
+   SharedWorkerPool pool_;
+};
+
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// RankFilter class
+// minimum, median, maximum or percentile of a square neighborhood
+//////////////////////////////////////////////////////////////////////////////
+class RankFilter : public CTimedProcessorBase<RankFilter>
+{
+public:
+   RankFilter () : performanceTiming_(0.), mode_("Median"), percentile_(50.)
+   {
+      // parent ID display
+      CreateHubIDProperty();
+   }
+   ~RankFilter () {}
+
+   int Shutdown() {return DEVICE_OK;}
+   void GetName(char* name) const {strcpy(name,"RankFilter");}
 
-      return ret;
+   int Initialize();
+   bool Busy(void) { return busy_.IsSet();};
+
+   // the windows read source pixels the stripes above and below replace,
+   // so the frame is filtered from a copy; grey and float frames only
+   template <class Traits> int Apply( typename Traits::Type* pI, unsigned int width, unsigned int height)
+   {
+      const size_t bytes = (size_t)width * height * sizeof(typename Traits::Type);
+      if (0 == bytes)
+         return DEVICE_OK;
+      void* pSource = source_.Reserve(bytes);
+      if (NULL == pSource)
+         return DEVICE_ERR;
+      memcpy(pSource, pI, bytes);
+      return FilterFrame(static_cast<const typename Traits::Type*>(pSource), pI, width, height);
    }
+
    int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
 
    // action interface
    // ----------------
    int OnPerformanceTiming(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnMode(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPercentile(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnRadius(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnThreads(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 private:
-   bool busy_;
-   MM::MMTime performanceTiming_;
-   void*  pSmoothedIm_;
-   unsigned long sizeOfSmoothedIm_;
-   
+   void ApplyRank();
 
+   template <class T> int FilterFrame(const T*, T*, unsigned int, unsigned int) {return DEVICE_NOT_SUPPORTED;}
+   int FilterFrame(const unsigned char* src, unsigned char* dst, unsigned int width, unsigned int height)
+   {
+      filter_.Filter(src, dst, width, height);
+      return DEVICE_OK;
+   }
+   int FilterFrame(const unsigned short* src, unsigned short* dst, unsigned int width, unsigned int height)
+   {
+      filter_.Filter(src, dst, width, height);
+      return DEVICE_OK;
+   }
+   int FilterFrame(const float* src, float* dst, unsigned int width, unsigned int height)
+   {
+      filter_.Filter(src, dst, width, height);
+      return DEVICE_OK;
+   }
 
+   BusyFlag busy_;
+   MM::MMTime performanceTiming_;
+   std::string mode_;
+   double percentile_;
+   HistogramRankFilter filter_;
+   ScratchBlock source_;   // copy of the frame being filtered
 };
 
 
@@ -1284,6 +1943,94 @@ private:
 };
 
 
+class FocusTrackingThread;
+
+//////////////////////////////////////////////////////////////////////////////
+// ReconstructionAutoFocus class
+// Focuses the hologram reconstruction of the camera by searching the
+// propagation distance on the current frame
+//////////////////////////////////////////////////////////////////////////////
+class ReconstructionAutoFocus : public CAutoFocusBase<ReconstructionAutoFocus>
+{
+public:
+   ReconstructionAutoFocus();
+   ~ReconstructionAutoFocus();
+
+   // MMDevice API
+   bool Busy() {return false;}
+   void GetName(char* pszName) const;
+
+   int Initialize();
+   int Shutdown();
+
+   // AutoFocus API
+   virtual int SetContinuousFocusing(bool state);
+   virtual int GetContinuousFocusing(bool& state);
+   virtual bool IsContinuousFocusLocked();
+   virtual int FullFocus();
+   virtual int IncrementalFocus();
+   virtual int GetLastFocusScore(double& score);
+   virtual int GetCurrentFocusScore(double& score);
+   virtual int GetOffset(double& offset);
+   virtual int SetOffset(double offset);
+
+   // action interface
+   // ----------------
+   int OnCamera(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSearchMin(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSearchMax(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSearchSteps(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTolerance(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnDownsample(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFocusMetric(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTrackingStep(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTrackingInterval(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+private:
+   friend class FocusTrackingThread;
+   int FindCamera(CBaslerCamera*& camera, bool moves);
+   int LoadFrame(CBaslerCamera*& camera, bool moves);
+   int RunTrackingStep();
+
+   bool initialized_;
+   std::string cameraLabel_;
+   double searchMinUm_;
+   double searchMaxUm_;
+   long searchSteps_;
+   double toleranceUm_;
+   long downsample_;
+   double trackingStepUm_;
+   double trackingIntervalMs_;
+   double offsetUm_;
+   double lastScore_;
+   double lastMoveUm_;
+
+   FocusSearch search_;
+   MMThreadLock searchLock_;
+   FocusTrackingThread* thd_;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// FocusTrackingThread class
+// runs tracking steps of the reconstruction autofocus in continuous mode
+//////////////////////////////////////////////////////////////////////////////
+class FocusTrackingThread : public MMDeviceThreadBase
+{
+public:
+   FocusTrackingThread(ReconstructionAutoFocus* pFocus) : stop_(true), focus_(pFocus) {}
+   ~FocusTrackingThread() {}
+   void Start();
+   void Stop();
+   bool IsStopped();
+
+private:
+   int svc(void) throw();
+   bool stop_;
+   ReconstructionAutoFocus* focus_;
+   MMThreadLock stopLock_;
+};
+
+
 
 
 
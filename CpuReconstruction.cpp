@@ -0,0 +1,1823 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          CpuReconstruction.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   CPU angular spectrum reconstruction backend for the
+//                Basler camera adapter, float32 reference path plus half
+//                precision storage of the spectra and an int16 fixed point
+//                mode whose butterflies run on eight rows or columns at once
+//                in SIMD lanes. Every pass is split into
+//                independent rows or column blocks that the worker pool
+//                spreads across threads.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "CpuReconstruction.h"
+#include "PixelKernels.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+// SSE2 is part of every x64 target and of x86 builds for it
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define RECONSTRUCTION_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+   const double cPi = 3.14159265358979;
+
+   // std::complex multiplication goes through the C99 NaN recovery path on
+   // some compilers, which is far too slow for the butterflies
+   inline Complex Mul(const Complex& a, const Complex& b)
+   {
+      return Complex(a.real()*b.real() - a.imag()*b.imag(), a.real()*b.imag() + a.imag()*b.real());
+   }
+
+   inline Complex Twiddle(const Complex& w, bool inverse)
+   {
+      return inverse ? Complex(w.real(), -w.imag()) : w;
+   }
+
+   inline float Norm(const Complex& v)
+   {
+      return v.real()*v.real() + v.imag()*v.imag();
+   }
+
+   inline unsigned short ToWord(float v)
+   {
+      return (v >= 65534.5f) ? 65535 : (unsigned short)(v + 0.5f);
+   }
+
+   /**
+   * Spectrum storage types, converted a run of values at a time.
+   * LoadRow() returns the values of 'src' as Complex, in 'buffer' if they
+   * need converting; RowBuffer() gives where to build values bound for
+   * 'dst' and StoreRow() then writes them there.
+   */
+   inline const Complex* LoadRow(const Complex* src, size_t, Complex*) {return src;}
+   inline Complex* RowBuffer(Complex* dst, Complex*) {return dst;}
+   inline void StoreRow(const Complex* values, Complex* dst, size_t n)
+   {
+      if (values != dst)
+         memcpy(dst, values, n * sizeof(Complex));
+   }
+
+   inline const Complex* LoadRow(const HalfComplex* src, size_t n, Complex* buffer)
+   {
+      Kernels().halfToFloat(&src->re, reinterpret_cast<float*>(buffer), 2 * n);
+      return buffer;
+   }
+   inline Complex* RowBuffer(HalfComplex*, Complex* buffer) {return buffer;}
+   inline void StoreRow(const Complex* values, HalfComplex* dst, size_t n)
+   {
+      Kernels().floatToHalf(reinterpret_cast<const float*>(values), &dst->re, 2 * n);
+   }
+
+   // fixed point helpers
+   inline short SaturateToShort(int v)
+   {
+      return (short)((v > 32767) ? 32767 : ((v < -32768) ? -32768 : v));
+   }
+
+   inline short ToQ15(double v)
+   {
+      return SaturateToShort((int)floor(v * 32767.0 + 0.5));
+   }
+
+   // (re, -im) and (im, re) pairs of a Q15 twiddle, see FixedFFTPlan
+   inline void SetTwiddle(FixedComplex& re, FixedComplex& im, double wr, double wi)
+   {
+      re.re = ToQ15(wr);
+      re.im = ToQ15(-wi);
+      im.re = ToQ15(wi);
+      im.im = ToQ15(wr);
+   }
+
+   const int cLanes = FixedFFTPlan::cLanes;
+
+   /**
+   * Eight int16 lanes of the fixed point transforms, one sequence per lane.
+   * Complex products go through (re, im) pairs: a pair times a (wr, -wi)
+   * twiddle pair is re * wr - im * wi, summed exactly in 32 bit and
+   * rounded once, which is what pmaddwd does for four lanes.
+   */
+#ifdef RECONSTRUCTION_SSE2
+   typedef __m128i Lanes;
+
+   struct LanePairs
+   {
+      __m128i lo;
+      __m128i hi;
+   };
+
+   struct LaneSums
+   {
+      __m128i reLo, reHi;
+      __m128i imLo, imHi;
+   };
+
+   inline Lanes LoadLanes(const short* p) {return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));}
+   inline void StoreLanes(short* p, Lanes v) {_mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);}
+   inline Lanes ZeroLanes() {return _mm_setzero_si128();}
+   inline Lanes Add(Lanes a, Lanes b) {return _mm_add_epi16(a, b);}
+   inline Lanes Sub(Lanes a, Lanes b) {return _mm_sub_epi16(a, b);}
+
+   inline Lanes ShiftRound(Lanes v, int shift)
+   {
+      if (shift <= 0)
+         return v;
+      if (shift > 15)
+         return _mm_setzero_si128();
+      return _mm_sra_epi16(_mm_adds_epi16(v, _mm_set1_epi16((short)(1 << (shift - 1)))), _mm_cvtsi32_si128(shift));
+   }
+
+   // running maximum of |v|
+   inline Lanes MaxAbs(Lanes peak, Lanes v)
+   {
+      return _mm_max_epi16(peak, _mm_max_epi16(v, _mm_subs_epi16(_mm_setzero_si128(), v)));
+   }
+
+   inline int MaxLane(Lanes v)
+   {
+      v = _mm_max_epi16(v, _mm_srli_si128(v, 8));
+      v = _mm_max_epi16(v, _mm_srli_si128(v, 4));
+      v = _mm_max_epi16(v, _mm_srli_si128(v, 2));
+      return (short)_mm_cvtsi128_si32(v);
+   }
+
+   inline LanePairs Pairs(Lanes re, Lanes im)
+   {
+      LanePairs p;
+      p.lo = _mm_unpacklo_epi16(re, im);
+      p.hi = _mm_unpackhi_epi16(re, im);
+      return p;
+   }
+
+   inline void ClearSums(LaneSums& s)
+   {
+      s.reLo = s.reHi = s.imLo = s.imHi = _mm_setzero_si128();
+   }
+
+   // twiddle pairs of lanes 0-3 and 4-7, loaded from FixedComplex arrays
+   inline LanePairs LoadPairs(const FixedComplex* w)
+   {
+      LanePairs p;
+      p.lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w));
+      p.hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + 4));
+      return p;
+   }
+
+   // the same twiddle pair in every lane
+   inline LanePairs BroadcastPair(const FixedComplex& w)
+   {
+      int bits;
+      memcpy(&bits, &w, sizeof(bits));
+      LanePairs p;
+      p.lo = p.hi = _mm_set1_epi32(bits);
+      return p;
+   }
+
+   inline void MulAdd(LaneSums& s, const LanePairs& v, const LanePairs& wRe, const LanePairs& wIm)
+   {
+      s.reLo = _mm_add_epi32(s.reLo, _mm_madd_epi16(v.lo, wRe.lo));
+      s.reHi = _mm_add_epi32(s.reHi, _mm_madd_epi16(v.hi, wRe.hi));
+      s.imLo = _mm_add_epi32(s.imLo, _mm_madd_epi16(v.lo, wIm.lo));
+      s.imHi = _mm_add_epi32(s.imHi, _mm_madd_epi16(v.hi, wIm.hi));
+   }
+
+   // Q15 rounding of the sums, saturated to int16
+   inline void RoundSums(const LaneSums& s, Lanes& re, Lanes& im)
+   {
+      const __m128i half = _mm_set1_epi32(1 << 14);
+      re = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(s.reLo, half), 15), _mm_srai_epi32(_mm_add_epi32(s.reHi, half), 15));
+      im = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(s.imLo, half), 15), _mm_srai_epi32(_mm_add_epi32(s.imHi, half), 15));
+   }
+
+   // cLanes consecutive complex elements to and from lane order
+   inline void Deinterleave(const FixedComplex* p, Lanes& re, Lanes& im)
+   {
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+      const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 4));
+      re = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+      im = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+   }
+
+   inline void Interleave(Lanes re, Lanes im, FixedComplex* p)
+   {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_unpacklo_epi16(re, im));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 4), _mm_unpackhi_epi16(re, im));
+   }
+
+   /**
+   * Gathers the complex elements [x, x + count) of cLanes rows into lane
+   * order; absent rows are NULL and read as zero.
+   */
+   void GatherRows(const FixedComplex* const* rows, int x, int count, short* re, short* im)
+   {
+      const __m128i zero = _mm_setzero_si128();
+      int i = 0;
+      for (; i + 4 <= count; i += 4)
+      {
+         // 8x8 transpose of four complex elements of each row: the
+         // outputs are re and im of element 0, re and im of element 1, ...
+         __m128i v[cLanes];
+         for (int l = 0; l < cLanes; ++l)
+            v[l] = rows[l] ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[l] + x + i)) : zero;
+         __m128i t[cLanes];
+         for (int l = 0; l < cLanes; l += 2)
+         {
+            t[l] = _mm_unpacklo_epi16(v[l], v[l + 1]);
+            t[l + 1] = _mm_unpackhi_epi16(v[l], v[l + 1]);
+         }
+         __m128i u[cLanes];
+         for (int h = 0; h < cLanes; h += 4)
+         {
+            u[h] = _mm_unpacklo_epi32(t[h], t[h + 2]);
+            u[h + 1] = _mm_unpackhi_epi32(t[h], t[h + 2]);
+            u[h + 2] = _mm_unpacklo_epi32(t[h + 1], t[h + 3]);
+            u[h + 3] = _mm_unpackhi_epi32(t[h + 1], t[h + 3]);
+         }
+         for (int e = 0; e < 4; ++e)
+         {
+            StoreLanes(re + cLanes * (i + e), _mm_unpacklo_epi64(u[e], u[e + 4]));
+            StoreLanes(im + cLanes * (i + e), _mm_unpackhi_epi64(u[e], u[e + 4]));
+         }
+      }
+      for (; i < count; ++i)
+      {
+         for (int l = 0; l < cLanes; ++l)
+         {
+            re[cLanes * i + l] = rows[l] ? rows[l][x + i].re : 0;
+            im[cLanes * i + l] = rows[l] ? rows[l][x + i].im : 0;
+         }
+      }
+   }
+
+   // the reverse of GatherRows(), NULL rows are skipped
+   void ScatterRows(const short* re, const short* im, int x, int count, FixedComplex* const* rows)
+   {
+      int i = 0;
+      for (; i + 4 <= count; i += 4)
+      {
+         // element e of rows 0-3 and 4-7 as (re, im) pairs, then a 4x4
+         // transpose of the pairs for each half
+         __m128i p[8];
+         for (int e = 0; e < 4; ++e)
+         {
+            const Lanes r = LoadLanes(re + cLanes * (i + e));
+            const Lanes m = LoadLanes(im + cLanes * (i + e));
+            p[e] = _mm_unpacklo_epi16(r, m);
+            p[e + 4] = _mm_unpackhi_epi16(r, m);
+         }
+         for (int h = 0; h < 8; h += 4)
+         {
+            const __m128i a = _mm_unpacklo_epi32(p[h], p[h + 1]);
+            const __m128i b = _mm_unpacklo_epi32(p[h + 2], p[h + 3]);
+            const __m128i c = _mm_unpackhi_epi32(p[h], p[h + 1]);
+            const __m128i d = _mm_unpackhi_epi32(p[h + 2], p[h + 3]);
+            const __m128i out[4] = {_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b), _mm_unpacklo_epi64(c, d), _mm_unpackhi_epi64(c, d)};
+            for (int l = 0; l < 4; ++l)
+            {
+               if (rows[h + l])
+                  _mm_storeu_si128(reinterpret_cast<__m128i*>(rows[h + l] + x + i), out[l]);
+            }
+         }
+      }
+      for (; i < count; ++i)
+      {
+         for (int l = 0; l < cLanes; ++l)
+         {
+            if (rows[l])
+            {
+               rows[l][x + i].re = re[cLanes * i + l];
+               rows[l][x + i].im = im[cLanes * i + l];
+            }
+         }
+      }
+   }
+#else
+   // the same operations lane by lane
+   struct Lanes
+   {
+      short v[cLanes];
+   };
+
+   struct LanePairs
+   {
+      short re[cLanes];
+      short im[cLanes];
+   };
+
+   struct LaneSums
+   {
+      int re[cLanes];
+      int im[cLanes];
+   };
+
+   inline Lanes LoadLanes(const short* p) {Lanes v; memcpy(v.v, p, sizeof(v.v)); return v;}
+   inline void StoreLanes(short* p, const Lanes& v) {memcpy(p, v.v, sizeof(v.v));}
+   inline Lanes ZeroLanes() {Lanes v; memset(v.v, 0, sizeof(v.v)); return v;}
+
+   inline Lanes Add(const Lanes& a, const Lanes& b)
+   {
+      Lanes v;
+      for (int l = 0; l < cLanes; ++l)
+         v.v[l] = (short)(a.v[l] + b.v[l]);
+      return v;
+   }
+
+   inline Lanes Sub(const Lanes& a, const Lanes& b)
+   {
+      Lanes v;
+      for (int l = 0; l < cLanes; ++l)
+         v.v[l] = (short)(a.v[l] - b.v[l]);
+      return v;
+   }
+
+   inline Lanes ShiftRound(const Lanes& a, int shift)
+   {
+      if (shift <= 0)
+         return a;
+      if (shift > 15)
+         return ZeroLanes();
+      Lanes v;
+      for (int l = 0; l < cLanes; ++l)
+         v.v[l] = SaturateToShort((a.v[l] + (1 << (shift - 1))) >> shift);
+      return v;
+   }
+
+   inline Lanes MaxAbs(const Lanes& peak, const Lanes& a)
+   {
+      Lanes v;
+      for (int l = 0; l < cLanes; ++l)
+         v.v[l] = std::max(peak.v[l], SaturateToShort(abs(a.v[l])));
+      return v;
+   }
+
+   inline int MaxLane(const Lanes& a)
+   {
+      return *std::max_element(a.v, a.v + cLanes);
+   }
+
+   inline LanePairs Pairs(const Lanes& re, const Lanes& im)
+   {
+      LanePairs p;
+      memcpy(p.re, re.v, sizeof(p.re));
+      memcpy(p.im, im.v, sizeof(p.im));
+      return p;
+   }
+
+   inline void ClearSums(LaneSums& s)
+   {
+      memset(&s, 0, sizeof(s));
+   }
+
+   inline LanePairs LoadPairs(const FixedComplex* w)
+   {
+      LanePairs p;
+      for (int l = 0; l < cLanes; ++l)
+      {
+         p.re[l] = w[l].re;
+         p.im[l] = w[l].im;
+      }
+      return p;
+   }
+
+   inline LanePairs BroadcastPair(const FixedComplex& w)
+   {
+      LanePairs p;
+      for (int l = 0; l < cLanes; ++l)
+      {
+         p.re[l] = w.re;
+         p.im[l] = w.im;
+      }
+      return p;
+   }
+
+   inline void MulAdd(LaneSums& s, const LanePairs& v, const LanePairs& wRe, const LanePairs& wIm)
+   {
+      for (int l = 0; l < cLanes; ++l)
+      {
+         s.re[l] += v.re[l] * wRe.re[l] + v.im[l] * wRe.im[l];
+         s.im[l] += v.re[l] * wIm.re[l] + v.im[l] * wIm.im[l];
+      }
+   }
+
+   inline void RoundSums(const LaneSums& s, Lanes& re, Lanes& im)
+   {
+      for (int l = 0; l < cLanes; ++l)
+      {
+         re.v[l] = SaturateToShort((s.re[l] + (1 << 14)) >> 15);
+         im.v[l] = SaturateToShort((s.im[l] + (1 << 14)) >> 15);
+      }
+   }
+
+   inline void Deinterleave(const FixedComplex* p, Lanes& re, Lanes& im)
+   {
+      for (int l = 0; l < cLanes; ++l)
+      {
+         re.v[l] = p[l].re;
+         im.v[l] = p[l].im;
+      }
+   }
+
+   inline void Interleave(const Lanes& re, const Lanes& im, FixedComplex* p)
+   {
+      for (int l = 0; l < cLanes; ++l)
+      {
+         p[l].re = re.v[l];
+         p[l].im = im.v[l];
+      }
+   }
+
+   void GatherRows(const FixedComplex* const* rows, int x, int count, short* re, short* im)
+   {
+      for (int i = 0; i < count; ++i)
+      {
+         for (int l = 0; l < cLanes; ++l)
+         {
+            re[cLanes * i + l] = rows[l] ? rows[l][x + i].re : 0;
+            im[cLanes * i + l] = rows[l] ? rows[l][x + i].im : 0;
+         }
+      }
+   }
+
+   void ScatterRows(const short* re, const short* im, int x, int count, FixedComplex* const* rows)
+   {
+      for (int i = 0; i < count; ++i)
+      {
+         for (int l = 0; l < cLanes; ++l)
+         {
+            if (rows[l])
+            {
+               rows[l][x + i].re = re[cLanes * i + l];
+               rows[l][x + i].im = im[cLanes * i + l];
+            }
+         }
+      }
+   }
+#endif
+
+   // multiplies the lanes by twiddle pairs, rounding once
+   inline void Rotate(Lanes& re, Lanes& im, const LanePairs& wRe, const LanePairs& wIm)
+   {
+      LaneSums s;
+      ClearSums(s);
+      MulAdd(s, Pairs(re, im), wRe, wIm);
+      RoundSums(s, re, im);
+   }
+
+   // grows a per thread buffer; called by the thread that uses it
+   template <class T> T* Reserve(std::vector<T>& buffer, size_t size)
+   {
+      if (buffer.size() < size)
+         buffer.resize(size);
+      return &buffer[0];
+   }
+
+   // columns gathered per block of the column passes; every row access
+   // then touches a whole cache line instead of one element. The int16
+   // path transforms the columns of a block in the lanes.
+   const int cBlockCols = cLanes;
+
+   // elements of the transfer function applied to all frames of the stack
+   // before moving on
+   const size_t cTransferChunk = 4096;
+
+   // values converted at once where no per-worker buffer is at hand
+   const size_t cConvertBlock = 256;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// FFTPlan implementation
+// ~~~~~~~~~~~~~~~~~~~~~~
+
+void FFTPlan::Init(int n)
+{
+   n_ = n;
+   factors_.clear();
+   twiddles_.resize(n);
+   for (int i = 0; i < n; ++i)
+   {
+      double phase = -2.0 * cPi * i / n;
+      twiddles_[i] = Complex((float)cos(phase), (float)sin(phase));
+   }
+
+   // radix 4 first, then 2, then odd radices; whatever is left above
+   // sqrt(n) is prime and handled by the generic butterfly
+   const double floorSqrt = floor(sqrt((double)n));
+   int p = 4;
+   int rest = n;
+   maxRadix_ = 1;
+   do
+   {
+      while (rest % p)
+      {
+         switch (p)
+         {
+         case 4: p = 2; break;
+         case 2: p = 3; break;
+         default: p += 2; break;
+         }
+         if (p > floorSqrt)
+            p = rest;
+      }
+      rest /= p;
+      factors_.push_back(p);
+      factors_.push_back(rest);
+      maxRadix_ = std::max(maxRadix_, p);
+   } while (rest > 1);
+}
+
+void FFTPlan::Execute(Complex* data, int stride, int count, int dist, bool inverse, Complex* scratch) const
+{
+   Complex* in = scratch;
+   Complex* tmp = scratch + n_;
+   Complex* bfly = scratch + 2 * n_;
+   for (int c = 0; c < count; ++c)
+   {
+      Complex* seq = data + (size_t)c * dist;
+      if (1 == stride)
+      {
+         memcpy(in, seq, n_ * sizeof(Complex));
+         Work(seq, in, 1, &factors_[0], inverse, bfly);
+      }
+      else
+      {
+         for (int i = 0; i < n_; ++i)
+            in[i] = seq[(size_t)i * stride];
+         Work(tmp, in, 1, &factors_[0], inverse, bfly);
+         for (int i = 0; i < n_; ++i)
+            seq[(size_t)i * stride] = tmp[i];
+      }
+   }
+}
+
+void FFTPlan::Transform(const Complex* in, Complex* out, bool inverse, Complex* scratch) const
+{
+   Work(out, in, 1, &factors_[0], inverse, scratch);
+}
+
+void FFTPlan::Work(Complex* out, const Complex* in, int fstride, const int* factors, bool inverse, Complex* scratch) const
+{
+   Complex* outBegin = out;
+   const int p = *factors++;
+   const int m = *factors++;
+   const Complex* outEnd = out + p * m;
+
+   if (1 == m)
+   {
+      do
+      {
+         *out = *in;
+         in += fstride;
+      } while (++out != outEnd);
+   }
+   else
+   {
+      do
+      {
+         // decimation in time: each sub-transform reads every p-th input
+         Work(out, in, fstride * p, factors, inverse, scratch);
+         in += fstride;
+      } while ((out += m) != outEnd);
+   }
+
+   out = outBegin;
+   switch (p)
+   {
+   case 2: Butterfly2(out, fstride, m, inverse); break;
+   case 4: Butterfly4(out, fstride, m, inverse); break;
+   default: ButterflyGeneric(out, fstride, m, p, inverse, scratch); break;
+   }
+}
+
+void FFTPlan::Butterfly2(Complex* out, int fstride, int m, bool inverse) const
+{
+   Complex* out2 = out + m;
+   const Complex* tw = &twiddles_[0];
+   for (int k = 0; k < m; ++k)
+   {
+      Complex t = Mul(out2[k], Twiddle(*tw, inverse));
+      tw += fstride;
+      out2[k] = out[k] - t;
+      out[k] += t;
+   }
+}
+
+void FFTPlan::Butterfly4(Complex* out, int fstride, int m, bool inverse) const
+{
+   const Complex* tw1 = &twiddles_[0];
+   const Complex* tw2 = tw1;
+   const Complex* tw3 = tw1;
+   const int m2 = 2 * m;
+   const int m3 = 3 * m;
+   for (int k = 0; k < m; ++k, ++out)
+   {
+      Complex s0 = Mul(out[m], Twiddle(*tw1, inverse));
+      Complex s1 = Mul(out[m2], Twiddle(*tw2, inverse));
+      Complex s2 = Mul(out[m3], Twiddle(*tw3, inverse));
+      Complex s5 = out[0] - s1;
+      out[0] += s1;
+      Complex s3 = s0 + s2;
+      Complex s4 = s0 - s2;
+      out[m2] = out[0] - s3;
+      out[0] += s3;
+      tw1 += fstride;
+      tw2 += fstride * 2;
+      tw3 += fstride * 3;
+      if (inverse)
+      {
+         out[m] = Complex(s5.real() - s4.imag(), s5.imag() + s4.real());
+         out[m3] = Complex(s5.real() + s4.imag(), s5.imag() - s4.real());
+      }
+      else
+      {
+         out[m] = Complex(s5.real() + s4.imag(), s5.imag() - s4.real());
+         out[m3] = Complex(s5.real() - s4.imag(), s5.imag() + s4.real());
+      }
+   }
+}
+
+void FFTPlan::ButterflyGeneric(Complex* out, int fstride, int m, int p, bool inverse, Complex* scratch) const
+{
+   for (int u = 0; u < m; ++u)
+   {
+      int k = u;
+      for (int q1 = 0; q1 < p; ++q1, k += m)
+         scratch[q1] = out[k];
+
+      k = u;
+      for (int q1 = 0; q1 < p; ++q1, k += m)
+      {
+         int twidx = 0;
+         Complex acc = scratch[0];
+         for (int q = 1; q < p; ++q)
+         {
+            twidx += fstride * k;
+            if (twidx >= n_)
+               twidx -= n_;
+            acc += Mul(scratch[q], Twiddle(twiddles_[twidx], inverse));
+         }
+         out[k] = acc;
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// FixedFFTPlan implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void FixedFFTPlan::Init(int n)
+{
+   n_ = n;
+   radices_.clear();
+   twiddleRe_.resize(2 * n);
+   twiddleIm_.resize(2 * n);
+   for (int i = 0; i < n; ++i)
+   {
+      double phase = -2.0 * cPi * i / n;
+      SetTwiddle(twiddleRe_[i], twiddleIm_[i], cos(phase), sin(phase));
+      SetTwiddle(twiddleRe_[n + i], twiddleIm_[n + i], cos(phase), -sin(phase));
+   }
+
+   int p = 4;
+   int rest = n;
+   maxRadix_ = 1;
+   while (rest > 1)
+   {
+      while (rest % p)
+         p = (4 == p) ? 2 : ((2 == p) ? 3 : p + 2);
+      rest /= p;
+      radices_.push_back(p);
+      maxRadix_ = std::max(maxRadix_, p);
+   }
+}
+
+namespace
+{
+   /**
+   * One radix p stage of the self sorting decimation in frequency FFT:
+   * the inputs x[q + s*(pp + k*m)], k < p, scaled down by 'shift', give
+   * the outputs y[q + s*(p*pp + t)], rotated by w^(pp*t*s). Sequences are
+   * arrays of lanes; 'peak' collects the largest output component.
+   */
+   struct FixedStage
+   {
+      const short* xr;
+      const short* xi;
+      short* yr;
+      short* yi;
+      int n;         // sequence length
+      int m;         // sub-sequences
+      int s;         // lanes stride of the stage
+      int shift;
+      bool inverse;
+      const FixedComplex* twRe;   // forward or inverse twiddles
+      const FixedComplex* twIm;
+   };
+
+   inline Lanes LoadShifted(const short* p, int shift)
+   {
+      return ShiftRound(LoadLanes(p), shift);
+   }
+
+   inline void StoreOutput(short* yr, short* yi, int index, const Lanes& re, const Lanes& im, Lanes& peak)
+   {
+      StoreLanes(yr + cLanes * index, re);
+      StoreLanes(yi + cLanes * index, im);
+      peak = MaxAbs(MaxAbs(peak, re), im);
+   }
+
+   void FixedRadix2(const FixedStage& st, Lanes& peak)
+   {
+      const int step = st.s * st.m;
+      for (int pp = 0; pp < st.m; ++pp)
+      {
+         const int tw = pp * st.s;
+         const LanePairs wRe = BroadcastPair(st.twRe[tw]);
+         const LanePairs wIm = BroadcastPair(st.twIm[tw]);
+         for (int q = 0; q < st.s; ++q)
+         {
+            const int in = q + st.s * pp;
+            const Lanes ar = LoadShifted(st.xr + cLanes * in, st.shift);
+            const Lanes ai = LoadShifted(st.xi + cLanes * in, st.shift);
+            const Lanes br = LoadShifted(st.xr + cLanes * (in + step), st.shift);
+            const Lanes bi = LoadShifted(st.xi + cLanes * (in + step), st.shift);
+
+            const int out = q + st.s * 2 * pp;
+            StoreOutput(st.yr, st.yi, out, Add(ar, br), Add(ai, bi), peak);
+            Lanes yr = Sub(ar, br);
+            Lanes yi = Sub(ai, bi);
+            if (tw)
+               Rotate(yr, yi, wRe, wIm);
+            StoreOutput(st.yr, st.yi, out + st.s, yr, yi, peak);
+         }
+      }
+   }
+
+   void FixedRadix4(const FixedStage& st, Lanes& peak)
+   {
+      const int step = st.s * st.m;
+      for (int pp = 0; pp < st.m; ++pp)
+      {
+         LanePairs wRe[4];
+         LanePairs wIm[4];
+         for (int t = 1; t < 4; ++t)
+         {
+            wRe[t] = BroadcastPair(st.twRe[pp * t * st.s]);
+            wIm[t] = BroadcastPair(st.twIm[pp * t * st.s]);
+         }
+         for (int q = 0; q < st.s; ++q)
+         {
+            const int in = q + st.s * pp;
+            Lanes ar[4];
+            Lanes ai[4];
+            for (int k = 0; k < 4; ++k)
+            {
+               ar[k] = LoadShifted(st.xr + cLanes * (in + k * step), st.shift);
+               ai[k] = LoadShifted(st.xi + cLanes * (in + k * step), st.shift);
+            }
+            const Lanes b0r = Add(ar[0], ar[2]);
+            const Lanes b0i = Add(ai[0], ai[2]);
+            const Lanes b1r = Sub(ar[0], ar[2]);
+            const Lanes b1i = Sub(ai[0], ai[2]);
+            const Lanes b2r = Add(ar[1], ar[3]);
+            const Lanes b2i = Add(ai[1], ai[3]);
+            const Lanes b3r = Sub(ar[1], ar[3]);
+            const Lanes b3i = Sub(ai[1], ai[3]);
+
+            // X1 = b1 - i b3 and X3 = b1 + i b3 forward, the other way round
+            // for the inverse
+            Lanes yr[4];
+            Lanes yi[4];
+            yr[0] = Add(b0r, b2r);
+            yi[0] = Add(b0i, b2i);
+            yr[2] = Sub(b0r, b2r);
+            yi[2] = Sub(b0i, b2i);
+            const int minus = st.inverse ? 3 : 1;
+            yr[minus] = Add(b1r, b3i);
+            yi[minus] = Sub(b1i, b3r);
+            yr[4 - minus] = Sub(b1r, b3i);
+            yi[4 - minus] = Add(b1i, b3r);
+
+            const int out = q + st.s * 4 * pp;
+            StoreOutput(st.yr, st.yi, out, yr[0], yi[0], peak);
+            for (int t = 1; t < 4; ++t)
+            {
+               if (pp)
+                  Rotate(yr[t], yi[t], wRe[t], wIm[t]);
+               StoreOutput(st.yr, st.yi, out + t * st.s, yr[t], yi[t], peak);
+            }
+         }
+      }
+   }
+
+   /**
+   * Odd radices: every output t > 0 is the sum of its p inputs rotated by
+   * the combined DFT and stage twiddle w^(pp*t*s + t*k*n/p), accumulated
+   * in 32 bit and rounded once. 'work' holds the p input pairs.
+   */
+   void FixedRadixGeneric(const FixedStage& st, int p, Lanes& peak, short* work)
+   {
+      const int step = st.s * st.m;
+      const int pStride = st.n / p;
+      const int pairShorts = sizeof(LanePairs) / sizeof(short);
+      for (int pp = 0; pp < st.m; ++pp)
+      {
+         for (int q = 0; q < st.s; ++q)
+         {
+            const int in = q + st.s * pp;
+            Lanes sumR = ZeroLanes();
+            Lanes sumI = ZeroLanes();
+            for (int k = 0; k < p; ++k)
+            {
+               const Lanes r = LoadShifted(st.xr + cLanes * (in + k * step), st.shift);
+               const Lanes i = LoadShifted(st.xi + cLanes * (in + k * step), st.shift);
+               sumR = Add(sumR, r);
+               sumI = Add(sumI, i);
+               const LanePairs pair = Pairs(r, i);
+               memcpy(work + pairShorts * k, &pair, sizeof(pair));
+            }
+
+            const int out = q + st.s * p * pp;
+            StoreOutput(st.yr, st.yi, out, sumR, sumI, peak);
+            for (int t = 1; t < p; ++t)
+            {
+               const int advance = t * pStride;
+               int tw = pp * t * st.s;
+               LaneSums sums;
+               ClearSums(sums);
+               for (int k = 0; k < p; ++k)
+               {
+                  LanePairs pair;
+                  memcpy(&pair, work + pairShorts * k, sizeof(pair));
+                  MulAdd(sums, pair, BroadcastPair(st.twRe[tw]), BroadcastPair(st.twIm[tw]));
+                  tw += advance;
+                  if (tw >= st.n)
+                     tw -= st.n;
+               }
+               Lanes yr, yi;
+               RoundSums(sums, yr, yi);
+               StoreOutput(st.yr, st.yi, out + t * st.s, yr, yi, peak);
+            }
+         }
+      }
+   }
+}
+
+int FixedFFTPlan::Transform(short* re, short* im, bool inverse, short* scratch) const
+{
+   FixedStage st;
+   st.n = n_;
+   st.inverse = inverse;
+   st.twRe = &twiddleRe_[inverse ? n_ : 0];
+   st.twIm = &twiddleIm_[inverse ? n_ : 0];
+   short* xr = re;
+   short* xi = im;
+   short* yr = scratch;
+   short* yi = scratch + cLanes * n_;
+   short* work = scratch + 2 * cLanes * n_;
+
+   Lanes peakLanes = ZeroLanes();
+   for (int i = 0; i < n_; ++i)
+      peakLanes = MaxAbs(MaxAbs(peakLanes, LoadLanes(xr + cLanes * i)), LoadLanes(xi + cLanes * i));
+   int peak = MaxLane(peakLanes);
+
+   int exponent = 0;
+   int nCur = n_;
+   int s = 1;
+   for (size_t r = 0; r < radices_.size(); ++r)
+   {
+      const int p = radices_[r];
+
+      // p terms of magnitude sqrt(2) * peak must fit in int16; the
+      // rounding of the shift adds one
+      int shift = 0;
+      while (((peak >> shift) + 1) * p * 1.4143 > 32767.0)
+         ++shift;
+      exponent += shift;
+
+      st.xr = xr;
+      st.xi = xi;
+      st.yr = yr;
+      st.yi = yi;
+      st.m = nCur / p;
+      st.s = s;
+      st.shift = shift;
+      peakLanes = ZeroLanes();
+      switch (p)
+      {
+      case 2: FixedRadix2(st, peakLanes); break;
+      case 4: FixedRadix4(st, peakLanes); break;
+      default: FixedRadixGeneric(st, p, peakLanes, work); break;
+      }
+      peak = MaxLane(peakLanes);
+
+      std::swap(xr, yr);
+      std::swap(xi, yi);
+      nCur /= p;
+      s *= p;
+   }
+
+   if (xr != re)
+   {
+      memcpy(re, xr, cLanes * n_ * sizeof(short));
+      memcpy(im, xi, cLanes * n_ * sizeof(short));
+   }
+   return exponent;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CpuReconstructor implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+CpuReconstructor::CpuReconstructor() :
+   width_(0),
+   height_(0),
+   paddedX_(0),
+   paddedY_(0),
+   distanceUm_(RECONSTRUCTION_DEFAULT_DISTANCE_UM),
+   wavelengthNm_(RECONSTRUCTION_DEFAULT_WAVELENGTH_NM),
+   pixelPitchUm_(RECONSTRUCTION_DEFAULT_PIXELPITCH_UM),
+   precision_(PRECISION_FLOAT32),
+   output_(OUTPUT_INTENSITY8),
+   cacheSize_(RECONSTRUCTION_DEFAULT_CACHE_SIZE)
+{
+   for (int i = 0; i < 256; ++i)
+   {
+      amplitudeLut_[i] = (float)sqrt((double)i);
+      amplitudeQ9_[i] = (short)floor(sqrt((double)i) * 512.0 + 0.5);
+   }
+}
+
+void CpuReconstructor::Init(int width, int height, int* bx, int* by)
+{
+   int blockX = (*bx > 0) ? *bx : 1;
+   int blockY = (*by > 0) ? *by : 1;
+
+   width_ = width;
+   height_ = height;
+   paddedX_ = ((width + blockX - 1) / blockX) * blockX;
+   paddedY_ = ((height + blockY - 1) / blockY) * blockY;
+   *bx = paddedX_;
+   *by = paddedY_;
+
+   rowPlan_.Init(paddedX_);
+   colPlan_.Init(paddedY_);
+   rowFixed_.Init(paddedX_);
+   colFixed_.Init(paddedY_);
+
+   stack_.clear();
+   stackHalf_.clear();
+   stackFixed_.clear();
+
+   // cached transfer functions belong to the old padded size
+   planes_.clear();
+   transferCache_.clear();
+   UpdatePlanes(0);
+}
+
+void CpuReconstructor::SetGeometry(double distanceUm, double wavelengthNm, double pixelPitchUm, TransferList* computed)
+{
+   distanceUm_ = distanceUm;
+   wavelengthNm_ = wavelengthNm;
+   pixelPitchUm_ = pixelPitchUm;
+   UpdatePlanes(computed);
+}
+
+void CpuReconstructor::SetPlanes(const std::vector<double>& distancesUm, TransferList* computed)
+{
+   planeDistances_ = distancesUm;
+   UpdatePlanes(computed);
+}
+
+void CpuReconstructor::MissingForGeometry(double distanceUm, double wavelengthNm, double pixelPitchUm, TransferList& missing) const
+{
+   missing.clear();
+   if (planeDistances_.empty())
+      AddMissing(distanceUm, wavelengthNm, pixelPitchUm, missing);
+   for (size_t p = 0; p < planeDistances_.size(); ++p)
+      AddMissing(planeDistances_[p], wavelengthNm, pixelPitchUm, missing);
+}
+
+void CpuReconstructor::MissingForPlanes(const std::vector<double>& distancesUm, TransferList& missing) const
+{
+   missing.clear();
+   if (distancesUm.empty())
+      AddMissing(distanceUm_, wavelengthNm_, pixelPitchUm_, missing);
+   for (size_t p = 0; p < distancesUm.size(); ++p)
+      AddMissing(distancesUm[p], wavelengthNm_, pixelPitchUm_, missing);
+}
+
+void CpuReconstructor::ComputeTransferFunctions(TransferList& list)
+{
+   for (TransferList::iterator it = list.begin(); it != list.end(); ++it)
+   {
+      if (it->values.empty())
+         ComputeTransferFunction(*it);
+   }
+}
+
+void CpuReconstructor::SetThreadCount(int count)
+{
+   pool_.SetThreadCount(count);
+   // the buffers are allocated again by the threads that use them
+   workerScratch_.clear();
+   workerScratch_.resize(pool_.ThreadCount());
+}
+
+void CpuReconstructor::SetCacheSize(int size)
+{
+   cacheSize_ = std::max(size, 0);
+   TrimTransferCache();
+}
+
+void CpuReconstructor::UpdatePlanes(TransferList* computed)
+{
+   planes_.clear();
+   if (!IsInitialized())
+      return;
+
+   const int planes = PlaneCount();
+   for (int p = 0; p < planes; ++p)
+      planes_.push_back(AcquireTransferFunction(PlaneDistance(p), computed));
+   TrimTransferCache();
+}
+
+namespace
+{
+   bool SameGeometry(const CpuReconstructor::TransferFunction& tf, double distanceUm, double wavelengthNm, double pixelPitchUm, int paddedX, int paddedY)
+   {
+      return tf.distanceUm == distanceUm && tf.wavelengthNm == wavelengthNm && tf.pixelPitchUm == pixelPitchUm &&
+         tf.paddedX == paddedX && tf.paddedY == paddedY;
+   }
+
+   bool ContainsGeometry(const CpuReconstructor::TransferList& list, double distanceUm, double wavelengthNm, double pixelPitchUm, int paddedX, int paddedY)
+   {
+      for (CpuReconstructor::TransferList::const_iterator it = list.begin(); it != list.end(); ++it)
+      {
+         if (SameGeometry(*it, distanceUm, wavelengthNm, pixelPitchUm, paddedX, paddedY))
+            return true;
+      }
+      return false;
+   }
+
+   CpuReconstructor::TransferList::iterator FindGeometry(CpuReconstructor::TransferList& list, double distanceUm, double wavelengthNm, double pixelPitchUm, int paddedX, int paddedY)
+   {
+      CpuReconstructor::TransferList::iterator it = list.begin();
+      while (it != list.end() && !SameGeometry(*it, distanceUm, wavelengthNm, pixelPitchUm, paddedX, paddedY))
+         ++it;
+      return it;
+   }
+}
+
+/**
+* Queues an uncomputed transfer function for a geometry the cache misses.
+*/
+void CpuReconstructor::AddMissing(double distanceUm, double wavelengthNm, double pixelPitchUm, TransferList& missing) const
+{
+   if (!IsInitialized())
+      return;
+   if (ContainsGeometry(transferCache_, distanceUm, wavelengthNm, pixelPitchUm, paddedX_, paddedY_) ||
+      ContainsGeometry(missing, distanceUm, wavelengthNm, pixelPitchUm, paddedX_, paddedY_))
+      return;
+
+   missing.push_back(TransferFunction());
+   TransferFunction& tf = missing.back();
+   tf.distanceUm = distanceUm;
+   tf.wavelengthNm = wavelengthNm;
+   tf.pixelPitchUm = pixelPitchUm;
+   tf.paddedX = paddedX_;
+   tf.paddedY = paddedY_;
+}
+
+/**
+* Looks the transfer function up in the cache and moves it to the front;
+* on a miss it is taken from 'computed' when there, computed otherwise.
+*/
+CpuReconstructor::TransferCache::iterator CpuReconstructor::AcquireTransferFunction(double distanceUm, TransferList* computed)
+{
+   TransferCache::iterator it = FindGeometry(transferCache_, distanceUm, wavelengthNm_, pixelPitchUm_, paddedX_, paddedY_);
+   if (it != transferCache_.end())
+   {
+      transferCache_.splice(transferCache_.begin(), transferCache_, it);
+      return transferCache_.begin();
+   }
+
+   if (computed)
+   {
+      it = FindGeometry(*computed, distanceUm, wavelengthNm_, pixelPitchUm_, paddedX_, paddedY_);
+      if (it != computed->end() && !it->values.empty())
+      {
+         transferCache_.splice(transferCache_.begin(), *computed, it);
+         return transferCache_.begin();
+      }
+   }
+
+   transferCache_.push_front(TransferFunction());
+   TransferFunction& tf = transferCache_.front();
+   tf.distanceUm = distanceUm;
+   tf.wavelengthNm = wavelengthNm_;
+   tf.pixelPitchUm = pixelPitchUm_;
+   tf.paddedX = paddedX_;
+   tf.paddedY = paddedY_;
+   ComputeTransferFunction(tf);
+   return transferCache_.begin();
+}
+
+/**
+* Drops the least recently used transfer functions that no plane refers to
+* once more than cacheSize_ of them are kept.
+*/
+void CpuReconstructor::TrimTransferCache()
+{
+   int unused = 0;
+   TransferCache::iterator it = transferCache_.begin();
+   while (it != transferCache_.end())
+   {
+      if (std::find(planes_.begin(), planes_.end(), it) != planes_.end() || unused++ < cacheSize_)
+         ++it;
+      else
+         it = transferCache_.erase(it);
+   }
+}
+
+void CpuReconstructor::ComputeTransferFunction(TransferFunction& tf)
+{
+   const int paddedX_ = tf.paddedX;
+   const int paddedY_ = tf.paddedY;
+   const double wavelengthUm = tf.wavelengthNm * 1e-3;
+   const double k = 2.0 * cPi / wavelengthUm;
+   const double dfx = 1.0 / (paddedX_ * tf.pixelPitchUm);
+   const double dfy = 1.0 / (paddedY_ * tf.pixelPitchUm);
+
+   // H only depends on fx^2 and fy^2: the upper half of every row and the
+   // upper half of the rows are computed, the rest is mirrored
+   tf.values.resize((size_t)paddedX_ * paddedY_);
+   tf.valuesQ15Re.clear();
+   tf.valuesQ15Im.clear();
+   for (int v = 0; v <= paddedY_ / 2; ++v)
+   {
+      const double ly = wavelengthUm * dfy * v;
+      Complex* row = &tf.values[(size_t)v * paddedX_];
+      for (int u = 0; u <= paddedX_ / 2; ++u)
+      {
+         const double lx = wavelengthUm * dfx * u;
+         const double arg = 1.0 - lx * lx - ly * ly;
+         if (arg <= 0.0)
+         {
+            // evanescent components do not reach the sensor
+            row[u] = Complex(0.f, 0.f);
+         }
+         else
+         {
+            const double phase = -k * tf.distanceUm * sqrt(arg);
+            row[u] = Complex((float)cos(phase), (float)sin(phase));
+         }
+      }
+      for (int u = paddedX_ / 2 + 1; u < paddedX_; ++u)
+         row[u] = row[paddedX_ - u];
+   }
+   for (int v = paddedY_ / 2 + 1; v < paddedY_; ++v)
+      memcpy(&tf.values[(size_t)v * paddedX_], &tf.values[(size_t)(paddedY_ - v) * paddedX_], paddedX_ * sizeof(Complex));
+}
+
+template <class S>
+void CpuReconstructor::LoadFrame(const unsigned char* frame, S* field, float scale) const
+{
+   // the hologram intensity is taken as the field amplitude, the padding
+   // is filled with the mean amplitude to keep the frame edges quiet
+   Complex buffer[cConvertBlock];
+   double sum = 0.;
+   for (int y = 0; y < height_; ++y)
+   {
+      const unsigned char* src = frame + (size_t)y * width_;
+      S* dst = field + (size_t)y * paddedX_;
+      for (int x0 = 0; x0 < width_; x0 += (int)cConvertBlock)
+      {
+         const int n = std::min((int)cConvertBlock, width_ - x0);
+         Complex* values = RowBuffer(dst + x0, buffer);
+         for (int x = 0; x < n; ++x)
+         {
+            const float a = amplitudeLut_[src[x0 + x]];
+            values[x] = Complex(a * scale, 0.f);
+            sum += a;
+         }
+         StoreRow(values, dst + x0, n);
+      }
+   }
+   const Complex meanValue((float)(scale * sum / ((double)width_ * height_)), 0.f);
+   S mean;
+   StoreRow(&meanValue, &mean, 1);
+   for (int y = 0; y < height_; ++y)
+      std::fill(field + (size_t)y * paddedX_ + width_, field + (size_t)(y + 1) * paddedX_, mean);
+   std::fill(field + (size_t)height_ * paddedX_, field + (size_t)paddedY_ * paddedX_, mean);
+}
+
+template <class S>
+class CpuReconstructor::PassTask : public WorkerPool::Task
+{
+public:
+   PassTask(CpuReconstructor& r, Pass pass, S* data) :
+      r_(r), pass_(pass), data_(data), dst(data), count(1), tf(0), scale(1.f), inverse(false), outs(0), outOffset(0)
+   {}
+
+   void Run(int begin, int end, int worker)
+   {
+      switch (pass_)
+      {
+      case PASS_ROWS: r_.RowPass(data_, begin, end, inverse, worker); break;
+      case PASS_COLUMNS: r_.ColumnPass(data_, begin, end, inverse, worker); break;
+      case PASS_TRANSFER: r_.ApplyTransferFunction(data_, dst, count, tf, scale, begin, end); break;
+      case PASS_STORE: r_.InverseAndStore(data_, outs, outOffset, begin, end, worker); break;
+      }
+   }
+
+private:
+   CpuReconstructor& r_;
+   Pass pass_;
+   S* data_;
+
+public:
+   S* dst;
+   int count;
+   const Complex* tf;
+   float scale;
+   bool inverse;
+   unsigned char* const* outs;   // output of each frame of the stack
+   size_t outOffset;             // bytes into the outputs
+};
+
+void CpuReconstructor::RunPass(WorkerPool::Task& task, int items)
+{
+   // a few chunks per thread leave room for stealing when threads are
+   // descheduled or run at different clocks
+   const int threads = pool_.ThreadCount();
+   if ((int)workerScratch_.size() < threads)
+      workerScratch_.resize(threads);
+   pool_.ParallelFor(items, std::max(1, items / (4 * threads)), task);
+}
+
+int CpuReconstructor::ColumnBlocks() const
+{
+   return (paddedX_ + cBlockCols - 1) / cBlockCols;
+}
+
+int CpuReconstructor::TransferChunks() const
+{
+   return (int)(((size_t)paddedX_ * paddedY_ + cTransferChunk - 1) / cTransferChunk);
+}
+
+template <class S>
+void CpuReconstructor::RowPass(S* rows, int begin, int end, bool inverse, int worker)
+{
+   Complex* buffer = Reserve(workerScratch_[worker].complex, std::max(rowPlan_.ScratchSize(), colPlan_.ScratchSize()));
+   Complex* out = buffer + paddedX_;
+   Complex* bfly = out + paddedX_;
+   for (int r = begin; r < end; ++r)
+   {
+      S* row = rows + (size_t)r * paddedX_;
+      rowPlan_.Transform(LoadRow(row, paddedX_, buffer), out, inverse, bfly);
+      StoreRow(out, row, paddedX_);
+   }
+}
+
+/**
+* Column blocks [blockBegin, blockEnd) of a stack of planes, ColumnBlocks()
+* per plane.
+*/
+template <class S>
+void CpuReconstructor::ColumnPass(S* stack, int blockBegin, int blockEnd, bool inverse, int worker)
+{
+   WorkerScratch& scratch = workerScratch_[worker];
+   // the block of columns, then one row of the block for the conversions
+   Complex* columns = Reserve(scratch.columns, (size_t)cBlockCols * (paddedY_ + 1));
+   Complex* buffer = columns + (size_t)cBlockCols * paddedY_;
+   Complex* out = Reserve(scratch.complex, std::max(rowPlan_.ScratchSize(), colPlan_.ScratchSize()));
+   Complex* bfly = out + paddedY_;
+   const int blocks = ColumnBlocks();
+
+   for (int b = blockBegin; b < blockEnd; ++b)
+   {
+      S* plane = stack + (size_t)(b / blocks) * paddedX_ * paddedY_;
+      const int x0 = (b % blocks) * cBlockCols;
+      const int nb = std::min(cBlockCols, paddedX_ - x0);
+      for (int y = 0; y < paddedY_; ++y)
+      {
+         const Complex* src = LoadRow(plane + (size_t)y * paddedX_ + x0, nb, buffer);
+         for (int c = 0; c < nb; ++c)
+            columns[(size_t)c * paddedY_ + y] = src[c];
+      }
+      for (int c = 0; c < nb; ++c)
+      {
+         Complex* column = columns + (size_t)c * paddedY_;
+         colPlan_.Transform(column, out, inverse, bfly);
+         memcpy(column, out, paddedY_ * sizeof(Complex));
+      }
+      for (int y = 0; y < paddedY_; ++y)
+      {
+         S* dst = plane + (size_t)y * paddedX_ + x0;
+         Complex* values = RowBuffer(dst, buffer);
+         for (int c = 0; c < nb; ++c)
+            values[c] = columns[(size_t)c * paddedY_ + y];
+         StoreRow(values, dst, nb);
+      }
+   }
+}
+
+template <class S>
+void CpuReconstructor::ApplyTransferFunction(const S* src, S* dst, int count, const Complex* tf, float scale, int chunkBegin, int chunkEnd) const
+{
+   // walk the transfer function once, applying each cached chunk to all
+   // frames of the stack before moving on; src and dst may be the same
+   const size_t planeSize = (size_t)paddedX_ * paddedY_;
+   Complex buffer[cConvertBlock];
+   for (int chunk = chunkBegin; chunk < chunkEnd; ++chunk)
+   {
+      const size_t base = chunk * cTransferChunk;
+      const size_t end = std::min(base + cTransferChunk, planeSize);
+      for (int f = 0; f < count; ++f)
+      {
+         const S* in = src + f * planeSize;
+         S* out = dst + f * planeSize;
+         for (size_t i = base; i < end; i += cConvertBlock)
+         {
+            const size_t n = std::min(cConvertBlock, end - i);
+            const Complex* values = LoadRow(in + i, n, buffer);
+            Complex* result = RowBuffer(out + i, buffer);
+            for (size_t k = 0; k < n; ++k)
+               result[k] = Mul(values[k], tf[i + k]) * scale;
+            StoreRow(result, out + i, n);
+         }
+      }
+   }
+}
+
+/**
+* Image rows [rowBegin, rowEnd) of a stack of planes, height_ per plane;
+* the rows of plane f go to outs[f] + outOffset.
+*/
+template <class S>
+void CpuReconstructor::InverseAndStore(const S* stack, unsigned char* const* outs, size_t outOffset, int rowBegin, int rowEnd, int worker)
+{
+   Complex* buffer = Reserve(workerScratch_[worker].complex, std::max(rowPlan_.ScratchSize(), colPlan_.ScratchSize()));
+   Complex* row = buffer + paddedX_;
+   Complex* bfly = row + paddedX_;
+
+   // the last row pass writes the output pixels directly, rows in the
+   // padding are never transformed back
+   const size_t lineBytes = (size_t)width_ * OutputBytesPerPixel();
+   for (int i = rowBegin; i < rowEnd; ++i)
+   {
+      const int f = i / height_;
+      const int y = i % height_;
+      const S* src = stack + ((size_t)f * paddedY_ + y) * paddedX_;
+      rowPlan_.Transform(LoadRow(src, paddedX_, buffer), row, true, bfly);
+      EmitRow(row, outs[f] + outOffset + y * lineBytes, 1.f);
+   }
+}
+
+int CpuReconstructor::OutputBytesPerPixel() const
+{
+   switch (output_)
+   {
+   case OUTPUT_INTENSITY32: return sizeof(float);
+   case OUTPUT_AMPLITUDE_PHASE: return 4 * sizeof(unsigned short);
+   default: return 1;
+   }
+}
+
+/**
+* Converts one transformed row to the output format while it is still in
+* cache. 'scale' converts the row values to the field amplitude.
+*/
+void CpuReconstructor::EmitRow(const Complex* row, unsigned char* dst, float scale) const
+{
+   const float scale2 = scale * scale;
+   switch (output_)
+   {
+   case OUTPUT_INTENSITY32:
+      {
+         float* out = reinterpret_cast<float*>(dst);
+         for (int x = 0; x < width_; ++x)
+            out[x] = Norm(row[x]) * scale2;
+      }
+      break;
+   case OUTPUT_AMPLITUDE_PHASE:
+      {
+         unsigned short* out = reinterpret_cast<unsigned short*>(dst);
+         const float amplitudeScale = (float)(scale * RECONSTRUCTION_AMPLITUDE_SCALE);
+         const float phaseScale = (float)(65535.0 / (2.0 * cPi));
+         for (int x = 0; x < width_; ++x, out += 4)
+         {
+            out[0] = ToWord(sqrt(Norm(row[x])) * amplitudeScale);
+            out[1] = ToWord((float)((atan2(row[x].imag(), row[x].real()) + cPi) * phaseScale));
+            out[2] = 0;
+            out[3] = 0;
+         }
+      }
+      break;
+   default:
+      for (int x = 0; x < width_; ++x)
+      {
+         const float intensity = Norm(row[x]) * scale2;
+         dst[x] = (intensity >= 254.5f) ? 255 : (unsigned char)(intensity + 0.5f);
+      }
+      break;
+   }
+}
+
+template <class S>
+void CpuReconstructor::ReconstructStack(const unsigned char* const* frames, int count, unsigned char* const* outs, std::vector<S>& stack, float loadScale, float transferScale)
+{
+   const size_t planeSize = (size_t)paddedX_ * paddedY_;
+   const int planes = PlaneCount();
+   // multi-plane output keeps the spectra and propagates into a work stack
+   const size_t stackSize = (planes > 1 ? 2 : 1) * count * planeSize;
+   if (stack.size() < stackSize)
+      stack.resize(stackSize);
+   S* base = &stack[0];
+
+   for (int f = 0; f < count; ++f)
+      LoadFrame(frames[f], base + f * planeSize, loadScale);
+
+   // every pass runs once over all frames of the stack
+   PassTask<S> rows(*this, PASS_ROWS, base);
+   RunPass(rows, count * paddedY_);
+   PassTask<S> columns(*this, PASS_COLUMNS, base);
+   RunPass(columns, count * ColumnBlocks());
+
+   // only the transfer function multiply and the inverse transform are
+   // repeated per plane
+   S* work = (planes > 1) ? base + count * planeSize : base;
+   const size_t planeBytes = OutputPlaneBytes();
+   for (int p = 0; p < planes; ++p)
+   {
+      PassTask<S> transfer(*this, PASS_TRANSFER, base);
+      transfer.dst = work;
+      transfer.count = count;
+      transfer.tf = &planes_[p]->values[0];
+      transfer.scale = transferScale;
+      RunPass(transfer, TransferChunks());
+      PassTask<S> inverse(*this, PASS_COLUMNS, work);
+      inverse.inverse = true;
+      RunPass(inverse, count * ColumnBlocks());
+      PassTask<S> store(*this, PASS_STORE, work);
+      store.outs = outs;
+      store.outOffset = p * planeBytes;
+      RunPass(store, count * height_);
+   }
+}
+
+class CpuReconstructor::FixedPassTask : public WorkerPool::Task
+{
+public:
+   FixedPassTask(CpuReconstructor& r, Pass pass, FixedComplex* data) :
+      r_(r), pass_(pass), data_(data), tf(0), outs(0), outOffset(0)
+   {}
+
+   void Run(int begin, int end, int worker)
+   {
+      switch (pass_)
+      {
+      case PASS_ROWS: r_.FixedRowPass(data_, begin, end, worker); break;
+      case PASS_COLUMNS: r_.FixedColumnPropagate(data_, *tf, begin, end, worker); break;
+      case PASS_STORE: r_.FixedInverseAndStore(data_, *tf, outs, outOffset, begin, end, worker); break;
+      default: break;
+      }
+   }
+
+private:
+   CpuReconstructor& r_;
+   Pass pass_;
+   FixedComplex* data_;
+
+public:
+   const TransferFunction* tf;
+   unsigned char* const* outs;   // output of each frame of the stack
+   size_t outOffset;             // bytes into the outputs
+};
+
+/**
+* Lane buffers of a worker: the real and imaginary lanes of a row or column
+* block, followed by the FFT scratch.
+*/
+short* CpuReconstructor::FixedScratch(int worker)
+{
+   const int length = std::max(paddedX_, paddedY_);
+   return Reserve(workerScratch_[worker].lanes, 2 * cLanes * length + std::max(rowFixed_.ScratchSize(), colFixed_.ScratchSize()));
+}
+
+/**
+* Groups of cLanes rows of a stack, FixedRowGroups() per frame. A group
+* never spans two frames: its rows share a block exponent, which would
+* make a frame's result depend on the frames batched with it.
+*/
+int CpuReconstructor::FixedRowGroups() const
+{
+   return (paddedY_ + cLanes - 1) / cLanes;
+}
+
+void CpuReconstructor::FixedRowPass(FixedComplex* rows, int groupBegin, int groupEnd, int worker)
+{
+   short* re = FixedScratch(worker);
+   short* im = re + cLanes * paddedX_;
+   short* bfly = im + cLanes * paddedX_;
+   const int groups = FixedRowGroups();
+   for (int g = groupBegin; g < groupEnd; ++g)
+   {
+      const int y0 = (g % groups) * cLanes;
+      const int r0 = (g / groups) * paddedY_ + y0;
+      const int n = std::min(cLanes, paddedY_ - y0);
+      FixedComplex* lanes[cLanes];
+      for (int l = 0; l < cLanes; ++l)
+         lanes[l] = (l < n) ? rows + (size_t)(r0 + l) * paddedX_ : 0;
+      GatherRows(lanes, 0, paddedX_, re, im);
+      const int exponent = rowFixed_.Transform(re, im, false, bfly);
+      ScatterRows(re, im, 0, paddedX_, lanes);
+      for (int l = 0; l < n; ++l)
+         rowExp_[r0 + l] = exponent;
+   }
+}
+
+/**
+* Column blocks [blockBegin, blockEnd) of a stack of planes, ColumnBlocks()
+* per plane.
+*/
+void CpuReconstructor::FixedColumnPropagate(FixedComplex* stack, const TransferFunction& transfer, int blockBegin, int blockEnd, int worker)
+{
+   // rows leave the row pass with the block exponents of their groups,
+   // they are aligned to the largest one of their frame while the columns
+   // are gathered
+   short* re = FixedScratch(worker);
+   short* im = re + cLanes * paddedY_;
+   short* bfly = im + cLanes * paddedY_;
+   const int blocks = ColumnBlocks();
+
+   for (int b = blockBegin; b < blockEnd; ++b)
+   {
+      const int f = b / blocks;
+      FixedComplex* plane = stack + (size_t)f * paddedX_ * paddedY_;
+      const int* rowExp = &rowExp_[(size_t)f * paddedY_];
+      const int rowMax = rowMax_[f];
+      const int x0 = (b % blocks) * cLanes;
+      const int nb = std::min(cLanes, paddedX_ - x0);
+      FixedComplex block[cLanes];
+      memset(block, 0, sizeof(block));
+      for (int y = 0; y < paddedY_; ++y)
+      {
+         const FixedComplex* src = plane + (size_t)y * paddedX_ + x0;
+         if (nb < cLanes)
+         {
+            memcpy(block, src, nb * sizeof(FixedComplex));
+            src = block;
+         }
+         Lanes r, i;
+         Deinterleave(src, r, i);
+         const int shift = rowMax - rowExp[y];
+         StoreLanes(re + cLanes * y, ShiftRound(r, shift));
+         StoreLanes(im + cLanes * y, ShiftRound(i, shift));
+      }
+
+      // forward transform, transfer function and inverse transform while
+      // the columns are in cache, so the spectrum never goes back to the plane
+      int exponent = colFixed_.Transform(re, im, false, bfly);
+      const FixedComplex* tfRe = &transfer.valuesQ15Re[x0];
+      const FixedComplex* tfIm = &transfer.valuesQ15Im[x0];
+      for (int y = 0; y < paddedY_; ++y)
+      {
+         Lanes r = LoadLanes(re + cLanes * y);
+         Lanes i = LoadLanes(im + cLanes * y);
+         Rotate(r, i, LoadPairs(tfRe + (size_t)y * paddedX_), LoadPairs(tfIm + (size_t)y * paddedX_));
+         StoreLanes(re + cLanes * y, r);
+         StoreLanes(im + cLanes * y, i);
+      }
+      exponent += colFixed_.Transform(re, im, true, bfly);
+      for (int c = 0; c < nb; ++c)
+         colExp_[(size_t)f * paddedX_ + x0 + c] = rowMax + exponent;
+
+      for (int y = 0; y < paddedY_; ++y)
+      {
+         FixedComplex* dst = plane + (size_t)y * paddedX_ + x0;
+         if (nb < cLanes)
+         {
+            Interleave(LoadLanes(re + cLanes * y), LoadLanes(im + cLanes * y), block);
+            memcpy(dst, block, nb * sizeof(FixedComplex));
+         }
+         else
+         {
+            Interleave(LoadLanes(re + cLanes * y), LoadLanes(im + cLanes * y), dst);
+         }
+      }
+   }
+}
+
+/**
+* Groups of cLanes image rows of a stack of planes, FixedStoreGroups() per
+* plane; the rows of plane f go to outs[f] + outOffset.
+*/
+int CpuReconstructor::FixedStoreGroups() const
+{
+   return (height_ + cLanes - 1) / cLanes;
+}
+
+void CpuReconstructor::FixedInverseAndStore(const FixedComplex* stack, const TransferFunction& transfer, unsigned char* const* outs, size_t outOffset, int groupBegin, int groupEnd, int worker)
+{
+   short* re = FixedScratch(worker);
+   short* im = re + cLanes * paddedX_;
+   short* bfly = im + cLanes * paddedX_;
+   Complex* row = Reserve(workerScratch_[worker].complex, std::max(rowPlan_.ScratchSize(), colPlan_.ScratchSize()));
+   const double norm = 1.0 / (512.0 * paddedX_ * paddedY_);
+   const size_t lineBytes = (size_t)width_ * OutputBytesPerPixel();
+
+   // align the columns, transform the rows back, undo the block exponents
+   // and the Q9 scaling and add the frame mean back in the output conversion
+   const int groups = FixedStoreGroups();
+   for (int g = groupBegin; g < groupEnd; ++g)
+   {
+      const int f = g / groups;
+      const FixedComplex* plane = stack + (size_t)f * paddedX_ * paddedY_;
+      const int* colExp = &colExp_[(size_t)f * paddedX_];
+      const int colMax = colMax_[f];
+      const Complex mean = Mul(Complex((float)frameMean_[f], 0.f), transfer.values[0]);
+      unsigned char* out = outs[f] + outOffset;
+      const int y0 = (g % groups) * cLanes;
+      const FixedComplex* lanes[cLanes];
+      for (int l = 0; l < cLanes; ++l)
+         lanes[l] = (y0 + l < height_) ? plane + (size_t)(y0 + l) * paddedX_ : 0;
+      GatherRows(lanes, 0, paddedX_, re, im);
+      for (int x = 0; x < paddedX_; ++x)
+      {
+         const int shift = colMax - colExp[x];
+         if (shift)
+         {
+            StoreLanes(re + cLanes * x, ShiftRound(LoadLanes(re + cLanes * x), shift));
+            StoreLanes(im + cLanes * x, ShiftRound(LoadLanes(im + cLanes * x), shift));
+         }
+      }
+      const int exponent = rowFixed_.Transform(re, im, true, bfly);
+      const float scale = (float)ldexp(norm, colMax + exponent);
+      for (int l = 0; l < cLanes && y0 + l < height_; ++l)
+      {
+         for (int x = 0; x < width_; ++x)
+            row[x] = Complex(re[cLanes * x + l] * scale + mean.real(), im[cLanes * x + l] * scale + mean.imag());
+         EmitRow(row, out + (y0 + l) * lineBytes, 1.f);
+      }
+   }
+}
+
+void CpuReconstructor::ReconstructFixed(const unsigned char* const* frames, int count, unsigned char* const* outs)
+{
+   const size_t planeSize = (size_t)paddedX_ * paddedY_;
+   const int planes = PlaneCount();
+   const size_t stackSize = (planes > 1 ? 2 : 1) * count * planeSize;
+   if (stackFixed_.size() < stackSize)
+      stackFixed_.resize(stackSize);
+   for (int p = 0; p < planes; ++p)
+   {
+      TransferFunction& tf = *planes_[p];
+      if (tf.valuesQ15Re.size() != planeSize + cLanes)
+      {
+         // a block of lanes past the end for the last column block
+         const FixedComplex zero = {0, 0};
+         tf.valuesQ15Re.assign(planeSize + cLanes, zero);
+         tf.valuesQ15Im.assign(planeSize + cLanes, zero);
+         for (size_t i = 0; i < planeSize; ++i)
+            SetTwiddle(tf.valuesQ15Re[i], tf.valuesQ15Im[i], tf.values[i].real(), tf.values[i].imag());
+      }
+   }
+   rowExp_.resize((size_t)count * paddedY_);
+   rowMax_.resize(count);
+   colExp_.resize((size_t)count * paddedX_);
+   colMax_.resize(count);
+   frameMean_.resize(count);
+   FixedComplex* base = &stackFixed_[0];
+
+   // Q9 amplitudes leave room for the first butterflies. The frame mean is
+   // taken out: it only propagates to itself times the transfer function
+   // at zero frequency, and without it the block exponents follow the
+   // detail of the hologram instead of its DC term.
+   for (int f = 0; f < count; ++f)
+   {
+      FixedComplex* field = base + f * planeSize;
+      long long sum = 0;
+      for (int y = 0; y < height_; ++y)
+      {
+         const unsigned char* src = frames[f] + (size_t)y * width_;
+         for (int x = 0; x < width_; ++x)
+            sum += amplitudeQ9_[src[x]];
+      }
+      const short mean = (short)((sum + (long long)width_ * height_ / 2) / ((long long)width_ * height_));
+      frameMean_[f] = mean / 512.0;
+      const FixedComplex zero = {0, 0};
+      for (int y = 0; y < height_; ++y)
+      {
+         const unsigned char* src = frames[f] + (size_t)y * width_;
+         FixedComplex* dst = field + (size_t)y * paddedX_;
+         for (int x = 0; x < width_; ++x)
+         {
+            dst[x].re = (short)(amplitudeQ9_[src[x]] - mean);
+            dst[x].im = 0;
+         }
+         std::fill(dst + width_, dst + paddedX_, zero);
+      }
+      std::fill(field + (size_t)height_ * paddedX_, field + planeSize, zero);
+   }
+
+   // one row pass over every row of every frame in the stack, in groups
+   // of cLanes rows of one frame
+   FixedPassTask rows(*this, PASS_ROWS, base);
+   RunPass(rows, count * FixedRowGroups());
+
+   for (int f = 0; f < count; ++f)
+      rowMax_[f] = *std::max_element(rowExp_.begin() + (size_t)f * paddedY_, rowExp_.begin() + (size_t)(f + 1) * paddedY_);
+
+   // the column transforms are fused with the transfer function, so for
+   // several planes only the row pass is shared; each plane propagates a
+   // copy of the row spectra, a single plane propagates them in place
+   FixedComplex* work = (planes > 1) ? base + count * planeSize : base;
+   const size_t planeBytes = OutputPlaneBytes();
+   for (int p = 0; p < planes; ++p)
+   {
+      if (planes > 1)
+         memcpy(work, base, count * planeSize * sizeof(FixedComplex));
+
+      FixedPassTask columns(*this, PASS_COLUMNS, work);
+      columns.tf = &*planes_[p];
+      RunPass(columns, count * ColumnBlocks());
+      for (int f = 0; f < count; ++f)
+         colMax_[f] = *std::max_element(colExp_.begin() + (size_t)f * paddedX_, colExp_.begin() + (size_t)(f + 1) * paddedX_);
+
+      FixedPassTask store(*this, PASS_STORE, work);
+      store.tf = &*planes_[p];
+      store.outs = outs;
+      store.outOffset = p * planeBytes;
+      RunPass(store, count * FixedStoreGroups());
+   }
+}
+
+void CpuReconstructor::Reconstruct(const unsigned char* frame, unsigned char* out)
+{
+   ReconstructBatch(&frame, 1, &out);
+}
+
+void CpuReconstructor::ReconstructBatch(const unsigned char* const* frames, int count, unsigned char* const* outs)
+{
+   if (!IsInitialized() || count <= 0)
+      return;
+
+   // forward and inverse transforms are unnormalized
+   const float norm = 1.f / ((float)paddedX_ * paddedY_);
+   switch (precision_)
+   {
+   case PRECISION_FLOAT16:
+      // unitary scaling keeps the spectra inside the half precision range
+      ReconstructStack(frames, count, outs, stackHalf_, sqrt(norm), sqrt(norm));
+      break;
+   case PRECISION_INT16:
+      ReconstructFixed(frames, count, outs);
+      break;
+   default:
+      ReconstructStack(frames, count, outs, stack_, 1.f, norm);
+      break;
+   }
+}
+
+void CpuReconstructor::MeasureAccuracy(const unsigned char* frame, double& maxAbsError, double& psnrDb)
+{
+   maxAbsError = 0.;
+   psnrDb = 0.;
+   if (!IsInitialized())
+      return;
+
+   const size_t size = (size_t)width_ * height_ * PlaneCount();
+   std::vector<unsigned char> reference(size);
+   std::vector<unsigned char> result(size);
+
+   const ReconstructionPrecision precision = precision_;
+   const ReconstructionOutput output = output_;
+   output_ = OUTPUT_INTENSITY8;
+   precision_ = PRECISION_FLOAT32;
+   Reconstruct(frame, &reference[0]);
+   precision_ = precision;
+   Reconstruct(frame, &result[0]);
+   output_ = output;
+
+   double sumSq = 0.;
+   for (size_t i = 0; i < size; ++i)
+   {
+      const double d = (double)result[i] - reference[i];
+      sumSq += d * d;
+      maxAbsError = std::max(maxAbsError, fabs(d));
+   }
+   const double mse = sumSq / size;
+   // identical images are reported as 100 dB
+   psnrDb = (mse > 0.) ? 10.0 * log10(255.0 * 255.0 / mse) : 100.0;
+}
@@ -0,0 +1,320 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          CpuReconstruction.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   CPU angular spectrum reconstruction backend for the
+//                Basler camera adapter. Mirrors the initReconstruction /
+//                reconstruct interface of the CUDA backend and adds a
+//                batched entry point that reconstructs a stack of frames
+//                with one FFT execution per pass, reduced precision
+//                (float16 storage, int16 fixed point) modes and multi-plane
+//                refocusing from one forward spectrum. Transfer functions
+//                are kept in a small LRU cache so geometry changes are cheap.
+//                Row, column and transfer function passes are split across
+//                a work stealing thread pool.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#ifndef _CPURECONSTRUCTION_H_
+#define _CPURECONSTRUCTION_H_
+
+#include "WorkerPool.h"
+#include <complex>
+#include <list>
+#include <vector>
+
+typedef std::complex<float> Complex;
+
+// precision of the intermediate spectra
+enum ReconstructionPrecision
+{
+   PRECISION_FLOAT32,   // float32 butterflies and storage (reference)
+   PRECISION_FLOAT16,   // float32 butterflies, half precision storage
+   PRECISION_INT16      // Q15 fixed point butterflies, int16 storage
+};
+
+// pixel format of the reconstructed image
+enum ReconstructionOutput
+{
+   OUTPUT_INTENSITY8,       // 8 bit intensity, clamped at 255
+   OUTPUT_INTENSITY32,      // float32 intensity
+   OUTPUT_AMPLITUDE_PHASE   // 64bitRGB pixels: 16 bit amplitude, 16 bit phase, two unused components
+};
+
+struct HalfComplex
+{
+   unsigned short re;
+   unsigned short im;
+};
+
+struct FixedComplex
+{
+   short re;
+   short im;
+};
+
+// default reconstruction geometry (acA2000-340km pixel pitch)
+#define RECONSTRUCTION_DEFAULT_DISTANCE_UM    1000.0
+#define RECONSTRUCTION_DEFAULT_WAVELENGTH_NM   532.0
+#define RECONSTRUCTION_DEFAULT_PIXELPITCH_UM     5.5
+
+// transfer functions kept besides the ones in use
+#define RECONSTRUCTION_DEFAULT_CACHE_SIZE        4
+
+// amplitude scale of OUTPUT_AMPLITUDE_PHASE, phase maps -pi..pi to 0..65535
+#define RECONSTRUCTION_AMPLITUDE_SCALE        2048.0
+
+//////////////////////////////////////////////////////////////////////////////
+// FFTPlan class
+// mixed radix (4, 2 and generic odd radix) complex FFT of one length
+//////////////////////////////////////////////////////////////////////////////
+class FFTPlan
+{
+public:
+   FFTPlan() : n_(0), maxRadix_(0) {}
+
+   void Init(int n);
+   int Size() const {return n_;}
+
+   // size of the scratch area (in Complex elements) Execute() needs
+   int ScratchSize() const {return 2 * n_ + maxRadix_;}
+
+   // transforms 'count' sequences of length n in place
+   // element i of sequence c is data[c*dist + i*stride]
+   void Execute(Complex* data, int stride, int count, int dist, bool inverse, Complex* scratch) const;
+
+   // single transform, contiguous in and out (out != in)
+   void Transform(const Complex* in, Complex* out, bool inverse, Complex* scratch) const;
+
+private:
+   void Work(Complex* out, const Complex* in, int fstride, const int* factors, bool inverse, Complex* scratch) const;
+   void Butterfly2(Complex* out, int fstride, int m, bool inverse) const;
+   void Butterfly4(Complex* out, int fstride, int m, bool inverse) const;
+   void ButterflyGeneric(Complex* out, int fstride, int m, int p, bool inverse, Complex* scratch) const;
+
+   int n_;
+   int maxRadix_;
+   std::vector<int> factors_;       // radix, remaining length pairs
+   std::vector<Complex> twiddles_;  // exp(-2 pi i k / n)
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// FixedFFTPlan class
+// mixed radix Stockham FFT on int16 data with Q15 twiddles, run on cLanes
+// sequences side by side in SIMD lanes. Radix 4 and 2 stages add and
+// subtract, then rotate by one twiddle; other radices sum their rotated
+// inputs in 32 bit. Each stage shifts right as far as its radix needs for
+// the peak the previous stage stored, and the shifts are returned as a
+// block exponent.
+//////////////////////////////////////////////////////////////////////////////
+class FixedFFTPlan
+{
+public:
+   // sequences transformed side by side
+   static const int cLanes = 8;
+
+   FixedFFTPlan() : n_(0), maxRadix_(0) {}
+
+   void Init(int n);
+   int Size() const {return n_;}
+
+   // size of the scratch area (in shorts) Transform() needs
+   int ScratchSize() const {return 2 * cLanes * (n_ + maxRadix_);}
+
+   // transforms cLanes sequences in place, element i of sequence l is
+   // (re[cLanes*i + l], im[cLanes*i + l]); returns the number of right
+   // shifts applied, the same for all sequences
+   int Transform(short* re, short* im, bool inverse, short* scratch) const;
+
+private:
+   int n_;
+   int maxRadix_;
+   std::vector<int> radices_;
+   // Q15 exp(-2 pi i k / n) as the (re, -im) and (im, re) pairs giving the
+   // real and imaginary part of a product; the inverse twiddles follow at n
+   std::vector<FixedComplex> twiddleRe_;
+   std::vector<FixedComplex> twiddleIm_;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// CpuReconstructor class
+// angular spectrum propagation of inline holograms on the CPU
+//////////////////////////////////////////////////////////////////////////////
+class CpuReconstructor
+{
+public:
+   struct TransferFunction
+   {
+      double distanceUm;
+      double wavelengthNm;
+      double pixelPitchUm;
+      int paddedX;
+      int paddedY;
+      std::vector<Complex> values;            // padded size, unit modulus
+      // built by the int16 path: Q15 (re, -im) and (im, re) pairs, as the
+      // twiddles of FixedFFTPlan, padded by a block of lanes
+      std::vector<FixedComplex> valuesQ15Re;
+      std::vector<FixedComplex> valuesQ15Im;
+   };
+   typedef std::list<TransferFunction> TransferList;
+
+   CpuReconstructor();
+   ~CpuReconstructor() {}
+
+   // same contract as initReconstruction(): *bx / *by carry the block size
+   // in and the padded size out
+   void Init(int width, int height, int* bx, int* by);
+   bool IsInitialized() const {return paddedX_ > 0;}
+
+   int Width() const {return width_;}
+   int Height() const {return height_;}
+   int PaddedX() const {return paddedX_;}
+   int PaddedY() const {return paddedY_;}
+
+   // positive distances propagate from the sensor back to the object plane;
+   // only the transfer functions are recomputed, and only on a cache miss.
+   // Transfer functions in 'computed' that the change needs are taken over.
+   void SetGeometry(double distanceUm, double wavelengthNm, double pixelPitchUm, TransferList* computed = 0);
+   double Distance() const {return distanceUm_;}
+   double Wavelength() const {return wavelengthNm_;}
+   double PixelPitch() const {return pixelPitchUm_;}
+
+   // reconstructs every frame at each of 'distancesUm', an empty list
+   // goes back to the single SetGeometry() distance
+   void SetPlanes(const std::vector<double>& distancesUm, TransferList* computed = 0);
+
+   /**
+   * A cache miss computes a padded size transfer function. Callers that
+   * serialize the setters with Reconstruct() can take it out of that lock:
+   * MissingForGeometry() / MissingForPlanes() list, under the lock, what
+   * the change would miss; ComputeTransferFunctions() fills the list and
+   * touches nothing else, so it runs outside; SetGeometry() / SetPlanes()
+   * then take the list back under the lock.
+   */
+   void MissingForGeometry(double distanceUm, double wavelengthNm, double pixelPitchUm, TransferList& missing) const;
+   void MissingForPlanes(const std::vector<double>& distancesUm, TransferList& missing) const;
+   static void ComputeTransferFunctions(TransferList& list);
+   int PlaneCount() const {return planeDistances_.empty() ? 1 : (int)planeDistances_.size();}
+   double PlaneDistance(int plane) const {return planeDistances_.empty() ? distanceUm_ : planeDistances_[plane];}
+
+   // number of unused transfer functions kept for reuse
+   void SetCacheSize(int size);
+   int CacheSize() const {return cacheSize_;}
+
+   void SetPrecision(ReconstructionPrecision precision) {precision_ = precision;}
+   ReconstructionPrecision GetPrecision() const {return precision_;}
+
+   // threads sharing each pass, the calling thread included
+   void SetThreadCount(int count);
+   int ThreadCount() const {return pool_.ThreadCount();}
+
+   void SetOutput(ReconstructionOutput output) {output_ = output;}
+   ReconstructionOutput GetOutput() const {return output_;}
+   int OutputBytesPerPixel() const;
+   size_t OutputPlaneBytes() const {return (size_t)width_ * height_ * OutputBytesPerPixel();}
+
+   // reconstructs 'frame' in float32 and in the current precision mode and
+   // compares the 8 bit results
+   void MeasureAccuracy(const unsigned char* frame, double& maxAbsError, double& psnrDb);
+
+   // reconstructs one width x height 8 bit frame, 'out' holds PlaneCount()
+   // consecutive planes of OutputPlaneBytes()
+   void Reconstruct(const unsigned char* frame, unsigned char* out);
+
+   // reconstructs 'count' frames with one batched FFT execution per pass
+   // and one transfer function sweep over the whole stack
+   void ReconstructBatch(const unsigned char* const* frames, int count, unsigned char* const* outs);
+
+private:
+   typedef TransferList TransferCache;
+
+   void UpdatePlanes(TransferList* computed);
+   void AddMissing(double distanceUm, double wavelengthNm, double pixelPitchUm, TransferList& missing) const;
+   TransferCache::iterator AcquireTransferFunction(double distanceUm, TransferList* computed);
+   void TrimTransferCache();
+   static void ComputeTransferFunction(TransferFunction& tf);
+
+   // one pass of the reconstruction, run over a range of rows, column
+   // blocks or transfer function chunks by the worker pool
+   enum Pass
+   {
+      PASS_ROWS,
+      PASS_COLUMNS,
+      PASS_TRANSFER,
+      PASS_STORE
+   };
+   template <class S> class PassTask;
+   class FixedPassTask;
+
+   // per thread FFT buffers, allocated by the thread that uses them so the
+   // pages land on its NUMA node
+   struct WorkerScratch
+   {
+      std::vector<Complex> complex;
+      std::vector<Complex> columns;
+      std::vector<short> lanes;
+   };
+
+   void RunPass(WorkerPool::Task& task, int items);
+   int ColumnBlocks() const;
+   int TransferChunks() const;
+
+   // float32 and float16 paths, S is the storage type of the spectra
+   template <class S> void ReconstructStack(const unsigned char* const* frames, int count, unsigned char* const* outs, std::vector<S>& stack, float loadScale, float transferScale);
+   template <class S> void LoadFrame(const unsigned char* frame, S* field, float scale) const;
+   template <class S> void RowPass(S* rows, int begin, int end, bool inverse, int worker);
+   template <class S> void ColumnPass(S* stack, int blockBegin, int blockEnd, bool inverse, int worker);
+   template <class S> void ApplyTransferFunction(const S* src, S* dst, int count, const Complex* tf, float scale, int chunkBegin, int chunkEnd) const;
+   template <class S> void InverseAndStore(const S* stack, unsigned char* const* outs, size_t outOffset, int rowBegin, int rowEnd, int worker);
+   void EmitRow(const Complex* row, unsigned char* dst, float scale) const;
+
+   // int16 path
+   void ReconstructFixed(const unsigned char* const* frames, int count, unsigned char* const* outs);
+   int FixedRowGroups() const;
+   void FixedRowPass(FixedComplex* rows, int groupBegin, int groupEnd, int worker);
+   void FixedColumnPropagate(FixedComplex* stack, const TransferFunction& tf, int blockBegin, int blockEnd, int worker);
+   int FixedStoreGroups() const;
+   void FixedInverseAndStore(const FixedComplex* stack, const TransferFunction& tf, unsigned char* const* outs, size_t outOffset, int groupBegin, int groupEnd, int worker);
+   short* FixedScratch(int worker);
+
+   int width_;
+   int height_;
+   int paddedX_;
+   int paddedY_;
+   double distanceUm_;  // single plane distance
+   double wavelengthNm_;
+   double pixelPitchUm_;
+   std::vector<double> planeDistances_;
+
+   ReconstructionPrecision precision_;
+   ReconstructionOutput output_;
+
+   FFTPlan rowPlan_;
+   FFTPlan colPlan_;
+   TransferCache transferCache_;                // most recently used first
+   std::vector<TransferCache::iterator> planes_;
+   int cacheSize_;
+   std::vector<Complex> stack_;     // count * padded size, twice for several planes
+   std::vector<HalfComplex> stackHalf_;
+   float amplitudeLut_[256];
+
+   FixedFFTPlan rowFixed_;
+   FixedFFTPlan colFixed_;
+   std::vector<FixedComplex> stackFixed_;   // mean free amplitudes, twice for several planes
+   std::vector<double> frameMean_;          // field amplitude taken out of each frame
+   std::vector<int> rowExp_;                // block exponents of the rows of each frame
+   std::vector<int> rowMax_;                // largest row exponent of each frame
+   std::vector<int> colExp_;                // block exponents of the columns of each frame
+   std::vector<int> colMax_;                // largest column exponent of each frame
+   short amplitudeQ9_[256];
+
+   WorkerPool pool_;
+   std::vector<WorkerScratch> workerScratch_;
+};
+
+#endif //_CPURECONSTRUCTION_H_
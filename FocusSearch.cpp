@@ -0,0 +1,203 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FocusSearch.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Numerical focus search for inline holograms.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "FocusSearch.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// the downsampled frame is padded to a multiple of this for FFT friendly sizes
+const int g_FocusBlock = 16;
+
+FocusSearch::FocusSearch() :
+   metric_(FOCUS_METRIC_LAPLACIAN),
+   wavelengthNm_(RECONSTRUCTION_DEFAULT_WAVELENGTH_NM),
+   pixelPitchUm_(RECONSTRUCTION_DEFAULT_PIXELPITCH_UM),
+   width_(0),
+   height_(0),
+   downsample_(0)
+{
+   reconstructor_.SetOutput(OUTPUT_INTENSITY32);
+   // every search asks for new distances, reuse is unlikely
+   reconstructor_.SetCacheSize(0);
+   reconstructor_.SetThreadCount(WorkerPool::HardwareThreads());
+}
+
+void FocusSearch::SetOptics(double wavelengthNm, double pixelPitchUm)
+{
+   wavelengthNm_ = wavelengthNm;
+   pixelPitchUm_ = pixelPitchUm;
+   downsample_ = 0;
+}
+
+void FocusSearch::SetFrame(const unsigned char* frame, int width, int height)
+{
+   frame_.assign(frame, frame + (size_t)width * height);
+   width_ = width;
+   height_ = height;
+   downsample_ = 0;
+}
+
+/**
+* Box filters the frame down by 'downsample' and sets the reconstructor up
+* for the reduced size and the correspondingly larger pixel pitch.
+*/
+void FocusSearch::Prepare(int downsample)
+{
+   downsample = std::max(1, std::min(downsample, std::min(width_, height_)));
+   if (downsample == downsample_)
+      return;
+
+   const int w = width_ / downsample;
+   const int h = height_ / downsample;
+   const int area = downsample * downsample;
+   small_.resize((size_t)w * h);
+   std::vector<int> sums(w);
+   for (int y = 0; y < h; ++y)
+   {
+      std::fill(sums.begin(), sums.end(), 0);
+      for (int dy = 0; dy < downsample; ++dy)
+      {
+         const unsigned char* src = &frame_[(size_t)(y * downsample + dy) * width_];
+         for (int x = 0; x < w; ++x)
+            for (int dx = 0; dx < downsample; ++dx)
+               sums[x] += src[x * downsample + dx];
+      }
+      unsigned char* dst = &small_[(size_t)y * w];
+      for (int x = 0; x < w; ++x)
+         dst[x] = (unsigned char)((sums[x] + area / 2) / area);
+   }
+
+   if (reconstructor_.Width() != w || reconstructor_.Height() != h)
+   {
+      int bx = g_FocusBlock;
+      int by = g_FocusBlock;
+      reconstructor_.Init(w, h, &bx, &by);
+   }
+   reconstructor_.SetGeometry(reconstructor_.Distance(), wavelengthNm_, pixelPitchUm_ * downsample);
+   downsample_ = downsample;
+}
+
+/**
+* Normalized high frequency energy of the amplitude. Both metrics are
+* divided by the squared mean amplitude so that exposure changes do not
+* move the focus.
+*/
+double FocusSearch::Sharpness(const float* plane)
+{
+   const int w = reconstructor_.Width();
+   const int h = reconstructor_.Height();
+   const size_t n = (size_t)w * h;
+   if (w < 3 || h < 3)
+      return 0.;
+
+   amplitude_.resize(n);
+   double sum = 0.;
+   for (size_t i = 0; i < n; ++i)
+   {
+      amplitude_[i] = sqrtf(plane[i]);
+      sum += amplitude_[i];
+   }
+   const double mean = sum / n;
+   if (mean <= 0.)
+      return 0.;
+
+   double energy = 0.;
+   for (int y = 1; y < h - 1; ++y)
+   {
+      const float* row = &amplitude_[(size_t)y * w];
+      for (int x = 1; x < w - 1; ++x)
+      {
+         if (FOCUS_METRIC_GRADIENT == metric_)
+         {
+            const double gx = row[x + 1] - row[x];
+            const double gy = row[x + w] - row[x];
+            energy += gx * gx + gy * gy;
+         }
+         else
+         {
+            const double l = 4. * row[x] - row[x - 1] - row[x + 1] - row[x - w] - row[x + w];
+            energy += l * l;
+         }
+      }
+   }
+   return energy / ((double)(w - 2) * (h - 2) * mean * mean);
+}
+
+void FocusSearch::Score(const double* distancesUm, int count, int downsample, double* scores)
+{
+   if (!HasFrame() || count <= 0)
+      return;
+
+   Prepare(downsample);
+   reconstructor_.SetPlanes(std::vector<double>(distancesUm, distancesUm + count));
+
+   const size_t planeSize = (size_t)reconstructor_.Width() * reconstructor_.Height();
+   planes_.resize(planeSize * count);
+   reconstructor_.Reconstruct(&small_[0], reinterpret_cast<unsigned char*>(&planes_[0]));
+   for (int i = 0; i < count; ++i)
+      scores[i] = Sharpness(&planes_[planeSize * i]);
+}
+
+double FocusSearch::Search(double minUm, double maxUm, int steps, double toleranceUm, int downsample, double& score)
+{
+   steps = std::max(steps, (int)cMinSearchSteps);
+   std::vector<double> distances(steps + 1);
+   std::vector<double> scores(steps + 1);
+
+   double lo = minUm;
+   double hi = maxUm;
+   double best = 0.5 * (lo + hi);
+   score = 0.;
+   for (int round = 0; ; ++round)
+   {
+      const double step = (hi - lo) / steps;
+      for (int i = 0; i <= steps; ++i)
+         distances[i] = lo + i * step;
+      Score(&distances[0], steps + 1, downsample, &scores[0]);
+
+      const int k = (int)(std::max_element(scores.begin(), scores.end()) - scores.begin());
+      best = distances[k];
+      score = scores[k];
+      if (step <= toleranceUm || step <= 0. || round + 1 >= cMaxSearchRounds)
+         break;
+
+      lo = std::max(minUm, best - step);
+      hi = std::min(maxUm, best + step);
+   }
+   return best;
+}
+
+double FocusSearch::Track(double distanceUm, double stepUm, int downsample, double& score)
+{
+   double distances[3] = {distanceUm - stepUm, distanceUm, distanceUm + stepUm};
+   double scores[3] = {0., 0., 0.};
+   Score(distances, 3, downsample, scores);
+
+   score = scores[1];
+   if (scores[0] > scores[1] && scores[0] >= scores[2])
+   {
+      score = scores[0];
+      return distances[0];
+   }
+   if (scores[2] > scores[1])
+   {
+      score = scores[2];
+      return distances[2];
+   }
+
+   // the middle is the best: move to the vertex of the parabola
+   const double curvature = scores[0] - 2. * scores[1] + scores[2];
+   if (curvature >= 0.)
+      return distanceUm;
+   const double offset = 0.5 * stepUm * (scores[0] - scores[2]) / curvature;
+   return distanceUm + std::max(-stepUm, std::min(stepUm, offset));
+}
@@ -0,0 +1,81 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FocusSearch.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Numerical focus search for inline holograms. Scores
+//                reconstructions of a downsampled frame at candidate
+//                propagation distances and refines coarse to fine.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#ifndef _FOCUSSEARCH_H_
+#define _FOCUSSEARCH_H_
+
+#include "CpuReconstruction.h"
+#include <vector>
+
+enum FocusMetric
+{
+   FOCUS_METRIC_LAPLACIAN,  // Laplacian energy of the amplitude
+   FOCUS_METRIC_GRADIENT    // gradient energy of the amplitude
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// FocusSearch class
+//////////////////////////////////////////////////////////////////////////////
+class FocusSearch
+{
+public:
+   // fewest grid intervals of a search: each finer grid spans two
+   // intervals of the last, so it only narrows with three or more
+   static const int cMinSearchSteps = 3;
+   // finer grids a search makes at most
+   static const int cMaxSearchRounds = 32;
+
+   FocusSearch();
+   ~FocusSearch() {}
+
+   void SetMetric(FocusMetric metric) {metric_ = metric;}
+   void SetOptics(double wavelengthNm, double pixelPitchUm);
+
+   // copies the width x height 8 bit hologram used by the next evaluations
+   void SetFrame(const unsigned char* frame, int width, int height);
+   bool HasFrame() const {return !frame_.empty();}
+
+   // scores 'count' distances with one forward transform of the frame
+   // downsampled by 'downsample'; higher is sharper
+   void Score(const double* distancesUm, int count, int downsample, double* scores);
+
+   // grid search over [minUm, maxUm] with 'steps' intervals, then finer
+   // grids around the best distance until the grid spacing is below
+   // 'toleranceUm' or cMaxSearchRounds grids were made; the raw hologram (distance 0) shows sensor noise in
+   // focus and should be left out of the range
+   double Search(double minUm, double maxUm, int steps, double toleranceUm, int downsample, double& score);
+
+   // one hill climbing step around 'distanceUm': scores distanceUm +- stepUm
+   // and returns the parabolic peak, limited to one step
+   double Track(double distanceUm, double stepUm, int downsample, double& score);
+
+private:
+   void Prepare(int downsample);
+   double Sharpness(const float* plane);
+
+   FocusMetric metric_;
+   double wavelengthNm_;
+   double pixelPitchUm_;
+
+   std::vector<unsigned char> frame_;
+   int width_;
+   int height_;
+
+   std::vector<unsigned char> small_;   // downsampled frame
+   int downsample_;                     // factor small_ was made with
+   CpuReconstructor reconstructor_;
+   std::vector<float> planes_;
+   std::vector<float> amplitude_;
+};
+
+#endif //_FOCUSSEARCH_H_
@@ -0,0 +1,342 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameReplay.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Replay of raw frame recordings through a mapped window.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "FrameReplay.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+   // bytes mapped at a time: frames are served from the window until one
+   // falls outside it. Small enough to find room in a 32 bit process.
+   const size_t cWindowBytes = (sizeof(void*) > 4) ? ((size_t)1 << 30) : ((size_t)1 << 27);
+
+   // spacing of the frames the index gives no timestamps for
+   const double cDefaultFrameRate = 30.0;
+
+#ifdef WIN32
+   // PrefetchVirtualMemory exists from Windows 8 on and is looked up at run
+   // time; older systems rely on the read-ahead of the sequential scan hint
+   struct PrefetchRange
+   {
+      PVOID address;
+      SIZE_T bytes;
+   };
+   typedef BOOL (WINAPI *PrefetchFunction)(HANDLE process, ULONG_PTR count, PrefetchRange* ranges, ULONG flags);
+
+   PrefetchFunction Prefetch()
+   {
+      static const PrefetchFunction prefetch = (PrefetchFunction)GetProcAddress(GetModuleHandleA("kernel32.dll"), "PrefetchVirtualMemory");
+      return prefetch;
+   }
+#endif
+}
+
+struct FrameReplay::Impl
+{
+#ifdef WIN32
+   Impl() : file(INVALID_HANDLE_VALUE), mapping(NULL), fileBytes(0), granularity(65536), view(NULL), viewOffset(0), viewBytes(0) {}
+
+   HANDLE file;
+   HANDLE mapping;
+#else
+   Impl() : file(-1), fileBytes(0), granularity(4096), view(NULL), viewOffset(0), viewBytes(0) {}
+
+   int file;
+#endif
+   unsigned long long fileBytes;
+   size_t granularity;              // alignment of the window offsets
+   unsigned char* view;
+   unsigned long long viewOffset;
+   size_t viewBytes;
+};
+
+FrameReplay::FrameReplay() :
+   impl_(new Impl),
+   width_(0),
+   height_(0),
+   bytesPerPixel_(1),
+   frameRate_(cDefaultFrameRate),
+   readAhead_(64 << 20),
+   advisedEnd_(0)
+{
+}
+
+FrameReplay::~FrameReplay()
+{
+   Close();
+   delete impl_;
+}
+
+bool FrameReplay::Open(const std::string& rawPath, const std::string& indexPath)
+{
+   Close();
+   rawPath_ = rawPath;
+   indexPath_ = indexPath.empty() ? rawPath + ".idx" : indexPath;
+
+#ifdef WIN32
+   SYSTEM_INFO info;
+   GetSystemInfo(&info);
+   impl_->granularity = info.dwAllocationGranularity;
+   impl_->file = CreateFileA(rawPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+   if (INVALID_HANDLE_VALUE == impl_->file)
+      return false;
+   LARGE_INTEGER size;
+   if (!GetFileSizeEx(impl_->file, &size) || size.QuadPart <= 0)
+   {
+      Close();
+      return false;
+   }
+   impl_->fileBytes = (unsigned long long)size.QuadPart;
+   impl_->mapping = CreateFileMappingA(impl_->file, NULL, PAGE_READONLY, 0, 0, NULL);
+   if (NULL == impl_->mapping)
+   {
+      Close();
+      return false;
+   }
+#else
+   impl_->granularity = (size_t)sysconf(_SC_PAGESIZE);
+   impl_->file = open(rawPath.c_str(), O_RDONLY);
+   if (impl_->file < 0)
+      return false;
+   struct stat status;
+   if (0 != fstat(impl_->file, &status) || status.st_size <= 0)
+   {
+      Close();
+      return false;
+   }
+   impl_->fileBytes = (unsigned long long)status.st_size;
+#endif
+
+   if (!ReadIndex(indexPath_, impl_->fileBytes))
+   {
+      Close();
+      return false;
+   }
+   return true;
+}
+
+void FrameReplay::Close()
+{
+   if (NULL != impl_->view)
+   {
+#ifdef WIN32
+      UnmapViewOfFile(impl_->view);
+#else
+      munmap(impl_->view, impl_->viewBytes);
+#endif
+      impl_->view = NULL;
+      impl_->viewBytes = 0;
+   }
+#ifdef WIN32
+   if (NULL != impl_->mapping)
+      CloseHandle(impl_->mapping);
+   if (INVALID_HANDLE_VALUE != impl_->file)
+      CloseHandle(impl_->file);
+   impl_->mapping = NULL;
+   impl_->file = INVALID_HANDLE_VALUE;
+#else
+   if (impl_->file >= 0)
+      close(impl_->file);
+   impl_->file = -1;
+#endif
+   impl_->fileBytes = 0;
+   offsets_.clear();
+   timestamps_.clear();
+   advisedEnd_ = 0;
+}
+
+/**
+* Frame lines give an offset and optionally a timestamp; frames past the
+* end of the recording or timestamps running backwards reject the index.
+*/
+bool FrameReplay::ReadIndex(const std::string& path, unsigned long long fileBytes)
+{
+   std::ifstream index(path.c_str());
+   if (!index)
+      return false;
+
+   width_ = height_ = 0;
+   bytesPerPixel_ = 1;
+   frameRate_ = cDefaultFrameRate;
+   bool timed = true;
+   std::string line;
+   while (std::getline(index, line))
+   {
+      std::istringstream is(line);
+      std::string key;
+      if (!(is >> key) || '#' == key[0])
+         continue;
+      if ("width" == key)
+         is >> width_;
+      else if ("height" == key)
+         is >> height_;
+      else if ("bytesPerPixel" == key)
+         is >> bytesPerPixel_;
+      else if ("frameRate" == key)
+         is >> frameRate_;
+      else
+      {
+         std::istringstream frame(line);
+         unsigned long long offset;
+         long long timestamp;
+         if (!(frame >> offset))
+            return false;
+         offsets_.push_back(offset);
+         if (frame >> timestamp)
+            timestamps_.push_back(timestamp);
+         else
+            timed = false;
+      }
+   }
+
+   if (0 == width_ || 0 == height_ || 0 == bytesPerPixel_ || frameRate_ <= 0.)
+      return false;
+   const unsigned long long frameBytes = FrameBytes();
+   if (offsets_.empty())
+   {
+      for (unsigned long long offset = 0; offset + frameBytes <= fileBytes; offset += frameBytes)
+         offsets_.push_back(offset);
+      timed = false;
+   }
+   if (!timed)
+   {
+      timestamps_.resize(offsets_.size());
+      for (size_t i = 0; i < offsets_.size(); ++i)
+         timestamps_[i] = (long long)(i * 1e6 / frameRate_);
+   }
+
+   for (size_t i = 0; i < offsets_.size(); ++i)
+   {
+      if (offsets_[i] + frameBytes > fileBytes || (i > 0 && timestamps_[i] < timestamps_[i - 1]))
+      {
+         offsets_.clear();
+         timestamps_.clear();
+         return false;
+      }
+   }
+   return !offsets_.empty();
+}
+
+size_t FrameReplay::FrameAt(long long timestampUs) const
+{
+   const std::vector<long long>::const_iterator it = std::upper_bound(timestamps_.begin(), timestamps_.end(), timestampUs);
+   return (it == timestamps_.begin()) ? 0 : (size_t)(it - timestamps_.begin()) - 1;
+}
+
+long long FrameReplay::DurationUs() const
+{
+   const size_t count = timestamps_.size();
+   if (0 == count)
+      return 0;
+   const long long span = timestamps_[count - 1] - timestamps_[0];
+   const long long interval = (count > 1) ? span / (long long)(count - 1) : (long long)(1e6 / frameRate_);
+   return span + std::max(1LL, interval);
+}
+
+/**
+* The read-ahead is requested in steps of half its size, so a request
+* covers a few frames and the kernel sees long sequential ranges.
+*/
+const unsigned char* FrameReplay::Frame(size_t index)
+{
+   if (index >= offsets_.size())
+      return NULL;
+
+   const unsigned long long offset = offsets_[index];
+   const size_t bytes = FrameBytes();
+   if (NULL == impl_->view || offset < impl_->viewOffset || offset + bytes > impl_->viewOffset + impl_->viewBytes)
+   {
+      if (!MapWindow(offset, bytes))
+         return NULL;
+      advisedEnd_ = offset;
+   }
+   else if (offset + bytes + readAhead_ < advisedEnd_)
+   {
+      // a seek back: the advice ahead of the old position does not help
+      advisedEnd_ = offset;
+   }
+
+   const unsigned long long viewEnd = impl_->viewOffset + impl_->viewBytes;
+   const unsigned long long wanted = std::min(viewEnd, offset + bytes + readAhead_);
+   if (advisedEnd_ < std::min(viewEnd, offset + bytes + readAhead_ / 2))
+   {
+      Advise(std::max(advisedEnd_, offset), wanted);
+      advisedEnd_ = wanted;
+   }
+   return impl_->view + (offset - impl_->viewOffset);
+}
+
+/**
+* Maps the window starting at the granularity boundary below 'offset', at
+* least the frame and the read-ahead after it.
+*/
+bool FrameReplay::MapWindow(unsigned long long offset, size_t bytes)
+{
+   if (NULL != impl_->view)
+   {
+#ifdef WIN32
+      UnmapViewOfFile(impl_->view);
+#else
+      munmap(impl_->view, impl_->viewBytes);
+#endif
+      impl_->view = NULL;
+      impl_->viewBytes = 0;
+   }
+
+   const unsigned long long start = offset / impl_->granularity * impl_->granularity;
+   const unsigned long long length = std::min<unsigned long long>(impl_->fileBytes - start,
+      std::max<unsigned long long>(cWindowBytes, offset - start + bytes + readAhead_));
+#ifdef WIN32
+   void* view = MapViewOfFile(impl_->mapping, FILE_MAP_READ, (DWORD)(start >> 32), (DWORD)(start & 0xffffffff), (SIZE_T)length);
+   if (NULL == view)
+      return false;
+#else
+   void* view = mmap(NULL, (size_t)length, PROT_READ, MAP_SHARED, impl_->file, (off_t)start);
+   if (MAP_FAILED == view)
+      return false;
+   madvise(view, (size_t)length, MADV_SEQUENTIAL);
+#endif
+   impl_->view = static_cast<unsigned char*>(view);
+   impl_->viewOffset = start;
+   impl_->viewBytes = (size_t)length;
+   return true;
+}
+
+void FrameReplay::Advise(unsigned long long begin, unsigned long long end)
+{
+   if (end <= begin)
+      return;
+   // page aligned start inside the view, which starts page aligned
+   const size_t page = 4096;
+   const size_t first = (size_t)(begin - impl_->viewOffset) / page * page;
+   const size_t length = (size_t)(end - impl_->viewOffset) - first;
+#ifdef WIN32
+   PrefetchFunction prefetch = Prefetch();
+   if (NULL != prefetch)
+   {
+      PrefetchRange range = {impl_->view + first, length};
+      prefetch(GetCurrentProcess(), 1, &range, 0);
+   }
+#else
+   madvise(impl_->view + first, length, MADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameReplay.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Replay of raw frame recordings. The recording is mapped
+//                into memory a window at a time, so files far larger than
+//                the address space replay without copies: frames are handed
+//                out as pointers into the mapping, and the pages of the
+//                frames ahead are requested from the kernel (madvise, or
+//                PrefetchVirtualMemory where Windows has it) while the
+//                current ones are processed.
+//
+//                The index is a text file next to the recording:
+//                   width <pixels>
+//                   height <pixels>
+//                   bytesPerPixel <bytes>
+//                   frameRate <fps>          (optional)
+//                   <offset> <timestamp us>  (one line per frame, optional)
+//                Without frame lines the recording is taken as frames back
+//                to back from offset 0, timed by frameRate. Lines starting
+//                with '#' are comments.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#ifndef _FRAMEREPLAY_H_
+#define _FRAMEREPLAY_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+// FrameReplay class
+//////////////////////////////////////////////////////////////////////////////
+class FrameReplay
+{
+public:
+   FrameReplay();
+   ~FrameReplay();
+
+   /**
+   * Opens a recording and its index, an empty index path stands for the
+   * recording path + ".idx". Returns false, with the replay closed, when
+   * either cannot be read or the index does not fit the recording.
+   */
+   bool Open(const std::string& rawPath, const std::string& indexPath);
+   void Close();
+   bool IsOpen() const {return !offsets_.empty();}
+   const std::string& RawPath() const {return rawPath_;}
+   const std::string& IndexPath() const {return indexPath_;}
+
+   unsigned Width() const {return width_;}
+   unsigned Height() const {return height_;}
+   unsigned BytesPerPixel() const {return bytesPerPixel_;}
+   size_t FrameBytes() const {return (size_t)width_ * height_ * bytesPerPixel_;}
+   size_t FrameCount() const {return offsets_.size();}
+
+   // recording time of a frame, and the last frame recorded at or before
+   // 'timestampUs'
+   long long TimestampUs(size_t frame) const {return timestamps_[frame];}
+   size_t FrameAt(long long timestampUs) const;
+   // recording length, one frame interval included so loops keep the pace
+   long long DurationUs() const;
+
+   // bytes after the served frame requested ahead of use
+   void SetReadAhead(size_t bytes) {readAhead_ = bytes;}
+   size_t ReadAhead() const {return readAhead_;}
+
+   /**
+   * Maps frame 'index' and requests the read-ahead after it. The pointer
+   * stays valid up to the next call; NULL when the frame cannot be mapped.
+   */
+   const unsigned char* Frame(size_t index);
+
+private:
+   struct Impl;
+
+   bool ReadIndex(const std::string& path, unsigned long long fileBytes);
+   bool MapWindow(unsigned long long offset, size_t bytes);
+   void Advise(unsigned long long begin, unsigned long long end);
+
+   FrameReplay(const FrameReplay&);
+   FrameReplay& operator=(const FrameReplay&);
+
+   Impl* impl_;
+   std::string rawPath_;
+   std::string indexPath_;
+   unsigned width_;
+   unsigned height_;
+   unsigned bytesPerPixel_;
+   double frameRate_;
+   std::vector<unsigned long long> offsets_;
+   std::vector<long long> timestamps_;
+   size_t readAhead_;
+   unsigned long long advisedEnd_;   // file offset the read-ahead reaches
+};
+
+#endif //_FRAMEREPLAY_H_
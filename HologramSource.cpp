@@ -0,0 +1,491 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          HologramSource.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Synthetic in-line holograms for the reconstruction pipeline.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "HologramSource.h"
+#include "PixelKernels.h"
+#include <math.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+namespace
+{
+   const double cPi = 3.14159265358979;
+
+   // fourth Philox counter word of the particle placement
+   const unsigned cStreamParticles = 4 << 8;
+
+   // smallest n >= size with no prime factor above 5, the fast lengths of
+   // FFTPlan
+   int FastSize(int size)
+   {
+      for (int n = std::max(size, 1); ; ++n)
+      {
+         int m = n;
+         while (0 == m % 2) m /= 2;
+         while (0 == m % 3) m /= 3;
+         while (0 == m % 5) m /= 5;
+         if (1 == m)
+            return n;
+      }
+   }
+
+   inline float Overlap(float a0, float a1, float b0, float b1)
+   {
+      return std::max(0.f, std::min(a1, b1) - std::max(a0, b0));
+   }
+
+   /**
+   * Makes the rectangle [x0, x1) x [y0, y1) opaque, edge pixels keep the
+   * uncovered part of their area.
+   */
+   void FillRect(float* field, unsigned stride, unsigned width, unsigned height, float x0, float y0, float x1, float y1)
+   {
+      const int i0 = std::max(0, (int)floor(x0));
+      const int i1 = std::min((int)width, (int)ceil(x1));
+      const int j0 = std::max(0, (int)floor(y0));
+      const int j1 = std::min((int)height, (int)ceil(y1));
+      for (int j = j0; j < j1; ++j)
+      {
+         const float cy = Overlap((float)j, j + 1.f, y0, y1);
+         float* row = field + (size_t)j * stride;
+         for (int i = i0; i < i1; ++i)
+            row[i] = std::min(row[i], 1.f - cy * Overlap((float)i, i + 1.f, x0, x1));
+      }
+   }
+
+   // next token of a PGM header, comments skipped
+   bool PgmToken(FILE* file, char* token, int size)
+   {
+      int c = fgetc(file);
+      for (;;)
+      {
+         while (EOF != c && isspace(c))
+            c = fgetc(file);
+         if ('#' != c)
+            break;
+         while (EOF != c && '\n' != c)
+            c = fgetc(file);
+      }
+      int n = 0;
+      while (EOF != c && !isspace(c) && n < size - 1)
+      {
+         token[n++] = (char)c;
+         c = fgetc(file);
+      }
+      token[n] = 0;
+      // the single white space after the last header field is consumed here
+      return n > 0;
+   }
+}
+
+/**
+* Propagates frames: the scene is rendered into the middle of the padded
+* grid, the rest of the grid is unscattered wave, and the sensor keeps
+* |U|^2 in units of the background level.
+*/
+class HologramSource::PropagateTask : public WorkerPool::Task
+{
+public:
+   PropagateTask(const HologramSource& source, unsigned char* frames) : source_(source), frames_(frames) {}
+
+   void Run(int begin, int end, int)
+   {
+      const int px = source_.paddedX_;
+      const int py = source_.paddedY_;
+      const unsigned width = source_.width_;
+      const unsigned height = source_.height_;
+      const int ox = (px - (int)width) / 2;
+      const int oy = (py - (int)height) / 2;
+      std::vector<Complex> grid((size_t)px * py);
+      std::vector<Complex> scratch(std::max(source_.rowPlan_.ScratchSize(), source_.colPlan_.ScratchSize()));
+      std::vector<float> scene((size_t)width * height);
+
+      // the FFT pair scales by px * py, the intensity by its square
+      const double norm = 1.0 / ((double)px * py);
+      const float scale = (float)(source_.settings_.background * norm * norm);
+      for (int f = begin; f < end; ++f)
+      {
+         source_.RenderScene(f, &scene[0], width);
+         std::fill(grid.begin(), grid.end(), Complex(1.f, 0.f));
+         for (unsigned y = 0; y < height; ++y)
+         {
+            Complex* dst = &grid[(size_t)(y + oy) * px + ox];
+            const float* src = &scene[(size_t)y * width];
+            for (unsigned x = 0; x < width; ++x)
+               dst[x] = Complex(src[x], 0.f);
+         }
+
+         source_.rowPlan_.Execute(&grid[0], 1, py, px, false, &scratch[0]);
+         source_.colPlan_.Execute(&grid[0], px, px, 1, false, &scratch[0]);
+         for (size_t i = 0; i < grid.size(); ++i)
+            grid[i] *= source_.transfer_[i];
+         source_.colPlan_.Execute(&grid[0], px, px, 1, true, &scratch[0]);
+         source_.rowPlan_.Execute(&grid[0], 1, py, px, true, &scratch[0]);
+
+         unsigned char* frame = frames_ + (size_t)f * width * height;
+         for (unsigned y = 0; y < height; ++y)
+         {
+            const Complex* src = &grid[(size_t)(y + oy) * px + ox];
+            unsigned char* dst = frame + (size_t)y * width;
+            for (unsigned x = 0; x < width; ++x)
+               dst[x] = (unsigned char)std::min(255.f, std::norm(src[x]) * scale + 0.5f);
+         }
+      }
+   }
+
+private:
+   PropagateTask& operator=(const PropagateTask&);
+
+   const HologramSource& source_;
+   unsigned char* frames_;
+};
+
+bool HologramSource::Settings::operator==(const Settings& other) const
+{
+   if (scene != other.scene || frameCount != other.frameCount || seed != other.seed ||
+      distanceUm != other.distanceUm || wavelengthNm != other.wavelengthNm || pixelPitchUm != other.pixelPitchUm ||
+      background != other.background)
+      return false;
+   if (SCENE_PARTICLES == scene &&
+      (particleCount != other.particleCount || particleDiameterUm != other.particleDiameterUm || driftUm != other.driftUm))
+      return false;
+   if (SCENE_IMAGE == scene && imagePath != other.imagePath)
+      return false;
+   // the exposure only matters to the dark signal
+   if (noise.enabled != other.noise.enabled)
+      return false;
+   return !noise.enabled || (exposureMs == other.exposureMs && noise.gain == other.noise.gain &&
+      noise.readNoise == other.noise.readNoise && noise.darkCurrent == other.noise.darkCurrent &&
+      noise.prnu == other.noise.prnu && noise.dsnu == other.noise.dsnu);
+}
+
+HologramSource::HologramSource() :
+   width_(0),
+   height_(0),
+   frameCount_(0),
+   paddedX_(0),
+   paddedY_(0)
+{
+}
+
+/**
+* The grid leaves a quarter of the frame plus the spread of the diffraction
+* pattern, lambda z / (2 pitch), around the frame so the wrap around of the
+* FFT does not reach it. Static scenes are propagated once; the frames then
+* only differ by their noise.
+*/
+bool HologramSource::Prepare(unsigned width, unsigned height, const Settings& settings)
+{
+   if (frameCount_ > 0 && width == width_ && height == height_ && settings == settings_)
+      return true;
+
+   frameCount_ = 0;
+   if (0 == width || 0 == height || settings.frameCount <= 0 || settings.pixelPitchUm <= 0. || settings.wavelengthNm <= 0.)
+      return false;
+   width_ = width;
+   height_ = height;
+   settings_ = settings;
+   if (SCENE_IMAGE == settings.scene && !LoadImage(settings.imagePath))
+      return false;
+
+   const double spread = settings.wavelengthNm * 1e-3 * fabs(settings.distanceUm) / (2.0 * settings.pixelPitchUm * settings.pixelPitchUm);
+   const int margin = (int)std::min(spread, 4096.0);
+   paddedX_ = FastSize(width + width / 4 + 2 * margin);
+   paddedY_ = FastSize(height + height / 4 + 2 * margin);
+   rowPlan_.Init(paddedX_);
+   colPlan_.Init(paddedY_);
+   ComputeTransferFunction();
+   PlaceParticles();
+
+   const size_t frameBytes = (size_t)width * height;
+   unsigned char* frames = static_cast<unsigned char*>(frames_.Reserve(frameBytes * settings.frameCount));
+   if (NULL == frames)
+      return false;
+
+   const bool moving = SCENE_PARTICLES == settings.scene && settings.driftUm != 0.;
+   const int distinct = moving ? settings.frameCount : 1;
+   PropagateTask task(*this, frames);
+   pool_->ParallelFor(distinct, 1, task);
+   for (int f = distinct; f < settings.frameCount; ++f)
+      memcpy(frames + f * frameBytes, frames, frameBytes);
+
+   if (settings.noise.enabled)
+   {
+      noise_.SetSeed(settings.seed);
+      for (int f = 0; f < settings.frameCount; ++f)
+         noise_.Apply(frames + f * frameBytes, width, height, PIXEL_UINT8, settings.noise, settings.exposureMs, 255., 0., 0.);
+   }
+   frameCount_ = settings.frameCount;
+   return true;
+}
+
+const unsigned char* HologramSource::Frame(int index) const
+{
+   if (frameCount_ <= 0)
+      return NULL;
+   index %= frameCount_;
+   if (index < 0)
+      index += frameCount_;
+   return static_cast<const unsigned char*>(frames_.Get()) + (size_t)index * width_ * height_;
+}
+
+/**
+* Transfer function over the object to sensor distance: the conjugate of
+* the one CpuReconstructor uses to go back by the same distance.
+*/
+void HologramSource::ComputeTransferFunction()
+{
+   const double wavelengthUm = settings_.wavelengthNm * 1e-3;
+   const double k = 2.0 * cPi / wavelengthUm;
+   const double dfx = 1.0 / (paddedX_ * settings_.pixelPitchUm);
+   const double dfy = 1.0 / (paddedY_ * settings_.pixelPitchUm);
+
+   transfer_.resize((size_t)paddedX_ * paddedY_);
+   for (int v = 0; v < paddedY_; ++v)
+   {
+      // frequencies above the half size are the negative ones
+      const double ly = wavelengthUm * dfy * std::min(v, paddedY_ - v);
+      Complex* row = &transfer_[(size_t)v * paddedX_];
+      for (int u = 0; u < paddedX_; ++u)
+      {
+         const double lx = wavelengthUm * dfx * std::min(u, paddedX_ - u);
+         const double arg = 1.0 - lx * lx - ly * ly;
+         if (arg <= 0.0)
+         {
+            row[u] = Complex(0.f, 0.f);
+         }
+         else
+         {
+            const double phase = k * settings_.distanceUm * sqrt(arg);
+            row[u] = Complex((float)cos(phase), (float)sin(phase));
+         }
+      }
+   }
+}
+
+/**
+* Particle i takes the Philox block i of the seed: start position, drift
+* direction and a diameter within 20 % of the nominal one.
+*/
+void HologramSource::PlaceParticles()
+{
+   particles_.clear();
+   if (SCENE_PARTICLES != settings_.scene || settings_.particleCount <= 0)
+      return;
+
+   const unsigned count = (unsigned)settings_.particleCount;
+   std::vector<unsigned> words(4 * (size_t)count);
+   Kernels().philox(settings_.seed, 0, 0, 0, 0, cStreamParticles, &words[0], count);
+
+   const double unit = 1.0 / 4294967296.0;
+   const double drift = settings_.driftUm / settings_.pixelPitchUm;
+   const double radius = 0.5 * settings_.particleDiameterUm / settings_.pixelPitchUm;
+   particles_.resize(5 * (size_t)count);
+   for (unsigned i = 0; i < count; ++i)
+   {
+      const unsigned* w = &words[4 * (size_t)i];
+      float* p = &particles_[5 * (size_t)i];
+      const double angle = 2.0 * cPi * w[2] * unit;
+      p[0] = (float)(w[0] * unit * width_);
+      p[1] = (float)(w[1] * unit * height_);
+      p[2] = (float)(drift * cos(angle));
+      p[3] = (float)(drift * sin(angle));
+      p[4] = (float)(radius * (0.8 + 0.4 * w[3] * unit));
+   }
+}
+
+void HologramSource::RenderScene(int index, std::vector<float>& transmittance) const
+{
+   transmittance.resize((size_t)width_ * height_);
+   if (!transmittance.empty())
+      RenderScene(index, &transmittance[0], width_);
+}
+
+void HologramSource::RenderScene(int index, float* field, unsigned stride) const
+{
+   for (unsigned y = 0; y < height_; ++y)
+      std::fill(field + (size_t)y * stride, field + (size_t)y * stride + width_, 1.f);
+
+   switch (settings_.scene)
+   {
+   case SCENE_PARTICLES: RenderParticles(index, field, stride); break;
+   case SCENE_USAF: RenderUsaf(field, stride); break;
+   case SCENE_IMAGE: RenderImage(field, stride); break;
+   default: break;
+   }
+}
+
+/**
+* Discs at their drifted positions, wrapped around the frame. Edge pixels
+* are covered by the part of the pixel inside the disc, approximated from
+* the distance of the pixel centre to the rim.
+*/
+void HologramSource::RenderParticles(int index, float* field, unsigned stride) const
+{
+   const size_t count = particles_.size() / 5;
+   for (size_t i = 0; i < count; ++i)
+   {
+      const float* p = &particles_[5 * i];
+      float cx = fmodf(p[0] + index * p[2], (float)width_);
+      float cy = fmodf(p[1] + index * p[3], (float)height_);
+      if (cx < 0.f) cx += width_;
+      if (cy < 0.f) cy += height_;
+      const float r = p[4];
+
+      const int i0 = std::max(0, (int)floor(cx - r - 1.f));
+      const int i1 = std::min((int)width_, (int)ceil(cx + r + 1.f));
+      const int j0 = std::max(0, (int)floor(cy - r - 1.f));
+      const int j1 = std::min((int)height_, (int)ceil(cy + r + 1.f));
+      for (int j = j0; j < j1; ++j)
+      {
+         float* row = field + (size_t)j * stride;
+         const float dy = j + 0.5f - cy;
+         for (int x = i0; x < i1; ++x)
+         {
+            const float dx = x + 0.5f - cx;
+            const float cover = std::min(1.f, std::max(0.f, r + 0.5f - sqrtf(dx * dx + dy * dy)));
+            row[x] = std::min(row[x], 1.f - cover);
+         }
+      }
+   }
+}
+
+/**
+* Elements of three horizontal and three vertical bars, bar and gap width
+* b and bar length 5 b, b shrinking by 2^(1/6) from element to element as
+* on the USAF 1951 target, laid out in rows until the bars get narrower
+* than a pixel.
+*/
+void HologramSource::RenderUsaf(float* field, unsigned stride) const
+{
+   const float start = std::max(1.f, std::min(width_, height_) / 24.f);
+   const float step = (float)pow(2.0, -1.0 / 6.0);
+   float x = 0.f, y = 0.f, rowHeight = 0.f;
+   for (float b = start; b >= 1.f; b *= step)
+   {
+      const float cellWidth = 12.f * b;
+      if (x > 0.f && x + cellWidth > width_)
+      {
+         x = 0.f;
+         y += rowHeight;
+         rowHeight = 0.f;
+      }
+      if (y + 6.f * b > height_)
+         break;
+      const float x0 = x + b;
+      const float y0 = y + b;
+      for (int k = 0; k < 3; ++k)
+      {
+         FillRect(field, stride, width_, height_, x0, y0 + 2 * k * b, x0 + 5 * b, y0 + (2 * k + 1) * b);
+         FillRect(field, stride, width_, height_, x0 + 6 * b + 2 * k * b, y0, x0 + 6 * b + (2 * k + 1) * b, y0 + 5 * b);
+      }
+      x += cellWidth;
+      rowHeight = std::max(rowHeight, 6.f * b);
+   }
+}
+
+void HologramSource::RenderImage(float* field, unsigned stride) const
+{
+   if (image_.size() != (size_t)width_ * height_)
+      return;
+   for (unsigned y = 0; y < height_; ++y)
+      memcpy(field + (size_t)y * stride, &image_[(size_t)y * width_], width_ * sizeof(float));
+}
+
+/**
+* Reads a binary PGM (P5, 8 or 16 bit) and scales it bilinearly to the
+* frame size; grey levels over the maximum value are the amplitude
+* transmittance.
+*/
+bool HologramSource::LoadImage(const std::string& path)
+{
+   image_.clear();
+   FILE* file = fopen(path.c_str(), "rb");
+   if (NULL == file)
+      return false;
+
+   char magic[8], w[16], h[16], m[16];
+   bool ok = PgmToken(file, magic, sizeof(magic)) && 0 == strcmp(magic, "P5") &&
+      PgmToken(file, w, sizeof(w)) && PgmToken(file, h, sizeof(h)) && PgmToken(file, m, sizeof(m));
+   const long sourceWidth = ok ? atol(w) : 0;
+   const long sourceHeight = ok ? atol(h) : 0;
+   const long maxValue = ok ? atol(m) : 0;
+   ok = ok && sourceWidth > 0 && sourceHeight > 0 && maxValue > 0 && maxValue < 65536;
+
+   std::vector<float> source;
+   if (ok)
+   {
+      const int bytes = maxValue < 256 ? 1 : 2;
+      std::vector<unsigned char> data((size_t)sourceWidth * sourceHeight * bytes);
+      ok = fread(&data[0], 1, data.size(), file) == data.size();
+      source.resize((size_t)sourceWidth * sourceHeight);
+      for (size_t i = 0; ok && i < source.size(); ++i)
+      {
+         // 16 bit samples are big endian
+         const unsigned value = (1 == bytes) ? data[i] : (data[2 * i] << 8 | data[2 * i + 1]);
+         source[i] = std::min(1.f, (float)value / maxValue);
+      }
+   }
+   fclose(file);
+   if (!ok)
+      return false;
+
+   image_.resize((size_t)width_ * height_);
+   const double sx = (double)sourceWidth / width_;
+   const double sy = (double)sourceHeight / height_;
+   for (unsigned y = 0; y < height_; ++y)
+   {
+      const double fy = std::min(std::max(0.0, (y + 0.5) * sy - 0.5), sourceHeight - 1.0);
+      const long y0 = (long)fy;
+      const long y1 = std::min(y0 + 1, sourceHeight - 1);
+      const float ty = (float)(fy - y0);
+      for (unsigned x = 0; x < width_; ++x)
+      {
+         const double fx = std::min(std::max(0.0, (x + 0.5) * sx - 0.5), sourceWidth - 1.0);
+         const long x0 = (long)fx;
+         const long x1 = std::min(x0 + 1, sourceWidth - 1);
+         const float tx = (float)(fx - x0);
+         const float top = source[y0 * sourceWidth + x0] + tx * (source[y0 * sourceWidth + x1] - source[y0 * sourceWidth + x0]);
+         const float bottom = source[y1 * sourceWidth + x0] + tx * (source[y1 * sourceWidth + x1] - source[y1 * sourceWidth + x0]);
+         image_[(size_t)y * width_ + x] = top + ty * (bottom - top);
+      }
+   }
+   return true;
+}
+
+double HologramSource::ScoreReconstruction(int index, const unsigned char* intensity) const
+{
+   if (NULL == intensity || frameCount_ <= 0)
+      return 0.;
+
+   std::vector<float> scene;
+   RenderScene(index, scene);
+   double sa = 0., sb = 0., saa = 0., sbb = 0., sab = 0.;
+   for (size_t i = 0; i < scene.size(); ++i)
+   {
+      const double a = (double)scene[i] * scene[i];
+      const double b = intensity[i];
+      sa += a;
+      sb += b;
+      saa += a * a;
+      sbb += b * b;
+      sab += a * b;
+   }
+   const double n = (double)scene.size();
+   const double va = saa - sa * sa / n;
+   const double vb = sbb - sb * sb / n;
+   if (va <= 0. || vb <= 0.)
+      return 0.;
+   return (sab - sa * sb / n) / sqrt(va * vb);
+}
@@ -0,0 +1,120 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          HologramSource.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Synthetic in-line holograms for the reconstruction pipeline.
+//                A scene of moving particles, a USAF style bar target or an
+//                image file is forward propagated with the angular spectrum
+//                transfer function the CPU reconstructor inverts, and the
+//                sensor intensities of a sequence are computed once into a
+//                pool of 8 bit frames that stands in for the grabber
+//                surfaces. The scene of every frame can be rendered again
+//                to score reconstructions against it.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#ifndef _HOLOGRAMSOURCE_H_
+#define _HOLOGRAMSOURCE_H_
+
+#include "CpuReconstruction.h"
+#include "SensorNoise.h"
+#include "ScratchArena.h"
+#include "WorkerPool.h"
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+// HologramSource class
+//////////////////////////////////////////////////////////////////////////////
+class HologramSource
+{
+public:
+   enum Scene
+   {
+      SCENE_PARTICLES,     // opaque discs drifting across the field
+      SCENE_USAF,          // bar triplets shrinking by 2^(1/6), static
+      SCENE_IMAGE          // amplitude transmittance from a PGM file, static
+   };
+
+   struct Settings
+   {
+      Settings() : scene(SCENE_PARTICLES), frameCount(32), particleCount(50), particleDiameterUm(20.), driftUm(5.), seed(1),
+         distanceUm(1000.), wavelengthNm(532.), pixelPitchUm(5.5), background(100.), exposureMs(10.) {}
+
+      bool operator==(const Settings& other) const;
+      bool operator!=(const Settings& other) const {return !(*this == other);}
+
+      Scene scene;
+      int frameCount;
+      int particleCount;
+      double particleDiameterUm;
+      double driftUm;            // particle travel per frame
+      unsigned seed;             // particle positions, directions and noise
+      std::string imagePath;     // binary PGM of SCENE_IMAGE
+      double distanceUm;         // object to sensor
+      double wavelengthNm;
+      double pixelPitchUm;
+      double background;         // ADU of the unscattered wave
+      double exposureMs;         // dark signal of the noise model
+      SensorNoise::Model noise;
+   };
+
+   HologramSource();
+
+   // threads of the shared pool that propagate the frames
+   void SetThreadCount(int count) {pool_->SetThreadCount(count);}
+   int ThreadCount() const {return pool_->ThreadCount();}
+
+   /**
+   * Fills the pool with the width x height holograms of 'settings'; nothing
+   * is done when neither changed. Returns false when the image of
+   * SCENE_IMAGE cannot be read or the pool cannot be allocated, the pool is
+   * empty then.
+   */
+   bool Prepare(unsigned width, unsigned height, const Settings& settings);
+
+   int FrameCount() const {return frameCount_;}
+   unsigned Width() const {return width_;}
+   unsigned Height() const {return height_;}
+   const unsigned char* Frame(int index) const;
+
+   // amplitude transmittance of the scene of frame 'index', width x height
+   void RenderScene(int index, std::vector<float>& transmittance) const;
+
+   // correlation coefficient of an 8 bit intensity reconstruction of frame
+   // 'index' with the intensity transmittance of its scene, 1 for a perfect
+   // reconstruction up to scale
+   double ScoreReconstruction(int index, const unsigned char* intensity) const;
+
+private:
+   class PropagateTask;
+
+   bool LoadImage(const std::string& path);
+   void RenderScene(int index, float* field, unsigned stride) const;
+   void RenderParticles(int index, float* field, unsigned stride) const;
+   void RenderUsaf(float* field, unsigned stride) const;
+   void RenderImage(float* field, unsigned stride) const;
+   void ComputeTransferFunction();
+   void PlaceParticles();
+
+   SharedWorkerPool pool_;
+   SensorNoise noise_;
+   ScratchBlock frames_;
+   Settings settings_;
+   unsigned width_;
+   unsigned height_;
+   int frameCount_;
+   // propagation grid: the frame with a margin of unscattered wave
+   int paddedX_;
+   int paddedY_;
+   FFTPlan rowPlan_;
+   FFTPlan colPlan_;
+   std::vector<Complex> transfer_;      // H(-z): object to sensor
+   std::vector<float> image_;           // SCENE_IMAGE at the frame size
+   std::vector<float> particles_;       // x, y (pixels), dx, dy per frame, radius
+};
+
+#endif //_HOLOGRAMSOURCE_H_
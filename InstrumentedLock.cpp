@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          InstrumentedLock.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Recursive lock with per call site wait, hold and contention
+//                statistics.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "InstrumentedLock.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+namespace
+{
+#ifdef WIN32
+   double TicksPerUs()
+   {
+      LARGE_INTEGER frequency;
+      QueryPerformanceFrequency(&frequency);
+      return frequency.QuadPart / 1e6;
+   }
+
+   const double cTicksPerUs = TicksPerUs();
+#endif
+}
+
+// the lock itself is taken by a try first, the failure is the contention
+struct InstrumentedLock::Impl
+{
+#ifdef WIN32
+   CRITICAL_SECTION section;
+#else
+   pthread_mutex_t mutex;
+#endif
+};
+
+InstrumentedLock::InstrumentedLock(int siteCount) :
+   impl_(new Impl),
+   siteCount_(siteCount),
+   wait_(new LatencyHistogram[siteCount]),
+   hold_(new LatencyHistogram[siteCount]),
+   contentions_(new unsigned long[siteCount])
+{
+#ifdef WIN32
+   InitializeCriticalSection(&impl_->section);
+#else
+   pthread_mutexattr_t attributes;
+   pthread_mutexattr_init(&attributes);
+   pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+   pthread_mutex_init(&impl_->mutex, &attributes);
+   pthread_mutexattr_destroy(&attributes);
+#endif
+   for (int i = 0; i < siteCount_; ++i)
+      contentions_[i] = 0;
+}
+
+InstrumentedLock::~InstrumentedLock()
+{
+#ifdef WIN32
+   DeleteCriticalSection(&impl_->section);
+#else
+   pthread_mutex_destroy(&impl_->mutex);
+#endif
+   delete impl_;
+   delete[] wait_;
+   delete[] hold_;
+   delete[] contentions_;
+}
+
+double InstrumentedLock::NowUs()
+{
+#ifdef WIN32
+   LARGE_INTEGER counter;
+   QueryPerformanceCounter(&counter);
+   return counter.QuadPart / cTicksPerUs;
+#else
+   timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return 1e6 * now.tv_sec + 1e-3 * now.tv_nsec;
+#endif
+}
+
+void InstrumentedLock::Lock(int site)
+{
+#ifdef WIN32
+   if (TryEnterCriticalSection(&impl_->section))
+      return;
+   EnterCriticalSection(&impl_->section);
+#else
+   if (0 == pthread_mutex_trylock(&impl_->mutex))
+      return;
+   pthread_mutex_lock(&impl_->mutex);
+#endif
+   ++contentions_[site];
+}
+
+void InstrumentedLock::Unlock()
+{
+#ifdef WIN32
+   LeaveCriticalSection(&impl_->section);
+#else
+   pthread_mutex_unlock(&impl_->mutex);
+#endif
+}
+
+void InstrumentedLock::Record(int site, double waitUs, double holdUs)
+{
+   wait_[site].Record(waitUs, 0.);
+   hold_[site].Record(holdUs, 0.);
+}
+
+void InstrumentedLock::Reset()
+{
+   // a contention this counts is cleared with the rest
+   Lock(0);
+   for (int i = 0; i < siteCount_; ++i)
+   {
+      wait_[i].Reset();
+      hold_[i].Reset();
+      contentions_[i] = 0;
+   }
+   Unlock();
+}
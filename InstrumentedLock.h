@@ -0,0 +1,90 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          InstrumentedLock.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Recursive lock that keeps, for every call site taking it,
+//                the distribution of the time spent waiting for it and of
+//                the time it was held, and how often another thread held it
+//                at the time. Sites are numbered by the owner, which names
+//                them.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#ifndef _INSTRUMENTEDLOCK_H_
+#define _INSTRUMENTEDLOCK_H_
+
+#include "LatencyHistogram.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// InstrumentedLock class
+//////////////////////////////////////////////////////////////////////////////
+class InstrumentedLock
+{
+public:
+   explicit InstrumentedLock(int siteCount);
+   ~InstrumentedLock();
+
+   // a monotonic clock for the waits and holds
+   static double NowUs();
+
+   // takes the lock, counting a contention of 'site' when another thread
+   // holds it; the calling thread may hold it already
+   void Lock(int site);
+   void Unlock();
+   // one acquisition of 'site', recorded after the unlock
+   void Record(int site, double waitUs, double holdUs);
+
+   int SiteCount() const {return siteCount_;}
+   const LatencyHistogram& Wait(int site) const {return wait_[site];}
+   const LatencyHistogram& Hold(int site) const {return hold_[site];}
+   unsigned long Contentions(int site) const {return contentions_[site];}
+   void Reset();
+
+private:
+   struct Impl;
+
+   InstrumentedLock(const InstrumentedLock&);
+   InstrumentedLock& operator=(const InstrumentedLock&);
+
+   Impl* impl_;
+   int siteCount_;
+   LatencyHistogram* wait_;
+   LatencyHistogram* hold_;
+   unsigned long* contentions_;    // changed with the lock held
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// InstrumentedGuard class
+// holds an InstrumentedLock for a block, on behalf of one call site
+//////////////////////////////////////////////////////////////////////////////
+class InstrumentedGuard
+{
+public:
+   InstrumentedGuard(InstrumentedLock& lock, int site) : lock_(lock), site_(site)
+   {
+      const double start = InstrumentedLock::NowUs();
+      lock_.Lock(site_);
+      acquiredUs_ = InstrumentedLock::NowUs();
+      waitUs_ = acquiredUs_ - start;
+   }
+   ~InstrumentedGuard()
+   {
+      const double holdUs = InstrumentedLock::NowUs() - acquiredUs_;
+      lock_.Unlock();
+      lock_.Record(site_, waitUs_, holdUs);
+   }
+
+private:
+   InstrumentedGuard(const InstrumentedGuard&);
+   InstrumentedGuard& operator=(const InstrumentedGuard&);
+
+   InstrumentedLock& lock_;
+   int site_;
+   double acquiredUs_;
+   double waitUs_;
+};
+
+#endif //_INSTRUMENTEDLOCK_H_
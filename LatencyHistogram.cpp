@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          LatencyHistogram.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Latency distribution of a processing stage.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "LatencyHistogram.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+   const double cTicksPerUs = 10.;
+
+   const char* const g_StatisticNames[LatencyHistogram::LATENCY_STATISTIC_COUNT] =
+   {
+      "Latency p50 (us)", "Latency p90 (us)", "Latency p99 (us)", "Latency max (us)", "Throughput (MB/s)"
+   };
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+   Reset();
+}
+
+const char* LatencyHistogram::StatisticName(Statistic s)
+{
+   return (s >= LATENCY_P50 && s < LATENCY_STATISTIC_COUNT) ? g_StatisticNames[s] : "";
+}
+
+/**
+* Ticks below 2 * cSubBuckets have a bucket each. Above, a bucket holds
+* 2^shift ticks, shift chosen so that ticks >> shift keeps cSubBits + 1
+* bits: 32 buckets per power of two, none wider than 1/32 of its values.
+*/
+int LatencyHistogram::BucketOf(unsigned long long ticks)
+{
+   if (ticks < 2 * cSubBuckets)
+      return (int)ticks;
+   int msb = cSubBits + 1;
+   while (msb < cMaxShift + cSubBits && (ticks >> (msb + 1)) != 0)
+      ++msb;
+   const int shift = msb - cSubBits;
+   const unsigned long long sub = std::min<unsigned long long>(ticks >> shift, 2 * cSubBuckets - 1);
+   return shift * cSubBuckets + (int)sub;
+}
+
+// largest tick count of a bucket
+unsigned long long LatencyHistogram::BucketTop(int bucket)
+{
+   if (bucket < 2 * cSubBuckets)
+      return bucket;
+   const int shift = bucket / cSubBuckets - 1;
+   const unsigned long long sub = bucket - shift * cSubBuckets;
+   return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(double usec, double bytes)
+{
+   const unsigned long long ticks = (unsigned long long)(std::max(usec, 0.) * cTicksPerUs + 0.5);
+   MMThreadGuard g(lock_);
+   ++counts_[BucketOf(ticks)];
+   ++count_;
+   maxTicks_ = std::max(maxTicks_, ticks);
+   totalUs_ += usec;
+   totalBytes_ += bytes;
+}
+
+void LatencyHistogram::Reset()
+{
+   MMThreadGuard g(lock_);
+   memset(counts_, 0, sizeof(counts_));
+   count_ = 0;
+   maxTicks_ = 0;
+   totalUs_ = 0.;
+   totalBytes_ = 0.;
+}
+
+unsigned long LatencyHistogram::Count() const
+{
+   MMThreadGuard g(lock_);
+   return count_;
+}
+
+double LatencyHistogram::PercentileLocked(double percent) const
+{
+   if (0 == count_)
+      return 0.;
+   // rank of the sample, 1 based
+   const unsigned long rank = std::max(1UL, (unsigned long)ceil(count_ * std::min(percent, 100.) / 100.));
+   unsigned long seen = 0;
+   for (int b = 0; b < cBuckets; ++b)
+   {
+      seen += counts_[b];
+      if (seen >= rank)
+         return std::min(BucketTop(b), maxTicks_) / cTicksPerUs;
+   }
+   return maxTicks_ / cTicksPerUs;
+}
+
+double LatencyHistogram::Percentile(double percent) const
+{
+   MMThreadGuard g(lock_);
+   return PercentileLocked(percent);
+}
+
+double LatencyHistogram::Max() const
+{
+   MMThreadGuard g(lock_);
+   return maxTicks_ / cTicksPerUs;
+}
+
+double LatencyHistogram::BytesPerSecond() const
+{
+   MMThreadGuard g(lock_);
+   return (totalUs_ > 0.) ? totalBytes_ * 1e6 / totalUs_ : 0.;
+}
+
+double LatencyHistogram::Value(Statistic s) const
+{
+   switch (s)
+   {
+   case LATENCY_P50: return Percentile(50.);
+   case LATENCY_P90: return Percentile(90.);
+   case LATENCY_P99: return Percentile(99.);
+   case LATENCY_MAX: return Max();
+   case LATENCY_THROUGHPUT: return BytesPerSecond() / 1e6;
+   default: return 0.;
+   }
+}
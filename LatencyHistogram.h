@@ -0,0 +1,72 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          LatencyHistogram.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Latency distribution of a processing stage with bounded
+//                relative error: log-linear buckets, 32 per power of two
+//                above 6.4 us, of 0.1 us below, up to 2.5 days.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#ifndef _LATENCYHISTOGRAM_H_
+#define _LATENCYHISTOGRAM_H_
+
+#include "../../MMDevice/DeviceThreads.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// LatencyHistogram class
+//////////////////////////////////////////////////////////////////////////////
+class LatencyHistogram
+{
+public:
+   // the statistics the devices expose as properties
+   enum Statistic
+   {
+      LATENCY_P50,
+      LATENCY_P90,
+      LATENCY_P99,
+      LATENCY_MAX,
+      LATENCY_THROUGHPUT,   // MB per second spent in the stage
+      LATENCY_STATISTIC_COUNT
+   };
+
+   LatencyHistogram();
+
+   // property name of a statistic, e.g. "Latency p99 (us)"
+   static const char* StatisticName(Statistic s);
+
+   // one call of the stage that took 'usec' for 'bytes'
+   void Record(double usec, double bytes);
+   void Reset();
+
+   unsigned long Count() const;
+   // microseconds that 'percent' of the calls did not exceed, within 1/32
+   double Percentile(double percent) const;
+   double Max() const;
+   double BytesPerSecond() const;
+   // microseconds, MB/s for LATENCY_THROUGHPUT
+   double Value(Statistic s) const;
+
+private:
+   static const int cSubBits = 5;
+   static const int cSubBuckets = 1 << cSubBits;
+   // ticks of 0.1 us below 2^41 (61 hours)
+   static const int cMaxShift = 40 - cSubBits;
+   static const int cBuckets = (cMaxShift + 2) * cSubBuckets;
+
+   static int BucketOf(unsigned long long ticks);
+   static unsigned long long BucketTop(int bucket);
+   double PercentileLocked(double percent) const;
+
+   mutable MMThreadLock lock_;
+   unsigned long counts_[cBuckets];
+   unsigned long count_;
+   unsigned long long maxTicks_;
+   double totalUs_;
+   double totalBytes_;
+};
+
+#endif //_LATENCYHISTOGRAM_H_
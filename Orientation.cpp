@@ -0,0 +1,208 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Orientation.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   The eight rotations and mirror images of a frame.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "Orientation.h"
+#include "PixelKernels.h"
+#include <string.h>
+#include <algorithm>
+
+namespace
+{
+   // block edge: a block of 8 byte pixels and its tile fit in 64 kB
+   const unsigned cBlock = 64;
+
+   const char* const g_OrientationNames[ORIENT_COUNT] =
+   {
+      "Identity", "Rotate90", "Rotate180", "Rotate270", "FlipX", "FlipY", "Transpose", "AntiTranspose"
+   };
+
+   // every transform is an optional transpose followed by optional mirrors
+   // of the result
+   inline bool MirrorsX(Orientation o)
+   {
+      return ORIENT_ROTATE90 == o || ORIENT_ROTATE180 == o || ORIENT_FLIP_X == o || ORIENT_ANTITRANSPOSE == o;
+   }
+
+   inline bool MirrorsY(Orientation o)
+   {
+      return ORIENT_ROTATE270 == o || ORIENT_ROTATE180 == o || ORIENT_FLIP_Y == o || ORIENT_ANTITRANSPOSE == o;
+   }
+
+   inline void Reverse(unsigned char* pixels, size_t count) {Kernels().reverse8(pixels, count);}
+   inline void Reverse(unsigned short* pixels, size_t count) {Kernels().reverse16(pixels, count);}
+   inline void Reverse(unsigned int* pixels, size_t count) {Kernels().reverse32(pixels, count);}
+   inline void Reverse(unsigned long long* pixels, size_t count) {Kernels().reverse64(pixels, count);}
+
+   template <class T> void Transpose(const T* src, size_t srcStride, T* dst, size_t dstStride, unsigned width, unsigned height)
+   {
+      for (unsigned x = 0; x < width; ++x)
+      {
+         for (unsigned y = 0; y < height; ++y)
+            dst[x * dstStride + y] = src[y * srcStride + x];
+      }
+   }
+   inline void Transpose(const unsigned char* src, size_t srcStride, unsigned char* dst, size_t dstStride, unsigned width, unsigned height)
+   {
+      Kernels().transpose8(src, srcStride, dst, dstStride, width, height);
+   }
+   inline void Transpose(const unsigned short* src, size_t srcStride, unsigned short* dst, size_t dstStride, unsigned width, unsigned height)
+   {
+      Kernels().transpose16(src, srcStride, dst, dstStride, width, height);
+   }
+
+   // transforms that keep the axes: each source row is copied to its
+   // destination row and reversed there while it is cached
+   template <class T> void OrientRows(const T* src, T* dst, unsigned width, unsigned height, bool mirrorX, bool mirrorY, unsigned y0, unsigned y1)
+   {
+      for (unsigned y = y0; y < y1; ++y)
+      {
+         T* row = dst + (size_t)(mirrorY ? height - 1 - y : y) * width;
+         memcpy(row, src + (size_t)y * width, sizeof(T) * width);
+         if (mirrorX)
+            Reverse(row, width);
+      }
+   }
+
+   /**
+   * Transforms that swap the axes: each source block is transposed into a
+   * tile, the tile rows are reversed for a horizontal mirror and then
+   * written to their destination rows.
+   */
+   template <class T> void OrientBlocks(const T* src, T* dst, unsigned width, unsigned height, bool mirrorX, bool mirrorY, unsigned y0, unsigned y1)
+   {
+      T tile[cBlock * cBlock];
+      for (unsigned by = y0; by < y1; by += cBlock)
+      {
+         const unsigned bh = std::min(cBlock, y1 - by);
+         // first destination column of these source rows
+         const unsigned column = mirrorX ? height - by - bh : by;
+         for (unsigned bx = 0; bx < width; bx += cBlock)
+         {
+            const unsigned bw = std::min(cBlock, width - bx);
+            Transpose(src + (size_t)by * width + bx, width, tile, cBlock, bw, bh);
+            for (unsigned i = 0; i < bw; ++i)
+            {
+               T* t = tile + i * cBlock;
+               if (mirrorX)
+                  Reverse(t, bh);
+               const unsigned row = mirrorY ? width - 1 - (bx + i) : bx + i;
+               memcpy(dst + (size_t)row * height + column, t, sizeof(T) * bh);
+            }
+         }
+      }
+   }
+
+   template <class T> void OrientPixels(const T* src, T* dst, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1)
+   {
+      y1 = std::min(y1, height);
+      if (y0 >= y1)
+         return;
+      if (OrientationSwapsAxes(o))
+         OrientBlocks(src, dst, width, height, MirrorsX(o), MirrorsY(o), y0, y1);
+      else
+         OrientRows(src, dst, width, height, MirrorsX(o), MirrorsY(o), y0, y1);
+   }
+
+   /**
+   * Mirrors in place: opposite rows are reversed while they are cached and
+   * then exchanged; the middle row of an odd height is only reversed.
+   */
+   template <class T> bool OrientPixelsInPlace(T* pixels, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1)
+   {
+      if (OrientationSwapsAxes(o))
+         return false;
+
+      const bool mirrorX = MirrorsX(o);
+      const bool mirrorY = MirrorsY(o);
+      y1 = std::min(y1, OrientInPlaceRows(height, o));
+      for (unsigned y = y0; y < y1; ++y)
+      {
+         T* a = pixels + (size_t)y * width;
+         T* b = pixels + (size_t)(height - 1 - y) * width;
+         if (!mirrorY || a == b)
+         {
+            if (mirrorX)
+               Reverse(a, width);
+            continue;
+         }
+         if (mirrorX)
+         {
+            Reverse(a, width);
+            Reverse(b, width);
+         }
+         Kernels().swapBytes(reinterpret_cast<unsigned char*>(a), reinterpret_cast<unsigned char*>(b), sizeof(T) * width);
+      }
+      return true;
+   }
+}
+
+const char* OrientationName(Orientation o)
+{
+   return (o >= ORIENT_IDENTITY && o < ORIENT_COUNT) ? g_OrientationNames[o] : "";
+}
+
+Orientation OrientationFromName(const char* name)
+{
+   int o = ORIENT_IDENTITY;
+   while (o < ORIENT_COUNT && strcmp(name, g_OrientationNames[o]) != 0)
+      ++o;
+   return (Orientation)o;
+}
+
+bool OrientationSwapsAxes(Orientation o)
+{
+   return ORIENT_ROTATE90 == o || ORIENT_ROTATE270 == o || ORIENT_TRANSPOSE == o || ORIENT_ANTITRANSPOSE == o;
+}
+
+unsigned OrientInPlaceRows(unsigned height, Orientation o)
+{
+   return MirrorsY(o) ? (height + 1) / 2 : height;
+}
+
+void Orient(const unsigned char* src, unsigned char* dst, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1)
+{
+   OrientPixels(src, dst, width, height, o, y0, y1);
+}
+
+void Orient(const unsigned short* src, unsigned short* dst, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1)
+{
+   OrientPixels(src, dst, width, height, o, y0, y1);
+}
+
+void Orient(const unsigned int* src, unsigned int* dst, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1)
+{
+   OrientPixels(src, dst, width, height, o, y0, y1);
+}
+
+void Orient(const unsigned long long* src, unsigned long long* dst, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1)
+{
+   OrientPixels(src, dst, width, height, o, y0, y1);
+}
+
+bool OrientInPlace(unsigned char* pixels, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1)
+{
+   return OrientPixelsInPlace(pixels, width, height, o, y0, y1);
+}
+
+bool OrientInPlace(unsigned short* pixels, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1)
+{
+   return OrientPixelsInPlace(pixels, width, height, o, y0, y1);
+}
+
+bool OrientInPlace(unsigned int* pixels, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1)
+{
+   return OrientPixelsInPlace(pixels, width, height, o, y0, y1);
+}
+
+bool OrientInPlace(unsigned long long* pixels, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1)
+{
+   return OrientPixelsInPlace(pixels, width, height, o, y0, y1);
+}
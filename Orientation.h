@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Orientation.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   The eight rotations and mirror images of a frame in one
+//                pass: 64x64 pixel blocks are transposed and reversed in a
+//                cached tile before they are written out.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#ifndef _ORIENTATION_H_
+#define _ORIENTATION_H_
+
+#include <stddef.h>
+
+// rotations are clockwise, as seen on the screen
+enum Orientation
+{
+   ORIENT_IDENTITY,
+   ORIENT_ROTATE90,
+   ORIENT_ROTATE180,
+   ORIENT_ROTATE270,
+   ORIENT_FLIP_X,          // mirrors left and right
+   ORIENT_FLIP_Y,          // mirrors top and bottom
+   ORIENT_TRANSPOSE,       // mirrors at the main diagonal
+   ORIENT_ANTITRANSPOSE,   // mirrors at the other diagonal
+   ORIENT_COUNT
+};
+
+const char* OrientationName(Orientation o);
+
+// ORIENT_COUNT for unknown names
+Orientation OrientationFromName(const char* name);
+
+// the result of the transform is height x width pixels
+bool OrientationSwapsAxes(Orientation o);
+
+// writes the pixels of the source rows [y0, y1) of the width x height
+// frame 'src' to their oriented places in 'dst'; the buffers must not
+// overlap. Bands of rows can run in parallel.
+void Orient(const unsigned char* src, unsigned char* dst, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1);
+void Orient(const unsigned short* src, unsigned short* dst, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1);
+void Orient(const unsigned int* src, unsigned int* dst, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1);
+void Orient(const unsigned long long* src, unsigned long long* dst, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1);
+
+// rows OrientInPlace() splits into bands: the top half, middle row
+// included, when the transform mirrors top and bottom, all rows otherwise
+unsigned OrientInPlaceRows(unsigned height, Orientation o);
+
+// orients rows [y0, y1) of OrientInPlaceRows() in place, and the rows they
+// trade places with; false, with the pixels untouched, for the transforms
+// that swap the axes
+bool OrientInPlace(unsigned char* pixels, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1);
+bool OrientInPlace(unsigned short* pixels, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1);
+bool OrientInPlace(unsigned int* pixels, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1);
+bool OrientInPlace(unsigned long long* pixels, unsigned width, unsigned height, Orientation o, unsigned y0, unsigned y1);
+
+#endif //_ORIENTATION_H_
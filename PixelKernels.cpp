@@ -0,0 +1,1668 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          PixelKernels.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Scalar and SIMD variants of the pixel kernels and the CPUID
+//                based selection. The AVX2 and AVX-512 variants are compiled
+//                with per function target attributes (gcc) or plain
+//                intrinsics (MSVC) and are only called after CPUID and XGETBV
+//                confirmed CPU and OS support.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "PixelKernels.h"
+#include <string.h>
+#include <algorithm>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define PIXEL_KERNELS_X86
+#endif
+
+#ifdef PIXEL_KERNELS_X86
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#define TARGET_AVX512
+#if _MSC_VER >= 1911
+#define PIXEL_KERNELS_AVX2 1
+#define PIXEL_KERNELS_AVX512 1
+#elif _MSC_VER >= 1700
+#define PIXEL_KERNELS_AVX2 1
+#define PIXEL_KERNELS_AVX512 0
+#else
+#define PIXEL_KERNELS_AVX2 0
+#define PIXEL_KERNELS_AVX512 0
+#endif
+#elif defined(__GNUC__)
+#include <cpuid.h>
+#define TARGET_AVX2 __attribute__((target("avx2,f16c")))
+#define TARGET_AVX512 __attribute__((target("avx2,f16c,avx512f,avx512bw")))
+#if __GNUC__ >= 6 || defined(__clang__)
+#define PIXEL_KERNELS_AVX2 1
+#define PIXEL_KERNELS_AVX512 1
+#else
+#define PIXEL_KERNELS_AVX2 0
+#define PIXEL_KERNELS_AVX512 0
+#endif
+#else
+#define PIXEL_KERNELS_AVX2 0
+#define PIXEL_KERNELS_AVX512 0
+#endif
+#if PIXEL_KERNELS_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+// 3x3 median as a 19 exchange sorting network (Paeth); SORT(a, b) must
+// leave the smaller value in a and the larger in b, p[4] is the median
+#define MEDIAN9_NETWORK(p, SORT) \
+   SORT(p[1], p[2]); SORT(p[4], p[5]); SORT(p[7], p[8]); \
+   SORT(p[0], p[1]); SORT(p[3], p[4]); SORT(p[6], p[7]); \
+   SORT(p[1], p[2]); SORT(p[4], p[5]); SORT(p[7], p[8]); \
+   SORT(p[0], p[3]); SORT(p[5], p[8]); SORT(p[4], p[7]); \
+   SORT(p[3], p[6]); SORT(p[1], p[4]); SORT(p[2], p[5]); \
+   SORT(p[4], p[7]); SORT(p[4], p[2]); SORT(p[6], p[4]); \
+   SORT(p[4], p[2])
+
+namespace
+{
+   ///////////////////////////////////////////////////////////////////////////
+   // scalar variants, also used for the row ends of the SIMD variants
+
+   template <class T> void ReverseScalar(T* pixels, size_t count)
+   {
+      std::reverse(pixels, pixels + count);
+   }
+
+   void SwapBytesScalar(unsigned char* a, unsigned char* b, size_t bytes)
+   {
+      std::swap_ranges(a, a + bytes, b);
+   }
+
+   ///////////////////////////////////////////////////////////////////////////
+   // transposes, blocked for any B x B tile micro kernel. A tile policy
+   // provides
+   //    Transpose(src, srcStride, dst, dstStride)   dst = src^T
+   //    Swap(a, b, stride)                           a, b = b^T, a^T
+   //    TransposeInPlace(a, stride)                  a = a^T
+   //    Prefetch(p)                                  hint the line at p
+   // for full tiles; partial tiles at the right and bottom edges are done
+   // pixel by pixel
+
+   // square blocks the rectangle transpose works through: 128 source rows
+   // and 128 destination rows of 128 pixels stay in L2 with the next block
+   const unsigned cTransposeBlock = 128;
+   // blocks the in place recursion stops at
+   const unsigned cTransposeLeaf = 64;
+
+   template <class T, int B> struct ScalarTile
+   {
+      static void Transpose(const T* src, size_t srcStride, T* dst, size_t dstStride)
+      {
+         for (int y = 0; y < B; ++y)
+            for (int x = 0; x < B; ++x)
+               dst[x * dstStride + y] = src[y * srcStride + x];
+      }
+      static void Swap(T* a, T* b, size_t stride)
+      {
+         for (int y = 0; y < B; ++y)
+            for (int x = 0; x < B; ++x)
+               std::swap(a[y * stride + x], b[x * stride + y]);
+      }
+      static void TransposeInPlace(T* a, size_t stride)
+      {
+         for (int y = 0; y < B; ++y)
+            for (int x = y + 1; x < B; ++x)
+               std::swap(a[y * stride + x], a[x * stride + y]);
+      }
+      static void Prefetch(const void*) {}
+   };
+
+   template <class T, int B, class Tile>
+   void TransposeRect(const T* src, size_t srcStride, T* dst, size_t dstStride, unsigned width, unsigned height)
+   {
+      for (unsigned by = 0; by < height; by += cTransposeBlock)
+      {
+         const unsigned ey = std::min(height, by + cTransposeBlock);
+         for (unsigned bx = 0; bx < width; bx += cTransposeBlock)
+         {
+            const unsigned ex = std::min(width, bx + cTransposeBlock);
+            // the rows of a block are a stride apart, a page or more in full
+            // frames, which the hardware prefetchers do not follow: the lines
+            // of the next block are requested while this one is transposed.
+            // Kept inline, GCC drops calls to a function that only prefetches.
+            {
+               const unsigned line = 64 / sizeof(T);
+               const unsigned nx = (ex < width) ? ex : 0;
+               const unsigned ny = (ex < width) ? by : ey;
+               const unsigned nex = std::min(width, nx + cTransposeBlock);
+               const unsigned ney = std::min(height, ny + cTransposeBlock);
+               for (unsigned y = ny; y < ney; ++y)
+                  for (unsigned x = nx; x < nex; x += line)
+                     Tile::Prefetch(src + y * srcStride + x);
+               for (unsigned x = nx; x < nex; ++x)
+                  for (unsigned y = ny; y < ney; y += line)
+                     Tile::Prefetch(dst + x * dstStride + y);
+            }
+            for (unsigned y = by; y < ey; y += B)
+            {
+               for (unsigned x = bx; x < ex; x += B)
+               {
+                  const T* s = src + y * srcStride + x;
+                  T* d = dst + x * dstStride + y;
+                  if (y + B <= ey && x + B <= ex)
+                  {
+                     Tile::Transpose(s, srcStride, d, dstStride);
+                     continue;
+                  }
+                  const unsigned h = std::min((unsigned)B, ey - y);
+                  const unsigned w = std::min((unsigned)B, ex - x);
+                  for (unsigned i = 0; i < h; ++i)
+                     for (unsigned j = 0; j < w; ++j)
+                        d[j * dstStride + i] = s[i * srcStride + j];
+               }
+            }
+         }
+      }
+   }
+
+   // swaps the rows x cols tile at (r, c) with the transposed one at (c, r)
+   template <class T, int B, class Tile>
+   inline void SwapTiles(T* pixels, size_t dim, unsigned r, unsigned c, unsigned rows, unsigned cols)
+   {
+      T* a = pixels + r * dim + c;
+      T* b = pixels + c * dim + r;
+      if (rows == (unsigned)B && cols == (unsigned)B)
+      {
+         Tile::Swap(a, b, dim);
+         return;
+      }
+      for (unsigned i = 0; i < rows; ++i)
+         for (unsigned j = 0; j < cols; ++j)
+            std::swap(a[i * dim + j], b[j * dim + i]);
+   }
+
+   // rows [r0, r1) x columns [c0, c1) above the diagonal exchanged with
+   // their mirror image; the longer side is halved until the block is a
+   // leaf, so the working set shrinks to whatever cache level holds it
+   template <class T, int B, class Tile>
+   void SwapBlocks(T* pixels, size_t dim, unsigned r0, unsigned r1, unsigned c0, unsigned c1)
+   {
+      if (r1 - r0 <= cTransposeLeaf && c1 - c0 <= cTransposeLeaf)
+      {
+         for (unsigned r = r0; r < r1; r += B)
+            for (unsigned c = c0; c < c1; c += B)
+               SwapTiles<T, B, Tile>(pixels, dim, r, c, std::min((unsigned)B, r1 - r), std::min((unsigned)B, c1 - c));
+         return;
+      }
+      // split on tile boundaries; r0 and c0 always are on one
+      if (r1 - r0 >= c1 - c0)
+      {
+         const unsigned mid = r0 + (r1 - r0) / (2 * B) * B;
+         SwapBlocks<T, B, Tile>(pixels, dim, r0, mid, c0, c1);
+         SwapBlocks<T, B, Tile>(pixels, dim, mid, r1, c0, c1);
+      }
+      else
+      {
+         const unsigned mid = c0 + (c1 - c0) / (2 * B) * B;
+         SwapBlocks<T, B, Tile>(pixels, dim, r0, r1, c0, mid);
+         SwapBlocks<T, B, Tile>(pixels, dim, r0, r1, mid, c1);
+      }
+   }
+
+   // the diagonal block [d0, d1)^2 transposed in place
+   template <class T, int B, class Tile>
+   void TransposeDiagonal(T* pixels, size_t dim, unsigned d0, unsigned d1)
+   {
+      if (d1 - d0 > cTransposeLeaf)
+      {
+         const unsigned mid = d0 + (d1 - d0) / (2 * B) * B;
+         TransposeDiagonal<T, B, Tile>(pixels, dim, d0, mid);
+         TransposeDiagonal<T, B, Tile>(pixels, dim, mid, d1);
+         SwapBlocks<T, B, Tile>(pixels, dim, d0, mid, mid, d1);
+         return;
+      }
+      for (unsigned r = d0; r < d1; r += B)
+      {
+         const unsigned n = std::min((unsigned)B, d1 - r);
+         T* a = pixels + r * dim + r;
+         if (n == (unsigned)B)
+            Tile::TransposeInPlace(a, dim);
+         else
+         {
+            for (unsigned i = 0; i < n; ++i)
+               for (unsigned j = i + 1; j < n; ++j)
+                  std::swap(a[i * dim + j], a[j * dim + i]);
+         }
+         for (unsigned c = r + B; c < d1; c += B)
+            SwapTiles<T, B, Tile>(pixels, dim, r, c, n, std::min((unsigned)B, d1 - c));
+      }
+   }
+
+   template <class T, int B, class Tile> void TransposeSquare(T* pixels, unsigned dim)
+   {
+      TransposeDiagonal<T, B, Tile>(pixels, dim, 0, dim);
+   }
+
+   void Transpose8Scalar(const unsigned char* src, size_t srcStride, unsigned char* dst, size_t dstStride, unsigned width, unsigned height)
+   {
+      TransposeRect<unsigned char, 8, ScalarTile<unsigned char, 8> >(src, srcStride, dst, dstStride, width, height);
+   }
+
+   void Transpose16Scalar(const unsigned short* src, size_t srcStride, unsigned short* dst, size_t dstStride, unsigned width, unsigned height)
+   {
+      TransposeRect<unsigned short, 8, ScalarTile<unsigned short, 8> >(src, srcStride, dst, dstStride, width, height);
+   }
+
+   void TransposeSquare8Scalar(unsigned char* pixels, unsigned dim)
+   {
+      TransposeSquare<unsigned char, 8, ScalarTile<unsigned char, 8> >(pixels, dim);
+   }
+
+   void TransposeSquare16Scalar(unsigned short* pixels, unsigned dim)
+   {
+      TransposeSquare<unsigned short, 8, ScalarTile<unsigned short, 8> >(pixels, dim);
+   }
+
+   template <class T> inline void SortPair(T& a, T& b)
+   {
+      if (b < a)
+         std::swap(a, b);
+   }
+
+   template <class T> T MedianAt(const T* above, const T* row, const T* below, unsigned x, unsigned width)
+   {
+      const unsigned l = (x > 0) ? x - 1 : 0;
+      const unsigned r = (x + 1 < width) ? x + 1 : width - 1;
+      T p[9] = {above[l], above[x], above[r], row[l], row[x], row[r], below[l], below[x], below[r]};
+      MEDIAN9_NETWORK(p, SortPair);
+      return p[4];
+   }
+
+   template <class T> void MedianScalar(const T* above, const T* row, const T* below, T* dst, unsigned width)
+   {
+      for (unsigned x = 0; x < width; ++x)
+         dst[x] = MedianAt(above, row, below, x, width);
+   }
+
+   void Widen8to16Scalar(const unsigned char* src, unsigned short* dst, size_t count)
+   {
+      for (size_t i = 0; i < count; ++i)
+         dst[i] = src[i];
+   }
+
+   union FloatBits
+   {
+      float f;
+      unsigned int u;
+   };
+
+   void HalfToFloatScalar(const unsigned short* src, float* dst, size_t count)
+   {
+      for (size_t i = 0; i < count; ++i)
+      {
+         const unsigned short h = src[i];
+         FloatBits o;
+         o.u = (unsigned int)(h & 0x7fff) << 13;
+         const unsigned int exponent = o.u & (0x7c00u << 13);
+         o.u += (127 - 15) << 23;
+         if (exponent == (0x7c00u << 13))
+         {
+            // infinity or NaN
+            o.u += (128 - 16) << 23;
+         }
+         else if (0 == exponent)
+         {
+            // zero or subnormal, renormalized by the float subtraction
+            FloatBits magic;
+            magic.u = 113u << 23;
+            o.u += 1 << 23;
+            o.f -= magic.f;
+         }
+         o.u |= (unsigned int)(h & 0x8000) << 16;
+         dst[i] = o.f;
+      }
+   }
+
+   void FloatToHalfScalar(const float* src, unsigned short* dst, size_t count)
+   {
+      for (size_t i = 0; i < count; ++i)
+      {
+         FloatBits v;
+         v.f = src[i];
+         const unsigned int sign = v.u & 0x80000000u;
+         v.u ^= sign;
+
+         unsigned int h;
+         if (v.u >= 0x47800000u)
+         {
+            // overflow to infinity, NaN stays NaN
+            h = (v.u > 0x7f800000u) ? 0x7e00 : 0x7c00;
+         }
+         else if (v.u < 0x38800000u)
+         {
+            // subnormal: adding 0.5 lines the mantissa up with the half
+            // precision subnormal bits and rounds it
+            FloatBits magic;
+            magic.u = 126u << 23;
+            v.f += magic.f;
+            h = v.u - magic.u;
+         }
+         else
+         {
+            const unsigned int mantissaOdd = (v.u >> 13) & 1;
+            v.u += 0xc8000fffu + mantissaOdd;
+            h = v.u >> 13;
+         }
+         dst[i] = (unsigned short)(h | (sign >> 16));
+      }
+   }
+
+   inline float SineValue(const float* sinK, const float* cosK, float a, float b, float pedestal, float maxValue, float factor, unsigned k)
+   {
+      return factor * std::min(maxValue, pedestal + a * cosK[k] + b * sinK[k]);
+   }
+
+   template <class T> void SineRowScalar(const float* sinK, const float* cosK, float a, float b, float pedestal, float maxValue, float factor, T* dst, unsigned count)
+   {
+      // integer pixels truncate like the original double to integer casts
+      const float top = (float)(T)~(T)0;
+      for (unsigned k = 0; k < count; ++k)
+      {
+         const float v = SineValue(sinK, cosK, a, b, pedestal, maxValue, factor, k);
+         dst[k] = (T)std::max(0.f, std::min(top, v));
+      }
+   }
+
+   void SineRowScalar32f(const float* sinK, const float* cosK, float a, float b, float pedestal, float maxValue, float factor, float* dst, unsigned count)
+   {
+      for (unsigned k = 0; k < count; ++k)
+         dst[k] = SineValue(sinK, cosK, a, b, pedestal, maxValue, factor, k);
+   }
+
+   void PackRgb32Scalar(const unsigned char* c0, const unsigned char* c1, const unsigned char* c2, unsigned int* dst, unsigned count)
+   {
+      for (unsigned k = 0; k < count; ++k)
+         dst[k] = c0[k] | ((unsigned int)c1[k] << 8) | ((unsigned int)c2[k] << 16);
+   }
+
+   void PackRgb64Scalar(const unsigned short* c0, const unsigned short* c1, const unsigned short* c2, unsigned long long* dst, unsigned count)
+   {
+      for (unsigned k = 0; k < count; ++k)
+         dst[k] = c0[k] | ((unsigned long long)c1[k] << 16) | ((unsigned long long)c2[k] << 32);
+   }
+
+   // Philox4x32 multipliers and Weyl key increments
+   const unsigned cPhiloxM0 = 0xD2511F53;
+   const unsigned cPhiloxM1 = 0xCD9E8D57;
+   const unsigned cPhiloxW0 = 0x9E3779B9;
+   const unsigned cPhiloxW1 = 0xBB67AE85;
+   const int cPhiloxRounds = 10;
+
+   void PhiloxScalar(unsigned k0, unsigned k1, unsigned first, unsigned c1, unsigned c2, unsigned c3, unsigned* dst, unsigned blocks)
+   {
+      for (unsigned i = 0; i < blocks; ++i)
+      {
+         unsigned c[4] = {first + i, c1, c2, c3};
+         unsigned key0 = k0, key1 = k1;
+         for (int r = 0; r < cPhiloxRounds; ++r)
+         {
+            const unsigned long long p0 = (unsigned long long)cPhiloxM0 * c[0];
+            const unsigned long long p1 = (unsigned long long)cPhiloxM1 * c[2];
+            c[0] = (unsigned)(p1 >> 32) ^ c[1] ^ key0;
+            c[1] = (unsigned)p1;
+            c[2] = (unsigned)(p0 >> 32) ^ c[3] ^ key1;
+            c[3] = (unsigned)p0;
+            key0 += cPhiloxW0;
+            key1 += cPhiloxW1;
+         }
+         memcpy(dst + 4 * i, c, sizeof(c));
+      }
+   }
+
+   const PixelKernels cScalarKernels =
+   {
+      ISA_SCALAR,
+      &ReverseScalar<unsigned char>,
+      &ReverseScalar<unsigned short>,
+      &ReverseScalar<unsigned int>,
+      &ReverseScalar<unsigned long long>,
+      &SwapBytesScalar,
+      &Transpose8Scalar,
+      &Transpose16Scalar,
+      &TransposeSquare8Scalar,
+      &TransposeSquare16Scalar,
+      &MedianScalar<unsigned char>,
+      &MedianScalar<unsigned short>,
+      &Widen8to16Scalar,
+      &SineRowScalar<unsigned char>,
+      &SineRowScalar<unsigned short>,
+      &SineRowScalar32f,
+      &PackRgb32Scalar,
+      &PackRgb64Scalar,
+      &HalfToFloatScalar,
+      &FloatToHalfScalar,
+      &PhiloxScalar
+   };
+
+#ifdef PIXEL_KERNELS_X86
+   ///////////////////////////////////////////////////////////////////////////
+   // SSE2 variants
+
+   inline __m128i ReverseLanes16Sse2(__m128i v)
+   {
+      v = _mm_shufflelo_epi16(v, 0x1b);
+      v = _mm_shufflehi_epi16(v, 0x1b);
+      return _mm_shuffle_epi32(v, 0x4e);
+   }
+
+   inline __m128i ReverseLanes32Sse2(__m128i v)
+   {
+      return _mm_shuffle_epi32(v, 0x1b);
+   }
+
+   inline __m128i ReverseLanes64Sse2(__m128i v)
+   {
+      return _mm_shuffle_epi32(v, 0x4e);
+   }
+
+   inline __m128i ReverseLanes8Sse2(__m128i v)
+   {
+      // swap the bytes of every word, then reverse the words
+      return ReverseLanes16Sse2(_mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+   }
+
+   // exchanges mirrored vectors from both ends towards the middle, the
+   // remaining middle part is reversed by the scalar loop
+   template <class T, class V, V (*Load)(const V*), void (*Store)(V*, V), V (*Rev)(V)>
+   inline void ReverseVectors(T* pixels, size_t count)
+   {
+      const size_t lanes = sizeof(V) / sizeof(T);
+      T* left = pixels;
+      T* right = pixels + count;
+      while ((size_t)(right - left) >= 2 * lanes)
+      {
+         right -= lanes;
+         const V l = Load(reinterpret_cast<const V*>(left));
+         const V r = Load(reinterpret_cast<const V*>(right));
+         Store(reinterpret_cast<V*>(left), Rev(r));
+         Store(reinterpret_cast<V*>(right), Rev(l));
+         left += lanes;
+      }
+      std::reverse(left, right);
+   }
+
+   inline __m128i LoadSse2(const __m128i* p) {return _mm_loadu_si128(p);}
+   inline void StoreSse2(__m128i* p, __m128i v) {_mm_storeu_si128(p, v);}
+
+   void Reverse8Sse2(unsigned char* pixels, size_t count)
+   {
+      ReverseVectors<unsigned char, __m128i, LoadSse2, StoreSse2, ReverseLanes8Sse2>(pixels, count);
+   }
+
+   void Reverse16Sse2(unsigned short* pixels, size_t count)
+   {
+      ReverseVectors<unsigned short, __m128i, LoadSse2, StoreSse2, ReverseLanes16Sse2>(pixels, count);
+   }
+
+   void Reverse32Sse2(unsigned int* pixels, size_t count)
+   {
+      ReverseVectors<unsigned int, __m128i, LoadSse2, StoreSse2, ReverseLanes32Sse2>(pixels, count);
+   }
+
+   void Reverse64Sse2(unsigned long long* pixels, size_t count)
+   {
+      ReverseVectors<unsigned long long, __m128i, LoadSse2, StoreSse2, ReverseLanes64Sse2>(pixels, count);
+   }
+
+   void SwapBytesSse2(unsigned char* a, unsigned char* b, size_t bytes)
+   {
+      size_t i = 0;
+      for (; i + 16 <= bytes; i += 16)
+      {
+         const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+         const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(a + i), vb);
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(b + i), va);
+      }
+      std::swap_ranges(a + i, a + bytes, b + i);
+   }
+
+   // transposes 8 rows of 8 words in registers
+   inline void Transpose8x16(__m128i* r)
+   {
+      __m128i t[8];
+      for (int i = 0; i < 4; ++i)
+      {
+         t[i] = _mm_unpacklo_epi16(r[2 * i], r[2 * i + 1]);
+         t[i + 4] = _mm_unpackhi_epi16(r[2 * i], r[2 * i + 1]);
+      }
+      for (int i = 0; i < 4; ++i)
+      {
+         r[i] = _mm_unpacklo_epi32(t[2 * i], t[2 * i + 1]);
+         r[i + 4] = _mm_unpackhi_epi32(t[2 * i], t[2 * i + 1]);
+      }
+      for (int i = 0; i < 4; ++i)
+      {
+         t[i] = _mm_unpacklo_epi64(r[2 * i], r[2 * i + 1]);
+         t[i + 4] = _mm_unpackhi_epi64(r[2 * i], r[2 * i + 1]);
+      }
+      // column c ends up in t[] at the bit reversed index of c
+      static const int order[8] = {0, 4, 2, 6, 1, 5, 3, 7};
+      for (int c = 0; c < 8; ++c)
+         r[c] = t[order[c]];
+   }
+
+   // transposes 16 rows of 16 bytes in registers
+   inline void Transpose16x8(__m128i* r)
+   {
+      __m128i t[16];
+      for (int i = 0; i < 8; ++i)
+      {
+         t[i] = _mm_unpacklo_epi8(r[2 * i], r[2 * i + 1]);
+         t[i + 8] = _mm_unpackhi_epi8(r[2 * i], r[2 * i + 1]);
+      }
+      for (int i = 0; i < 8; ++i)
+      {
+         r[i] = _mm_unpacklo_epi16(t[2 * i], t[2 * i + 1]);
+         r[i + 8] = _mm_unpackhi_epi16(t[2 * i], t[2 * i + 1]);
+      }
+      for (int i = 0; i < 8; ++i)
+      {
+         t[i] = _mm_unpacklo_epi32(r[2 * i], r[2 * i + 1]);
+         t[i + 8] = _mm_unpackhi_epi32(r[2 * i], r[2 * i + 1]);
+      }
+      for (int i = 0; i < 8; ++i)
+      {
+         r[i] = _mm_unpacklo_epi64(t[2 * i], t[2 * i + 1]);
+         r[i + 8] = _mm_unpackhi_epi64(t[2 * i], t[2 * i + 1]);
+      }
+      // column c ends up in r[] at the bit reversed index of c
+      static const int order[16] = {0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15};
+      for (int c = 0; c < 16; ++c)
+         t[c] = r[order[c]];
+      for (int c = 0; c < 16; ++c)
+         r[c] = t[c];
+   }
+
+   // B x B tiles of B lanes, B = 16 bytes or 8 words
+   template <class T, int B, void (*TransposeRegisters)(__m128i*)> struct Sse2Tile
+   {
+      static void Load(const T* p, size_t stride, __m128i* r)
+      {
+         for (int i = 0; i < B; ++i)
+            r[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i * stride));
+      }
+      static void Store(T* p, size_t stride, const __m128i* r)
+      {
+         for (int i = 0; i < B; ++i)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i * stride), r[i]);
+      }
+      static void Transpose(const T* src, size_t srcStride, T* dst, size_t dstStride)
+      {
+         __m128i r[B];
+         Load(src, srcStride, r);
+         TransposeRegisters(r);
+         Store(dst, dstStride, r);
+      }
+      static void Swap(T* a, T* b, size_t stride)
+      {
+         __m128i ra[B];
+         __m128i rb[B];
+         Load(a, stride, ra);
+         Load(b, stride, rb);
+         TransposeRegisters(ra);
+         TransposeRegisters(rb);
+         Store(b, stride, ra);
+         Store(a, stride, rb);
+      }
+      static void TransposeInPlace(T* a, size_t stride)
+      {
+         Transpose(a, stride, a, stride);
+      }
+      static void Prefetch(const void* p)
+      {
+         _mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+      }
+   };
+
+   typedef Sse2Tile<unsigned char, 16, Transpose16x8> Sse2Tile8;
+   typedef Sse2Tile<unsigned short, 8, Transpose8x16> Sse2Tile16;
+
+   void Transpose8Sse2(const unsigned char* src, size_t srcStride, unsigned char* dst, size_t dstStride, unsigned width, unsigned height)
+   {
+      TransposeRect<unsigned char, 16, Sse2Tile8>(src, srcStride, dst, dstStride, width, height);
+   }
+
+   void Transpose16Sse2(const unsigned short* src, size_t srcStride, unsigned short* dst, size_t dstStride, unsigned width, unsigned height)
+   {
+      TransposeRect<unsigned short, 8, Sse2Tile16>(src, srcStride, dst, dstStride, width, height);
+   }
+
+   void TransposeSquare8Sse2(unsigned char* pixels, unsigned dim)
+   {
+      TransposeSquare<unsigned char, 16, Sse2Tile8>(pixels, dim);
+   }
+
+   void TransposeSquare16Sse2(unsigned short* pixels, unsigned dim)
+   {
+      TransposeSquare<unsigned short, 8, Sse2Tile16>(pixels, dim);
+   }
+
+   // SSE2 has no unsigned 16 bit min/max: compare with the sign bit flipped
+   inline __m128i Sign16() {return _mm_set1_epi16((short)0x8000);}
+
+#define SORT_EPU8_SSE2(a, b) {const __m128i t = _mm_min_epu8(a, b); b = _mm_max_epu8(a, b); a = t;}
+#define SORT_EPI16_SSE2(a, b) {const __m128i t = _mm_min_epi16(a, b); b = _mm_max_epi16(a, b); a = t;}
+
+   // medians of the 16 columns from x, which must be interior
+   inline void Median8Sse2Block(const unsigned char* above, const unsigned char* row, const unsigned char* below, unsigned char* dst, unsigned x)
+   {
+      __m128i p[9];
+      const unsigned char* rows[3] = {above, row, below};
+      for (int r = 0; r < 3; ++r)
+         for (int c = 0; c < 3; ++c)
+            p[3 * r + c] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[r] + x + c - 1));
+      MEDIAN9_NETWORK(p, SORT_EPU8_SSE2);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), p[4]);
+   }
+
+   void Median8Sse2(const unsigned char* above, const unsigned char* row, const unsigned char* below, unsigned char* dst, unsigned width)
+   {
+      // rows without one full vector of interior columns
+      if (width < 18)
+      {
+         MedianScalar(above, row, below, dst, width);
+         return;
+      }
+      dst[0] = MedianAt(above, row, below, 0, width);
+      unsigned x = 1;
+      for (; x + 16 < width; x += 16)
+         Median8Sse2Block(above, row, below, dst, x);
+      // the rest of the interior with one vector overlapping the last
+      if (x < width - 1)
+         Median8Sse2Block(above, row, below, dst, width - 1 - 16);
+      dst[width - 1] = MedianAt(above, row, below, width - 1, width);
+   }
+
+   // medians of the 8 columns from x, which must be interior
+   inline void Median16Sse2Block(const unsigned short* above, const unsigned short* row, const unsigned short* below, unsigned short* dst, unsigned x, __m128i sign)
+   {
+      __m128i p[9];
+      const unsigned short* rows[3] = {above, row, below};
+      for (int r = 0; r < 3; ++r)
+         for (int c = 0; c < 3; ++c)
+            p[3 * r + c] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[r] + x + c - 1)), sign);
+      MEDIAN9_NETWORK(p, SORT_EPI16_SSE2);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_xor_si128(p[4], sign));
+   }
+
+   void Median16Sse2(const unsigned short* above, const unsigned short* row, const unsigned short* below, unsigned short* dst, unsigned width)
+   {
+      // rows without one full vector of interior columns
+      if (width < 10)
+      {
+         MedianScalar(above, row, below, dst, width);
+         return;
+      }
+      const __m128i sign = Sign16();
+      dst[0] = MedianAt(above, row, below, 0, width);
+      unsigned x = 1;
+      for (; x + 8 < width; x += 8)
+         Median16Sse2Block(above, row, below, dst, x, sign);
+      // the rest of the interior with one vector overlapping the last
+      if (x < width - 1)
+         Median16Sse2Block(above, row, below, dst, width - 1 - 8, sign);
+      dst[width - 1] = MedianAt(above, row, below, width - 1, width);
+   }
+
+   void Widen8to16Sse2(const unsigned char* src, unsigned short* dst, size_t count)
+   {
+      const __m128i zero = _mm_setzero_si128();
+      size_t i = 0;
+      for (; i + 16 <= count; i += 16)
+      {
+         const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi8(v, zero));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), _mm_unpackhi_epi8(v, zero));
+      }
+      Widen8to16Scalar(src + i, dst + i, count - i);
+   }
+
+   /**
+   * Half precision conversions in integer SIMD, four values per step in
+   * 32 bit lanes, with the same results as the scalar loops. Subnormals
+   * are renormalized by one float multiply or add instead of branches.
+   */
+   inline __m128 HalfToFloatSse2Step(__m128i h)
+   {
+      const __m128i expmant = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+      const __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expmant), 16);
+      // rebias the exponent by a multiply, which also normalizes subnormals
+      const __m128i magic = _mm_set1_epi32((254 - 15) << 23);
+      const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)), _mm_castsi128_ps(magic));
+      const __m128i infnan = _mm_and_si128(_mm_cmpgt_epi32(expmant, _mm_set1_epi32(0x7bff)), _mm_set1_epi32(255 << 23));
+      return _mm_or_ps(_mm_castsi128_ps(_mm_or_si128(infnan, sign)), scaled);
+   }
+
+   void HalfToFloatSse2(const unsigned short* src, float* dst, size_t count)
+   {
+      const __m128i zero = _mm_setzero_si128();
+      size_t i = 0;
+      for (; i + 8 <= count; i += 8)
+      {
+         const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+         _mm_storeu_ps(dst + i, HalfToFloatSse2Step(_mm_unpacklo_epi16(h, zero)));
+         _mm_storeu_ps(dst + i + 4, HalfToFloatSse2Step(_mm_unpackhi_epi16(h, zero)));
+      }
+      HalfToFloatScalar(src + i, dst + i, count - i);
+   }
+
+   // halves in the low 16 bits of the lanes, sign extended
+   inline __m128i FloatToHalfSse2Step(__m128 f)
+   {
+      const __m128i bits = _mm_castps_si128(f);
+      const __m128i sign = _mm_and_si128(bits, _mm_set1_epi32((int)0x80000000u));
+      const __m128i absBits = _mm_xor_si128(bits, sign);
+      const __m128 absF = _mm_castsi128_ps(absBits);
+
+      // NaN keeps a quiet NaN, everything from 65520 up is infinity
+      const __m128i isNan = _mm_castps_si128(_mm_cmpunord_ps(absF, absF));
+      const __m128i isRegular = _mm_cmpgt_epi32(_mm_set1_epi32(0x47800000), absBits);
+      const __m128i infNan = _mm_or_si128(_mm_and_si128(isNan, _mm_set1_epi32(0x0200)), _mm_set1_epi32(0x7c00));
+
+      // subnormal results: the float add rounds the mantissa into place
+      const __m128i isSubnormal = _mm_cmpgt_epi32(_mm_set1_epi32(0x38800000), absBits);
+      const __m128i magic = _mm_set1_epi32(126 << 23);
+      const __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absF, _mm_castsi128_ps(magic))), magic);
+
+      // normal results: rebias, round to nearest even, shift into place
+      const __m128i mantissaOdd = _mm_and_si128(_mm_srli_epi32(absBits, 13), _mm_set1_epi32(1));
+      const __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(absBits, _mm_set1_epi32((int)0xc8000fffu)), mantissaOdd), 13);
+
+      const __m128i finite = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+      const __m128i h = _mm_or_si128(_mm_and_si128(isRegular, finite), _mm_andnot_si128(isRegular, infNan));
+      return _mm_or_si128(h, _mm_srai_epi32(sign, 16));
+   }
+
+   void FloatToHalfSse2(const float* src, unsigned short* dst, size_t count)
+   {
+      size_t i = 0;
+      for (; i + 8 <= count; i += 8)
+      {
+         const __m128i lo = FloatToHalfSse2Step(_mm_loadu_ps(src + i));
+         const __m128i hi = FloatToHalfSse2Step(_mm_loadu_ps(src + i + 4));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(lo, hi));
+      }
+      FloatToHalfScalar(src + i, dst + i, count - i);
+   }
+
+   inline __m128 SineSse2(const float* sinK, const float* cosK, __m128 a, __m128 b, __m128 pedestal, __m128 maxValue, __m128 factor, unsigned k)
+   {
+      const __m128 v = _mm_add_ps(pedestal, _mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(cosK + k)), _mm_mul_ps(b, _mm_loadu_ps(sinK + k))));
+      return _mm_mul_ps(factor, _mm_min_ps(maxValue, v));
+   }
+
+   void SineRow8Sse2(const float* sinK, const float* cosK, float a, float b, float pedestal, float maxValue, float factor, unsigned char* dst, unsigned count)
+   {
+      const __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b), vp = _mm_set1_ps(pedestal);
+      const __m128 vm = _mm_set1_ps(maxValue), vf = _mm_set1_ps(factor);
+      unsigned k = 0;
+      for (; k + 16 <= count; k += 16)
+      {
+         // truncation, then saturating packs clamp to 0..255
+         const __m128i i0 = _mm_cvttps_epi32(SineSse2(sinK, cosK, va, vb, vp, vm, vf, k));
+         const __m128i i1 = _mm_cvttps_epi32(SineSse2(sinK, cosK, va, vb, vp, vm, vf, k + 4));
+         const __m128i i2 = _mm_cvttps_epi32(SineSse2(sinK, cosK, va, vb, vp, vm, vf, k + 8));
+         const __m128i i3 = _mm_cvttps_epi32(SineSse2(sinK, cosK, va, vb, vp, vm, vf, k + 12));
+         const __m128i w = _mm_packus_epi16(_mm_packs_epi32(i0, i1), _mm_packs_epi32(i2, i3));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + k), w);
+      }
+      SineRowScalar(sinK + k, cosK + k, a, b, pedestal, maxValue, factor, dst + k, count - k);
+   }
+
+   void SineRow16Sse2(const float* sinK, const float* cosK, float a, float b, float pedestal, float maxValue, float factor, unsigned short* dst, unsigned count)
+   {
+      const __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b), vp = _mm_set1_ps(pedestal);
+      const __m128 vm = _mm_set1_ps(maxValue), vf = _mm_set1_ps(factor);
+      const __m128 top = _mm_set1_ps(65535.f);
+      const __m128i bias = _mm_set1_epi32(32768);
+      unsigned k = 0;
+      for (; k + 8 <= count; k += 8)
+      {
+         // no unsigned 32 -> 16 bit pack in SSE2: pack signed around the
+         // bias and flip the sign bit back
+         const __m128 lo = _mm_min_ps(top, _mm_max_ps(_mm_setzero_ps(), SineSse2(sinK, cosK, va, vb, vp, vm, vf, k)));
+         const __m128 hi = _mm_min_ps(top, _mm_max_ps(_mm_setzero_ps(), SineSse2(sinK, cosK, va, vb, vp, vm, vf, k + 4)));
+         const __m128i i0 = _mm_sub_epi32(_mm_cvttps_epi32(lo), bias);
+         const __m128i i1 = _mm_sub_epi32(_mm_cvttps_epi32(hi), bias);
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + k), _mm_xor_si128(_mm_packs_epi32(i0, i1), Sign16()));
+      }
+      SineRowScalar(sinK + k, cosK + k, a, b, pedestal, maxValue, factor, dst + k, count - k);
+   }
+
+   void SineRow32fSse2(const float* sinK, const float* cosK, float a, float b, float pedestal, float maxValue, float factor, float* dst, unsigned count)
+   {
+      const __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b), vp = _mm_set1_ps(pedestal);
+      const __m128 vm = _mm_set1_ps(maxValue), vf = _mm_set1_ps(factor);
+      unsigned k = 0;
+      for (; k + 4 <= count; k += 4)
+         _mm_storeu_ps(dst + k, SineSse2(sinK, cosK, va, vb, vp, vm, vf, k));
+      SineRowScalar32f(sinK + k, cosK + k, a, b, pedestal, maxValue, factor, dst + k, count - k);
+   }
+
+   void PackRgb32Sse2(const unsigned char* c0, const unsigned char* c1, const unsigned char* c2, unsigned int* dst, unsigned count)
+   {
+      const __m128i zero = _mm_setzero_si128();
+      unsigned k = 0;
+      for (; k + 16 <= count; k += 16)
+      {
+         const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c0 + k));
+         const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c1 + k));
+         const __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c2 + k));
+         // byte pairs of channels 0, 1 and of channel 2 with zero, then
+         // pairs of pairs
+         const __m128i lo01 = _mm_unpacklo_epi8(v0, v1), hi01 = _mm_unpackhi_epi8(v0, v1);
+         const __m128i lo2 = _mm_unpacklo_epi8(v2, zero), hi2 = _mm_unpackhi_epi8(v2, zero);
+         __m128i* d = reinterpret_cast<__m128i*>(dst + k);
+         _mm_storeu_si128(d, _mm_unpacklo_epi16(lo01, lo2));
+         _mm_storeu_si128(d + 1, _mm_unpackhi_epi16(lo01, lo2));
+         _mm_storeu_si128(d + 2, _mm_unpacklo_epi16(hi01, hi2));
+         _mm_storeu_si128(d + 3, _mm_unpackhi_epi16(hi01, hi2));
+      }
+      PackRgb32Scalar(c0 + k, c1 + k, c2 + k, dst + k, count - k);
+   }
+
+   void PackRgb64Sse2(const unsigned short* c0, const unsigned short* c1, const unsigned short* c2, unsigned long long* dst, unsigned count)
+   {
+      const __m128i zero = _mm_setzero_si128();
+      unsigned k = 0;
+      for (; k + 8 <= count; k += 8)
+      {
+         const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c0 + k));
+         const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c1 + k));
+         const __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c2 + k));
+         const __m128i lo01 = _mm_unpacklo_epi16(v0, v1), hi01 = _mm_unpackhi_epi16(v0, v1);
+         const __m128i lo2 = _mm_unpacklo_epi16(v2, zero), hi2 = _mm_unpackhi_epi16(v2, zero);
+         __m128i* d = reinterpret_cast<__m128i*>(dst + k);
+         _mm_storeu_si128(d, _mm_unpacklo_epi32(lo01, lo2));
+         _mm_storeu_si128(d + 1, _mm_unpackhi_epi32(lo01, lo2));
+         _mm_storeu_si128(d + 2, _mm_unpacklo_epi32(hi01, hi2));
+         _mm_storeu_si128(d + 3, _mm_unpackhi_epi32(hi01, hi2));
+      }
+      PackRgb64Scalar(c0 + k, c1 + k, c2 + k, dst + k, count - k);
+   }
+
+   // high and low halves of the 32 x 32 bit products of the lanes of 'a'
+   // and 'm'; mul_epu32 multiplies the even lanes only
+   inline void MulHiLoSse2(__m128i a, __m128i m, __m128i& hi, __m128i& lo)
+   {
+      const __m128i p02 = _mm_mul_epu32(a, m);
+      const __m128i p13 = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+      lo = _mm_unpacklo_epi32(_mm_shuffle_epi32(p02, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(p13, _MM_SHUFFLE(0, 0, 2, 0)));
+      hi = _mm_unpacklo_epi32(_mm_shuffle_epi32(p02, _MM_SHUFFLE(0, 0, 3, 1)), _mm_shuffle_epi32(p13, _MM_SHUFFLE(0, 0, 3, 1)));
+   }
+
+   void PhiloxSse2(unsigned k0, unsigned k1, unsigned first, unsigned c1, unsigned c2, unsigned c3, unsigned* dst, unsigned blocks)
+   {
+      const __m128i m0 = _mm_set1_epi32((int)cPhiloxM0), m1 = _mm_set1_epi32((int)cPhiloxM1);
+      unsigned i = 0;
+      for (; i + 4 <= blocks; i += 4)
+      {
+         // word w of four consecutive counters per register
+         __m128i c[4];
+         c[0] = _mm_add_epi32(_mm_set1_epi32((int)(first + i)), _mm_setr_epi32(0, 1, 2, 3));
+         c[1] = _mm_set1_epi32((int)c1);
+         c[2] = _mm_set1_epi32((int)c2);
+         c[3] = _mm_set1_epi32((int)c3);
+         unsigned key0 = k0, key1 = k1;
+         for (int r = 0; r < cPhiloxRounds; ++r)
+         {
+            __m128i hi0, lo0, hi1, lo1;
+            MulHiLoSse2(c[0], m0, hi0, lo0);
+            MulHiLoSse2(c[2], m1, hi1, lo1);
+            c[0] = _mm_xor_si128(_mm_xor_si128(hi1, c[1]), _mm_set1_epi32((int)key0));
+            c[1] = lo1;
+            c[2] = _mm_xor_si128(_mm_xor_si128(hi0, c[3]), _mm_set1_epi32((int)key1));
+            c[3] = lo0;
+            key0 += cPhiloxW0;
+            key1 += cPhiloxW1;
+         }
+         // 4x4 transpose to the four words of each counter
+         const __m128i t0 = _mm_unpacklo_epi32(c[0], c[1]), t1 = _mm_unpacklo_epi32(c[2], c[3]);
+         const __m128i t2 = _mm_unpackhi_epi32(c[0], c[1]), t3 = _mm_unpackhi_epi32(c[2], c[3]);
+         __m128i* d = reinterpret_cast<__m128i*>(dst + 4 * i);
+         _mm_storeu_si128(d, _mm_unpacklo_epi64(t0, t1));
+         _mm_storeu_si128(d + 1, _mm_unpackhi_epi64(t0, t1));
+         _mm_storeu_si128(d + 2, _mm_unpacklo_epi64(t2, t3));
+         _mm_storeu_si128(d + 3, _mm_unpackhi_epi64(t2, t3));
+      }
+      PhiloxScalar(k0, k1, first + i, c1, c2, c3, dst + 4 * i, blocks - i);
+   }
+
+   const PixelKernels cSse2Kernels =
+   {
+      ISA_SSE2,
+      &Reverse8Sse2,
+      &Reverse16Sse2,
+      &Reverse32Sse2,
+      &Reverse64Sse2,
+      &SwapBytesSse2,
+      &Transpose8Sse2,
+      &Transpose16Sse2,
+      &TransposeSquare8Sse2,
+      &TransposeSquare16Sse2,
+      &Median8Sse2,
+      &Median16Sse2,
+      &Widen8to16Sse2,
+      &SineRow8Sse2,
+      &SineRow16Sse2,
+      &SineRow32fSse2,
+      &PackRgb32Sse2,
+      &PackRgb64Sse2,
+      &HalfToFloatSse2,
+      &FloatToHalfSse2,
+      &PhiloxSse2
+   };
+
+#if PIXEL_KERNELS_AVX2
+   ///////////////////////////////////////////////////////////////////////////
+   // AVX2 variants; transposes and the colour packs stay on the SSE2 code
+
+   TARGET_AVX2 void Reverse8Avx2(unsigned char* pixels, size_t count)
+   {
+      const __m256i mask = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+         15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+      unsigned char* left = pixels;
+      unsigned char* right = pixels + count;
+      while (right - left >= 64)
+      {
+         right -= 32;
+         const __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left));
+         const __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right));
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(left), _mm256_permute4x64_epi64(_mm256_shuffle_epi8(r, mask), 0x4e));
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(right), _mm256_permute4x64_epi64(_mm256_shuffle_epi8(l, mask), 0x4e));
+         left += 32;
+      }
+      Reverse8Sse2(left, right - left);
+   }
+
+   TARGET_AVX2 void Reverse16Avx2(unsigned short* pixels, size_t count)
+   {
+      const __m256i mask = _mm256_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1,
+         14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+      unsigned short* left = pixels;
+      unsigned short* right = pixels + count;
+      while (right - left >= 32)
+      {
+         right -= 16;
+         const __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left));
+         const __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right));
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(left), _mm256_permute4x64_epi64(_mm256_shuffle_epi8(r, mask), 0x4e));
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(right), _mm256_permute4x64_epi64(_mm256_shuffle_epi8(l, mask), 0x4e));
+         left += 16;
+      }
+      Reverse16Sse2(left, right - left);
+   }
+
+   TARGET_AVX2 void Reverse32Avx2(unsigned int* pixels, size_t count)
+   {
+      const __m256i index = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+      unsigned int* left = pixels;
+      unsigned int* right = pixels + count;
+      while (right - left >= 16)
+      {
+         right -= 8;
+         const __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left));
+         const __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right));
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(left), _mm256_permutevar8x32_epi32(r, index));
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(right), _mm256_permutevar8x32_epi32(l, index));
+         left += 8;
+      }
+      Reverse32Sse2(left, right - left);
+   }
+
+   TARGET_AVX2 void Reverse64Avx2(unsigned long long* pixels, size_t count)
+   {
+      unsigned long long* left = pixels;
+      unsigned long long* right = pixels + count;
+      while (right - left >= 8)
+      {
+         right -= 4;
+         const __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left));
+         const __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right));
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(left), _mm256_permute4x64_epi64(r, 0x1b));
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(right), _mm256_permute4x64_epi64(l, 0x1b));
+         left += 4;
+      }
+      Reverse64Sse2(left, right - left);
+   }
+
+   TARGET_AVX2 void SwapBytesAvx2(unsigned char* a, unsigned char* b, size_t bytes)
+   {
+      size_t i = 0;
+      for (; i + 32 <= bytes; i += 32)
+      {
+         const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+         const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(a + i), vb);
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(b + i), va);
+      }
+      std::swap_ranges(a + i, a + bytes, b + i);
+   }
+
+#define SORT_EPU8_AVX2(a, b) {const __m256i t = _mm256_min_epu8(a, b); b = _mm256_max_epu8(a, b); a = t;}
+#define SORT_EPU16_AVX2(a, b) {const __m256i t = _mm256_min_epu16(a, b); b = _mm256_max_epu16(a, b); a = t;}
+
+   // medians of the 32 columns from x, which must be interior
+   TARGET_AVX2 inline void Median8Avx2Block(const unsigned char* above, const unsigned char* row, const unsigned char* below, unsigned char* dst, unsigned x)
+   {
+      __m256i p[9];
+      const unsigned char* rows[3] = {above, row, below};
+      for (int r = 0; r < 3; ++r)
+         for (int c = 0; c < 3; ++c)
+            p[3 * r + c] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[r] + x + c - 1));
+      MEDIAN9_NETWORK(p, SORT_EPU8_AVX2);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), p[4]);
+   }
+
+   TARGET_AVX2 void Median8Avx2(const unsigned char* above, const unsigned char* row, const unsigned char* below, unsigned char* dst, unsigned width)
+   {
+      // rows without one full vector of interior columns
+      if (width < 34)
+      {
+         Median8Sse2(above, row, below, dst, width);
+         return;
+      }
+      dst[0] = MedianAt(above, row, below, 0, width);
+      unsigned x = 1;
+      for (; x + 32 < width; x += 32)
+         Median8Avx2Block(above, row, below, dst, x);
+      // the rest of the interior with one vector overlapping the last
+      if (x < width - 1)
+         Median8Avx2Block(above, row, below, dst, width - 1 - 32);
+      dst[width - 1] = MedianAt(above, row, below, width - 1, width);
+   }
+
+   // medians of the 16 columns from x, which must be interior
+   TARGET_AVX2 inline void Median16Avx2Block(const unsigned short* above, const unsigned short* row, const unsigned short* below, unsigned short* dst, unsigned x)
+   {
+      __m256i p[9];
+      const unsigned short* rows[3] = {above, row, below};
+      for (int r = 0; r < 3; ++r)
+         for (int c = 0; c < 3; ++c)
+            p[3 * r + c] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[r] + x + c - 1));
+      MEDIAN9_NETWORK(p, SORT_EPU16_AVX2);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), p[4]);
+   }
+
+   TARGET_AVX2 void Median16Avx2(const unsigned short* above, const unsigned short* row, const unsigned short* below, unsigned short* dst, unsigned width)
+   {
+      // rows without one full vector of interior columns
+      if (width < 18)
+      {
+         Median16Sse2(above, row, below, dst, width);
+         return;
+      }
+      dst[0] = MedianAt(above, row, below, 0, width);
+      unsigned x = 1;
+      for (; x + 16 < width; x += 16)
+         Median16Avx2Block(above, row, below, dst, x);
+      // the rest of the interior with one vector overlapping the last
+      if (x < width - 1)
+         Median16Avx2Block(above, row, below, dst, width - 1 - 16);
+      dst[width - 1] = MedianAt(above, row, below, width - 1, width);
+   }
+
+   TARGET_AVX2 void Widen8to16Avx2(const unsigned char* src, unsigned short* dst, size_t count)
+   {
+      size_t i = 0;
+      for (; i + 16 <= count; i += 16)
+      {
+         const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_cvtepu8_epi16(v));
+      }
+      Widen8to16Scalar(src + i, dst + i, count - i);
+   }
+
+   // F16C, part of the AVX2 level
+   TARGET_AVX2 void HalfToFloatAvx2(const unsigned short* src, float* dst, size_t count)
+   {
+      size_t i = 0;
+      for (; i + 8 <= count; i += 8)
+         _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+      _mm256_zeroupper();
+      HalfToFloatScalar(src + i, dst + i, count - i);
+   }
+
+   TARGET_AVX2 void FloatToHalfAvx2(const float* src, unsigned short* dst, size_t count)
+   {
+      size_t i = 0;
+      for (; i + 8 <= count; i += 8)
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+      _mm256_zeroupper();
+      FloatToHalfScalar(src + i, dst + i, count - i);
+   }
+
+   TARGET_AVX2 inline __m256 SineAvx2(const float* sinK, const float* cosK, __m256 a, __m256 b, __m256 pedestal, __m256 maxValue, __m256 factor, unsigned k)
+   {
+      const __m256 v = _mm256_add_ps(pedestal, _mm256_add_ps(_mm256_mul_ps(a, _mm256_loadu_ps(cosK + k)), _mm256_mul_ps(b, _mm256_loadu_ps(sinK + k))));
+      return _mm256_mul_ps(factor, _mm256_min_ps(maxValue, v));
+   }
+
+   TARGET_AVX2 void SineRow8Avx2(const float* sinK, const float* cosK, float a, float b, float pedestal, float maxValue, float factor, unsigned char* dst, unsigned count)
+   {
+      const __m256 va = _mm256_set1_ps(a), vb = _mm256_set1_ps(b), vp = _mm256_set1_ps(pedestal);
+      const __m256 vm = _mm256_set1_ps(maxValue), vf = _mm256_set1_ps(factor);
+      unsigned k = 0;
+      for (; k + 16 <= count; k += 16)
+      {
+         const __m256i i0 = _mm256_cvttps_epi32(SineAvx2(sinK, cosK, va, vb, vp, vm, vf, k));
+         const __m256i i1 = _mm256_cvttps_epi32(SineAvx2(sinK, cosK, va, vb, vp, vm, vf, k + 8));
+         // the packs work per 128 bit lane: reorder the quadwords afterwards
+         const __m256i w = _mm256_permute4x64_epi64(_mm256_packs_epi32(i0, i1), 0xd8);
+         const __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(w), _mm256_extracti128_si256(w, 1));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + k), bytes);
+      }
+      // the tail is legacy SSE code that stalls on dirty upper halves
+      _mm256_zeroupper();
+      SineRowScalar(sinK + k, cosK + k, a, b, pedestal, maxValue, factor, dst + k, count - k);
+   }
+
+   TARGET_AVX2 void SineRow16Avx2(const float* sinK, const float* cosK, float a, float b, float pedestal, float maxValue, float factor, unsigned short* dst, unsigned count)
+   {
+      const __m256 va = _mm256_set1_ps(a), vb = _mm256_set1_ps(b), vp = _mm256_set1_ps(pedestal);
+      const __m256 vm = _mm256_set1_ps(maxValue), vf = _mm256_set1_ps(factor);
+      unsigned k = 0;
+      for (; k + 16 <= count; k += 16)
+      {
+         const __m256i i0 = _mm256_cvttps_epi32(SineAvx2(sinK, cosK, va, vb, vp, vm, vf, k));
+         const __m256i i1 = _mm256_cvttps_epi32(SineAvx2(sinK, cosK, va, vb, vp, vm, vf, k + 8));
+         const __m256i w = _mm256_permute4x64_epi64(_mm256_packus_epi32(i0, i1), 0xd8);
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + k), w);
+      }
+      _mm256_zeroupper();
+      SineRowScalar(sinK + k, cosK + k, a, b, pedestal, maxValue, factor, dst + k, count - k);
+   }
+
+   TARGET_AVX2 void SineRow32fAvx2(const float* sinK, const float* cosK, float a, float b, float pedestal, float maxValue, float factor, float* dst, unsigned count)
+   {
+      const __m256 va = _mm256_set1_ps(a), vb = _mm256_set1_ps(b), vp = _mm256_set1_ps(pedestal);
+      const __m256 vm = _mm256_set1_ps(maxValue), vf = _mm256_set1_ps(factor);
+      unsigned k = 0;
+      for (; k + 8 <= count; k += 8)
+         _mm256_storeu_ps(dst + k, SineAvx2(sinK, cosK, va, vb, vp, vm, vf, k));
+      SineRowScalar32f(sinK + k, cosK + k, a, b, pedestal, maxValue, factor, dst + k, count - k);
+   }
+
+   TARGET_AVX2 inline void MulHiLoAvx2(__m256i a, __m256i m, __m256i& hi, __m256i& lo)
+   {
+      const __m256i p02 = _mm256_mul_epu32(a, m);
+      const __m256i p13 = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+      lo = _mm256_unpacklo_epi32(_mm256_shuffle_epi32(p02, _MM_SHUFFLE(0, 0, 2, 0)), _mm256_shuffle_epi32(p13, _MM_SHUFFLE(0, 0, 2, 0)));
+      hi = _mm256_unpacklo_epi32(_mm256_shuffle_epi32(p02, _MM_SHUFFLE(0, 0, 3, 1)), _mm256_shuffle_epi32(p13, _MM_SHUFFLE(0, 0, 3, 1)));
+   }
+
+   TARGET_AVX2 void PhiloxAvx2(unsigned k0, unsigned k1, unsigned first, unsigned c1, unsigned c2, unsigned c3, unsigned* dst, unsigned blocks)
+   {
+      const __m256i m0 = _mm256_set1_epi32((int)cPhiloxM0), m1 = _mm256_set1_epi32((int)cPhiloxM1);
+      unsigned i = 0;
+      for (; i + 8 <= blocks; i += 8)
+      {
+         __m256i c[4];
+         c[0] = _mm256_add_epi32(_mm256_set1_epi32((int)(first + i)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+         c[1] = _mm256_set1_epi32((int)c1);
+         c[2] = _mm256_set1_epi32((int)c2);
+         c[3] = _mm256_set1_epi32((int)c3);
+         unsigned key0 = k0, key1 = k1;
+         for (int r = 0; r < cPhiloxRounds; ++r)
+         {
+            __m256i hi0, lo0, hi1, lo1;
+            MulHiLoAvx2(c[0], m0, hi0, lo0);
+            MulHiLoAvx2(c[2], m1, hi1, lo1);
+            c[0] = _mm256_xor_si256(_mm256_xor_si256(hi1, c[1]), _mm256_set1_epi32((int)key0));
+            c[1] = lo1;
+            c[2] = _mm256_xor_si256(_mm256_xor_si256(hi0, c[3]), _mm256_set1_epi32((int)key1));
+            c[3] = lo0;
+            key0 += cPhiloxW0;
+            key1 += cPhiloxW1;
+         }
+         // the unpacks transpose each 128 bit lane: counters 0-3 end up in
+         // the low lanes, 4-7 in the high ones
+         const __m256i t0 = _mm256_unpacklo_epi32(c[0], c[1]), t1 = _mm256_unpacklo_epi32(c[2], c[3]);
+         const __m256i t2 = _mm256_unpackhi_epi32(c[0], c[1]), t3 = _mm256_unpackhi_epi32(c[2], c[3]);
+         const __m256i b0 = _mm256_unpacklo_epi64(t0, t1), b1 = _mm256_unpackhi_epi64(t0, t1);
+         const __m256i b2 = _mm256_unpacklo_epi64(t2, t3), b3 = _mm256_unpackhi_epi64(t2, t3);
+         __m256i* d = reinterpret_cast<__m256i*>(dst + 4 * i);
+         _mm256_storeu_si256(d, _mm256_permute2x128_si256(b0, b1, 0x20));
+         _mm256_storeu_si256(d + 1, _mm256_permute2x128_si256(b2, b3, 0x20));
+         _mm256_storeu_si256(d + 2, _mm256_permute2x128_si256(b0, b1, 0x31));
+         _mm256_storeu_si256(d + 3, _mm256_permute2x128_si256(b2, b3, 0x31));
+      }
+      _mm256_zeroupper();
+      PhiloxSse2(k0, k1, first + i, c1, c2, c3, dst + 4 * i, blocks - i);
+   }
+
+   const PixelKernels cAvx2Kernels =
+   {
+      ISA_AVX2,
+      &Reverse8Avx2,
+      &Reverse16Avx2,
+      &Reverse32Avx2,
+      &Reverse64Avx2,
+      &SwapBytesAvx2,
+      &Transpose8Sse2,
+      &Transpose16Sse2,
+      &TransposeSquare8Sse2,
+      &TransposeSquare16Sse2,
+      &Median8Avx2,
+      &Median16Avx2,
+      &Widen8to16Avx2,
+      &SineRow8Avx2,
+      &SineRow16Avx2,
+      &SineRow32fAvx2,
+      &PackRgb32Sse2,
+      &PackRgb64Sse2,
+      &HalfToFloatAvx2,
+      &FloatToHalfAvx2,
+      &PhiloxAvx2
+   };
+#endif
+
+#if PIXEL_KERNELS_AVX512
+   ///////////////////////////////////////////////////////////////////////////
+   // AVX-512 variants; transposes, the synthetic rows and the half
+   // precision conversions stay on narrower code, they are bound by memory
+   // or by the table loads
+
+   const unsigned char cReverseBytes[64] =
+   {
+      15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+      15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+      15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+      15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+   };
+
+   const unsigned short cReverseWords[32] =
+   {
+      31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16,
+      15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+   };
+
+   TARGET_AVX512 void Reverse8Avx512(unsigned char* pixels, size_t count)
+   {
+      // reverse the bytes of every lane, then the order of the lanes
+      const __m512i mask = _mm512_loadu_si512(cReverseBytes);
+      const __m512i lanes = _mm512_set_epi64(1, 0, 3, 2, 5, 4, 7, 6);
+      unsigned char* left = pixels;
+      unsigned char* right = pixels + count;
+      while (right - left >= 128)
+      {
+         right -= 64;
+         const __m512i l = _mm512_loadu_si512(left);
+         const __m512i r = _mm512_loadu_si512(right);
+         _mm512_storeu_si512(left, _mm512_permutexvar_epi64(lanes, _mm512_shuffle_epi8(r, mask)));
+         _mm512_storeu_si512(right, _mm512_permutexvar_epi64(lanes, _mm512_shuffle_epi8(l, mask)));
+         left += 64;
+      }
+      Reverse8Avx2(left, right - left);
+   }
+
+   TARGET_AVX512 void Reverse16Avx512(unsigned short* pixels, size_t count)
+   {
+      const __m512i index = _mm512_loadu_si512(cReverseWords);
+      unsigned short* left = pixels;
+      unsigned short* right = pixels + count;
+      while (right - left >= 64)
+      {
+         right -= 32;
+         const __m512i l = _mm512_loadu_si512(left);
+         const __m512i r = _mm512_loadu_si512(right);
+         _mm512_storeu_si512(left, _mm512_permutexvar_epi16(index, r));
+         _mm512_storeu_si512(right, _mm512_permutexvar_epi16(index, l));
+         left += 32;
+      }
+      Reverse16Avx2(left, right - left);
+   }
+
+   TARGET_AVX512 void Reverse32Avx512(unsigned int* pixels, size_t count)
+   {
+      const __m512i index = _mm512_set_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+      unsigned int* left = pixels;
+      unsigned int* right = pixels + count;
+      while (right - left >= 32)
+      {
+         right -= 16;
+         const __m512i l = _mm512_loadu_si512(left);
+         const __m512i r = _mm512_loadu_si512(right);
+         _mm512_storeu_si512(left, _mm512_permutexvar_epi32(index, r));
+         _mm512_storeu_si512(right, _mm512_permutexvar_epi32(index, l));
+         left += 16;
+      }
+      Reverse32Avx2(left, right - left);
+   }
+
+   TARGET_AVX512 void Reverse64Avx512(unsigned long long* pixels, size_t count)
+   {
+      const __m512i index = _mm512_set_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+      unsigned long long* left = pixels;
+      unsigned long long* right = pixels + count;
+      while (right - left >= 16)
+      {
+         right -= 8;
+         const __m512i l = _mm512_loadu_si512(left);
+         const __m512i r = _mm512_loadu_si512(right);
+         _mm512_storeu_si512(left, _mm512_permutexvar_epi64(index, r));
+         _mm512_storeu_si512(right, _mm512_permutexvar_epi64(index, l));
+         left += 8;
+      }
+      Reverse64Avx2(left, right - left);
+   }
+
+   TARGET_AVX512 void SwapBytesAvx512(unsigned char* a, unsigned char* b, size_t bytes)
+   {
+      size_t i = 0;
+      for (; i + 64 <= bytes; i += 64)
+      {
+         const __m512i va = _mm512_loadu_si512(a + i);
+         const __m512i vb = _mm512_loadu_si512(b + i);
+         _mm512_storeu_si512(a + i, vb);
+         _mm512_storeu_si512(b + i, va);
+      }
+      std::swap_ranges(a + i, a + bytes, b + i);
+   }
+
+#define SORT_EPU8_AVX512(a, b) {const __m512i t = _mm512_min_epu8(a, b); b = _mm512_max_epu8(a, b); a = t;}
+#define SORT_EPU16_AVX512(a, b) {const __m512i t = _mm512_min_epu16(a, b); b = _mm512_max_epu16(a, b); a = t;}
+
+   // medians of the 64 columns from x, which must be interior
+   TARGET_AVX512 inline void Median8Avx512Block(const unsigned char* above, const unsigned char* row, const unsigned char* below, unsigned char* dst, unsigned x)
+   {
+      __m512i p[9];
+      const unsigned char* rows[3] = {above, row, below};
+      for (int r = 0; r < 3; ++r)
+         for (int c = 0; c < 3; ++c)
+            p[3 * r + c] = _mm512_loadu_si512(rows[r] + x + c - 1);
+      MEDIAN9_NETWORK(p, SORT_EPU8_AVX512);
+      _mm512_storeu_si512(dst + x, p[4]);
+   }
+
+   TARGET_AVX512 void Median8Avx512(const unsigned char* above, const unsigned char* row, const unsigned char* below, unsigned char* dst, unsigned width)
+   {
+      // rows without one full vector of interior columns
+      if (width < 66)
+      {
+         Median8Avx2(above, row, below, dst, width);
+         return;
+      }
+      dst[0] = MedianAt(above, row, below, 0, width);
+      unsigned x = 1;
+      for (; x + 64 < width; x += 64)
+         Median8Avx512Block(above, row, below, dst, x);
+      // the rest of the interior with one vector overlapping the last
+      if (x < width - 1)
+         Median8Avx512Block(above, row, below, dst, width - 1 - 64);
+      dst[width - 1] = MedianAt(above, row, below, width - 1, width);
+   }
+
+   // medians of the 32 columns from x, which must be interior
+   TARGET_AVX512 inline void Median16Avx512Block(const unsigned short* above, const unsigned short* row, const unsigned short* below, unsigned short* dst, unsigned x)
+   {
+      __m512i p[9];
+      const unsigned short* rows[3] = {above, row, below};
+      for (int r = 0; r < 3; ++r)
+         for (int c = 0; c < 3; ++c)
+            p[3 * r + c] = _mm512_loadu_si512(rows[r] + x + c - 1);
+      MEDIAN9_NETWORK(p, SORT_EPU16_AVX512);
+      _mm512_storeu_si512(dst + x, p[4]);
+   }
+
+   TARGET_AVX512 void Median16Avx512(const unsigned short* above, const unsigned short* row, const unsigned short* below, unsigned short* dst, unsigned width)
+   {
+      // rows without one full vector of interior columns
+      if (width < 34)
+      {
+         Median16Avx2(above, row, below, dst, width);
+         return;
+      }
+      dst[0] = MedianAt(above, row, below, 0, width);
+      unsigned x = 1;
+      for (; x + 32 < width; x += 32)
+         Median16Avx512Block(above, row, below, dst, x);
+      // the rest of the interior with one vector overlapping the last
+      if (x < width - 1)
+         Median16Avx512Block(above, row, below, dst, width - 1 - 32);
+      dst[width - 1] = MedianAt(above, row, below, width - 1, width);
+   }
+
+   TARGET_AVX512 void Widen8to16Avx512(const unsigned char* src, unsigned short* dst, size_t count)
+   {
+      size_t i = 0;
+      for (; i + 32 <= count; i += 32)
+      {
+         const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+         _mm512_storeu_si512(dst + i, _mm512_cvtepu8_epi16(v));
+      }
+      Widen8to16Scalar(src + i, dst + i, count - i);
+   }
+
+   TARGET_AVX512 inline void MulHiLoAvx512(__m512i a, __m512i m, __m512i& hi, __m512i& lo)
+   {
+      const __m512i p02 = _mm512_mul_epu32(a, m);
+      const __m512i p13 = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), m);
+      lo = _mm512_unpacklo_epi32(_mm512_shuffle_epi32(p02, (_MM_PERM_ENUM)_MM_SHUFFLE(0, 0, 2, 0)), _mm512_shuffle_epi32(p13, (_MM_PERM_ENUM)_MM_SHUFFLE(0, 0, 2, 0)));
+      hi = _mm512_unpacklo_epi32(_mm512_shuffle_epi32(p02, (_MM_PERM_ENUM)_MM_SHUFFLE(0, 0, 3, 1)), _mm512_shuffle_epi32(p13, (_MM_PERM_ENUM)_MM_SHUFFLE(0, 0, 3, 1)));
+   }
+
+   TARGET_AVX512 void PhiloxAvx512(unsigned k0, unsigned k1, unsigned first, unsigned c1, unsigned c2, unsigned c3, unsigned* dst, unsigned blocks)
+   {
+      const __m512i m0 = _mm512_set1_epi32((int)cPhiloxM0), m1 = _mm512_set1_epi32((int)cPhiloxM1);
+      const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+      unsigned i = 0;
+      for (; i + 16 <= blocks; i += 16)
+      {
+         __m512i c[4];
+         c[0] = _mm512_add_epi32(_mm512_set1_epi32((int)(first + i)), lanes);
+         c[1] = _mm512_set1_epi32((int)c1);
+         c[2] = _mm512_set1_epi32((int)c2);
+         c[3] = _mm512_set1_epi32((int)c3);
+         unsigned key0 = k0, key1 = k1;
+         for (int r = 0; r < cPhiloxRounds; ++r)
+         {
+            __m512i hi0, lo0, hi1, lo1;
+            MulHiLoAvx512(c[0], m0, hi0, lo0);
+            MulHiLoAvx512(c[2], m1, hi1, lo1);
+            c[0] = _mm512_xor_si512(_mm512_xor_si512(hi1, c[1]), _mm512_set1_epi32((int)key0));
+            c[1] = lo1;
+            c[2] = _mm512_xor_si512(_mm512_xor_si512(hi0, c[3]), _mm512_set1_epi32((int)key1));
+            c[3] = lo0;
+            key0 += cPhiloxW0;
+            key1 += cPhiloxW1;
+         }
+         // per 128 bit lane transposes: lane l holds counters 4l .. 4l+3
+         const __m512i t0 = _mm512_unpacklo_epi32(c[0], c[1]), t1 = _mm512_unpacklo_epi32(c[2], c[3]);
+         const __m512i t2 = _mm512_unpackhi_epi32(c[0], c[1]), t3 = _mm512_unpackhi_epi32(c[2], c[3]);
+         const __m512i b0 = _mm512_unpacklo_epi64(t0, t1), b1 = _mm512_unpackhi_epi64(t0, t1);
+         const __m512i b2 = _mm512_unpacklo_epi64(t2, t3), b3 = _mm512_unpackhi_epi64(t2, t3);
+         __m128i* d = reinterpret_cast<__m128i*>(dst + 4 * i);
+         _mm_storeu_si128(d, _mm512_castsi512_si128(b0));
+         _mm_storeu_si128(d + 1, _mm512_castsi512_si128(b1));
+         _mm_storeu_si128(d + 2, _mm512_castsi512_si128(b2));
+         _mm_storeu_si128(d + 3, _mm512_castsi512_si128(b3));
+         _mm_storeu_si128(d + 4, _mm512_extracti32x4_epi32(b0, 1));
+         _mm_storeu_si128(d + 5, _mm512_extracti32x4_epi32(b1, 1));
+         _mm_storeu_si128(d + 6, _mm512_extracti32x4_epi32(b2, 1));
+         _mm_storeu_si128(d + 7, _mm512_extracti32x4_epi32(b3, 1));
+         _mm_storeu_si128(d + 8, _mm512_extracti32x4_epi32(b0, 2));
+         _mm_storeu_si128(d + 9, _mm512_extracti32x4_epi32(b1, 2));
+         _mm_storeu_si128(d + 10, _mm512_extracti32x4_epi32(b2, 2));
+         _mm_storeu_si128(d + 11, _mm512_extracti32x4_epi32(b3, 2));
+         _mm_storeu_si128(d + 12, _mm512_extracti32x4_epi32(b0, 3));
+         _mm_storeu_si128(d + 13, _mm512_extracti32x4_epi32(b1, 3));
+         _mm_storeu_si128(d + 14, _mm512_extracti32x4_epi32(b2, 3));
+         _mm_storeu_si128(d + 15, _mm512_extracti32x4_epi32(b3, 3));
+      }
+      _mm256_zeroupper();
+      PhiloxAvx2(k0, k1, first + i, c1, c2, c3, dst + 4 * i, blocks - i);
+   }
+
+   const PixelKernels cAvx512Kernels =
+   {
+      ISA_AVX512,
+      &Reverse8Avx512,
+      &Reverse16Avx512,
+      &Reverse32Avx512,
+      &Reverse64Avx512,
+      &SwapBytesAvx512,
+      &Transpose8Sse2,
+      &Transpose16Sse2,
+      &TransposeSquare8Sse2,
+      &TransposeSquare16Sse2,
+      &Median8Avx512,
+      &Median16Avx512,
+      &Widen8to16Avx512,
+      &SineRow8Avx2,
+      &SineRow16Avx2,
+      &SineRow32fAvx2,
+      &PackRgb32Sse2,
+      &PackRgb64Sse2,
+      &HalfToFloatAvx2,
+      &FloatToHalfAvx2,
+      &PhiloxAvx512
+   };
+#endif
+
+   ///////////////////////////////////////////////////////////////////////////
+   // CPUID
+
+   void CpuId(int leaf, int subleaf, unsigned regs[4])
+   {
+#if defined(_MSC_VER)
+      int r[4];
+      __cpuidex(r, leaf, subleaf);
+      for (int i = 0; i < 4; ++i)
+         regs[i] = (unsigned)r[i];
+#else
+      __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+   }
+
+   // register state the OS saves on context switches
+   unsigned long long XGetBv()
+   {
+#if defined(_MSC_VER)
+#if PIXEL_KERNELS_AVX2
+      return _xgetbv(0);
+#else
+      return 0;
+#endif
+#else
+      unsigned eax, edx;
+      __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+      return ((unsigned long long)edx << 32) | eax;
+#endif
+   }
+#endif // PIXEL_KERNELS_X86
+
+   PixelIsa DetectIsa()
+   {
+#ifdef PIXEL_KERNELS_X86
+      unsigned regs[4];
+      CpuId(0, 0, regs);
+      const unsigned maxLeaf = regs[0];
+      CpuId(1, 0, regs);
+      if (0 == (regs[3] & (1u << 26)))
+         return ISA_SCALAR;
+
+      // AVX needs OSXSAVE and the YMM state enabled by the OS
+      const bool osxsave = 0 != (regs[2] & (1u << 27));
+      const bool avx = 0 != (regs[2] & (1u << 28));
+      const bool f16c = 0 != (regs[2] & (1u << 29));
+      if (!osxsave || !avx || maxLeaf < 7)
+         return ISA_SSE2;
+      const unsigned long long xcr0 = XGetBv();
+      if ((xcr0 & 0x6) != 0x6)
+         return ISA_SSE2;
+
+      CpuId(7, 0, regs);
+      const bool avx2 = 0 != (regs[1] & (1u << 5));
+      const bool avx512f = 0 != (regs[1] & (1u << 16));
+      const bool avx512bw = 0 != (regs[1] & (1u << 30));
+      if (!avx2 || !f16c || !PIXEL_KERNELS_AVX2)
+         return ISA_SSE2;
+      // opmask, upper ZMM halves and ZMM16-31 state
+      if (avx512f && avx512bw && (xcr0 & 0xe6) == 0xe6 && PIXEL_KERNELS_AVX512)
+         return ISA_AVX512;
+      return ISA_AVX2;
+#else
+      return ISA_SCALAR;
+#endif
+   }
+
+   const PixelKernels* KernelsFor(PixelIsa isa)
+   {
+      switch (isa)
+      {
+#ifdef PIXEL_KERNELS_X86
+#if PIXEL_KERNELS_AVX512
+      case ISA_AVX512: return &cAvx512Kernels;
+#endif
+#if PIXEL_KERNELS_AVX2
+      case ISA_AVX2: return &cAvx2Kernels;
+#endif
+      case ISA_SSE2: return &cSse2Kernels;
+#endif
+      default: return &cScalarKernels;
+      }
+   }
+
+   // zero initialized before any constructor runs: calls from other static
+   // initializers detect on first use, the rest is set up at load time
+   bool g_Detected;
+   PixelIsa g_DetectedIsa;
+   const PixelKernels* volatile g_Kernels;
+
+   struct KernelSelection
+   {
+      KernelSelection() {Kernels();}
+   } g_KernelSelection;
+}
+
+const PixelKernels& Kernels()
+{
+   if (0 == g_Kernels)
+      g_Kernels = KernelsFor(DetectedPixelIsa());
+   return *g_Kernels;
+}
+
+PixelIsa DetectedPixelIsa()
+{
+   // repeated detection by racing threads gives the same answer
+   if (!g_Detected)
+   {
+      g_DetectedIsa = DetectIsa();
+      g_Detected = true;
+   }
+   return g_DetectedIsa;
+}
+
+PixelIsa LimitPixelIsa(PixelIsa isa)
+{
+   g_Kernels = KernelsFor(std::min(isa, DetectedPixelIsa()));
+   return g_Kernels->isa;
+}
+
+const char* PixelIsaName(PixelIsa isa)
+{
+   switch (isa)
+   {
+   case ISA_SSE2: return "SSE2";
+   case ISA_AVX2: return "AVX2";
+   case ISA_AVX512: return "AVX-512";
+   default: return "Scalar";
+   }
+}
@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          PixelKernels.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Pixel loops of the camera and the image processors with
+//                scalar, SSE2, AVX2 and AVX-512 variants. The variant is
+//                picked once at load time from CPUID and can be limited
+//                at run time for A/B comparisons. The AVX2 level includes
+//                F16C, which every AVX2 processor has.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#ifndef _PIXELKERNELS_H_
+#define _PIXELKERNELS_H_
+
+#include <stddef.h>
+
+enum PixelIsa
+{
+   ISA_SCALAR,
+   ISA_SSE2,
+   ISA_AVX2,
+   ISA_AVX512    // AVX-512 F and BW
+};
+
+struct PixelKernels
+{
+   PixelIsa isa;
+
+   // reverses 'count' pixels in place (ImageFlipX)
+   void (*reverse8)(unsigned char* pixels, size_t count);
+   void (*reverse16)(unsigned short* pixels, size_t count);
+   void (*reverse32)(unsigned int* pixels, size_t count);
+   void (*reverse64)(unsigned long long* pixels, size_t count);
+
+   // exchanges two non overlapping byte ranges (ImageFlipY)
+   void (*swapBytes)(unsigned char* a, unsigned char* b, size_t bytes);
+
+   // transposes width x height pixels into a height x width image at 'dst';
+   // strides are in pixels (TransposeProcessor)
+   void (*transpose8)(const unsigned char* src, size_t srcStride, unsigned char* dst, size_t dstStride, unsigned width, unsigned height);
+   void (*transpose16)(const unsigned short* src, size_t srcStride, unsigned short* dst, size_t dstStride, unsigned width, unsigned height);
+
+   // transposes a dim x dim image in place
+   void (*transposeSquare8)(unsigned char* pixels, unsigned dim);
+   void (*transposeSquare16)(unsigned short* pixels, unsigned dim);
+
+   // 3x3 median of one row; 'above' and 'below' are the neighbouring rows
+   // (the row itself at the image border), edge columns are replicated
+   void (*median8)(const unsigned char* above, const unsigned char* row, const unsigned char* below, unsigned char* dst, unsigned width);
+   void (*median16)(const unsigned short* above, const unsigned short* row, const unsigned short* below, unsigned short* dst, unsigned width);
+
+   // zero extends 8 bit pixels to 16 bit
+   void (*widen8to16)(const unsigned char* src, unsigned short* dst, size_t count);
+
+   // one row of the synthetic test pattern:
+   // dst[k] = factor * min(maxValue, pedestal + a * cosK[k] + b * sinK[k]),
+   // truncated and clamped to the pixel range for the integer types
+   void (*sineRow8)(const float* sinK, const float* cosK, float a, float b, float pedestal, float maxValue, float factor, unsigned char* dst, unsigned count);
+   void (*sineRow16)(const float* sinK, const float* cosK, float a, float b, float pedestal, float maxValue, float factor, unsigned short* dst, unsigned count);
+   void (*sineRow32f)(const float* sinK, const float* cosK, float a, float b, float pedestal, float maxValue, float factor, float* dst, unsigned count);
+
+   // interleaves three channel rows into colour pixels, channel 0 in the
+   // low bits and the fourth channel zero
+   void (*packRgb32)(const unsigned char* c0, const unsigned char* c1, const unsigned char* c2, unsigned int* dst, unsigned count);
+   void (*packRgb64)(const unsigned short* c0, const unsigned short* c1, const unsigned short* c2, unsigned long long* dst, unsigned count);
+
+   // IEEE half precision to float and back, rounding to nearest even
+   // (spectra of the float16 reconstruction); only NaN payloads differ
+   // between the variants
+   void (*halfToFloat)(const unsigned short* src, float* dst, size_t count);
+   void (*floatToHalf)(const float* src, unsigned short* dst, size_t count);
+
+   // Philox4x32-10 counter based random numbers: block i is the four words
+   // for the counter (first + i, c1, c2, c3) under the key (k0, k1), stored
+   // at dst[4 * i] .. dst[4 * i + 3]
+   void (*philox)(unsigned k0, unsigned k1, unsigned first, unsigned c1, unsigned c2, unsigned c3, unsigned* dst, unsigned blocks);
+};
+
+// kernels in use, the best variant the CPU and OS support unless limited
+const PixelKernels& Kernels();
+
+// widest instruction set the machine supports
+PixelIsa DetectedPixelIsa();
+
+// limits the kernels to 'isa' (ISA_SCALAR forces the plain C++ loops);
+// returns the variant now in use
+PixelIsa LimitPixelIsa(PixelIsa isa);
+
+const char* PixelIsaName(PixelIsa isa);
+
+#endif //_PIXELKERNELS_H_
@@ -0,0 +1,154 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          PixelTraits.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Pixel formats of the frames the image processors receive and
+//                a dispatch table, built at compile time, that calls a
+//                processor's code for the format of a frame.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#ifndef _PIXELTRAITS_H_
+#define _PIXELTRAITS_H_
+
+enum PixelFormat
+{
+   PIXEL_UINT8,
+   PIXEL_UINT16,
+   PIXEL_FLOAT32,
+   PIXEL_RGBA32,
+   PIXEL_RGB64,
+   PIXEL_FORMAT_COUNT
+};
+
+// colour pixels as Micro-Manager stores them: blue, green, red and a fourth
+// channel the cameras leave unused
+struct Rgba32
+{
+   typedef unsigned char Channel;
+   enum {Channels = 4};
+   Channel c[4];
+};
+
+struct Rgb64
+{
+   typedef unsigned short Channel;
+   enum {Channels = 4};
+   Channel c[4];
+};
+
+// Type:     one pixel
+// Storage:  unsigned integer of the pixel size, for code that only moves
+//           pixels around
+template <PixelFormat F> struct PixelTraits;
+
+template <> struct PixelTraits<PIXEL_UINT8>
+{
+   typedef unsigned char Type;
+   typedef unsigned char Storage;
+   static const char* Name() {return "uint8";}
+};
+
+template <> struct PixelTraits<PIXEL_UINT16>
+{
+   typedef unsigned short Type;
+   typedef unsigned short Storage;
+   static const char* Name() {return "uint16";}
+};
+
+template <> struct PixelTraits<PIXEL_FLOAT32>
+{
+   typedef float Type;
+   typedef unsigned int Storage;
+   static const char* Name() {return "float32";}
+};
+
+template <> struct PixelTraits<PIXEL_RGBA32>
+{
+   typedef Rgba32 Type;
+   typedef unsigned int Storage;
+   static const char* Name() {return "RGBA32";}
+};
+
+template <> struct PixelTraits<PIXEL_RGB64>
+{
+   typedef Rgb64 Type;
+   typedef unsigned long long Storage;
+   static const char* Name() {return "RGB64";}
+};
+
+/**
+* Format of a frame from its pixel size and the number of components of the
+* camera's pixels: 4 byte pixels are RGBA for colour cameras and float
+* otherwise. PIXEL_FORMAT_COUNT for sizes no format has.
+*/
+inline PixelFormat FramePixelFormat(unsigned byteDepth, unsigned components)
+{
+   switch (byteDepth)
+   {
+   case 1: return PIXEL_UINT8;
+   case 2: return PIXEL_UINT16;
+   case 4: return (components > 1) ? PIXEL_RGBA32 : PIXEL_FLOAT32;
+   case 8: return PIXEL_RGB64;
+   default: return PIXEL_FORMAT_COUNT;
+   }
+}
+
+// bytes of one pixel of 'format'
+inline unsigned PixelFormatBytes(PixelFormat format)
+{
+   switch (format)
+   {
+   case PIXEL_UINT8: return 1;
+   case PIXEL_UINT16: return 2;
+   case PIXEL_FLOAT32:
+   case PIXEL_RGBA32: return 4;
+   case PIXEL_RGB64: return 8;
+   default: return 0;
+   }
+}
+
+/**
+* Table of op.Apply<PixelTraits<F> >(pixels, width, height) for every format
+* F, so that a processor picks its code for a frame with one indirect call
+* and the pixel loops carry no type tests.
+*/
+template <class Op> class PixelDispatch
+{
+public:
+   // 'format' must be below PIXEL_FORMAT_COUNT
+   static int Run(PixelFormat format, Op& op, unsigned char* pixels, unsigned width, unsigned height)
+   {
+      return table_[format](op, pixels, width, height);
+   }
+
+private:
+   typedef int (*Entry)(Op&, unsigned char*, unsigned, unsigned);
+
+   template <PixelFormat F> static int Call(Op& op, unsigned char* pixels, unsigned width, unsigned height)
+   {
+      typedef PixelTraits<F> Traits;
+      return op.template Apply<Traits>(reinterpret_cast<typename Traits::Type*>(pixels), width, height);
+   }
+
+   static const Entry table_[PIXEL_FORMAT_COUNT];
+};
+
+template <class Op> const typename PixelDispatch<Op>::Entry PixelDispatch<Op>::table_[PIXEL_FORMAT_COUNT] =
+{
+   &PixelDispatch<Op>::template Call<PIXEL_UINT8>,
+   &PixelDispatch<Op>::template Call<PIXEL_UINT16>,
+   &PixelDispatch<Op>::template Call<PIXEL_FLOAT32>,
+   &PixelDispatch<Op>::template Call<PIXEL_RGBA32>,
+   &PixelDispatch<Op>::template Call<PIXEL_RGB64>
+};
+
+template <class Op> inline int DispatchPixels(PixelFormat format, Op& op, unsigned char* pixels, unsigned width, unsigned height)
+{
+   return PixelDispatch<Op>::Run(format, op, pixels, width, height);
+}
+
+#endif //_PIXELTRAITS_H_
@@ -0,0 +1,495 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          RankFilter.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Constant time rank filters on sliding histograms.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "RankFilter.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+// SSE2 is part of every x64 target and of x86 builds for it
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define RANKFILTER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+   inline int Clamp(int i, int n)
+   {
+      return (i < 0) ? 0 : (i >= n ? n - 1 : i);
+   }
+
+   // fixed trip counts, so the compilers unroll and vectorize these
+   template <int N> inline void AddCounts(unsigned short* dst, const unsigned char* src)
+   {
+      for (int i = 0; i < N; ++i)
+         dst[i] = (unsigned short)(dst[i] + src[i]);
+   }
+
+   template <int N> inline void SubtractCounts(unsigned short* dst, const unsigned char* src)
+   {
+      for (int i = 0; i < N; ++i)
+         dst[i] = (unsigned short)(dst[i] - src[i]);
+   }
+
+   template <int N> inline void SlideCounts(unsigned short* dst, const unsigned char* in, const unsigned char* out)
+   {
+      for (int i = 0; i < N; ++i)
+         dst[i] = (unsigned short)(dst[i] + in[i] - out[i]);
+   }
+
+   /**
+   * Bin of N window counts that holds the value of rank 'remaining', which
+   * is reduced by the counts of the bins below it. The counts are at most
+   * (2 cMaxRadius + 1)^2, so their running sums fit signed 16 bit lanes:
+   * the SSE2 variant forms them 8 bins at a time and finds the first sum
+   * above the rank without a branch per bin.
+   */
+   template <int N> inline int FindBin(const unsigned short* counts, int& remaining)
+   {
+#ifdef RANKFILTER_SSE2
+      const __m128i rank = _mm_set1_epi16((short)remaining);
+      __m128i below = _mm_setzero_si128();
+      for (int i = 0; i < N; i += 8)
+      {
+         __m128i sums = _mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + i));
+         sums = _mm_add_epi16(sums, _mm_slli_si128(sums, 2));
+         sums = _mm_add_epi16(sums, _mm_slli_si128(sums, 4));
+         sums = _mm_add_epi16(sums, _mm_slli_si128(sums, 8));
+         sums = _mm_add_epi16(sums, below);
+         // the sums only grow: the bins above the rank are the high lanes
+         const unsigned above = (unsigned)_mm_movemask_epi8(_mm_cmpgt_epi16(sums, rank));
+         if (above)
+         {
+            unsigned low = ~above & 0xffff;
+            low = (low & 0x5555) + ((low >> 1) & 0x5555);
+            low = (low & 0x3333) + ((low >> 2) & 0x3333);
+            low = (low & 0x0f0f) + ((low >> 4) & 0x0f0f);
+            const int lane = (int)((low & 0xff) + (low >> 8)) / 2;
+            short lanes[8];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sums);
+            remaining -= lanes[lane] - counts[i + lane];
+            return i + lane;
+         }
+         below = _mm_shuffle_epi32(_mm_shufflehi_epi16(sums, 0xff), 0xff);
+      }
+      return N - 1;
+#else
+      int b = 0;
+      while (remaining >= counts[b])
+         remaining -= counts[b++];
+      return b;
+#endif
+   }
+
+   /**
+   * Comparators of a sorting network for 'n' inputs, Batcher's merge
+   * exchange (Knuth, TAOCP 5.2.2, algorithm M), keeping only those the
+   * output at 'rank' depends on.
+   */
+   void SelectionNetwork(int n, int rank, std::vector<std::pair<int, int> >& network)
+   {
+      network.clear();
+      int t = 0;
+      while ((1 << t) < n)
+         ++t;
+      for (int p = (t > 0) ? 1 << (t - 1) : 0; p > 0; p >>= 1)
+      {
+         int q = 1 << (t - 1);
+         int r = 0;
+         int d = p;
+         for (;;)
+         {
+            for (int i = 0; i + d < n; ++i)
+            {
+               if ((i & p) == r)
+                  network.push_back(std::make_pair(i, i + d));
+            }
+            if (q == p)
+               break;
+            d = q - p;
+            q >>= 1;
+            r = p;
+         }
+      }
+
+      std::vector<bool> needed(n, false);
+      needed[rank] = true;
+      size_t kept = network.size();
+      for (size_t c = network.size(); c-- > 0; )
+      {
+         const std::pair<int, int> comparator = network[c];
+         if (needed[comparator.first] || needed[comparator.second])
+         {
+            needed[comparator.first] = needed[comparator.second] = true;
+            network[--kept] = comparator;
+         }
+      }
+      network.erase(network.begin(), network.begin() + kept);
+   }
+
+   // pixels of a row the selection network sorts at once
+   const int cNetworkLanes = 64;
+
+   // the smaller of each pair of lanes to 'low', the larger to 'high'
+   template <class T> inline void Exchange(T* low, T* high)
+   {
+      for (int i = 0; i < cNetworkLanes; ++i)
+      {
+         const T a = low[i];
+         const T b = high[i];
+         low[i] = std::min(a, b);
+         high[i] = std::max(a, b);
+      }
+   }
+
+#ifdef RANKFILTER_SSE2
+   inline void Exchange(unsigned char* low, unsigned char* high)
+   {
+      for (int i = 0; i < cNetworkLanes; i += 16)
+      {
+         const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(low + i));
+         const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(high + i));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(low + i), _mm_min_epu8(a, b));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(high + i), _mm_max_epu8(a, b));
+      }
+   }
+
+   // SSE2 has no unsigned 16 bit min/max: a - (a -sat b) and b + (a -sat b)
+   inline void Exchange(unsigned short* low, unsigned short* high)
+   {
+      for (int i = 0; i < cNetworkLanes; i += 8)
+      {
+         const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(low + i));
+         const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(high + i));
+         const __m128i excess = _mm_subs_epu16(a, b);
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(low + i), _mm_sub_epi16(a, excess));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(high + i), _mm_add_epi16(b, excess));
+      }
+   }
+
+   inline void Exchange(float* low, float* high)
+   {
+      for (int i = 0; i < cNetworkLanes; i += 4)
+      {
+         const __m128 a = _mm_loadu_ps(low + i);
+         const __m128 b = _mm_loadu_ps(high + i);
+         _mm_storeu_ps(low + i, _mm_min_ps(a, b));
+         _mm_storeu_ps(high + i, _mm_max_ps(a, b));
+      }
+   }
+#endif
+
+   // histogram bits covering every value of the frame: 8, 10 or 12, or 0
+   // beyond cMaxHistogramBits
+   template <class T> int HistogramBits(const T* pixels, size_t count, int maxBits)
+   {
+      T top = 0;
+      for (size_t i = 0; i < count; ++i)
+         top = std::max(top, pixels[i]);
+      int bits = 8;
+      while (bits <= maxBits && (unsigned)top >> bits)
+         bits += 2;
+      return (bits > maxBits) ? 0 : bits;
+   }
+}
+
+/**
+* Filters the rows of one stripe.
+*/
+template <class T> class HistogramRankFilter::StripeTask : public WorkerPool::Task
+{
+public:
+   StripeTask(HistogramRankFilter& filter, const T* src, T* dst, int width, int height, int stripes) :
+      filter_(filter), src_(src), dst_(dst), width_(width), height_(height), stripes_(stripes) {}
+
+   void Run(int begin, int end, int worker)
+   {
+      for (int s = begin; s < end; ++s)
+      {
+         const int y0 = (int)((long long)height_ * s / stripes_);
+         const int y1 = (int)((long long)height_ * (s + 1) / stripes_);
+         filter_.FilterStripe(src_, dst_, width_, height_, y0, y1, worker);
+      }
+   }
+
+private:
+   StripeTask& operator=(const StripeTask&);
+
+   HistogramRankFilter& filter_;
+   const T* src_;
+   T* dst_;
+   int width_;
+   int height_;
+   int stripes_;
+};
+
+HistogramRankFilter::HistogramRankFilter() :
+   radius_(1),
+   percentile_(50.),
+   bits_(8)
+{
+   UpdateNetwork();
+}
+
+void HistogramRankFilter::SetRadius(int radius)
+{
+   radius_ = std::max(1, std::min(radius, (int)cMaxRadius));
+   UpdateNetwork();
+}
+
+void HistogramRankFilter::SetPercentile(double percentile)
+{
+   percentile_ = std::max(0., std::min(percentile, 100.));
+   UpdateNetwork();
+}
+
+void HistogramRankFilter::UpdateNetwork()
+{
+   const int side = 2 * radius_ + 1;
+   if (radius_ <= cMaxNetworkRadius)
+      SelectionNetwork(side * side, WindowRank(), network_);
+   else
+      network_.clear();
+}
+
+int HistogramRankFilter::WindowRank() const
+{
+   const int side = 2 * radius_ + 1;
+   return (int)floor(percentile_ / 100. * (side * side - 1) + 0.5);
+}
+
+void HistogramRankFilter::Filter(const unsigned char* src, unsigned char* dst, int width, int height)
+{
+   bits_ = 8;
+   Run(src, dst, width, height);
+}
+
+void HistogramRankFilter::Filter(const unsigned short* src, unsigned short* dst, int width, int height)
+{
+   bits_ = HistogramBits(src, (size_t)width * height, cMaxHistogramBits);
+   Run(src, dst, width, height);
+}
+
+void HistogramRankFilter::Filter(const float* src, float* dst, int width, int height)
+{
+   bits_ = 0;
+   Run(src, dst, width, height);
+}
+
+template <class T> void HistogramRankFilter::Run(const T* src, T* dst, int width, int height)
+{
+   if (width <= 0 || height <= 0)
+      return;
+
+   // one stripe per thread: every stripe pays for clearing and filling its
+   // column histograms. Other processors can resize the shared pool up to
+   // the hardware threads between here and the dispatch, so every worker
+   // index the pool can hand out has its histograms.
+   const int stripes = std::min(height, pool_->ThreadCount());
+   const size_t workers = std::max(pool_->ThreadCount(), WorkerPool::HardwareThreads());
+   if (histograms_.size() < workers)
+      histograms_.resize(workers);
+   StripeTask<T> task(*this, src, dst, width, height, stripes);
+   pool_->ParallelFor(stripes, 1, task);
+}
+
+template <class T> void HistogramRankFilter::FilterStripe(const T* src, T* dst, int width, int height, int y0, int y1, int worker)
+{
+   if (radius_ <= cMaxNetworkRadius)
+      NetworkRows(src, dst, width, height, y0, y1);
+   else if (0 == bits_)
+      SortRows(src, dst, width, height, y0, y1);
+   else
+   {
+      Histograms& h = histograms_[worker];
+      if (8 == bits_)
+         FilterRows<T, 4>(src, dst, width, height, y0, y1, h);
+      else if (10 == bits_)
+         FilterRows<T, 5>(src, dst, width, height, y0, y1, h);
+      else
+         FilterRows<T, 6>(src, dst, width, height, y0, y1, h);
+   }
+}
+
+void HistogramRankFilter::FilterStripe(const float* src, float* dst, int width, int height, int y0, int y1, int)
+{
+   if (radius_ <= cMaxNetworkRadius)
+      NetworkRows(src, dst, width, height, y0, y1);
+   else
+      SortRows(src, dst, width, height, y0, y1);
+}
+
+/**
+* Rows [y0, y1) from column histograms that slide down the stripe and a
+* window histogram that slides along each row. The histograms are split in
+* coarse bins (high half of the value bits) and fine bins; the coarse window
+* histogram follows every column, the fine part of a coarse bin only catches
+* up when the rank falls into that bin.
+*/
+template <class T, int Shift> void HistogramRankFilter::FilterRows(const T* src, T* dst, int width, int height, int y0, int y1, Histograms& h)
+{
+   const int r = radius_;
+   const int rank = WindowRank();
+   const int shift = Shift;
+   const int coarseBins = 1 << Shift;
+   const int bins = coarseBins << Shift;
+   const int finePerCoarse = coarseBins;
+
+   h.columnFine.assign((size_t)width * bins, 0);
+   const size_t fineStride = (size_t)width * finePerCoarse;
+   h.columnCoarse.assign((size_t)width * coarseBins, 0);
+   unsigned char* columnFine = &h.columnFine[0];
+   unsigned char* columnCoarse = &h.columnCoarse[0];
+
+   // window histograms on the stack: the compilers then know the byte
+   // sized column counts cannot alias them and vectorize the updates
+   unsigned short windowFine[bins];
+   unsigned short windowCoarse[coarseBins];
+   int fineAt[coarseBins];
+
+   // column histograms of rows y0 - r .. y0 + r
+   for (int k = -r; k <= r; ++k)
+   {
+      const T* row = src + (size_t)Clamp(y0 + k, height) * width;
+      for (int x = 0; x < width; ++x)
+      {
+         ++columnFine[(row[x] >> shift) * fineStride + (size_t)x * finePerCoarse + (row[x] & (finePerCoarse - 1))];
+         ++columnCoarse[(size_t)x * coarseBins + (row[x] >> shift)];
+      }
+   }
+
+   for (int y = y0; y < y1; ++y)
+   {
+      if (y > y0)
+      {
+         const T* out = src + (size_t)Clamp(y - 1 - r, height) * width;
+         const T* in = src + (size_t)Clamp(y + r, height) * width;
+         for (int x = 0; x < width; ++x)
+         {
+            --columnFine[(out[x] >> shift) * fineStride + (size_t)x * finePerCoarse + (out[x] & (finePerCoarse - 1))];
+            --columnCoarse[(size_t)x * coarseBins + (out[x] >> shift)];
+            ++columnFine[(in[x] >> shift) * fineStride + (size_t)x * finePerCoarse + (in[x] & (finePerCoarse - 1))];
+            ++columnCoarse[(size_t)x * coarseBins + (in[x] >> shift)];
+         }
+      }
+
+      // window at column 0; no fine bins valid yet
+      memset(windowCoarse, 0, sizeof(unsigned short) * coarseBins);
+      for (int k = -r; k <= r; ++k)
+         AddCounts<coarseBins>(windowCoarse, columnCoarse + (size_t)Clamp(k, width) * coarseBins);
+      for (int b = 0; b < coarseBins; ++b)
+         fineAt[b] = -2 * r - 2;
+
+      T* target = dst + (size_t)y * width;
+      for (int x = 0; x < width; ++x)
+      {
+         if (x > 0)
+         {
+            SlideCounts<coarseBins>(windowCoarse, columnCoarse + (size_t)Clamp(x + r, width) * coarseBins,
+               columnCoarse + (size_t)Clamp(x - 1 - r, width) * coarseBins);
+         }
+
+         int remaining = rank;
+         const int b = FindBin<coarseBins>(windowCoarse, remaining);
+
+         // fine counts of bin b at column x: rebuilt after long gaps,
+         // otherwise slid over the columns since the last use
+         unsigned short* fine = windowFine + b * finePerCoarse;
+         const unsigned char* columns = columnFine + b * fineStride;
+         if (x - fineAt[b] > 2 * r)
+         {
+            memset(fine, 0, sizeof(unsigned short) * finePerCoarse);
+            for (int k = -r; k <= r; ++k)
+               AddCounts<finePerCoarse>(fine, columns + (size_t)Clamp(x + k, width) * finePerCoarse);
+         }
+         else
+         {
+            for (int c = fineAt[b] + 1; c <= x; ++c)
+            {
+               SlideCounts<finePerCoarse>(fine, columns + (size_t)Clamp(c + r, width) * finePerCoarse,
+                  columns + (size_t)Clamp(c - 1 - r, width) * finePerCoarse);
+            }
+         }
+         fineAt[b] = x;
+
+         const int f = FindBin<finePerCoarse>(fine, remaining);
+         target[x] = (T)((b << shift) | f);
+      }
+   }
+}
+
+/**
+* Small windows: the selection network runs on cNetworkLanes pixels of a
+* row at once, each of its inputs being one window offset of all of them.
+*/
+template <class T> void HistogramRankFilter::NetworkRows(const T* src, T* dst, int width, int height, int y0, int y1)
+{
+   const int r = radius_;
+   const int side = 2 * r + 1;
+   const int rank = WindowRank();
+   const size_t comparators = network_.size();
+   std::vector<T> lanes((size_t)side * side * cNetworkLanes);
+   for (int y = y0; y < y1; ++y)
+   {
+      for (int x0 = 0; x0 < width; x0 += cNetworkLanes)
+      {
+         const int count = std::min(cNetworkLanes, width - x0);
+         const bool inside = (x0 - r >= 0) && (x0 + cNetworkLanes + r <= width);
+         T* input = &lanes[0];
+         for (int ky = -r; ky <= r; ++ky)
+         {
+            const T* row = src + (size_t)Clamp(y + ky, height) * width;
+            for (int kx = -r; kx <= r; ++kx, input += cNetworkLanes)
+            {
+               if (inside)
+                  memcpy(input, row + x0 + kx, cNetworkLanes * sizeof(T));
+               else
+               {
+                  // lanes past the row end repeat its last pixel
+                  for (int i = 0; i < cNetworkLanes; ++i)
+                     input[i] = row[Clamp(std::min(x0 + i, width - 1) + kx, width)];
+               }
+            }
+         }
+
+         for (size_t c = 0; c < comparators; ++c)
+            Exchange(&lanes[(size_t)network_[c].first * cNetworkLanes], &lanes[(size_t)network_[c].second * cNetworkLanes]);
+         memcpy(dst + (size_t)y * width + x0, &lanes[(size_t)rank * cNetworkLanes], count * sizeof(T));
+      }
+   }
+}
+
+/**
+* Selection on a copy of each window, for 16 bit values the histograms do
+* not cover.
+*/
+template <class T> void HistogramRankFilter::SortRows(const T* src, T* dst, int width, int height, int y0, int y1)
+{
+   const int r = radius_;
+   const int rank = WindowRank();
+   std::vector<T> window((2 * r + 1) * (2 * r + 1));
+   for (int y = y0; y < y1; ++y)
+   {
+      for (int x = 0; x < width; ++x)
+      {
+         size_t n = 0;
+         for (int ky = -r; ky <= r; ++ky)
+         {
+            const T* row = src + (size_t)Clamp(y + ky, height) * width;
+            for (int kx = -r; kx <= r; ++kx)
+               window[n++] = row[Clamp(x + kx, width)];
+         }
+         std::nth_element(window.begin(), window.begin() + rank, window.end());
+         dst[(size_t)y * width + x] = window[rank];
+      }
+   }
+}
@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          RankFilter.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Square window rank filters (minimum, median, maximum, any
+//                percentile) with a cost per pixel that does not depend on
+//                the radius: sliding column and window histograms after
+//                Perreault and Hebert, "Median Filtering in Constant Time",
+//                IEEE TIP 16(9), 2007. Horizontal stripes of the frame run
+//                on a worker pool.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#ifndef _RANKFILTER_H_
+#define _RANKFILTER_H_
+
+#include "WorkerPool.h"
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+// HistogramRankFilter class
+//////////////////////////////////////////////////////////////////////////////
+class HistogramRankFilter
+{
+public:
+   // column histograms count in bytes
+   static const int cMaxRadius = 63;
+   // widest data the histograms cover; 16 bit frames with larger values
+   // take a sorting fallback whose cost grows with the window
+   static const int cMaxHistogramBits = 12;
+   // radii up to this take a selection network on the window pixels,
+   // faster than the histograms' fixed cost per pixel at these sizes
+   static const int cMaxNetworkRadius = 3;
+
+   HistogramRankFilter();
+   ~HistogramRankFilter() {}
+
+   // window of (2 radius + 1)^2 pixels, edges replicated
+   void SetRadius(int radius);
+   int Radius() const {return radius_;}
+
+   // 0 minimum, 50 median, 100 maximum
+   void SetPercentile(double percentile);
+   double Percentile() const {return percentile_;}
+
+   // threads of the pool the image processors share
+   void SetThreadCount(int count) {pool_->SetThreadCount(count);}
+   int ThreadCount() const {return pool_->ThreadCount();}
+
+   // filters width x height pixels of 'src' into 'dst'; the buffers must
+   // not overlap
+   void Filter(const unsigned char* src, unsigned char* dst, int width, int height);
+   void Filter(const unsigned short* src, unsigned short* dst, int width, int height);
+   // float frames always take the sorting fallback
+   void Filter(const float* src, float* dst, int width, int height);
+
+private:
+   // one worker's column histograms
+   struct Histograms
+   {
+      std::vector<unsigned char> columnFine;     // coarse bins x width x fine bins
+      std::vector<unsigned char> columnCoarse;   // width x coarse bins
+   };
+
+   template <class T> class StripeTask;
+   template <class T> void Run(const T* src, T* dst, int width, int height);
+   template <class T> void FilterStripe(const T* src, T* dst, int width, int height, int y0, int y1, int worker);
+   void FilterStripe(const float* src, float* dst, int width, int height, int y0, int y1, int worker);
+   template <class T, int Shift> void FilterRows(const T* src, T* dst, int width, int height, int y0, int y1, Histograms& h);
+   template <class T> void NetworkRows(const T* src, T* dst, int width, int height, int y0, int y1);
+   template <class T> void SortRows(const T* src, T* dst, int width, int height, int y0, int y1);
+   int WindowRank() const;
+   void UpdateNetwork();
+
+   HistogramRankFilter(const HistogramRankFilter&);
+   HistogramRankFilter& operator=(const HistogramRankFilter&);
+
+   int radius_;
+   double percentile_;
+   int bits_;                  // histogram bits of the current frame, 0 sorts
+   SharedWorkerPool pool_;
+   std::vector<Histograms> histograms_;
+   std::vector<std::pair<int, int> > network_;   // comparators for the window rank, small radii
+};
+
+#endif //_RANKFILTER_H_
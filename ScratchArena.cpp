@@ -0,0 +1,200 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ScratchArena.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Module wide arena of aligned, frame sized scratch blocks.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "ScratchArena.h"
+#include "../../MMDevice/DeviceThreads.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+
+#ifdef WIN32
+#include <malloc.h>
+#endif
+
+namespace
+{
+   // pages are touched at this stride when a block is new
+   const size_t cPageBytes = 4096;
+
+   void* AlignedAlloc(size_t bytes)
+   {
+#ifdef WIN32
+      return _aligned_malloc(bytes, ScratchArena::cAlignment);
+#else
+      void* block = 0;
+      return (0 == posix_memalign(&block, ScratchArena::cAlignment, bytes)) ? block : 0;
+#endif
+   }
+
+   void AlignedFree(void* block)
+   {
+#ifdef WIN32
+      _aligned_free(block);
+#else
+      free(block);
+#endif
+   }
+
+   /**
+   * Capacity for a request: rounded up to an eighth of its power of two,
+   * so that frames of nearly the same size share blocks and no more than
+   * an eighth is wasted.
+   */
+   size_t Capacity(size_t bytes)
+   {
+      const size_t alignment = ScratchArena::cAlignment;
+      size_t power = alignment;
+      while (power <= bytes / 2)
+         power *= 2;
+      const size_t step = std::max(alignment, power / 8);
+      return (std::max<size_t>(bytes, 1) + step - 1) / step * step;
+   }
+}
+
+struct ScratchArena::Impl
+{
+   typedef std::multimap<size_t, void*> FreeBlocks;
+
+   mutable MMThreadLock lock;
+   FreeBlocks free;     // by capacity
+   Stats stats;
+};
+
+// created when the module loads and kept to its unload: devices give their
+// blocks back from destructors that can run after static destructors
+ScratchArena* ScratchArena::instance_ = new ScratchArena;
+
+ScratchArena& ScratchArena::Instance()
+{
+   return *instance_;
+}
+
+ScratchArena::ScratchArena() :
+   impl_(new Impl)
+{
+   memset(&impl_->stats, 0, sizeof(impl_->stats));
+}
+
+ScratchArena::~ScratchArena()
+{
+   Trim();
+   delete impl_;
+}
+
+void* ScratchArena::Acquire(size_t bytes, size_t& capacity)
+{
+   capacity = Capacity(bytes);
+   {
+      MMThreadGuard g(impl_->lock);
+      Impl::FreeBlocks::iterator it = impl_->free.lower_bound(capacity);
+      if (it != impl_->free.end() && it->first <= 2 * capacity)
+      {
+         void* block = it->second;
+         capacity = it->first;
+         impl_->free.erase(it);
+         Stats& s = impl_->stats;
+         s.bytesFree -= capacity;
+         s.bytesInUse += capacity;
+         s.highWater = std::max(s.highWater, s.bytesInUse);
+         ++s.reuses;
+         return block;
+      }
+   }
+
+   // outside the lock: the allocation and the page faults are the slow part
+   unsigned char* block = static_cast<unsigned char*>(AlignedAlloc(capacity));
+   if (0 == block)
+   {
+      capacity = 0;
+      return 0;
+   }
+   for (size_t offset = 0; offset < capacity; offset += cPageBytes)
+      block[offset] = 0;
+
+   MMThreadGuard g(impl_->lock);
+   Stats& s = impl_->stats;
+   s.bytesInUse += capacity;
+   s.highWater = std::max(s.highWater, s.bytesInUse);
+   ++s.allocations;
+   return block;
+}
+
+void ScratchArena::Release(void* block, size_t capacity)
+{
+   if (0 == block)
+      return;
+
+   void* surplus = 0;
+   {
+      MMThreadGuard g(impl_->lock);
+      Stats& s = impl_->stats;
+      s.bytesInUse -= capacity;
+      s.bytesFree += capacity;
+      impl_->free.insert(std::make_pair(capacity, block));
+      if (impl_->free.size() > cMaxFreeBlocks)
+      {
+         Impl::FreeBlocks::iterator smallest = impl_->free.begin();
+         surplus = smallest->second;
+         s.bytesFree -= smallest->first;
+         impl_->free.erase(smallest);
+      }
+   }
+   AlignedFree(surplus);
+}
+
+ScratchArena::Stats ScratchArena::GetStats() const
+{
+   MMThreadGuard g(impl_->lock);
+   return impl_->stats;
+}
+
+void ScratchArena::Trim()
+{
+   Impl::FreeBlocks blocks;
+   {
+      MMThreadGuard g(impl_->lock);
+      blocks.swap(impl_->free);
+      impl_->stats.bytesFree = 0;
+   }
+   for (Impl::FreeBlocks::iterator it = blocks.begin(); it != blocks.end(); ++it)
+      AlignedFree(it->second);
+}
+
+void* ScratchBlock::Reserve(size_t bytes)
+{
+   if (0 != block_ && bytes <= capacity_)
+      return block_;
+   Release();
+   block_ = ScratchArena::Instance().Acquire(bytes, capacity_);
+   return block_;
+}
+
+void ScratchBlock::Release()
+{
+   ScratchArena::Instance().Release(block_, capacity_);
+   block_ = 0;
+   capacity_ = 0;
+}
+
+void FrameBuffer::Resize(unsigned width, unsigned height, unsigned depth)
+{
+   const size_t bytes = (size_t)width * height * depth;
+   if (0 == block_.Reserve(bytes))
+   {
+      width_ = height_ = 0;
+      return;
+   }
+   width_ = width;
+   height_ = height;
+   depth_ = depth;
+   memset(block_.Get(), 0, bytes);
+}
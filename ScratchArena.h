@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ScratchArena.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Module wide arena of aligned, frame sized scratch blocks.
+//                Blocks that are given back stay mapped and serve the next
+//                request they are large enough for, so that geometry changes
+//                do not reach the allocator or fault in fresh pages while
+//                frames are processed.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#ifndef _SCRATCHARENA_H_
+#define _SCRATCHARENA_H_
+
+#include <stddef.h>
+
+//////////////////////////////////////////////////////////////////////////////
+// ScratchArena class
+//////////////////////////////////////////////////////////////////////////////
+class ScratchArena
+{
+public:
+   // block alignment: a cache line, and the widest vector loads
+   static const size_t cAlignment = 64;
+   // free blocks held for reuse; the smallest goes back to the system
+   // beyond this
+   static const size_t cMaxFreeBlocks = 16;
+
+   struct Stats
+   {
+      size_t bytesInUse;      // capacity of the blocks handed out
+      size_t highWater;       // largest bytesInUse so far
+      size_t bytesFree;       // capacity of the blocks held for reuse
+      unsigned long allocations;   // blocks taken from the system
+      unsigned long reuses;        // requests served by a free block
+   };
+
+   // the arena of the module
+   static ScratchArena& Instance();
+
+   ~ScratchArena();
+
+   // a block of at least 'bytes', with its capacity; a free block is
+   // reused when it is no more than twice as large. Fresh blocks are
+   // written once, so their pages are mapped. NULL when out of memory.
+   void* Acquire(size_t bytes, size_t& capacity);
+   void Release(void* block, size_t capacity);
+
+   Stats GetStats() const;
+   // hands the free blocks back to the system
+   void Trim();
+
+private:
+   struct Impl;
+
+   ScratchArena();
+   ScratchArena(const ScratchArena&);
+   ScratchArena& operator=(const ScratchArena&);
+
+   static ScratchArena* instance_;
+   Impl* impl_;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// ScratchBlock class
+// one arena block owned by a processor or the camera
+//////////////////////////////////////////////////////////////////////////////
+class ScratchBlock
+{
+public:
+   ScratchBlock() : block_(0), capacity_(0) {}
+   ~ScratchBlock() {Release();}
+
+   // at least 'bytes' at Get(); the contents are lost when the block has to
+   // grow. NULL when out of memory.
+   void* Reserve(size_t bytes);
+   void* Get() const {return block_;}
+   size_t Capacity() const {return capacity_;}
+   // gives the block back to the arena
+   void Release();
+
+private:
+   ScratchBlock(const ScratchBlock&);
+   ScratchBlock& operator=(const ScratchBlock&);
+
+   void* block_;
+   size_t capacity_;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// FrameBuffer class
+// the ImgBuffer calls the camera makes, on an arena block: resizing keeps
+// the block while the frame fits in it
+//////////////////////////////////////////////////////////////////////////////
+class FrameBuffer
+{
+public:
+   FrameBuffer() : width_(0), height_(0), depth_(1) {}
+
+   unsigned Width() const {return width_;}
+   unsigned Height() const {return height_;}
+   unsigned Depth() const {return depth_;}
+   const unsigned char* GetPixels() const {return static_cast<const unsigned char*>(block_.Get());}
+   unsigned char* GetPixelsRW() {return static_cast<unsigned char*>(block_.Get());}
+
+   // clears the pixels, as ImgBuffer does
+   void Resize(unsigned width, unsigned height, unsigned depth);
+   void Resize(unsigned width, unsigned height) {Resize(width, height, depth_);}
+
+private:
+   ScratchBlock block_;
+   unsigned width_;
+   unsigned height_;
+   unsigned depth_;
+};
+
+#endif //_SCRATCHARENA_H_
@@ -0,0 +1,266 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SensorNoise.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Noise of a simulated sensor.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "SensorNoise.h"
+#include "PixelKernels.h"
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+   // fourth counter word: the stream, and the colour channel in the low byte
+   const unsigned cStreamTemporal = 1 << 8;
+   const unsigned cStreamFixed = 2 << 8;
+   const unsigned cStreamDefects = 3 << 8;
+
+   // pixels per pass: the random words of a pass stay on the stack
+   const unsigned cChunk = 256;
+
+   // below this many electrons the shot noise is drawn from the Poisson
+   // distribution itself, above from its normal approximation
+   const float cPoissonLimit = 20.f;
+
+   /**
+   * Inverse of the standard normal distribution (P. J. Acklam), relative
+   * error below 1.2e-9 over (0, 1).
+   */
+   double InverseNormal(double p)
+   {
+      static const double a[6] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02, 1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+      static const double b[5] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02, 6.680131188771972e+01, -1.328068155288572e+01};
+      static const double c[6] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00, -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+      static const double d[4] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00, 3.754408661907416e+00};
+      const double low = 0.02425;
+      if (p < low)
+      {
+         const double q = sqrt(-2 * log(p));
+         return (((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) / ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1);
+      }
+      if (p > 1 - low)
+         return -InverseNormal(1 - p);
+      const double q = p - 0.5;
+      const double r = q * q;
+      return (((((a[0]*r + a[1])*r + a[2])*r + a[3])*r + a[4])*r + a[5])*q / (((((b[0]*r + b[1])*r + b[2])*r + b[3])*r + b[4])*r + 1);
+   }
+
+   // uniform in (0, 1) from a random word
+   inline float Uniform(unsigned word)
+   {
+      return ((word >> 8) + 0.5f) * (1.f / 16777216.f);
+   }
+
+   // Poisson deviate of mean 'lambda', below cPoissonLimit, by inversion
+   // of its distribution
+   inline float Poisson(float lambda, float u)
+   {
+      float p = expf(-lambda);
+      float sum = p;
+      int k = 0;
+      while (u > sum && k < 100)
+      {
+         ++k;
+         p *= lambda / k;
+         sum += p;
+      }
+      return (float)k;
+   }
+
+   // integer channels are rounded and limited to the channel range, float
+   // pixels only kept non negative
+   template <typename T> inline void Store(T& v, float x, float maxValue)
+   {
+      v = (T)std::min(maxValue, std::max(0.f, x + 0.5f));
+   }
+   template <> inline void Store<float>(float& v, float x, float)
+   {
+      v = std::max(0.f, x);
+   }
+
+   class NoiseTask : public WorkerPool::Task
+   {
+   public:
+      NoiseTask(unsigned char* pixels, unsigned width, PixelFormat format, const SensorNoise::Model& model, double darkElectrons,
+         double maxValue, double dropFraction, double saturateFraction, const float* normal, int normalBits, unsigned seed, unsigned frame) :
+         pixels_(pixels), width_(width), format_(format), enabled_(model.enabled),
+         gain_((float)model.gain), invGain_((float)(1. / model.gain)), readNoise_((float)model.readNoise),
+         readVariance_((float)(model.readNoise * model.readNoise)), prnu_((float)model.prnu), dsnu_((float)model.dsnu),
+         darkElectrons_((float)darkElectrons), maxValue_((float)maxValue),
+         normal_(normal), normalShift_(32 - normalBits), fractionMask_((1u << (32 - normalBits)) - 1), seed_(seed), frame_(frame),
+         kernels_(Kernels())
+      {
+         // word thresholds: words below dropBelow_ drop the pixel, words
+         // from saturateFrom_ saturate it
+         const double words = 4294967296.;
+         drop_ = dropFraction > 0.;
+         saturate_ = saturateFraction > 0.;
+         dropBelow_ = (unsigned)std::min(words - 1, std::max(0., dropFraction) * words);
+         saturateFrom_ = (unsigned)std::min(words - 1, std::max(0., words - saturateFraction * words));
+         fixedPattern_ = model.enabled && (model.prnu > 0. || (model.dsnu > 0. && darkElectrons > 0.));
+      }
+
+      void Run(int begin, int end, int)
+      {
+         for (int j = begin; j < end; ++j)
+         {
+            switch (format_)
+            {
+            case PIXEL_UINT8: Row(pixels_ + (size_t)width_ * j, 1, 1, j); break;
+            case PIXEL_UINT16: Row(reinterpret_cast<unsigned short*>(pixels_) + (size_t)width_ * j, 1, 1, j); break;
+            case PIXEL_FLOAT32: Row(reinterpret_cast<float*>(pixels_) + (size_t)width_ * j, 1, 1, j); break;
+            // the fourth channel of the colour pixels is unused
+            case PIXEL_RGBA32: Row(pixels_ + (size_t)width_ * 4 * j, 4, 3, j); break;
+            case PIXEL_RGB64: Row(reinterpret_cast<unsigned short*>(pixels_) + (size_t)width_ * 4 * j, 4, 3, j); break;
+            default: break;
+            }
+         }
+      }
+
+   private:
+      NoiseTask& operator=(const NoiseTask&);
+
+      // standard normal deviate from a random word: the table of the
+      // inverse distribution, interpolated with the low bits
+      float Normal(unsigned word) const
+      {
+         const unsigned i = word >> normalShift_;
+         const float f = (word & fractionMask_) * (1.f / (fractionMask_ + 1.f));
+         return normal_[i] + f * (normal_[i + 1] - normal_[i]);
+      }
+
+      /**
+      * Signal of 'value' ADU plus the dark signal, with shot and read noise.
+      * Above cPoissonLimit electrons both are one normal deviate of the
+      * summed variance; below, the shot noise is a Poisson deviate from
+      * word 0 and the read noise a normal one from word 1.
+      */
+      float Noisy(float value, const unsigned* temporal, const unsigned* fixed) const
+      {
+         float signal = value * invGain_;
+         float dark = darkElectrons_;
+         if (fixedPattern_)
+         {
+            signal *= std::max(0.f, 1.f + prnu_ * Normal(fixed[0]));
+            dark *= std::max(0.f, 1.f + dsnu_ * Normal(fixed[1]));
+         }
+         const float lambda = signal + dark;
+         float electrons;
+         if (lambda < cPoissonLimit)
+            electrons = Poisson(lambda, Uniform(temporal[0])) + readNoise_ * Normal(temporal[1]);
+         else
+            electrons = lambda + sqrtf(lambda + readVariance_) * Normal(temporal[0]);
+         return electrons * gain_;
+      }
+
+      /**
+      * Channel c of the pixels at stride 'stride' in row j. A Philox block
+      * covers two pixels of the frame's noise (counter x / 2, j, frame) and
+      * two of the fixed pattern (counter x / 2, j, 0, the same in every
+      * frame), and four pixels of the defect decisions.
+      */
+      template <typename T> void Row(T* row, unsigned stride, unsigned channels, int j)
+      {
+         unsigned temporal[2 * cChunk];
+         unsigned fixed[2 * cChunk];
+         unsigned defects[cChunk];
+         for (unsigned c = 0; c < channels; ++c)
+         {
+            for (unsigned x = 0; x < width_; x += cChunk)
+            {
+               const unsigned n = std::min(cChunk, width_ - x);
+               if (enabled_)
+                  kernels_.philox(seed_, 0, x / 2, j, frame_, cStreamTemporal | c, temporal, (n + 1) / 2);
+               if (fixedPattern_)
+                  kernels_.philox(seed_, 0, x / 2, j, 0, cStreamFixed | c, fixed, (n + 1) / 2);
+               if (drop_ || saturate_)
+                  kernels_.philox(seed_, 0, x / 4, j, frame_, cStreamDefects | c, defects, (n + 3) / 4);
+               T* p = row + (size_t)x * stride + c;
+               for (unsigned k = 0; k < n; ++k, p += stride)
+               {
+                  float v = (float)*p;
+                  if (enabled_)
+                     v = Noisy(v, temporal + 2 * k, fixed + 2 * k);
+                  if (drop_ && defects[k] < dropBelow_)
+                     v = 0.f;
+                  else if (saturate_ && defects[k] >= saturateFrom_)
+                     v = maxValue_;
+                  Store(*p, v, maxValue_);
+               }
+            }
+         }
+      }
+
+      unsigned char* pixels_;
+      unsigned width_;
+      PixelFormat format_;
+      bool enabled_;
+      float gain_;
+      float invGain_;
+      float readNoise_;
+      float readVariance_;
+      float prnu_;
+      float dsnu_;
+      float darkElectrons_;
+      float maxValue_;
+      const float* normal_;
+      int normalShift_;
+      unsigned fractionMask_;
+      unsigned seed_;
+      unsigned frame_;
+      unsigned dropBelow_;
+      unsigned saturateFrom_;
+      bool drop_;
+      bool saturate_;
+      bool fixedPattern_;
+      const PixelKernels& kernels_;
+   };
+}
+
+/**
+* The table holds the inverse normal distribution at i / 2^cNormalBits, the
+* infinite ends replaced by the values half an interval inside, so the
+* deviates reach 3.66 standard deviations.
+*/
+SensorNoise::SensorNoise() :
+   seed_(1),
+   frame_(0)
+{
+   const int steps = 1 << cNormalBits;
+   normal_.resize(steps + 1);
+   for (int i = 0; i <= steps; ++i)
+   {
+      const double p = std::min(std::max((double)i, 0.5), steps - 0.5) / steps;
+      normal_[i] = (float)InverseNormal(p);
+   }
+}
+
+void SensorNoise::SetSeed(unsigned seed)
+{
+   seed_ = seed;
+   frame_ = 0;
+}
+
+void SensorNoise::Apply(unsigned char* pixels, unsigned width, unsigned height, PixelFormat format, const Model& model,
+   double exposureMs, double maxValue, double dropFraction, double saturateFraction)
+{
+   if (NULL == pixels || 0 == width || 0 == height || format >= PIXEL_FORMAT_COUNT)
+      return;
+   if (!model.enabled && dropFraction <= 0. && saturateFraction <= 0.)
+      return;
+   if (model.enabled && model.gain <= 0.)
+      return;
+
+   const double darkElectrons = model.darkCurrent * std::max(0., exposureMs) / 1000.;
+   NoiseTask task(pixels, width, format, model, darkElectrons, maxValue, dropFraction, saturateFraction, &normal_[0], cNormalBits, seed_, frame_++);
+   // rows cost about a Philox block per pixel and channel: bands of 16 kB
+   // of pixels
+   const size_t rowBytes = (size_t)width * PixelFormatBytes(format);
+   pool_->ParallelFor(height, (int)std::max<size_t>(1, 16384 / rowBytes), task);
+}
@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SensorNoise.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Noise of a simulated sensor: shot noise, read noise, dark
+//                current and fixed pattern noise, plus dropped and saturated
+//                pixels. The random numbers come from the Philox counter
+//                based generator keyed by the seed and indexed by pixel,
+//                row, frame and stream, so bands of rows are filled in
+//                parallel without shared state, the fixed pattern needs no
+//                storage and a seed replays the same frames.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#ifndef _SENSORNOISE_H_
+#define _SENSORNOISE_H_
+
+#include "PixelTraits.h"
+#include "WorkerPool.h"
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+// SensorNoise class
+//////////////////////////////////////////////////////////////////////////////
+class SensorNoise
+{
+public:
+   // pixel values are taken as the mean signal: value / gain electrons
+   // collected over the exposure
+   struct Model
+   {
+      Model() : enabled(false), gain(0.1), readNoise(5.), darkCurrent(50.), prnu(0.01), dsnu(0.2) {}
+
+      bool enabled;        // off leaves only the dropped and saturated pixels
+      double gain;         // ADU per electron
+      double readNoise;    // electrons rms per read
+      double darkCurrent;  // electrons per second
+      double prnu;         // photo response non uniformity, rms fraction of the signal
+      double dsnu;         // dark signal non uniformity, rms fraction of the dark current
+   };
+
+   SensorNoise();
+
+   // restarts the frame count: the same seed gives the same frames
+   void SetSeed(unsigned seed);
+   unsigned Seed() const {return seed_;}
+
+   /**
+   * Adds the noise of one frame to the pixels of a width x height frame of
+   * 'format', every colour channel on its own. 'exposureMs' scales the dark
+   * signal; values are limited to 'maxValue', which is also the level of
+   * saturated pixels. The given fractions of the pixels are dropped to 0
+   * and saturated.
+   */
+   void Apply(unsigned char* pixels, unsigned width, unsigned height, PixelFormat format, const Model& model,
+      double exposureMs, double maxValue, double dropFraction, double saturateFraction);
+
+private:
+   // intervals of the inverse normal distribution table
+   static const int cNormalBits = 12;
+
+   std::vector<float> normal_;
+   SharedWorkerPool pool_;
+   unsigned seed_;
+   unsigned frame_;
+};
+
+#endif //_SENSORNOISE_H_
@@ -0,0 +1,203 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SyntheticImage.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Synthetic sine wave frames for all camera pixel types.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "SyntheticImage.h"
+#include "PixelKernels.h"
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+   const double cPi = 3.14159265358979;
+
+   // columns per pass of the colour formats: the channel rows of a pass
+   // stay on the stack and in L1
+   const unsigned cChunk = 256;
+
+   /**
+   * Fills bands of rows. sin(phase + row) is expanded as
+   * sin(phase) cos(row) + cos(phase) sin(row) from the row tables, which
+   * gives the a and b coefficients of the row kernels.
+   */
+   class BandTask : public WorkerPool::Task
+   {
+   public:
+      BandTask(unsigned char* pixels, unsigned width, unsigned height, PixelFormat format, const SyntheticImageGenerator::Wave& wave,
+         const float* colSin, const float* colCos, const double* rowSin, const double* rowCos, unsigned char* bgr) :
+         pixels_(pixels), width_(width), height_(height), format_(format), wave_(wave),
+         colSin_(colSin), colCos_(colCos), rowSin_(rowSin), rowCos_(rowCos), bgr_(bgr),
+         kernels_(Kernels()), sinPhase_(sin(wave.phase)), cosPhase_(cos(wave.phase))
+      {}
+
+      void Run(int begin, int end, int)
+      {
+         for (int j = begin; j < end; ++j)
+         {
+            switch (format_)
+            {
+            case PIXEL_UINT8: Row8(j); break;
+            case PIXEL_UINT16: Row16(j); break;
+            case PIXEL_FLOAT32: Row32f(j); break;
+            case PIXEL_RGBA32: RowRgb32(j); break;
+            case PIXEL_RGB64: RowRgb64(j); break;
+            default: break;
+            }
+         }
+      }
+
+   private:
+      BandTask& operator=(const BandTask&);
+
+      // kernel coefficients of row j, channel c
+      float A(int j, int c) const
+      {
+         const size_t i = (size_t)c * height_ + j;
+         return (float)(wave_.amplitude * (sinPhase_ * rowCos_[i] + cosPhase_ * rowSin_[i]));
+      }
+      float B(int j, int c) const
+      {
+         const size_t i = (size_t)c * height_ + j;
+         return (float)(wave_.amplitude * (cosPhase_ * rowCos_[i] - sinPhase_ * rowSin_[i]));
+      }
+
+      void Row8(int j)
+      {
+         unsigned char* dst = pixels_ + (size_t)width_ * j;
+         kernels_.sineRow8(colSin_, colCos_, A(j, 0), B(j, 0), (float)wave_.pedestal, (float)wave_.maxValue, (float)wave_.factor, dst, width_);
+      }
+
+      void Row16(int j)
+      {
+         unsigned short* dst = reinterpret_cast<unsigned short*>(pixels_) + (size_t)width_ * j;
+         kernels_.sineRow16(colSin_, colCos_, A(j, 0), B(j, 0), (float)wave_.pedestal, (float)wave_.maxValue, (float)wave_.factor, dst, width_);
+      }
+
+      void Row32f(int j)
+      {
+         float* dst = reinterpret_cast<float*>(pixels_) + (size_t)width_ * j;
+         kernels_.sineRow32f(colSin_, colCos_, A(j, 0), B(j, 0), (float)wave_.pedestal, (float)wave_.maxValue, (float)wave_.factor, dst, width_);
+      }
+
+      void RowRgb32(int j)
+      {
+         unsigned int* dst = reinterpret_cast<unsigned int*>(pixels_) + (size_t)width_ * j;
+         unsigned char channel[SyntheticImageGenerator::cChannels][cChunk];
+         float a[SyntheticImageGenerator::cChannels], b[SyntheticImageGenerator::cChannels];
+         for (int c = 0; c < SyntheticImageGenerator::cChannels; ++c)
+         {
+            a[c] = A(j, c);
+            b[c] = B(j, c);
+         }
+         for (unsigned x = 0; x < width_; x += cChunk)
+         {
+            const unsigned n = std::min(cChunk, width_ - x);
+            for (int c = 0; c < SyntheticImageGenerator::cChannels; ++c)
+               kernels_.sineRow8(colSin_ + x, colCos_ + x, a[c], b[c], (float)wave_.pedestal, (float)wave_.maxValue, (float)wave_.factor, channel[c], n);
+            kernels_.packRgb32(channel[0], channel[1], channel[2], dst + x, n);
+            if (NULL != bgr_)
+            {
+               unsigned char* p = bgr_ + ((size_t)width_ * j + x) * 3;
+               for (unsigned k = 0; k < n; ++k, p += 3)
+               {
+                  p[0] = channel[2][k];
+                  p[1] = channel[1][k];
+                  p[2] = channel[0][k];
+               }
+            }
+         }
+      }
+
+      void RowRgb64(int j)
+      {
+         unsigned long long* dst = reinterpret_cast<unsigned long long*>(pixels_) + (size_t)width_ * j;
+         unsigned short channel[SyntheticImageGenerator::cChannels][cChunk];
+         float a[SyntheticImageGenerator::cChannels], b[SyntheticImageGenerator::cChannels];
+         for (int c = 0; c < SyntheticImageGenerator::cChannels; ++c)
+         {
+            a[c] = A(j, c);
+            b[c] = B(j, c);
+         }
+         for (unsigned x = 0; x < width_; x += cChunk)
+         {
+            const unsigned n = std::min(cChunk, width_ - x);
+            for (int c = 0; c < SyntheticImageGenerator::cChannels; ++c)
+               kernels_.sineRow16(colSin_ + x, colCos_ + x, a[c], b[c], (float)wave_.pedestal, (float)wave_.maxValue, (float)wave_.factor, channel[c], n);
+            kernels_.packRgb64(channel[0], channel[1], channel[2], dst + x, n);
+         }
+      }
+
+      unsigned char* pixels_;
+      unsigned width_;
+      unsigned height_;
+      PixelFormat format_;
+      const SyntheticImageGenerator::Wave& wave_;
+      const float* colSin_;
+      const float* colCos_;
+      const double* rowSin_;
+      const double* rowCos_;
+      unsigned char* bgr_;
+      const PixelKernels& kernels_;
+      double sinPhase_;
+      double cosPhase_;
+   };
+}
+
+SyntheticImageGenerator::SyntheticImageGenerator() :
+   width_(0),
+   height_(0)
+{
+}
+
+/**
+* The columns repeat twice across the frame, the rows advance a quarter
+* period over the frame height, times 1, 2 and 4 for the colour channels.
+*/
+void SyntheticImageGenerator::UpdateTables(unsigned width, unsigned height)
+{
+   if (width == width_ && height == height_)
+      return;
+
+   const long period = std::max(1L, (long)width / 2);
+   colSin_.resize(width);
+   colCos_.resize(width);
+   for (unsigned k = 0; k < width; ++k)
+   {
+      colSin_[k] = (float)sin((2.0 * cPi * k) / period);
+      colCos_[k] = (float)cos((2.0 * cPi * k) / period);
+   }
+
+   const double linePhaseInc = 2.0 * cPi / 4.0 / height;
+   rowSin_.resize((size_t)cChannels * height);
+   rowCos_.resize((size_t)cChannels * height);
+   for (int c = 0; c < cChannels; ++c)
+   {
+      for (unsigned j = 0; j < height; ++j)
+      {
+         const double linePhase = linePhaseInc * j * (1 << c);
+         rowSin_[(size_t)c * height + j] = sin(linePhase);
+         rowCos_[(size_t)c * height + j] = cos(linePhase);
+      }
+   }
+   width_ = width;
+   height_ = height;
+}
+
+void SyntheticImageGenerator::Generate(unsigned char* pixels, unsigned width, unsigned height, PixelFormat format, const Wave& wave, unsigned char* bgr)
+{
+   if (NULL == pixels || 0 == width || 0 == height || format >= PIXEL_FORMAT_COUNT)
+      return;
+
+   UpdateTables(width, height);
+   BandTask task(pixels, width, height, format, wave, &colSin_[0], &colCos_[0], &rowSin_[0], &rowCos_[0], bgr);
+   // about 64 kB of pixels per chunk
+   const size_t rowBytes = (size_t)width * PixelFormatBytes(format);
+   pool_->ParallelFor(height, (int)std::max<size_t>(1, 65536 / rowBytes), task);
+}
@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SyntheticImage.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Synthetic sine wave frames for all camera pixel types. The
+//                column and row phases are tabulated once per geometry, so
+//                a frame costs a multiply-add per pixel and channel, done
+//                by the SIMD row kernels on bands of rows in parallel.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#ifndef _SYNTHETICIMAGE_H_
+#define _SYNTHETICIMAGE_H_
+
+#include "PixelTraits.h"
+#include "WorkerPool.h"
+#include <stddef.h>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+// SyntheticImageGenerator class
+//////////////////////////////////////////////////////////////////////////////
+class SyntheticImageGenerator
+{
+public:
+   // channels of the colour formats; channel c advances its row phase
+   // 2^c times as fast down the frame
+   static const int cChannels = 3;
+
+   // pixel (x, y) is factor * min(maxValue, pedestal + amplitude *
+   // sin(phase + y * pi / 2 / height + 4 pi x / width)), truncated and
+   // clamped to the pixel range
+   struct Wave
+   {
+      double phase;
+      double amplitude;
+      double pedestal;
+      double maxValue;
+      double factor;
+   };
+
+   SyntheticImageGenerator();
+
+   // threads of the shared pool that fill the bands
+   void SetThreadCount(int count) {pool_->SetThreadCount(count);}
+   int ThreadCount() const {return pool_->ThreadCount();}
+
+   // fills a width x height frame of 'format'. 'bgr', when not NULL,
+   // receives a packed 3 byte BGR copy of PIXEL_RGBA32 frames.
+   void Generate(unsigned char* pixels, unsigned width, unsigned height, PixelFormat format, const Wave& wave, unsigned char* bgr = NULL);
+
+private:
+   void UpdateTables(unsigned width, unsigned height);
+
+   SharedWorkerPool pool_;
+   unsigned width_;
+   unsigned height_;
+   // sin and cos of the column phases
+   std::vector<float> colSin_;
+   std::vector<float> colCos_;
+   // sin and cos of the row phases, height_ per channel
+   std::vector<double> rowSin_;
+   std::vector<double> rowCos_;
+};
+
+#endif //_SYNTHETICIMAGE_H_
@@ -0,0 +1,294 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Trace.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Module wide trace of the acquisition pipeline.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "Trace.h"
+#include "../../MMDevice/DeviceThreads.h"
+#include <stdio.h>
+#include <algorithm>
+#include <new>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+namespace
+{
+   struct Event
+   {
+      long long ticks;
+      const char* name;
+      char phase;          // 'B'egin, 'E'nd or 'i'nstant, as in the trace format
+   };
+
+   long long NowTicks()
+   {
+#ifdef WIN32
+      LARGE_INTEGER counter;
+      QueryPerformanceCounter(&counter);
+      return counter.QuadPart;
+#else
+      timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      return 1000000000LL * now.tv_sec + now.tv_nsec;
+#endif
+   }
+
+   double TicksPerSecond()
+   {
+#ifdef WIN32
+      LARGE_INTEGER frequency;
+      QueryPerformanceFrequency(&frequency);
+      return (double)frequency.QuadPart;
+#else
+      return 1e9;
+#endif
+   }
+
+   // orders the event stores of the owning thread before the head it
+   // publishes, and the reads of a dump around its reads of the head
+   inline void Fence()
+   {
+#ifdef WIN32
+      MemoryBarrier();
+#else
+      __sync_synchronize();
+#endif
+   }
+
+   // thread slot value of threads that found no ring
+   char g_NoRing;
+}
+
+// events of one thread
+struct TraceRing
+{
+   Event events[TraceLog::cRingEvents];
+   volatile unsigned long head;     // events written, the ring index modulo cRingEvents
+   volatile bool owned;             // a live thread writes the ring
+   unsigned long tid;               // thread number in the trace
+   const char* name;
+};
+
+struct TraceLog::Impl
+{
+   mutable MMThreadLock lock;
+   std::vector<TraceRing*> rings;
+   unsigned long threads;
+   double ticksPerSecond;
+};
+
+namespace
+{
+   /**
+   * The ring of every thread is kept in a fiber local (Windows) or thread
+   * specific (POSIX) slot, whose destructor gives the ring back when the
+   * thread exits. The slot is released when the module unloads, so that no
+   * thread exits into the unloaded destructor.
+   */
+#ifdef WIN32
+   VOID WINAPI ReleaseRing(PVOID ring)
+#else
+   void ReleaseRing(void* ring)
+#endif
+   {
+      if (ring && &g_NoRing != ring)
+         static_cast<TraceRing*>(ring)->owned = false;
+   }
+
+   class ThreadSlot
+   {
+   public:
+#ifdef WIN32
+      ThreadSlot() : index_(FlsAlloc(ReleaseRing)) {}
+      ~ThreadSlot() {if (FLS_OUT_OF_INDEXES != index_) FlsFree(index_);}
+      bool Valid() const {return FLS_OUT_OF_INDEXES != index_;}
+      void* Get() const {return FlsGetValue(index_);}
+      void Set(void* value) {FlsSetValue(index_, value);}
+
+   private:
+      DWORD index_;
+#else
+      ThreadSlot() : valid_(0 == pthread_key_create(&key_, ReleaseRing)) {}
+      ~ThreadSlot() {if (valid_) pthread_key_delete(key_);}
+      bool Valid() const {return valid_;}
+      void* Get() const {return pthread_getspecific(key_);}
+      void Set(void* value) {pthread_setspecific(key_, value);}
+
+   private:
+      bool valid_;
+      pthread_key_t key_;
+#endif
+   };
+
+   ThreadSlot g_ThreadRing;
+}
+
+// created when the module loads and kept to its unload, like the scratch
+// arena: devices trace from destructors that can run after static destructors
+TraceLog* TraceLog::instance_ = new TraceLog;
+
+TraceLog& TraceLog::Instance()
+{
+   return *instance_;
+}
+
+TraceLog::TraceLog() :
+   impl_(new Impl),
+   enabled_(false)
+{
+   impl_->threads = 0;
+   impl_->ticksPerSecond = TicksPerSecond();
+}
+
+TraceLog::~TraceLog()
+{
+   for (size_t i = 0; i < impl_->rings.size(); ++i)
+      delete impl_->rings[i];
+   delete impl_;
+}
+
+void TraceLog::Record(const char* name, char phase)
+{
+   TraceRing* ring = ThreadRing();
+   if (NULL == ring)
+      return;
+   const unsigned long head = ring->head;
+   Event& e = ring->events[head & (cRingEvents - 1)];
+   e.ticks = NowTicks();
+   e.name = name;
+   e.phase = phase;
+   Fence();
+   ring->head = head + 1;
+}
+
+void TraceLog::SetThreadName(const char* name)
+{
+   if (!enabled_)
+      return;
+   TraceRing* ring = ThreadRing();
+   if (NULL != ring)
+      ring->name = name;
+}
+
+/**
+* The ring of the calling thread, taken on its first event: a new one up
+* to cMaxRings, then the one of an exited thread that was written longest
+* ago. Threads finding none are not traced.
+*/
+TraceRing* TraceLog::ThreadRing()
+{
+   if (!g_ThreadRing.Valid())
+      return NULL;
+   void* slot = g_ThreadRing.Get();
+   if (NULL != slot)
+      return (&g_NoRing == slot) ? NULL : static_cast<TraceRing*>(slot);
+
+   MMThreadGuard g(impl_->lock);
+   TraceRing* ring = NULL;
+   if (impl_->rings.size() < cMaxRings)
+   {
+      ring = new (std::nothrow) TraceRing;
+      if (NULL != ring)
+         impl_->rings.push_back(ring);
+   }
+   else
+   {
+      long long oldest = 0;
+      for (size_t i = 0; i < impl_->rings.size(); ++i)
+      {
+         TraceRing* r = impl_->rings[i];
+         const long long last = (r->head > 0) ? r->events[(r->head - 1) & (cRingEvents - 1)].ticks : 0;
+         if (!r->owned && (NULL == ring || last < oldest))
+         {
+            ring = r;
+            oldest = last;
+         }
+      }
+   }
+   if (NULL == ring)
+   {
+      g_ThreadRing.Set(&g_NoRing);
+      return NULL;
+   }
+
+   ring->head = 0;
+   ring->owned = true;
+   ring->tid = ++impl_->threads;
+   ring->name = NULL;
+   g_ThreadRing.Set(ring);
+   return ring;
+}
+
+bool TraceLog::Dump(const std::string& path, double seconds) const
+{
+   FILE* file = fopen(path.c_str(), "w");
+   if (NULL == file)
+      return false;
+
+   MMThreadGuard g(impl_->lock);
+   const double ticksPerUs = impl_->ticksPerSecond / 1e6;
+   const long long now = NowTicks();
+   const long long from = now - (long long)(seconds * impl_->ticksPerSecond);
+
+   fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+   bool first = true;
+   std::vector<Event> events;
+   for (size_t r = 0; r < impl_->rings.size(); ++r)
+   {
+      const TraceRing* ring = impl_->rings[r];
+
+      // the owner keeps writing: the events it may have overwritten while
+      // they were copied, the one it writes included, are dropped
+      const unsigned long head = ring->head;
+      Fence();
+      const unsigned long count = std::min<unsigned long>(head, cRingEvents);
+      events.resize(count);
+      for (unsigned long i = 0; i < count; ++i)
+         events[i] = ring->events[(head - count + i) & (cRingEvents - 1)];
+      Fence();
+      const unsigned long reach = ring->head + 1 - head;
+      const unsigned long overwritten = (reach > cRingEvents - count) ? std::min<unsigned long>(count, reach - (cRingEvents - count)) : 0;
+
+      char name[64];
+      if (ring->name)
+         sprintf(name, "%.63s", ring->name);
+      else
+         sprintf(name, "Thread %lu", ring->tid);
+      fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %lu, \"args\": {\"name\": \"%s\"}}",
+         first ? "" : ",\n", ring->tid, name);
+      first = false;
+
+      int depth = 0;
+      for (unsigned long i = overwritten; i < count; ++i)
+      {
+         const Event& e = events[i];
+         if (e.ticks < from)
+            continue;
+         if ('B' == e.phase)
+            ++depth;
+         else if ('E' == e.phase)
+         {
+            if (0 == depth)
+               continue;
+            --depth;
+         }
+         fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"%c\", %s\"ts\": %.3f, \"pid\": 1, \"tid\": %lu}",
+            e.name, e.phase, ('i' == e.phase) ? "\"s\": \"t\", " : "", (e.ticks - from) / ticksPerUs, ring->tid);
+      }
+   }
+   fprintf(file, "\n]}\n");
+   const bool written = !ferror(file);
+   return (0 == fclose(file)) && written;
+}
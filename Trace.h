@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Trace.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Module wide trace of the acquisition pipeline. Every thread
+//                that passes a trace point gets a ring of timestamped begin
+//                and end events it writes without locks; the last seconds
+//                of all rings can be written as a Chrome trace (JSON Trace
+//                Event Format), which chrome://tracing and Perfetto open, to
+//                see which stage of a frame was late when frames drop.
+//                Disabled trace points cost a test of one flag.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stddef.h>
+#include <string>
+
+struct TraceRing;
+
+//////////////////////////////////////////////////////////////////////////////
+// TraceLog class
+//////////////////////////////////////////////////////////////////////////////
+class TraceLog
+{
+public:
+   // events kept per thread, the oldest are overwritten: a few seconds of
+   // a frame rate in the thousands
+   static const size_t cRingEvents = 1 << 16;
+   // rings of threads that have exited are reused beyond this many
+   static const size_t cMaxRings = 16;
+
+   // the trace of the module
+   static TraceLog& Instance();
+
+   ~TraceLog();
+
+   void Enable(bool enable) {enabled_ = enable;}
+   bool Enabled() const {return enabled_;}
+
+   // events of the calling thread; 'name' must be a string literal, only
+   // the pointer is kept. Ends are recorded with tracing disabled too, for
+   // blocks that began before.
+   void Begin(const char* name) {if (enabled_) Record(name, 'B');}
+   void End(const char* name) {Record(name, 'E');}
+   // an event without duration, e.g. a dropped frame
+   void Instant(const char* name) {if (enabled_) Record(name, 'i');}
+   // name of the calling thread in the trace, a string literal
+   void SetThreadName(const char* name);
+
+   /**
+   * Writes the events of the last 'seconds' of every thread to 'path' as a
+   * Chrome trace. Ends without their begin are left out; false when the
+   * file cannot be written.
+   */
+   bool Dump(const std::string& path, double seconds) const;
+
+private:
+   struct Impl;
+
+   TraceLog();
+   TraceLog(const TraceLog&);
+   TraceLog& operator=(const TraceLog&);
+
+   void Record(const char* name, char phase);
+   TraceRing* ThreadRing();
+
+   static TraceLog* instance_;
+   Impl* impl_;
+   volatile bool enabled_;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// TraceScope class
+// begin and end event of a block
+//////////////////////////////////////////////////////////////////////////////
+class TraceScope
+{
+public:
+   explicit TraceScope(const char* name) : name_(TraceLog::Instance().Enabled() ? name : 0)
+   {
+      if (name_)
+         TraceLog::Instance().Begin(name_);
+   }
+   ~TraceScope()
+   {
+      if (name_)
+         TraceLog::Instance().End(name_);
+   }
+
+private:
+   TraceScope(const TraceScope&);
+   TraceScope& operator=(const TraceScope&);
+
+   const char* name_;
+};
+
+#endif //_TRACE_H_
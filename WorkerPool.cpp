@@ -0,0 +1,406 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          WorkerPool.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Work stealing thread pool, Win32 and pthreads versions.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "WorkerPool.h"
+#include <algorithm>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef WIN32
+   typedef DWORD ThreadId;
+
+   class Mutex
+   {
+   public:
+      Mutex() {InitializeCriticalSection(&cs_);}
+      ~Mutex() {DeleteCriticalSection(&cs_);}
+      void Lock() {EnterCriticalSection(&cs_);}
+      void Unlock() {LeaveCriticalSection(&cs_);}
+   private:
+      CRITICAL_SECTION cs_;
+   };
+
+   // auto reset event
+   class Event
+   {
+   public:
+      Event() {handle_ = CreateEvent(NULL, FALSE, FALSE, NULL);}
+      ~Event() {CloseHandle(handle_);}
+      void Set() {SetEvent(handle_);}
+      void Wait() {WaitForSingleObject(handle_, INFINITE);}
+   private:
+      HANDLE handle_;
+   };
+
+   // one pointer sized value per thread, null until set
+   class ThreadSlot
+   {
+   public:
+      ThreadSlot() {index_ = TlsAlloc();}
+      ~ThreadSlot() {TlsFree(index_);}
+      void* Get() const {return TlsGetValue(index_);}
+      void Set(void* value) {TlsSetValue(index_, value);}
+   private:
+      DWORD index_;
+   };
+
+   inline long AtomicDecrement(volatile long* value) {return InterlockedDecrement(value);}
+   inline bool AtomicSetIfZero(volatile long* value) {return 0 == InterlockedCompareExchange(value, 1, 0);}
+   inline void AtomicClear(volatile long* value) {InterlockedExchange(value, 0);}
+#else
+   typedef pthread_t ThreadId;
+
+   class Mutex
+   {
+   public:
+      Mutex() {pthread_mutex_init(&mutex_, NULL);}
+      ~Mutex() {pthread_mutex_destroy(&mutex_);}
+      void Lock() {pthread_mutex_lock(&mutex_);}
+      void Unlock() {pthread_mutex_unlock(&mutex_);}
+   private:
+      pthread_mutex_t mutex_;
+   };
+
+   // auto reset event
+   class Event
+   {
+   public:
+      Event() : set_(false)
+      {
+         pthread_mutex_init(&mutex_, NULL);
+         pthread_cond_init(&cond_, NULL);
+      }
+      ~Event()
+      {
+         pthread_cond_destroy(&cond_);
+         pthread_mutex_destroy(&mutex_);
+      }
+      void Set()
+      {
+         pthread_mutex_lock(&mutex_);
+         set_ = true;
+         pthread_cond_signal(&cond_);
+         pthread_mutex_unlock(&mutex_);
+      }
+      void Wait()
+      {
+         pthread_mutex_lock(&mutex_);
+         while (!set_)
+            pthread_cond_wait(&cond_, &mutex_);
+         set_ = false;
+         pthread_mutex_unlock(&mutex_);
+      }
+   private:
+      pthread_mutex_t mutex_;
+      pthread_cond_t cond_;
+      bool set_;
+   };
+
+   // one pointer sized value per thread, null until set
+   class ThreadSlot
+   {
+   public:
+      ThreadSlot() {pthread_key_create(&key_, NULL);}
+      ~ThreadSlot() {pthread_key_delete(key_);}
+      void* Get() const {return pthread_getspecific(key_);}
+      void Set(void* value) {pthread_setspecific(key_, value);}
+   private:
+      pthread_key_t key_;
+   };
+
+   inline long AtomicDecrement(volatile long* value) {return __sync_sub_and_fetch(value, 1L);}
+   inline bool AtomicSetIfZero(volatile long* value) {return __sync_bool_compare_and_swap(value, 0L, 1L);}
+   inline void AtomicClear(volatile long* value) {__sync_lock_release(value);}
+#endif
+
+   class MutexGuard
+   {
+   public:
+      MutexGuard(Mutex& mutex) : mutex_(mutex) {mutex_.Lock();}
+      ~MutexGuard() {mutex_.Unlock();}
+   private:
+      MutexGuard(const MutexGuard&);
+      MutexGuard& operator=(const MutexGuard&);
+      Mutex& mutex_;
+   };
+
+   // the pool of the SharedWorkerPool handles
+   Mutex g_SharedPoolLock;
+   WorkerPool* g_SharedPool = 0;
+   int g_SharedPoolUsers = 0;
+
+   // set while the thread runs chunks of a ParallelFor(), of any pool
+   ThreadSlot g_InTask;
+}
+
+// chunks [next, end) not yet taken from one thread's share; the owner takes
+// them from the front, thieves from the back. Padded to a cache line of its
+// own so the owners do not contend on one line.
+struct WorkerShare
+{
+   Mutex lock;
+   int next;
+   int end;
+   char pad[64];
+};
+
+struct WorkerPool::Impl
+{
+   struct Thread
+   {
+      Impl* impl;
+      int index;
+      Event start;
+      ThreadId id;
+#ifdef WIN32
+      HANDLE handle;
+#endif
+   };
+
+   WorkerPool* pool;
+   std::vector<Thread*> threads;
+   std::vector<WorkerShare*> shares;
+   Mutex dispatchLock;      // one ParallelFor() at a time
+   Event done;
+   volatile long pending;   // pool threads still running shares
+   bool quit;
+
+#ifdef WIN32
+   static unsigned __stdcall Entry(void* param)
+#else
+   static void* Entry(void* param)
+#endif
+   {
+      Thread* thread = static_cast<Thread*>(param);
+      thread->impl->pool->WorkerMain(thread->index);
+      return 0;
+   }
+};
+
+WorkerPool::WorkerPool() :
+   impl_(new Impl),
+   threadCount_(1),
+   task_(0),
+   count_(0),
+   grain_(1)
+{
+   impl_->pool = this;
+   impl_->pending = 0;
+   impl_->quit = false;
+   impl_->shares.push_back(new WorkerShare);
+}
+
+WorkerPool::~WorkerPool()
+{
+   StopThreads();
+   for (size_t i = 0; i < impl_->shares.size(); ++i)
+      delete impl_->shares[i];
+   delete impl_;
+}
+
+int WorkerPool::HardwareThreads()
+{
+#ifdef WIN32
+   SYSTEM_INFO info;
+   GetSystemInfo(&info);
+   return std::max(1, (int)info.dwNumberOfProcessors);
+#else
+   return std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+}
+
+void WorkerPool::SetThreadCount(int count)
+{
+   count = std::max(count, 1);
+   MutexGuard g(impl_->dispatchLock);
+   if (count == threadCount_)
+      return;
+
+   StopThreads();
+   while ((int)impl_->shares.size() < count)
+      impl_->shares.push_back(new WorkerShare);
+
+   // the list is complete before any thread looks itself up in it
+   impl_->quit = false;
+   for (int i = 1; i < count; ++i)
+   {
+      Impl::Thread* thread = new Impl::Thread;
+      thread->impl = impl_;
+      thread->index = i;
+      impl_->threads.push_back(thread);
+   }
+   for (size_t i = 0; i < impl_->threads.size(); ++i)
+   {
+      Impl::Thread* thread = impl_->threads[i];
+#ifdef WIN32
+      unsigned id;
+      thread->handle = (HANDLE)_beginthreadex(NULL, 0, &Impl::Entry, thread, 0, &id);
+      thread->id = id;
+#else
+      pthread_create(&thread->id, NULL, &Impl::Entry, thread);
+#endif
+   }
+   threadCount_ = count;
+}
+
+void WorkerPool::StopThreads()
+{
+   impl_->quit = true;
+   for (size_t i = 0; i < impl_->threads.size(); ++i)
+      impl_->threads[i]->start.Set();
+   for (size_t i = 0; i < impl_->threads.size(); ++i)
+   {
+      Impl::Thread* thread = impl_->threads[i];
+#ifdef WIN32
+      WaitForSingleObject(thread->handle, INFINITE);
+      CloseHandle(thread->handle);
+#else
+      pthread_join(thread->id, NULL);
+#endif
+      delete thread;
+   }
+   impl_->threads.clear();
+   threadCount_ = 1;
+}
+
+void WorkerPool::WorkerMain(int worker)
+{
+   Impl::Thread* thread = impl_->threads[worker - 1];
+   for (;;)
+   {
+      thread->start.Wait();
+      if (impl_->quit)
+         return;
+      RunShares(worker);
+      if (0 == AtomicDecrement(&impl_->pending))
+         impl_->done.Set();
+   }
+}
+
+/**
+* Takes the next chunk of the worker's own share, or steals the last chunk
+* of another share once the own share is empty.
+*/
+bool WorkerPool::NextChunk(int worker, int& chunk)
+{
+   {
+      WorkerShare& own = *impl_->shares[worker];
+      MutexGuard g(own.lock);
+      if (own.next < own.end)
+      {
+         chunk = own.next++;
+         return true;
+      }
+   }
+   for (int i = 1; i < threadCount_; ++i)
+   {
+      WorkerShare& victim = *impl_->shares[(worker + i) % threadCount_];
+      MutexGuard g(victim.lock);
+      if (victim.next < victim.end)
+      {
+         chunk = --victim.end;
+         return true;
+      }
+   }
+   return false;
+}
+
+void WorkerPool::RunShares(int worker)
+{
+   g_InTask.Set(this);
+   int chunk;
+   while (NextChunk(worker, chunk))
+   {
+      const int begin = chunk * grain_;
+      task_->Run(begin, std::min(begin + grain_, count_), worker);
+   }
+   g_InTask.Set(0);
+}
+
+void WorkerPool::ParallelFor(int count, int grain, Task& task)
+{
+   if (count <= 0)
+      return;
+   grain = std::max(grain, 1);
+
+   // nested calls would wait for threads that are busy with the outer call
+   if (count > grain && NULL == g_InTask.Get())
+   {
+      // the thread count is read under the lock SetThreadCount() takes, so
+      // the threads it counts are there to finish their shares
+      MutexGuard g(impl_->dispatchLock);
+      const int threads = threadCount_;
+      if (threads > 1)
+      {
+         task_ = &task;
+         count_ = count;
+         grain_ = grain;
+         const int chunks = (count + grain - 1) / grain;
+         for (int i = 0; i < threads; ++i)
+         {
+            WorkerShare& share = *impl_->shares[i];
+            MutexGuard sg(share.lock);
+            share.next = (int)((long long)chunks * i / threads);
+            share.end = (int)((long long)chunks * (i + 1) / threads);
+         }
+
+         impl_->pending = threads - 1;
+         for (size_t i = 0; i < impl_->threads.size(); ++i)
+            impl_->threads[i]->start.Set();
+         RunShares(0);
+         impl_->done.Wait();
+
+         task_ = 0;
+         return;
+      }
+   }
+   task.Run(0, count, 0);
+}
+
+SharedWorkerPool::SharedWorkerPool()
+{
+   MutexGuard g(g_SharedPoolLock);
+   if (0 == g_SharedPoolUsers++)
+   {
+      g_SharedPool = new WorkerPool;
+      g_SharedPool->SetThreadCount(WorkerPool::HardwareThreads());
+   }
+   pool_ = g_SharedPool;
+}
+
+SharedWorkerPool::~SharedWorkerPool()
+{
+   MutexGuard g(g_SharedPoolLock);
+   if (0 == --g_SharedPoolUsers)
+   {
+      delete g_SharedPool;
+      g_SharedPool = 0;
+   }
+}
+
+bool BusyFlag::TryEnter()
+{
+   return AtomicSetIfZero(&flag_);
+}
+
+void BusyFlag::Leave()
+{
+   AtomicClear(&flag_);
+}
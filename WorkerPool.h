@@ -0,0 +1,133 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          WorkerPool.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Fixed size thread pool splitting index ranges across worker
+//                threads. Every thread starts on its own contiguous share and
+//                steals chunks from the end of the other shares when done.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#ifndef _WORKERPOOL_H_
+#define _WORKERPOOL_H_
+
+//////////////////////////////////////////////////////////////////////////////
+// WorkerPool class
+//////////////////////////////////////////////////////////////////////////////
+class WorkerPool
+{
+public:
+   class Task
+   {
+   public:
+      virtual ~Task() {}
+      // processes items [begin, end); 'worker' is 0 for the calling thread
+      // and 1 .. ThreadCount()-1 for the pool threads
+      virtual void Run(int begin, int end, int worker) = 0;
+   };
+
+   WorkerPool();
+   ~WorkerPool();
+
+   // logical processors of the machine
+   static int HardwareThreads();
+
+   // threads taking part in ParallelFor(), the calling thread included;
+   // 1 runs everything on the caller
+   void SetThreadCount(int count);
+   int ThreadCount() const {return threadCount_;}
+
+   /**
+   * Runs 'task' over [0, count) in chunks of 'grain' items and returns
+   * when all chunks are done. One call at a time owns all threads of the
+   * pool: calls from different threads are serialized, the later ones wait
+   * for the running call to finish. Users of a shared pool therefore never
+   * overlap their passes, each runs at the full thread count in turn.
+   * Calls from inside a task run on the calling thread alone.
+   */
+   void ParallelFor(int count, int grain, Task& task);
+
+private:
+   struct Impl;
+
+   void WorkerMain(int worker);
+   void RunShares(int worker);
+   bool NextChunk(int worker, int& chunk);
+   void StopThreads();
+
+   WorkerPool(const WorkerPool&);
+   WorkerPool& operator=(const WorkerPool&);
+
+   Impl* impl_;
+   int threadCount_;
+
+   // the job of the current ParallelFor()
+   Task* task_;
+   int count_;
+   int grain_;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// SharedWorkerPool class
+// handle on the one pool the image processors of the module share; the pool
+// is created with the first handle and its threads end with the last one.
+// It starts with HardwareThreads() threads, and its thread count is a module
+// wide setting: a change through any handle applies to every user.
+//////////////////////////////////////////////////////////////////////////////
+class SharedWorkerPool
+{
+public:
+   SharedWorkerPool();
+   ~SharedWorkerPool();
+
+   WorkerPool& operator*() const {return *pool_;}
+   WorkerPool* operator->() const {return pool_;}
+
+private:
+   SharedWorkerPool(const SharedWorkerPool&);
+   SharedWorkerPool& operator=(const SharedWorkerPool&);
+
+   WorkerPool* pool_;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// BusyFlag class
+// re-entrancy guard that threads test and set atomically
+//////////////////////////////////////////////////////////////////////////////
+class BusyFlag
+{
+public:
+   BusyFlag() : flag_(0) {}
+
+   // sets the flag; false when it was set already
+   bool TryEnter();
+   void Leave();
+   bool IsSet() const {return 0 != flag_;}
+
+private:
+   BusyFlag(const BusyFlag&);
+   BusyFlag& operator=(const BusyFlag&);
+
+   volatile long flag_;
+};
+
+// holds a BusyFlag for the length of a scope, when it got it
+class BusyGuard
+{
+public:
+   explicit BusyGuard(BusyFlag& flag) : flag_(flag), entered_(flag.TryEnter()) {}
+   ~BusyGuard() {if (entered_) flag_.Leave();}
+   bool Entered() const {return entered_;}
+
+private:
+   BusyGuard(const BusyGuard&);
+   BusyGuard& operator=(const BusyGuard&);
+
+   BusyFlag& flag_;
+   bool entered_;
+};
+
+#endif //_WORKERPOOL_H_
@@ -0,0 +1,582 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AcquisitionBench.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Sustained acquisition benchmark of the camera outside
+//                Micro-Manager. The adapter DLL is loaded as the core loads
+//                it, and a mock core takes the images: it runs the image
+//                processor chain on them and copies them into a model of
+//                the circular buffer, drained by a consumer of fixed rate.
+//                Every combination of pixel type, ROI and processor chain
+//                runs a sequence acquisition and prints one JSON line with
+//                the sustained frame rate, the frames lost to overflows,
+//                the CPU time per frame and latency percentiles, the
+//                camera's own stage latencies included.
+//                Standalone console program, built by the project
+//                AcquisitionBench.vcproj next to this file, or from this
+//                file plus LatencyHistogram.cpp against the MMDevice
+//                headers the adapter is built with:
+//
+//                cl /O2 /EHsc /DWIN32 /I.. AcquisitionBench.cpp
+//                   ..\LatencyHistogram.cpp
+//
+//                usage: AcquisitionBench module=<adapter dll> [key=value ...]
+//                   frames=300           images per sequence
+//                   exposure=0           ms, 0 runs as fast as possible
+//                   pixelTypes=8bit      comma separated PixelType values
+//                   rois=full            comma separated WxH (centred) or
+//                                        WxH+X+Y, full for the whole sensor
+//                   chains=none          comma separated processor chains,
+//                                        processors joined by '+', e.g.
+//                                        ImageFlipX+MedianFilter
+//                   bufferMB=250         circular buffer size
+//                   drainFps=0           consumer rate, 0 keeps up always
+//                   stopOnOverflow=0
+//                   set=Name:Value       camera property, repeatable, e.g.
+//                                        set=FrameSource:SinePattern
+//
+//                The sequence thread reports the first processor to the
+//                camera as the core does; the processors after it get the
+//                same frame geometry, so only the first may swap axes.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "../../../MMDevice/MMDevice.h"
+#include "LatencyHistogram.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <deque>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+   typedef MM::Device* (*CreateDeviceFunction)(const char* name);
+   typedef void (*DeleteDeviceFunction)(MM::Device* device);
+   typedef void (*InitializeModuleDataFunction)();
+
+   const char* const cCameraName = "DCam";
+   const char* const cCameraLabel = "Camera";
+
+   double NowUs()
+   {
+#ifdef WIN32
+      LARGE_INTEGER frequency, counter;
+      QueryPerformanceFrequency(&frequency);
+      QueryPerformanceCounter(&counter);
+      return 1e6 * counter.QuadPart / frequency.QuadPart;
+#else
+      timeval tv;
+      gettimeofday(&tv, NULL);
+      return 1e6 * tv.tv_sec + tv.tv_usec;
+#endif
+   }
+
+   // user plus kernel time of the process
+   double CpuUs()
+   {
+#ifdef WIN32
+      FILETIME created, exited, kernel, user;
+      GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user);
+      ULARGE_INTEGER k, u;
+      k.LowPart = kernel.dwLowDateTime;
+      k.HighPart = kernel.dwHighDateTime;
+      u.LowPart = user.dwLowDateTime;
+      u.HighPart = user.dwHighDateTime;
+      return 0.1 * (double)(k.QuadPart + u.QuadPart);
+#else
+      rusage usage;
+      getrusage(RUSAGE_SELF, &usage);
+      return 1e6 * (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+   }
+
+   void SleepMs(int ms)
+   {
+#ifdef WIN32
+      Sleep(ms);
+#else
+      usleep(ms * 1000);
+#endif
+   }
+
+   std::vector<std::string> Split(const std::string& list, char separator)
+   {
+      std::vector<std::string> items;
+      size_t start = 0;
+      while (start <= list.size())
+      {
+         size_t end = list.find(separator, start);
+         if (std::string::npos == end)
+            end = list.size();
+         if (end > start)
+            items.push_back(list.substr(start, end - start));
+         start = end + 1;
+      }
+      return items;
+   }
+
+   /**
+   * The adapter module, loaded and asked for devices the way the core
+   * does it.
+   */
+   class Module
+   {
+   public:
+      Module() : handle_(NULL), create_(NULL), delete_(NULL) {}
+      ~Module()
+      {
+#ifdef WIN32
+         if (handle_)
+            FreeLibrary((HMODULE)handle_);
+#else
+         if (handle_)
+            dlclose(handle_);
+#endif
+      }
+
+      bool Load(const char* path)
+      {
+#ifdef WIN32
+         handle_ = LoadLibraryA(path);
+#else
+         handle_ = dlopen(path, RTLD_NOW);
+#endif
+         if (!handle_)
+            return false;
+         InitializeModuleDataFunction initialize = (InitializeModuleDataFunction)Symbol("InitializeModuleData");
+         create_ = (CreateDeviceFunction)Symbol("CreateDevice");
+         delete_ = (DeleteDeviceFunction)Symbol("DeleteDevice");
+         if (initialize)
+            initialize();
+         return create_ && delete_;
+      }
+
+      MM::Device* Create(const char* name) const {return create_(name);}
+      void Delete(MM::Device* device) const {delete_(device);}
+
+   private:
+      void* Symbol(const char* name) const
+      {
+#ifdef WIN32
+         return (void*)GetProcAddress((HMODULE)handle_, name);
+#else
+         return dlsym(handle_, name);
+#endif
+      }
+
+      void* handle_;
+      CreateDeviceFunction create_;
+      DeleteDeviceFunction delete_;
+   };
+
+   struct RunStats
+   {
+      long inserted;
+      long overflows;
+      long lost;              // frames cleared from the buffer by overflows
+      double firstUs;
+      double lastUs;
+      LatencyHistogram interval;      // between consecutive frames
+      LatencyHistogram processing;    // processor chain per frame
+      LatencyHistogram queueing;      // insertion to consumption
+   };
+
+   /**
+   * Core callback of the benchmark. The circular buffer is modelled as a
+   * FIFO of 'capacity' frames copied into a ring, emptied by a consumer
+   * that takes a frame every 1 / drainFps seconds, or at once for a rate
+   * of 0; consumption is evaluated when frames arrive.
+   */
+   class MockCore : public MM::Core
+   {
+   public:
+      MockCore() : camera_(NULL), bufferBytes_(250 << 20), drainFps_(0.), finished_(true), capacity_(0), slotBytes_(0), next_(0), consumerFree_(0.) {}
+
+      void SetCamera(MM::Camera* camera) {camera_ = camera;}
+      void SetChain(const std::vector<MM::ImageProcessor*>& chain) {chain_ = chain;}
+      void SetBuffer(size_t bytes, double drainFps) {bufferBytes_ = bytes; drainFps_ = drainFps;}
+      bool Finished() const {return finished_;}
+      RunStats& Stats() {return stats_;}
+
+      // consumes the frames still in the buffer at the consumer's pace
+      void Drain() {Consume(1e300);}
+
+      // sequence acquisition
+      int PrepareForAcq(const MM::Device*)
+      {
+         slotBytes_ = camera_->GetImageBufferSize() * camera_->GetNumberOfChannels();
+         capacity_ = std::max<size_t>(1, bufferBytes_ / std::max<size_t>(1, slotBytes_));
+         ring_.resize(capacity_ * slotBytes_);
+         queue_.clear();
+         next_ = 0;
+         consumerFree_ = 0.;
+         stats_.inserted = stats_.overflows = stats_.lost = 0;
+         stats_.firstUs = stats_.lastUs = 0.;
+         stats_.interval.Reset();
+         stats_.processing.Reset();
+         stats_.queueing.Reset();
+         finished_ = false;
+         return DEVICE_OK;
+      }
+      int AcqFinished(const MM::Device*, int)
+      {
+         finished_ = true;
+         return DEVICE_OK;
+      }
+      int InsertImage(const MM::Device*, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const char*, const bool doProcess)
+      {
+         return Insert(buf, width, height, byteDepth, doProcess);
+      }
+      int InsertImage(const MM::Device*, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const Metadata*, const bool doProcess)
+      {
+         return Insert(buf, width, height, byteDepth, doProcess);
+      }
+      int InsertImage(const MM::Device*, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned, const char*, const bool doProcess)
+      {
+         return Insert(buf, width, height, byteDepth, doProcess);
+      }
+      int InsertImage(const MM::Device*, const ImgBuffer&) {return DEVICE_NOT_SUPPORTED;}
+      int InsertMultiChannel(const MM::Device*, const unsigned char*, unsigned, unsigned, unsigned, unsigned, Metadata*) {return DEVICE_NOT_SUPPORTED;}
+      void ClearImageBuffer(const MM::Device*)
+      {
+         stats_.lost += (long)queue_.size();
+         queue_.clear();
+      }
+      bool InitializeImageBuffer(unsigned, unsigned, unsigned int, unsigned int, unsigned int) {return true;}
+      void SetAcqStatus(const MM::Device*, int) {}
+
+      // devices
+      int LogMessage(const MM::Device*, const char* msg, bool debugOnly) const
+      {
+         if (!debugOnly)
+            fprintf(stderr, "# %s\n", msg);
+         return DEVICE_OK;
+      }
+      MM::Device* GetDevice(const MM::Device*, const char* label)
+      {
+         return (camera_ && 0 == strcmp(label, cCameraLabel)) ? camera_ : NULL;
+      }
+      int GetDeviceProperty(const char* device, const char* property, char* value)
+      {
+         if (0 == strcmp(device, MM::g_Keyword_CoreDevice) && 0 == strcmp(property, MM::g_Keyword_CoreCamera))
+         {
+            strcpy(value, cCameraLabel);
+            return DEVICE_OK;
+         }
+         return DEVICE_INVALID_PROPERTY;
+      }
+      int SetDeviceProperty(const char*, const char*, const char*) {return DEVICE_INVALID_PROPERTY;}
+      void GetLoadedDeviceOfType(const MM::Device*, MM::DeviceType, char* name, const unsigned int) {name[0] = 0;}
+      MM::ImageProcessor* GetImageProcessor(const MM::Device*) {return chain_.empty() ? NULL : chain_[0];}
+      MM::AutoFocus* GetAutoFocus(const MM::Device*) {return NULL;}
+      MM::Hub* GetParentHub(const MM::Device*) const {return NULL;}
+      MM::State* GetStateDevice(const MM::Device*, const char*) {return NULL;}
+      MM::SignalIO* GetSignalIODevice(const MM::Device*, const char*) {return NULL;}
+
+      // notifications
+      int OnPropertiesChanged(const MM::Device*) {return DEVICE_OK;}
+      int OnPropertyChanged(const MM::Device*, const char*, const char*) {return DEVICE_OK;}
+      int OnStagePositionChanged(const MM::Device*, double) {return DEVICE_OK;}
+      int OnXYStagePositionChanged(const MM::Device*, double, double) {return DEVICE_OK;}
+      int OnExposureChanged(const MM::Device*, double) {return DEVICE_OK;}
+      int OnSLMExposureChanged(const MM::Device*, double) {return DEVICE_OK;}
+      int OnMagnifierChanged(const MM::Device*) {return DEVICE_OK;}
+
+      // time
+      unsigned long GetClockTicksUs(const MM::Device*) {return (unsigned long)NowUs();}
+      MM::MMTime GetCurrentMMTime() {return MM::MMTime(NowUs());}
+
+      // serial ports, autofocus and configuration access are not simulated
+      int SetSerialProperties(const char*, const char*, const char*, const char*, const char*, const char*, const char*) {return DEVICE_NOT_SUPPORTED;}
+      int SetSerialCommand(const MM::Device*, const char*, const char*, const char*) {return DEVICE_NOT_SUPPORTED;}
+      int GetSerialAnswer(const MM::Device*, const char*, unsigned long, char*, const char*) {return DEVICE_NOT_SUPPORTED;}
+      int WriteToSerial(const MM::Device*, const char*, const unsigned char*, unsigned long) {return DEVICE_NOT_SUPPORTED;}
+      int ReadFromSerial(const MM::Device*, const char*, unsigned char*, unsigned long, unsigned long&) {return DEVICE_NOT_SUPPORTED;}
+      int PurgeSerial(const MM::Device*, const char*) {return DEVICE_NOT_SUPPORTED;}
+      MM::PortType GetSerialPortType(const char*) const {return MM::InvalidPort;}
+      const char* GetImage() {return NULL;}
+      int GetImageDimensions(int& width, int& height, int& depth) {width = height = depth = 0; return DEVICE_NOT_SUPPORTED;}
+      int GetFocusPosition(double&) {return DEVICE_NOT_SUPPORTED;}
+      int SetFocusPosition(double) {return DEVICE_NOT_SUPPORTED;}
+      int MoveFocus(double) {return DEVICE_NOT_SUPPORTED;}
+      int SetXYPosition(double, double) {return DEVICE_NOT_SUPPORTED;}
+      int GetXYPosition(double&, double&) {return DEVICE_NOT_SUPPORTED;}
+      int MoveXYStage(double, double) {return DEVICE_NOT_SUPPORTED;}
+      int SetExposure(double) {return DEVICE_NOT_SUPPORTED;}
+      int GetExposure(double&) {return DEVICE_NOT_SUPPORTED;}
+      int SetConfig(const char*, const char*) {return DEVICE_NOT_SUPPORTED;}
+      int GetCurrentConfig(const char*, int, char*) {return DEVICE_NOT_SUPPORTED;}
+      int GetChannelConfig(char*, const unsigned int) {return DEVICE_NOT_SUPPORTED;}
+      void PostError(const int, const char*) {}
+      void ClearPostedErrors() {}
+
+   private:
+      int Insert(const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, bool doProcess)
+      {
+         const double arrival = NowUs();
+         if (doProcess)
+         {
+            for (size_t i = 0; i < chain_.size(); ++i)
+               chain_[i]->Process(const_cast<unsigned char*>(buf), width, height, byteDepth);
+            stats_.processing.Record(NowUs() - arrival, (double)width * height * byteDepth);
+         }
+
+         const double now = NowUs();
+         Consume(now);
+         if (queue_.size() >= capacity_)
+         {
+            ++stats_.overflows;
+            return DEVICE_BUFFER_OVERFLOW;
+         }
+
+         const size_t bytes = std::min<size_t>(slotBytes_, (size_t)width * height * byteDepth);
+         memcpy(&ring_[next_ * slotBytes_], buf, bytes);
+         next_ = (next_ + 1) % capacity_;
+         queue_.push_back(now);
+
+         if (stats_.inserted > 0)
+            stats_.interval.Record(now - stats_.lastUs, (double)bytes);
+         else
+            stats_.firstUs = now;
+         stats_.lastUs = now;
+         ++stats_.inserted;
+         return DEVICE_OK;
+      }
+
+      // takes the frames the consumer is done with by 'now'
+      void Consume(double now)
+      {
+         while (!queue_.empty())
+         {
+            const double start = std::max(queue_.front(), consumerFree_);
+            if (start > now)
+               break;
+            stats_.queueing.Record(start - queue_.front(), (double)slotBytes_);
+            consumerFree_ = start + ((drainFps_ > 0.) ? 1e6 / drainFps_ : 0.);
+            queue_.pop_front();
+         }
+      }
+
+      MM::Camera* camera_;
+      std::vector<MM::ImageProcessor*> chain_;
+      size_t bufferBytes_;
+      double drainFps_;
+      volatile bool finished_;
+      size_t capacity_;
+      size_t slotBytes_;
+      std::vector<unsigned char> ring_;
+      size_t next_;
+      std::deque<double> queue_;     // arrival times of the buffered frames
+      double consumerFree_;
+      RunStats stats_;
+   };
+
+   void PrintLatency(const char* name, const LatencyHistogram& h)
+   {
+      printf(", \"%s\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}", name,
+         h.Value(LatencyHistogram::LATENCY_P50), h.Value(LatencyHistogram::LATENCY_P90),
+         h.Value(LatencyHistogram::LATENCY_P99), h.Value(LatencyHistogram::LATENCY_MAX));
+   }
+
+   // the camera's stage latencies, "CaptureLatency p50 (us)" and so on
+   void PrintStageLatencies(MM::Camera* camera)
+   {
+      static const char* const stages[] = {"Capture", "Reconstruction", "Insert"};
+      static const char* const stats[] = {"p50", "p90", "p99", "max"};
+      for (int s = 0; s < 3; ++s)
+      {
+         printf(", \"camera%s\": {", stages[s]);
+         for (int k = 0; k < 4; ++k)
+         {
+            char name[MM::MaxStrLength];
+            char value[MM::MaxStrLength];
+            sprintf(name, "%sLatency %s (us)", stages[s], stats[k]);
+            if (DEVICE_OK != camera->GetProperty(name, value))
+               strcpy(value, "null");
+            printf("%s\"%s\": %s", k ? ", " : "", stats[k], value);
+         }
+         printf("}");
+      }
+   }
+
+   // "WxH", centred on the sensor, or "WxH+X+Y"; "full" clears the ROI
+   int ApplyRoi(MM::Camera* camera, const std::string& roi)
+   {
+      if (roi == "full")
+         return camera->ClearROI();
+      unsigned w = 0, h = 0, x = 0, y = 0;
+      const int fields = sscanf(roi.c_str(), "%ux%u+%u+%u", &w, &h, &x, &y);
+      if (fields < 2 || 0 == w || 0 == h)
+         return DEVICE_INVALID_INPUT_PARAM;
+      camera->ClearROI();
+      if (fields < 4)
+      {
+         const unsigned width = camera->GetImageWidth();
+         const unsigned height = camera->GetImageHeight();
+         x = (width > w) ? (width - w) / 2 : 0;
+         y = (height > h) ? (height - h) / 2 : 0;
+      }
+      return camera->SetROI(x, y, w, h);
+   }
+}
+
+int main(int argc, char* argv[])
+{
+   std::string module;
+   long frames = 300;
+   double exposure = 0.;
+   std::vector<std::string> pixelTypes(1, "8bit");
+   std::vector<std::string> rois(1, "full");
+   std::vector<std::string> chains(1, "none");
+   double bufferMB = 250.;
+   double drainFps = 0.;
+   bool stopOnOverflow = false;
+   std::vector<std::string> settings;
+   for (int i = 1; i < argc; ++i)
+   {
+      const std::string arg(argv[i]);
+      const size_t eq = arg.find('=');
+      const std::string key = arg.substr(0, eq);
+      const std::string value = (std::string::npos == eq) ? std::string() : arg.substr(eq + 1);
+      if (key == "module") module = value;
+      else if (key == "frames") frames = atol(value.c_str());
+      else if (key == "exposure") exposure = atof(value.c_str());
+      else if (key == "pixelTypes") pixelTypes = Split(value, ',');
+      else if (key == "rois") rois = Split(value, ',');
+      else if (key == "chains") chains = Split(value, ',');
+      else if (key == "bufferMB") bufferMB = atof(value.c_str());
+      else if (key == "drainFps") drainFps = atof(value.c_str());
+      else if (key == "stopOnOverflow") stopOnOverflow = 0 != atoi(value.c_str());
+      else if (key == "set") settings.push_back(value);
+      else
+      {
+         fprintf(stderr, "unknown argument %s\n", argv[i]);
+         return 1;
+      }
+   }
+   if (module.empty())
+   {
+      fprintf(stderr, "usage: AcquisitionBench module=<adapter dll> [frames=] [exposure=] [pixelTypes=] [rois=] [chains=] [bufferMB=] [drainFps=] [stopOnOverflow=] [set=Name:Value ...]\n");
+      return 1;
+   }
+
+   Module adapter;
+   if (!adapter.Load(module.c_str()))
+   {
+      fprintf(stderr, "cannot load %s\n", module.c_str());
+      return 1;
+   }
+
+   MockCore core;
+   core.SetBuffer((size_t)(bufferMB * 1048576.), drainFps);
+   MM::Camera* camera = dynamic_cast<MM::Camera*>(adapter.Create(cCameraName));
+   if (!camera)
+   {
+      fprintf(stderr, "%s has no %s camera\n", module.c_str(), cCameraName);
+      return 1;
+   }
+   camera->SetLabel(cCameraLabel);
+   camera->SetCallback(&core);
+   core.SetCamera(camera);
+   int ret = camera->Initialize();
+   for (size_t i = 0; DEVICE_OK == ret && i < settings.size(); ++i)
+   {
+      const size_t colon = settings[i].find(':');
+      ret = camera->SetProperty(settings[i].substr(0, colon).c_str(), (std::string::npos == colon) ? "" : settings[i].substr(colon + 1).c_str());
+   }
+   if (DEVICE_OK == ret)
+      camera->SetExposure(exposure);
+   else
+   {
+      char text[MM::MaxStrLength];
+      camera->GetErrorText(ret, text);
+      fprintf(stderr, "camera setup failed: %s\n", text);
+      adapter.Delete(camera);
+      return 1;
+   }
+
+   for (size_t c = 0; c < chains.size(); ++c)
+   {
+      std::vector<MM::ImageProcessor*> chain;
+      const std::vector<std::string> names = (chains[c] == "none") ? std::vector<std::string>() : Split(chains[c], '+');
+      for (size_t i = 0; i < names.size(); ++i)
+      {
+         MM::ImageProcessor* processor = dynamic_cast<MM::ImageProcessor*>(adapter.Create(names[i].c_str()));
+         if (!processor)
+         {
+            fprintf(stderr, "%s is not an image processor of %s\n", names[i].c_str(), module.c_str());
+            continue;
+         }
+         processor->SetLabel(names[i].c_str());
+         processor->SetCallback(&core);
+         processor->Initialize();
+         chain.push_back(processor);
+      }
+      core.SetChain(chain);
+
+      for (size_t p = 0; p < pixelTypes.size(); ++p)
+      {
+         for (size_t r = 0; r < rois.size(); ++r)
+         {
+            ret = camera->SetProperty(MM::g_Keyword_PixelType, pixelTypes[p].c_str());
+            if (DEVICE_OK == ret)
+               ret = ApplyRoi(camera, rois[r]);
+            if (DEVICE_OK == ret)
+               ret = camera->SetProperty("StageLatencyReset", "Reset");
+
+            const double cpu0 = CpuUs();
+            const double t0 = NowUs();
+            if (DEVICE_OK == ret)
+               ret = camera->StartSequenceAcquisition(frames, 0., stopOnOverflow);
+            if (DEVICE_OK == ret)
+            {
+               while (camera->IsCapturing() || !core.Finished())
+                  SleepMs(1);
+            }
+            const double seconds = 1e-6 * (NowUs() - t0);
+            const double cpu = CpuUs() - cpu0;
+            core.Drain();
+
+            const RunStats& s = core.Stats();
+            const double span = 1e-6 * (s.lastUs - s.firstUs);
+            printf("{\"pixelType\": \"%s\", \"roi\": \"%s\", \"chain\": \"%s\", \"width\": %u, \"height\": %u, \"status\": %d",
+               pixelTypes[p].c_str(), rois[r].c_str(), chains[c].c_str(), camera->GetImageWidth(), camera->GetImageHeight(), ret);
+            printf(", \"frames\": %ld, \"inserted\": %ld, \"overflows\": %ld, \"lost\": %ld, \"seconds\": %.3f",
+               frames, s.inserted, s.overflows, s.lost, seconds);
+            printf(", \"fps\": %.1f, \"cpuUsPerFrame\": %.1f",
+               (s.inserted > 1 && span > 0.) ? (s.inserted - 1) / span : 0., s.inserted > 0 ? cpu / s.inserted : 0.);
+            PrintLatency("intervalUs", s.interval);
+            PrintLatency("processingUs", s.processing);
+            PrintLatency("queueUs", s.queueing);
+            PrintStageLatencies(camera);
+            printf("}\n");
+            fflush(stdout);
+         }
+      }
+
+      core.SetChain(std::vector<MM::ImageProcessor*>());
+      for (size_t i = 0; i < chain.size(); ++i)
+      {
+         chain[i]->Shutdown();
+         adapter.Delete(chain[i]);
+      }
+   }
+
+   camera->Shutdown();
+   adapter.Delete(camera);
+   return 0;
+}
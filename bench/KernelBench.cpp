@@ -0,0 +1,623 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          KernelBench.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Microbenchmarks of the pixel kernels over a matrix of frame
+//                sizes, pixel depths and instruction sets, to judge kernel
+//                rewrites. Each case prints one JSON object with ns/pixel
+//                and GB/s (bytes read plus written); given a baseline, a
+//                previous output of this program, cases slower by more
+//                than the threshold are flagged and the exit code is 2.
+//                Standalone console program, built by the project
+//                KernelBench.vcproj next to this file, or from this file
+//                plus PixelKernels.cpp, SyntheticImage.cpp,
+//                CpuReconstruction.cpp and WorkerPool.cpp:
+//
+//                cl /O2 /EHsc /DWIN32 /I.. KernelBench.cpp
+//                   ..\PixelKernels.cpp ..\SyntheticImage.cpp
+//                   ..\CpuReconstruction.cpp ..\WorkerPool.cpp
+//
+//                usage: KernelBench [key=value ...]
+//                   sizes=2040x1088,...  comma separated WxH frame sizes
+//                   depths=8,16          bits per pixel
+//                   kernels=all          comma separated subset of flipX,
+//                                        flipY, transpose, median, synthetic,
+//                                        widen, half, bin2, crop,
+//                                        reconstruction
+//                   isa=best             best, all, or one of Scalar, SSE2,
+//                                        AVX2, AVX-512
+//                   threads=1            workers of the pooled kernels
+//                   seconds=0.05         minimum length of a timed run
+//                   baseline=<file>      output of an earlier run
+//                   threshold=10         % slowdown flagged as regression
+//
+//                The module has no binning or crop kernel: binning divides
+//                the sensor size and crop takes the ROI. bin2 and crop time
+//                plain reference loops of both, the numbers a kernel for
+//                them will be judged against.
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "PixelKernels.h"
+#include "SyntheticImage.h"
+#include "CpuReconstruction.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+namespace
+{
+   // largest frame of the camera, the source of the crops
+   const unsigned cSensorWidth = 2040;
+   const unsigned cSensorHeight = 1088;
+
+   // timed runs per case, the fastest is reported
+   const int cRuns = 5;
+
+   double NowSeconds()
+   {
+#ifdef WIN32
+      LARGE_INTEGER frequency, counter;
+      QueryPerformanceFrequency(&frequency);
+      QueryPerformanceCounter(&counter);
+      return (double)counter.QuadPart / frequency.QuadPart;
+#else
+      timeval tv;
+      gettimeofday(&tv, NULL);
+      return tv.tv_sec + 1e-6 * tv.tv_usec;
+#endif
+   }
+
+   std::vector<std::string> Split(const std::string& list, char separator)
+   {
+      std::vector<std::string> items;
+      size_t start = 0;
+      while (start <= list.size())
+      {
+         size_t end = list.find(separator, start);
+         if (std::string::npos == end)
+            end = list.size();
+         if (end > start)
+            items.push_back(list.substr(start, end - start));
+         start = end + 1;
+      }
+      return items;
+   }
+
+   /**
+   * One kernel on one frame geometry. Run() does a full frame; Bytes() is
+   * the traffic of a frame, input read plus output written.
+   */
+   class Case
+   {
+   public:
+      virtual ~Case() {}
+      virtual bool Supports(unsigned depth) const {return 8 == depth || 16 == depth;}
+      virtual void Prepare(unsigned width, unsigned height, unsigned depth) = 0;
+      virtual void Run() = 0;
+      virtual double Bytes() const = 0;
+   };
+
+   // frame of arbitrary content, every byte visited once so the pages are
+   // committed before timing
+   void Fill(std::vector<unsigned char>& buffer, size_t bytes)
+   {
+      buffer.resize(bytes);
+      unsigned state = 12345;
+      for (size_t i = 0; i < bytes; ++i)
+      {
+         state = state * 1103515245 + 12345;
+         buffer[i] = (unsigned char)(state >> 16);
+      }
+   }
+
+   class FlipXCase : public Case
+   {
+   public:
+      void Prepare(unsigned width, unsigned height, unsigned depth)
+      {
+         width_ = width;
+         height_ = height;
+         depth_ = depth;
+         Fill(frame_, (size_t)width * height * depth / 8);
+      }
+      void Run()
+      {
+         const PixelKernels& k = Kernels();
+         for (unsigned y = 0; y < height_; ++y)
+         {
+            if (8 == depth_)
+               k.reverse8(&frame_[(size_t)y * width_], width_);
+            else
+               k.reverse16(reinterpret_cast<unsigned short*>(&frame_[(size_t)y * width_ * 2]), width_);
+         }
+      }
+      double Bytes() const {return 2. * frame_.size();}
+
+   private:
+      unsigned width_, height_, depth_;
+      std::vector<unsigned char> frame_;
+   };
+
+   class FlipYCase : public Case
+   {
+   public:
+      void Prepare(unsigned width, unsigned height, unsigned depth)
+      {
+         row_ = (size_t)width * depth / 8;
+         height_ = height;
+         Fill(frame_, row_ * height);
+      }
+      void Run()
+      {
+         for (unsigned y = 0; y < height_ / 2; ++y)
+            Kernels().swapBytes(&frame_[row_ * y], &frame_[row_ * (height_ - 1 - y)], row_);
+      }
+      double Bytes() const {return 2. * row_ * (height_ & ~1u);}
+
+   private:
+      size_t row_;
+      unsigned height_;
+      std::vector<unsigned char> frame_;
+   };
+
+   class TransposeCase : public Case
+   {
+   public:
+      void Prepare(unsigned width, unsigned height, unsigned depth)
+      {
+         width_ = width;
+         height_ = height;
+         depth_ = depth;
+         Fill(src_, (size_t)width * height * depth / 8);
+         Fill(dst_, src_.size());
+      }
+      void Run()
+      {
+         if (8 == depth_)
+            Kernels().transpose8(&src_[0], width_, &dst_[0], height_, width_, height_);
+         else
+            Kernels().transpose16(reinterpret_cast<const unsigned short*>(&src_[0]), width_, reinterpret_cast<unsigned short*>(&dst_[0]), height_, width_, height_);
+      }
+      double Bytes() const {return 2. * src_.size();}
+
+   private:
+      unsigned width_, height_, depth_;
+      std::vector<unsigned char> src_;
+      std::vector<unsigned char> dst_;
+   };
+
+   class MedianCase : public Case
+   {
+   public:
+      void Prepare(unsigned width, unsigned height, unsigned depth)
+      {
+         width_ = width;
+         height_ = height;
+         depth_ = depth;
+         Fill(src_, (size_t)width * height * depth / 8);
+         Fill(dst_, src_.size());
+      }
+      void Run()
+      {
+         const PixelKernels& k = Kernels();
+         const size_t row = (size_t)width_ * depth_ / 8;
+         for (unsigned y = 0; y < height_; ++y)
+         {
+            const unsigned char* above = &src_[row * (y > 0 ? y - 1 : y)];
+            const unsigned char* center = &src_[row * y];
+            const unsigned char* below = &src_[row * (y + 1 < height_ ? y + 1 : y)];
+            if (8 == depth_)
+               k.median8(above, center, below, &dst_[row * y], width_);
+            else
+               k.median16(reinterpret_cast<const unsigned short*>(above), reinterpret_cast<const unsigned short*>(center),
+                  reinterpret_cast<const unsigned short*>(below), reinterpret_cast<unsigned short*>(&dst_[row * y]), width_);
+         }
+      }
+      double Bytes() const {return 2. * src_.size();}
+
+   private:
+      unsigned width_, height_, depth_;
+      std::vector<unsigned char> src_;
+      std::vector<unsigned char> dst_;
+   };
+
+   class SyntheticCase : public Case
+   {
+   public:
+      explicit SyntheticCase(int threads) {generator_.SetThreadCount(threads);}
+      void Prepare(unsigned width, unsigned height, unsigned depth)
+      {
+         width_ = width;
+         height_ = height;
+         format_ = (8 == depth) ? PIXEL_UINT8 : PIXEL_UINT16;
+         Fill(frame_, (size_t)width * height * depth / 8);
+         wave_.phase = 0.;
+         wave_.amplitude = (8 == depth) ? 100. : 25000.;
+         wave_.pedestal = (8 == depth) ? 128. : 32768.;
+         wave_.maxValue = (8 == depth) ? 255. : 65535.;
+         wave_.factor = 1.;
+         // the first frame fills the phase tables
+         generator_.Generate(&frame_[0], width_, height_, format_, wave_);
+      }
+      void Run()
+      {
+         wave_.phase += 0.1;
+         generator_.Generate(&frame_[0], width_, height_, format_, wave_);
+      }
+      double Bytes() const {return (double)frame_.size();}
+
+   private:
+      SyntheticImageGenerator generator_;
+      SyntheticImageGenerator::Wave wave_;
+      unsigned width_, height_;
+      PixelFormat format_;
+      std::vector<unsigned char> frame_;
+   };
+
+   // the 8 bit grabber surface copied into a 16 bit image
+   class WidenCase : public Case
+   {
+   public:
+      bool Supports(unsigned depth) const {return 8 == depth;}
+      void Prepare(unsigned width, unsigned height, unsigned)
+      {
+         Fill(src_, (size_t)width * height);
+         dst_.resize(src_.size());
+      }
+      void Run() {Kernels().widen8to16(&src_[0], &dst_[0], src_.size());}
+      double Bytes() const {return 3. * src_.size();}
+
+   private:
+      std::vector<unsigned char> src_;
+      std::vector<unsigned short> dst_;
+   };
+
+   // complex float frame to the half precision spectrum storage and back,
+   // two values per pixel
+   class HalfCase : public Case
+   {
+   public:
+      bool Supports(unsigned depth) const {return 16 == depth;}
+      void Prepare(unsigned width, unsigned height, unsigned)
+      {
+         values_.resize(2 * (size_t)width * height);
+         for (size_t i = 0; i < values_.size(); ++i)
+            values_[i] = (float)(rand() - RAND_MAX / 2) / 1024.f;
+         halves_.resize(values_.size());
+      }
+      void Run()
+      {
+         Kernels().floatToHalf(&values_[0], &halves_[0], values_.size());
+         Kernels().halfToFloat(&halves_[0], &values_[0], values_.size());
+      }
+      double Bytes() const {return 12. * values_.size();}
+
+   private:
+      std::vector<float> values_;
+      std::vector<unsigned short> halves_;
+   };
+
+   // reference 2x2 binning to the mean, the frame size is the output
+   class Bin2Case : public Case
+   {
+   public:
+      void Prepare(unsigned width, unsigned height, unsigned depth)
+      {
+         width_ = width;
+         height_ = height;
+         depth_ = depth;
+         Fill(src_, (size_t)width * height * 4 * depth / 8);
+         Fill(dst_, (size_t)width * height * depth / 8);
+      }
+      void Run()
+      {
+         if (8 == depth_)
+            Bin(&src_[0], &dst_[0]);
+         else
+            Bin(reinterpret_cast<const unsigned short*>(&src_[0]), reinterpret_cast<unsigned short*>(&dst_[0]));
+      }
+      double Bytes() const {return (double)(src_.size() + dst_.size());}
+
+   private:
+      template <typename T>
+      void Bin(const T* src, T* dst) const
+      {
+         const size_t stride = 2 * (size_t)width_;
+         for (unsigned y = 0; y < height_; ++y)
+         {
+            const T* r0 = src + 2 * y * stride;
+            const T* r1 = r0 + stride;
+            T* out = dst + (size_t)y * width_;
+            for (unsigned x = 0; x < width_; ++x)
+               out[x] = (T)((r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2);
+         }
+      }
+
+      unsigned width_, height_, depth_;
+      std::vector<unsigned char> src_;
+      std::vector<unsigned char> dst_;
+   };
+
+   // reference crop of a centred ROI out of the full sensor frame
+   class CropCase : public Case
+   {
+   public:
+      void Prepare(unsigned width, unsigned height, unsigned depth)
+      {
+         if (width > cSensorWidth) width = cSensorWidth;
+         if (height > cSensorHeight) height = cSensorHeight;
+         bytesPerPixel_ = depth / 8;
+         row_ = (size_t)width * bytesPerPixel_;
+         height_ = height;
+         Fill(src_, (size_t)cSensorWidth * cSensorHeight * bytesPerPixel_);
+         Fill(dst_, row_ * height);
+         offset_ = ((size_t)(cSensorHeight - height) / 2 * cSensorWidth + (cSensorWidth - width) / 2) * bytesPerPixel_;
+      }
+      void Run()
+      {
+         const size_t stride = (size_t)cSensorWidth * bytesPerPixel_;
+         for (unsigned y = 0; y < height_; ++y)
+            memcpy(&dst_[row_ * y], &src_[offset_ + stride * y], row_);
+      }
+      double Bytes() const {return 2. * dst_.size();}
+
+   private:
+      size_t bytesPerPixel_;
+      size_t row_;
+      unsigned height_;
+      size_t offset_;
+      std::vector<unsigned char> src_;
+      std::vector<unsigned char> dst_;
+   };
+
+   // 8 bit hologram to the 8 bit intensity of the reconstruction plane
+   class ReconstructionCase : public Case
+   {
+   public:
+      explicit ReconstructionCase(int threads) : threads_(threads) {}
+      bool Supports(unsigned depth) const {return 8 == depth;}
+      void Prepare(unsigned width, unsigned height, unsigned)
+      {
+         int bx = 4;
+         int by = 4;
+         reconstructor_.Init(width, height, &bx, &by);
+         reconstructor_.SetThreadCount(threads_);
+         Fill(frame_, (size_t)width * height);
+         out_.resize(reconstructor_.OutputPlaneBytes());
+         // the first frame allocates the per thread buffers
+         reconstructor_.Reconstruct(&frame_[0], &out_[0]);
+      }
+      void Run() {reconstructor_.Reconstruct(&frame_[0], &out_[0]);}
+      double Bytes() const {return (double)(frame_.size() + out_.size());}
+
+   private:
+      int threads_;
+      CpuReconstructor reconstructor_;
+      std::vector<unsigned char> frame_;
+      std::vector<unsigned char> out_;
+   };
+
+   Case* CreateCase(const std::string& name, int threads)
+   {
+      if (name == "flipX") return new FlipXCase;
+      if (name == "flipY") return new FlipYCase;
+      if (name == "transpose") return new TransposeCase;
+      if (name == "median") return new MedianCase;
+      if (name == "synthetic") return new SyntheticCase(threads);
+      if (name == "widen") return new WidenCase;
+      if (name == "half") return new HalfCase;
+      if (name == "bin2") return new Bin2Case;
+      if (name == "crop") return new CropCase;
+      if (name == "reconstruction") return new ReconstructionCase(threads);
+      return NULL;
+   }
+
+   // seconds per frame: the fastest of cRuns runs, each repeating the frame
+   // until it lasts 'minSeconds'
+   double Time(Case& c, double minSeconds)
+   {
+      c.Run();
+      int repeats = 1;
+      for (;;)
+      {
+         const double start = NowSeconds();
+         for (int i = 0; i < repeats; ++i)
+            c.Run();
+         const double elapsed = NowSeconds() - start;
+         if (elapsed >= minSeconds || repeats >= (1 << 24))
+            break;
+         repeats = (elapsed > 0.) ? (int)(repeats * 1.2 * minSeconds / elapsed) + 1 : repeats * 10;
+      }
+      double best = 1e300;
+      for (int run = 0; run < cRuns; ++run)
+      {
+         const double start = NowSeconds();
+         for (int i = 0; i < repeats; ++i)
+            c.Run();
+         const double perFrame = (NowSeconds() - start) / repeats;
+         if (perFrame < best)
+            best = perFrame;
+      }
+      return best;
+   }
+
+   std::string CaseKey(const std::string& kernel, const std::string& isa, unsigned width, unsigned height, unsigned depth)
+   {
+      char key[256];
+      sprintf(key, "%s/%s/%ux%u/%u", kernel.c_str(), isa.c_str(), width, height, depth);
+      return key;
+   }
+
+   // text after "name": in a line of this program's output
+   bool Field(const std::string& line, const char* name, std::string& value)
+   {
+      const std::string tag = std::string("\"") + name + "\": ";
+      size_t begin = line.find(tag);
+      if (std::string::npos == begin)
+         return false;
+      begin += tag.size();
+      if ('"' == line[begin])
+      {
+         const size_t end = line.find('"', begin + 1);
+         value = line.substr(begin + 1, end - begin - 1);
+      }
+      else
+         value = line.substr(begin, line.find_first_of(",}", begin) - begin);
+      return true;
+   }
+
+   /**
+   * ns/pixel of the cases of an earlier output, one object per line; lines
+   * without the fields, the array brackets among them, are skipped.
+   */
+   bool LoadBaseline(const char* path, std::map<std::string, double>& baseline)
+   {
+      std::ifstream file(path);
+      if (!file)
+         return false;
+      std::string line;
+      while (std::getline(file, line))
+      {
+         std::string kernel, isa, width, height, depth, ns;
+         if (Field(line, "kernel", kernel) && Field(line, "isa", isa) && Field(line, "width", width) &&
+            Field(line, "height", height) && Field(line, "depth", depth) && Field(line, "nsPerPixel", ns))
+         {
+            baseline[CaseKey(kernel, isa, atoi(width.c_str()), atoi(height.c_str()), atoi(depth.c_str()))] = atof(ns.c_str());
+         }
+      }
+      return true;
+   }
+}
+
+int main(int argc, char* argv[])
+{
+   std::vector<std::string> sizes = Split("2040x1088,2040x544,2040x256,2040x64,1024x1024,512x512,256x256", ',');
+   std::vector<std::string> depths = Split("8,16", ',');
+   std::vector<std::string> kernels = Split("flipX,flipY,transpose,median,synthetic,widen,half,bin2,crop,reconstruction", ',');
+   std::string isaChoice = "best";
+   int threads = 1;
+   double minSeconds = 0.05;
+   std::string baselinePath;
+   double threshold = 10.;
+   for (int i = 1; i < argc; ++i)
+   {
+      const std::string arg(argv[i]);
+      const size_t eq = arg.find('=');
+      const std::string key = arg.substr(0, eq);
+      const std::string value = (std::string::npos == eq) ? std::string() : arg.substr(eq + 1);
+      if (key == "sizes") sizes = Split(value, ',');
+      else if (key == "depths") depths = Split(value, ',');
+      else if (key == "kernels" && value != "all") kernels = Split(value, ',');
+      else if (key == "kernels") ;
+      else if (key == "isa") isaChoice = value;
+      else if (key == "threads") threads = atoi(value.c_str());
+      else if (key == "seconds") minSeconds = atof(value.c_str());
+      else if (key == "baseline") baselinePath = value;
+      else if (key == "threshold") threshold = atof(value.c_str());
+      else
+      {
+         fprintf(stderr, "unknown argument %s\n", argv[i]);
+         return 1;
+      }
+   }
+
+   std::vector<PixelIsa> isas;
+   const PixelIsa detected = DetectedPixelIsa();
+   if (isaChoice == "best")
+      isas.push_back(detected);
+   for (int isa = ISA_SCALAR; isa <= detected; ++isa)
+   {
+      if (isaChoice == "all" || isaChoice == PixelIsaName((PixelIsa)isa))
+         isas.push_back((PixelIsa)isa);
+   }
+   if (isas.empty())
+   {
+      fprintf(stderr, "instruction set %s is not supported here, the widest is %s\n", isaChoice.c_str(), PixelIsaName(detected));
+      return 1;
+   }
+
+   std::map<std::string, double> baseline;
+   if (!baselinePath.empty() && !LoadBaseline(baselinePath.c_str(), baseline))
+   {
+      fprintf(stderr, "cannot read baseline %s\n", baselinePath.c_str());
+      return 1;
+   }
+
+   int regressions = 0;
+   bool first = true;
+   printf("[\n");
+   for (size_t k = 0; k < kernels.size(); ++k)
+   {
+      Case* c = CreateCase(kernels[k], threads);
+      if (!c)
+      {
+         fprintf(stderr, "unknown kernel %s\n", kernels[k].c_str());
+         continue;
+      }
+      for (size_t i = 0; i < isas.size(); ++i)
+      {
+         const char* isa = PixelIsaName(LimitPixelIsa(isas[i]));
+         for (size_t d = 0; d < depths.size(); ++d)
+         {
+            const unsigned depth = atoi(depths[d].c_str());
+            if (!c->Supports(depth))
+               continue;
+            for (size_t s = 0; s < sizes.size(); ++s)
+            {
+               unsigned width = 0, height = 0;
+               if (2 != sscanf(sizes[s].c_str(), "%ux%u", &width, &height) || 0 == width || 0 == height)
+               {
+                  fprintf(stderr, "bad size %s\n", sizes[s].c_str());
+                  continue;
+               }
+               c->Prepare(width, height, depth);
+               const double seconds = Time(*c, minSeconds);
+               const double nsPerPixel = 1e9 * seconds / ((double)width * height);
+               const double gbPerSecond = 1e-9 * c->Bytes() / seconds;
+
+               printf("%s  {\"kernel\": \"%s\", \"isa\": \"%s\", \"width\": %u, \"height\": %u, \"depth\": %u, \"threads\": %d, \"nsPerPixel\": %.4f, \"gbPerSecond\": %.3f",
+                  first ? "" : ",\n", kernels[k].c_str(), isa, width, height, depth, threads, nsPerPixel, gbPerSecond);
+               first = false;
+               const std::map<std::string, double>::const_iterator base = baseline.find(CaseKey(kernels[k], isa, width, height, depth));
+               if (base != baseline.end() && base->second > 0.)
+               {
+                  const double change = 100. * (nsPerPixel / base->second - 1.);
+                  const bool regression = change > threshold;
+                  printf(", \"baselineNsPerPixel\": %.4f, \"changePercent\": %.1f, \"regression\": %s", base->second, change, regression ? "true" : "false");
+                  if (regression)
+                  {
+                     fprintf(stderr, "regression: %s %+.1f%%\n", CaseKey(kernels[k], isa, width, height, depth).c_str(), change);
+                     ++regressions;
+                  }
+               }
+               printf("}");
+               fflush(stdout);
+            }
+         }
+      }
+      delete c;
+   }
+   printf("\n]\n");
+   LimitPixelIsa(detected);
+
+   if (regressions > 0)
+   {
+      fprintf(stderr, "%d case(s) more than %.0f%% slower than the baseline\n", regressions, threshold);
+      return 2;
+   }
+   return 0;
+}
@@ -0,0 +1,117 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ReconstructionScaling.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Measures how the CPU reconstruction backend scales with the
+//                number of worker threads, to size acquisition workstations.
+//                Standalone console program, built by the project
+//                ReconstructionScaling.vcproj next to this file, or from
+//                this file plus CpuReconstruction.cpp, PixelKernels.cpp and
+//                WorkerPool.cpp:
+//
+//                cl /O2 /EHsc /DWIN32 /I.. ReconstructionScaling.cpp
+//                   ..\CpuReconstruction.cpp ..\PixelKernels.cpp
+//                   ..\WorkerPool.cpp
+//
+//                usage: ReconstructionScaling [width height [frames
+//                       [maxThreads [precision [block]]]]]
+//                precision is float32, float16 or int16
+//
+// AUTHOR:        agent, agent@local, 2026
+//
+// COPYRIGHT:     agent, 2026
+
+#include "CpuReconstruction.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+namespace
+{
+   double NowSeconds()
+   {
+#ifdef WIN32
+      LARGE_INTEGER frequency, counter;
+      QueryPerformanceFrequency(&frequency);
+      QueryPerformanceCounter(&counter);
+      return (double)counter.QuadPart / frequency.QuadPart;
+#else
+      timeval tv;
+      gettimeofday(&tv, NULL);
+      return tv.tv_sec + 1e-6 * tv.tv_usec;
+#endif
+   }
+
+   // inline hologram of a few absorbing disks, the content does not change
+   // the work done but keeps the numbers realistic
+   void MakeFrame(std::vector<unsigned char>& frame, int width, int height)
+   {
+      frame.assign((size_t)width * height, 100);
+      srand(1);
+      for (int k = 0; k < 64; ++k)
+      {
+         const int cx = rand() % width;
+         const int cy = rand() % height;
+         const int r = 3 + rand() % 8;
+         for (int y = cy - r; y < cy + r; ++y)
+            for (int x = cx - r; x < cx + r; ++x)
+               if (x >= 0 && y >= 0 && x < width && y < height && (x - cx) * (x - cx) + (y - cy) * (y - cy) < r * r)
+                  frame[(size_t)y * width + x] = 10;
+      }
+   }
+}
+
+int main(int argc, char* argv[])
+{
+   const int width = (argc > 2) ? atoi(argv[1]) : 2048;
+   const int height = (argc > 2) ? atoi(argv[2]) : 1088;
+   const int frames = (argc > 3) ? atoi(argv[3]) : 20;
+   const int maxThreads = (argc > 4) ? atoi(argv[4]) : WorkerPool::HardwareThreads();
+   ReconstructionPrecision precision = PRECISION_FLOAT32;
+   if (argc > 5 && 0 == strcmp(argv[5], "float16"))
+      precision = PRECISION_FLOAT16;
+   else if (argc > 5 && 0 == strcmp(argv[5], "int16"))
+      precision = PRECISION_INT16;
+   const int block = (argc > 6) ? atoi(argv[6]) : 4;
+
+   std::vector<unsigned char> frame;
+   MakeFrame(frame, width, height);
+
+   CpuReconstructor reconstructor;
+   int bx = block;
+   int by = block;
+   reconstructor.Init(width, height, &bx, &by);
+   reconstructor.SetPrecision(precision);
+   std::vector<unsigned char> out(reconstructor.OutputPlaneBytes());
+
+   printf("# %dx%d padded to %dx%d, %d frames per run, %d hardware threads\n",
+      width, height, bx, by, frames, WorkerPool::HardwareThreads());
+   printf("threads\tms/frame\tfps\tspeedup\tefficiency\n");
+
+   double single = 0.;
+   for (int threads = 1; threads <= maxThreads; ++threads)
+   {
+      reconstructor.SetThreadCount(threads);
+      // the first frame allocates the per thread buffers
+      reconstructor.Reconstruct(&frame[0], &out[0]);
+
+      const double start = NowSeconds();
+      for (int f = 0; f < frames; ++f)
+         reconstructor.Reconstruct(&frame[0], &out[0]);
+      const double perFrame = (NowSeconds() - start) / frames;
+
+      if (1 == threads)
+         single = perFrame;
+      const double speedup = single / perFrame;
+      printf("%d\t%.2f\t%.1f\t%.2f\t%.0f%%\n", threads, 1e3 * perFrame, 1.0 / perFrame, speedup, 100.0 * speedup / threads);
+   }
+   return 0;
+}